@@ -0,0 +1,442 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Windowed, sampled NetAnim trace.
+ *
+ * AnimationInterface records every packet for the whole run, and
+ * EnablePacketMetadata turns on Packet::EnablePrinting, which makes every
+ * packet in the simulation carry and copy its header metadata. This writer
+ * emits the same XML elements (node, nu, pr, wpr) but only inside the
+ * configured time windows and only for one packet in sampleEvery, chosen by
+ * packet uid so that a transmission and its receptions are kept or dropped
+ * together. The meta-info of a sampled packet is decoded from a copy of its
+ * bytes, so global packet printing stays off.
+ *
+ * Built with -DHAVE_ZLIB (and linked with -lz), a file name ending in ".gz"
+ * is written through zlib; NetAnim wants it uncompressed, so gunzip before
+ * loading. Without it such a name cannot be opened, and OutputName () gives
+ * the plain XML name instead.
+ */
+
+#ifndef CROWD_ANIM_WRITER_H
+#define CROWD_ANIM_WRITER_H
+
+#include "ns3/wifi-net-device.h"
+#include "ns3/wifi-phy.h"
+#include "ns3/wifi-mac-header.h"
+#include "ns3/llc-snap-header.h"
+#include "ns3/ipv4-header.h"
+#include "ns3/ipv6-header.h"
+#include "ns3/udp-header.h"
+#include "ns3/mobility-model.h"
+#include "ns3/node-container.h"
+#include "ns3/net-device-container.h"
+#include "ns3/packet.h"
+#include "ns3/simulator.h"
+#include "ns3/abort.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ns3 {
+
+class CrowdAnimWriter
+{
+public:
+  CrowdAnimWriter ()
+    : m_file (0),
+#ifdef HAVE_ZLIB
+      m_gz (0),
+#endif
+      m_failed (false),
+      m_line (256),
+      m_sampleEvery (1),
+      m_metadata (true),
+      m_window (0),
+      m_packets (0),
+      m_updates (0)
+  {
+  }
+
+  ~CrowdAnimWriter ()
+  {
+    Close ();
+  }
+
+  /*
+   * name with ".gz" added if this is built with zlib.
+   */
+  static std::string OutputName (std::string name)
+  {
+#ifdef HAVE_ZLIB
+    return name + ".gz";
+#else
+    return name;
+#endif
+  }
+
+  /*
+   * windows is a comma-separated list of "start-stop" pairs in seconds,
+   * e.g. "10-20,300-310"; empty means the whole run.
+   */
+  bool Open (std::string filename, std::string windows, uint32_t sampleEvery, bool metadata)
+  {
+    Close ();
+    ParseWindows (windows);
+    m_sampleEvery = sampleEvery > 0 ? sampleEvery : 1;
+    m_metadata = metadata;
+    m_window = 0;
+    m_packets = 0;
+    m_updates = 0;
+    m_failed = false;
+    if (filename.size () > 3 && filename.compare (filename.size () - 3, 3, ".gz") == 0)
+      {
+#ifdef HAVE_ZLIB
+        m_gz = gzopen (filename.c_str (), "wb");
+        if (!m_gz)
+          {
+            return false;
+          }
+        gzbuffer (m_gz, 1 << 20);
+#else
+        return false;
+#endif
+      }
+    else
+      {
+        m_file = std::fopen (filename.c_str (), "w");
+        if (!m_file)
+          {
+            return false;
+          }
+        std::setvbuf (m_file, 0, _IOFBF, 1 << 20);
+      }
+    Printf ("<anim ver=\"netanim-3.108\" filetype=\"animation\" >\n");
+    return true;
+  }
+
+  /*
+   * Declare the nodes and hook their mobility and Wi-Fi sniffer traces.
+   * Call after the mobility models are installed.
+   */
+  void Install (NodeContainer nodes, NetDeviceContainer devices)
+  {
+    NS_ABORT_MSG_UNLESS (IsOpen (), "CrowdAnimWriter::Install before Open");
+    for (NodeContainer::Iterator i = nodes.Begin (); i != nodes.End (); ++i)
+      {
+        Ptr<MobilityModel> mobility = (*i)->GetObject<MobilityModel> ();
+        Vector pos = mobility ? mobility->GetPosition () : Vector ();
+        Printf ("<node id=\"%u\" sysId=\"0\" locX=\"%g\" locY=\"%g\" />\n",
+                      (*i)->GetId (), pos.x, pos.y);
+        if (mobility)
+          {
+            m_mobility.push_back (mobility);
+            mobility->TraceConnectWithoutContext ("CourseChange",
+                                                  MakeBoundCallback (&CrowdAnimWriter::CourseChanged, this));
+          }
+      }
+    for (NetDeviceContainer::Iterator i = devices.Begin (); i != devices.End (); ++i)
+      {
+        Ptr<WifiNetDevice> dev = DynamicCast<WifiNetDevice> (*i);
+        if (!dev)
+          {
+            continue;
+          }
+        uint32_t node = dev->GetNode ()->GetId ();
+        dev->GetPhy ()->TraceConnectWithoutContext ("MonitorSnifferTx",
+                                                    MakeBoundCallback (&CrowdAnimWriter::SnifferTx, this, node));
+        // The phy is bound as a plain pointer, as it holds the callback
+        dev->GetPhy ()->TraceConnectWithoutContext ("MonitorSnifferRx",
+                                                    MakeBoundCallback (&CrowdAnimWriter::SnifferRx, this, node,
+                                                                       PeekPointer (dev->GetPhy ())));
+      }
+    // Node positions at the start of each window, so that a window seen on
+    // its own is not drawn with stale positions
+    for (size_t w = 0; w < m_windows.size (); w++)
+      {
+        Simulator::Schedule (m_windows[w].first - Simulator::Now (), &CrowdAnimWriter::Snapshot, this);
+      }
+  }
+
+  /*
+   * False if the trace could not be written in full.
+   */
+  bool Close (void)
+  {
+    if (!IsOpen ())
+      {
+        return true;
+      }
+    Printf ("</anim>\n");
+    bool ok = !m_failed;
+#ifdef HAVE_ZLIB
+    if (m_gz)
+      {
+        ok = gzclose (m_gz) == Z_OK && ok;
+        m_gz = 0;
+      }
+#endif
+    if (m_file)
+      {
+        ok = std::fclose (m_file) == 0 && ok;
+        m_file = 0;
+      }
+    m_mobility.clear ();
+    return ok;
+  }
+
+  void PrintStats (std::ostream &os) const
+  {
+    os << "animation: " << m_packets << " sampled packets, " << m_updates
+       << " position updates" << std::endl;
+  }
+
+private:
+  bool IsOpen (void) const
+  {
+#ifdef HAVE_ZLIB
+    if (m_gz)
+      {
+        return true;
+      }
+#endif
+    return m_file != 0;
+  }
+
+  void Printf (const char *format, ...)
+  {
+    va_list args;
+    va_start (args, format);
+#ifdef HAVE_ZLIB
+    if (m_gz)
+      {
+        va_list again;
+        va_copy (again, args);
+        int size = std::vsnprintf (&m_line[0], m_line.size (), format, args);
+        if (size >= 0 && size_t (size) >= m_line.size ())
+          {
+            m_line.resize (size + 1);
+            std::vsnprintf (&m_line[0], m_line.size (), format, again);
+          }
+        va_end (again);
+        if (size < 0 || (size > 0 && gzwrite (m_gz, &m_line[0], size) != size))
+          {
+            m_failed = true;
+          }
+        va_end (args);
+        return;
+      }
+#endif
+    if (std::vfprintf (m_file, format, args) < 0)
+      {
+        m_failed = true;
+      }
+    va_end (args);
+  }
+
+  void ParseWindows (const std::string &windows)
+  {
+    m_windows.clear ();
+    std::istringstream in (windows);
+    std::string item;
+    while (std::getline (in, item, ','))
+      {
+        double start, stop;
+        NS_ABORT_MSG_UNLESS (std::sscanf (item.c_str (), "%lf-%lf", &start, &stop) == 2 && start < stop,
+                             "bad animation window " << item);
+        m_windows.push_back (std::make_pair (Seconds (start), Seconds (stop)));
+      }
+    if (m_windows.empty ())
+      {
+        m_windows.push_back (std::make_pair (Seconds (0), Time::Max ()));
+      }
+    for (size_t w = 1; w < m_windows.size (); w++)
+      {
+        NS_ABORT_MSG_UNLESS (m_windows[w - 1].second <= m_windows[w].first,
+                             "animation windows must be sorted and disjoint");
+      }
+  }
+
+  /*
+   * Simulation time only moves forward, so the current window is a cursor.
+   */
+  bool InWindow (void)
+  {
+    Time now = Simulator::Now ();
+    while (m_window < m_windows.size () && now >= m_windows[m_window].second)
+      {
+        m_window++;
+      }
+    return m_window < m_windows.size () && now >= m_windows[m_window].first;
+  }
+
+  void WriteUpdate (Ptr<const MobilityModel> mobility)
+  {
+    Vector pos = mobility->GetPosition ();
+    Printf ("<nu p=\"p\" t=\"%.9f\" id=\"%u\" x=\"%g\" y=\"%g\" />\n",
+                  Simulator::Now ().GetSeconds (), mobility->GetObject<Node> ()->GetId (), pos.x, pos.y);
+    m_updates++;
+  }
+
+  void Snapshot (void)
+  {
+    for (size_t i = 0; i < m_mobility.size () && IsOpen (); i++)
+      {
+        WriteUpdate (m_mobility[i]);
+      }
+  }
+
+  static void CourseChanged (CrowdAnimWriter *writer, Ptr<const MobilityModel> mobility)
+  {
+    if (writer->IsOpen () && writer->InWindow ())
+      {
+        writer->WriteUpdate (mobility);
+      }
+  }
+
+  bool Sampled (Ptr<const Packet> packet)
+  {
+    return IsOpen () && packet->GetUid () % m_sampleEvery == 0 && InWindow ();
+  }
+
+  static void SnifferTx (CrowdAnimWriter *writer, uint32_t node, Ptr<const Packet> packet,
+                         uint16_t channelFreqMhz, WifiTxVector txVector, MpduInfo aMpdu)
+  {
+    if (!writer->Sampled (packet))
+      {
+        return;
+      }
+    writer->Printf ("<pr uId=\"%llu\" fId=\"%u\" fbTx=\"%.9f\"",
+                  (unsigned long long) packet->GetUid (), node, Simulator::Now ().GetSeconds ());
+    if (writer->m_metadata)
+      {
+        writer->Printf (" meta-info=\"%s\"", Describe (packet).c_str ());
+      }
+    writer->Printf (" />\n");
+    writer->m_packets++;
+  }
+
+  static void SnifferRx (CrowdAnimWriter *writer, uint32_t node, WifiPhy *phy, Ptr<const Packet> packet,
+                         uint16_t channelFreqMhz, WifiTxVector txVector, MpduInfo aMpdu,
+                         SignalNoiseDbm signalNoise)
+  {
+    if (!writer->Sampled (packet))
+      {
+        return;
+      }
+    // The sniffer reports a reception once its last bit is in
+    Time duration = phy->CalculateTxDuration (packet->GetSize (), txVector, channelFreqMhz);
+    double now = Simulator::Now ().GetSeconds ();
+    writer->Printf ("<wpr uId=\"%llu\" tId=\"%u\" fbRx=\"%.9f\" lbRx=\"%.9f\" />\n",
+                  (unsigned long long) packet->GetUid (), node, now - duration.GetSeconds (), now);
+  }
+
+  /*
+   * MAC, LLC and network/transport headers of a frame, XML-escaped.
+   */
+  static std::string Describe (Ptr<const Packet> packet)
+  {
+    Ptr<Packet> copy = packet->Copy ();
+    std::ostringstream os;
+    WifiMacHeader mac;
+    if (copy->GetSize () < mac.GetSerializedSize ())
+      {
+        return "";
+      }
+    copy->RemoveHeader (mac);
+    os << mac.GetTypeString () << " " << mac.GetAddr2 () << " > " << mac.GetAddr1 ();
+    LlcSnapHeader llc;
+    if (mac.IsData () && copy->GetSize () >= llc.GetSerializedSize ())
+      {
+        copy->RemoveHeader (llc);
+        if (llc.GetType () == 0x0800 && copy->GetSize () >= 20)
+          {
+            Ipv4Header ip;
+            copy->RemoveHeader (ip);
+            os << " | ";
+            ip.Print (os);
+            if (ip.GetProtocol () == UdpHeader::PROT_NUMBER && copy->GetSize () >= 8)
+              {
+                UdpHeader udp;
+                copy->RemoveHeader (udp);
+                os << " | ";
+                udp.Print (os);
+              }
+          }
+        else if (llc.GetType () == 0x86dd && copy->GetSize () >= 40)
+          {
+            Ipv6Header ip;
+            copy->RemoveHeader (ip);
+            os << " | ";
+            ip.Print (os);
+            if (ip.GetNextHeader () == UdpHeader::PROT_NUMBER && copy->GetSize () >= 8)
+              {
+                UdpHeader udp;
+                copy->RemoveHeader (udp);
+                os << " | ";
+                udp.Print (os);
+              }
+          }
+      }
+    return Escape (os.str ());
+  }
+
+  static std::string Escape (const std::string &in)
+  {
+    std::string out;
+    out.reserve (in.size () + 16);
+    for (size_t i = 0; i < in.size (); i++)
+      {
+        switch (in[i])
+          {
+          case '<': out += "&lt;"; break;
+          case '>': out += "&gt;"; break;
+          case '&': out += "&amp;"; break;
+          case '"': out += "&quot;"; break;
+          default: out += in[i];
+          }
+      }
+    return out;
+  }
+
+  std::FILE *m_file;
+#ifdef HAVE_ZLIB
+  gzFile m_gz;
+#endif
+  bool m_failed;
+  std::vector<char> m_line;
+  uint32_t m_sampleEvery;
+  bool m_metadata;
+  std::vector<std::pair<Time, Time> > m_windows;
+  size_t m_window;
+  std::vector<Ptr<MobilityModel> > m_mobility;
+  uint64_t m_packets;
+  uint64_t m_updates;
+};
+
+} // namespace ns3
+
+#endif /* CROWD_ANIM_WRITER_H */
@@ -0,0 +1,159 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Randomized check of CrowdBucketScheduler against an ordered std::set.
+//
+// ./waf --run "crowd-bucket-scheduler-check --ops=2000000 --seed=1"
+//
+// Drives the scheduler directly, without a simulation, through a random
+// mix of inserts, dequeues, peeks and cancels, and replays every operation
+// on a std::set of event keys, which is the order the scheduler has to
+// give. Insert times are mostly near the last dequeued event, some within
+// a wider spread and a fifth far in the future, like application stops
+// and Simulator::Stop, so that the bucket count grows and shrinks and the
+// day is fitted again along the way. Once the mix is done both are
+// drained. Any dequeue or peek that differs from the set ends the check
+// with the operation, the event expected and the one returned.
+
+#include "ns3/core-module.h"
+
+#include <cstdio>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "crowd-bucket-scheduler.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("CrowdBucketSchedulerCheck");
+
+static bool
+Same (const Scheduler::Event &ev, const Scheduler::EventKey &key, uint64_t op, const char *what)
+{
+  if (ev.key.m_ts == key.m_ts && ev.key.m_uid == key.m_uid)
+    {
+      return true;
+    }
+  std::printf ("op %llu: %s gave (%llu, %u), expected (%llu, %u)\n", (unsigned long long) op, what,
+               (unsigned long long) ev.key.m_ts, ev.key.m_uid, (unsigned long long) key.m_ts, key.m_uid);
+  return false;
+}
+
+int main (int argc, char *argv[])
+{
+  uint64_t ops = 2000000;
+  uint32_t seed = 1;
+
+  CommandLine cmd;
+  cmd.AddValue ("ops", "random operations before draining", ops);
+  cmd.AddValue ("seed", "seed of the operation mix", seed);
+  cmd.Parse (argc, argv);
+
+  std::mt19937_64 rng (seed);
+  CrowdBucketScheduler scheduler;
+  std::set<Scheduler::EventKey> expected;
+  // Events ever inserted, some long gone, to cancel from
+  std::vector<Scheduler::Event> inserted;
+  uint64_t now = 0;
+  uint32_t uid = 0;
+  uint64_t inserts = 0;
+  uint64_t dequeues = 0;
+  uint64_t peeks = 0;
+  uint64_t cancels = 0;
+  for (uint64_t op = 0; op < ops; op++)
+    {
+      uint32_t kind = rng () % 10;
+      if (kind < 5 || expected.empty ())
+        {
+          uint64_t delay;
+          if (rng () % 5 == 0)
+            {
+              delay = rng () % 1000000000000ULL;
+            }
+          else
+            {
+              delay = rng () % (rng () % 3 == 0 ? 100001 : 1001);
+            }
+          Scheduler::Event ev;
+          ev.impl = 0;
+          ev.key.m_ts = now + delay;
+          ev.key.m_uid = uid++;
+          ev.key.m_context = 0;
+          scheduler.Insert (ev);
+          expected.insert (ev.key);
+          inserted.push_back (ev);
+          inserts++;
+        }
+      else if (kind < 8)
+        {
+          Scheduler::Event ev = scheduler.RemoveNext ();
+          if (!Same (ev, *expected.begin (), op, "RemoveNext"))
+            {
+              return 1;
+            }
+          expected.erase (expected.begin ());
+          now = ev.key.m_ts;
+          dequeues++;
+        }
+      else if (kind == 8)
+        {
+          if (!Same (scheduler.PeekNext (), *expected.begin (), op, "PeekNext"))
+            {
+              return 1;
+            }
+          peeks++;
+        }
+      else
+        {
+          uint32_t k = rng () % inserted.size ();
+          Scheduler::Event ev = inserted[k];
+          inserted[k] = inserted.back ();
+          inserted.pop_back ();
+          if (expected.erase (ev.key) > 0)
+            {
+              scheduler.Remove (ev);
+              cancels++;
+            }
+        }
+      if (scheduler.IsEmpty () != expected.empty ())
+        {
+          std::printf ("op %llu: IsEmpty is %d with %llu events pending\n", (unsigned long long) op,
+                       scheduler.IsEmpty (), (unsigned long long) expected.size ());
+          return 1;
+        }
+    }
+  uint64_t drained = expected.size ();
+  while (!expected.empty ())
+    {
+      if (!Same (scheduler.RemoveNext (), *expected.begin (), ops, "draining RemoveNext"))
+        {
+          return 1;
+        }
+      expected.erase (expected.begin ());
+    }
+  if (!scheduler.IsEmpty ())
+    {
+      std::printf ("scheduler not empty after draining\n");
+      return 1;
+    }
+  std::printf ("ok: %llu inserts, %llu dequeues, %llu peeks, %llu cancels, %llu drained, "
+               "%llu resizes, %u buckets at the end\n",
+               (unsigned long long) inserts, (unsigned long long) dequeues, (unsigned long long) peeks,
+               (unsigned long long) cancels, (unsigned long long) drained,
+               (unsigned long long) scheduler.GetResizes (), scheduler.GetBucketCount ());
+  return 0;
+}
@@ -0,0 +1,340 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Calendar queue scheduler with contiguous buckets.
+ *
+ * Like ns3::CalendarScheduler this is Brown's calendar queue: buckets of
+ * one "day" (a power of two of time steps) each, an event going to bucket
+ * (ts / day) mod buckets, and the dequeue scanning forward from the
+ * bucket of the last event for the first one due within the current
+ * "year". Unlike it, a bucket is a std::vector of the Scheduler::Event
+ * values themselves, kept sorted latest first, so the next event is the
+ * bucket's last element and neither an insert nor a dequeue allocates
+ * once the buckets have grown to their working size: the vectors keep
+ * their capacity, which is the event node pool. The bucket index is a
+ * shift and a mask.
+ *
+ * The bucket count doubles when there are more than two events per
+ * bucket and halves below one per two buckets; on each resize the day is
+ * set to three times the mean gap between the earliest pending events,
+ * leaving out gaps more than twice the mean, as Brown suggests, and it
+ * is fitted again once dequeues keep finding nothing within a year. Far
+ * future events (a Simulator::Stop, application stop times) only take a
+ * slot in some bucket and are passed over until their year comes round.
+ *
+ * Select it with
+ *   Simulator::SetScheduler (ObjectFactory ("ns3::CrowdBucketScheduler"))
+ * or through the SchedulerType global value. crowd-bucket-scheduler-check
+ * replays random inserts, dequeues and cancels against a std::set.
+ */
+
+#ifndef CROWD_BUCKET_SCHEDULER_H
+#define CROWD_BUCKET_SCHEDULER_H
+
+#include "ns3/scheduler.h"
+#include "ns3/event-impl.h"
+#include "ns3/uinteger.h"
+#include "ns3/assert.h"
+
+#include <algorithm>
+#include <stdint.h>
+#include <vector>
+
+namespace ns3 {
+
+class CrowdBucketScheduler : public Scheduler
+{
+public:
+  static TypeId GetTypeId (void);
+
+  CrowdBucketScheduler ();
+  virtual ~CrowdBucketScheduler ();
+
+  virtual void Insert (const Event &ev);
+  virtual bool IsEmpty (void) const;
+  virtual Event PeekNext (void) const;
+  virtual Event RemoveNext (void);
+  virtual void Remove (const Event &ev);
+
+  uint32_t GetBucketCount (void) const;
+  uint64_t GetResizes (void) const;
+
+private:
+  typedef std::vector<Event> Bucket;
+
+  // Sorts a bucket latest first
+  static bool Later (const Event &a, const Event &b)
+  {
+    return b.key < a.key;
+  }
+
+  uint32_t BucketOf (uint64_t ts) const;
+  void Place (const Event &ev);
+  uint32_t Locate (void) const;
+  void Resize (uint32_t buckets);
+
+  uint32_t m_minBuckets;
+  std::vector<Bucket> m_buckets;
+  uint32_t m_mask;
+  uint32_t m_dayLog2;
+  uint64_t m_size;
+  uint64_t m_resizes;
+  // Where the dequeue scan stands: a bucket and the end of its current
+  // day. Every pending event is due at or after that day's start.
+  mutable uint32_t m_lastBucket;
+  mutable uint64_t m_dayEnd;
+  // Dequeues that found nothing within a year since the last resize
+  mutable uint32_t m_misses;
+  std::vector<Event> m_scratch;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (CrowdBucketScheduler);
+
+TypeId
+CrowdBucketScheduler::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::CrowdBucketScheduler")
+    .SetParent<Scheduler> ()
+    .SetGroupName ("Core")
+    .AddConstructor<CrowdBucketScheduler> ()
+    .AddAttribute ("MinBuckets", "Bucket count the calendar never shrinks below (a power of two).",
+                   UintegerValue (256),
+                   MakeUintegerAccessor (&CrowdBucketScheduler::m_minBuckets),
+                   MakeUintegerChecker<uint32_t> (2))
+  ;
+  return tid;
+}
+
+CrowdBucketScheduler::CrowdBucketScheduler ()
+  : m_minBuckets (256),
+    m_mask (0),
+    m_dayLog2 (10),
+    m_size (0),
+    m_resizes (0),
+    m_lastBucket (0),
+    m_dayEnd (0),
+    m_misses (0)
+{
+}
+
+CrowdBucketScheduler::~CrowdBucketScheduler ()
+{
+}
+
+uint32_t
+CrowdBucketScheduler::GetBucketCount (void) const
+{
+  return m_buckets.size ();
+}
+
+uint64_t
+CrowdBucketScheduler::GetResizes (void) const
+{
+  return m_resizes;
+}
+
+uint32_t
+CrowdBucketScheduler::BucketOf (uint64_t ts) const
+{
+  return (ts >> m_dayLog2) & m_mask;
+}
+
+/*
+ * Put ev in its bucket without touching the size or the scan position.
+ */
+void
+CrowdBucketScheduler::Place (const Event &ev)
+{
+  Bucket &bucket = m_buckets[BucketOf (ev.key.m_ts)];
+  Bucket::iterator at = std::lower_bound (bucket.begin (), bucket.end (), ev, &CrowdBucketScheduler::Later);
+  bucket.insert (at, ev);
+}
+
+void
+CrowdBucketScheduler::Insert (const Event &ev)
+{
+  if (m_buckets.empty ())
+    {
+      Resize (m_minBuckets);
+    }
+  uint64_t day = uint64_t (1) << m_dayLog2;
+  // An event before the scan's day (after a PeekNext has moved the scan
+  // ahead, or into an empty queue) moves the scan back to it
+  if (m_size == 0 || ev.key.m_ts < m_dayEnd - day)
+    {
+      m_lastBucket = BucketOf (ev.key.m_ts);
+      m_dayEnd = ((ev.key.m_ts >> m_dayLog2) + 1) << m_dayLog2;
+    }
+  Place (ev);
+  m_size++;
+  if (m_size > 2 * uint64_t (m_buckets.size ()) && m_buckets.size () < (1u << 24))
+    {
+      Resize (m_buckets.size () * 2);
+    }
+}
+
+bool
+CrowdBucketScheduler::IsEmpty (void) const
+{
+  return m_size == 0;
+}
+
+/*
+ * The bucket holding the earliest event; moves the scan up to it.
+ */
+uint32_t
+CrowdBucketScheduler::Locate (void) const
+{
+  NS_ASSERT (m_size > 0);
+  uint64_t day = uint64_t (1) << m_dayLog2;
+  uint32_t b = m_lastBucket;
+  uint64_t dayEnd = m_dayEnd;
+  for (uint32_t i = 0; i < m_buckets.size (); i++)
+    {
+      const Bucket &bucket = m_buckets[b];
+      if (!bucket.empty () && bucket.back ().key.m_ts < dayEnd)
+        {
+          m_lastBucket = b;
+          m_dayEnd = dayEnd;
+          return b;
+        }
+      b = (b + 1) & m_mask;
+      dayEnd += day;
+    }
+  // Nothing due within a year: take the earliest bucket head directly
+  m_misses++;
+  uint32_t best = m_buckets.size ();
+  for (uint32_t i = 0; i < m_buckets.size (); i++)
+    {
+      if (!m_buckets[i].empty ()
+          && (best == m_buckets.size () || m_buckets[i].back ().key < m_buckets[best].back ().key))
+        {
+          best = i;
+        }
+    }
+  uint64_t ts = m_buckets[best].back ().key.m_ts;
+  m_lastBucket = best;
+  m_dayEnd = ((ts >> m_dayLog2) + 1) << m_dayLog2;
+  return best;
+}
+
+Scheduler::Event
+CrowdBucketScheduler::PeekNext (void) const
+{
+  return m_buckets[Locate ()].back ();
+}
+
+Scheduler::Event
+CrowdBucketScheduler::RemoveNext (void)
+{
+  Bucket &bucket = m_buckets[Locate ()];
+  Event ev = bucket.back ();
+  bucket.pop_back ();
+  m_size--;
+  if (m_size < m_buckets.size () / 2 && m_buckets.size () > m_minBuckets)
+    {
+      Resize (m_buckets.size () / 2);
+    }
+  else if (m_misses > 8)
+    {
+      // The day no longer fits the events: fit it again
+      Resize (m_buckets.size ());
+    }
+  return ev;
+}
+
+void
+CrowdBucketScheduler::Remove (const Event &ev)
+{
+  Bucket &bucket = m_buckets[BucketOf (ev.key.m_ts)];
+  Bucket::iterator at = std::lower_bound (bucket.begin (), bucket.end (), ev, &CrowdBucketScheduler::Later);
+  NS_ASSERT (at != bucket.end () && at->key.m_uid == ev.key.m_uid);
+  bucket.erase (at);
+  m_size--;
+  if (m_size < m_buckets.size () / 2 && m_buckets.size () > m_minBuckets)
+    {
+      Resize (m_buckets.size () / 2);
+    }
+}
+
+/*
+ * Rebuild the calendar with buckets buckets and a day fitted to the
+ * earliest pending events.
+ */
+void
+CrowdBucketScheduler::Resize (uint32_t buckets)
+{
+  m_resizes++;
+  m_misses = 0;
+  m_scratch.clear ();
+  for (uint32_t i = 0; i < m_buckets.size (); i++)
+    {
+      m_scratch.insert (m_scratch.end (), m_buckets[i].begin (), m_buckets[i].end ());
+      m_buckets[i].clear ();
+    }
+  uint32_t minBuckets = 2;
+  while (minBuckets < m_minBuckets)
+    {
+      minBuckets *= 2;
+    }
+  m_buckets.resize (std::max (buckets, minBuckets));
+  m_mask = m_buckets.size () - 1;
+
+  // Mean gap between the earliest events, then again without the outliers
+  uint32_t sample = std::min<uint64_t> (m_scratch.size (), 25);
+  if (sample >= 2)
+    {
+      std::partial_sort (m_scratch.begin (), m_scratch.begin () + sample, m_scratch.end ());
+      double mean = double (m_scratch[sample - 1].key.m_ts - m_scratch[0].key.m_ts) / (sample - 1);
+      double sum = 0;
+      uint32_t gaps = 0;
+      for (uint32_t i = 1; i < sample; i++)
+        {
+          uint64_t gap = m_scratch[i].key.m_ts - m_scratch[i - 1].key.m_ts;
+          if (gap <= 2 * mean)
+            {
+              sum += gap;
+              gaps++;
+            }
+        }
+      if (gaps > 0 && sum > 0)
+        {
+          uint64_t day = uint64_t (3 * sum / gaps);
+          m_dayLog2 = 0;
+          while (m_dayLog2 < 62 && (uint64_t (1) << m_dayLog2) < day)
+            {
+              m_dayLog2++;
+            }
+        }
+    }
+
+  for (uint32_t i = 0; i < m_scratch.size (); i++)
+    {
+      Place (m_scratch[i]);
+    }
+  if (!m_scratch.empty ())
+    {
+      uint64_t first = std::min_element (m_scratch.begin (), m_scratch.end ())->key.m_ts;
+      m_lastBucket = BucketOf (first);
+      m_dayEnd = ((first >> m_dayLog2) + 1) << m_dayLog2;
+    }
+  m_scratch.clear ();
+}
+
+} // namespace ns3
+
+#endif /* CROWD_BUCKET_SCHEDULER_H */
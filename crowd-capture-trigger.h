@@ -0,0 +1,285 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Conditions that trigger a CrowdPcapngCapture set up with SetTriggered.
+ *
+ * A spec is a comma-separated list of conditions, any of which fires:
+ *
+ *   goodput<MBPS        a flow's goodput in a complete sample is below
+ *                       MBPS
+ *   hops>N              a packet is delivered after more than N hops
+ *   region=X0:X1:Y0:Y1  a node enters the rectangle
+ *
+ * e.g. "goodput<5,hops>3". Goodput and region are checked every Interval
+ * of simulated time (positions are polled, since models such as
+ * CrowdTrackMobilityModel never report course changes); a delivery is
+ * checked as it happens, from IPv6 LocalDeliver and the hop limit its
+ * sender started from, counted as crowd-pcap-analyzer does: a direct
+ * delivery is one hop.
+ *
+ * Goodput uses the sampler's per-flow series, each sample once, and a flow
+ * only from the sample after its first packet, so that flows not yet
+ * started stay quiet. Without per-flow series it falls back to the total
+ * over all flows. It only counts while the applications run
+ * (SetActivePeriod), as it drops to nothing once they stop. A condition
+ * that stays true keeps firing and so keeps the capture window open until
+ * postTrigger after it clears.
+ */
+
+#ifndef CROWD_CAPTURE_TRIGGER_H
+#define CROWD_CAPTURE_TRIGGER_H
+
+#include "ns3/ipv6-l3-protocol.h"
+#include "ns3/ipv6-header.h"
+#include "ns3/mobility-model.h"
+#include "ns3/node-container.h"
+#include "ns3/simulator.h"
+#include "ns3/nstime.h"
+#include "ns3/abort.h"
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "crowd-pcapng-capture.h"
+#include "crowd-goodput-sampler.h"
+#include "crowd-trace-bind.h"
+
+namespace ns3 {
+
+class CrowdCaptureTrigger
+{
+public:
+  CrowdCaptureTrigger ()
+    : m_capture (0),
+      m_sampler (0),
+      m_goodputMbps (-1.0),
+      m_hopsEnabled (false),
+      m_hops (0),
+      m_region (false),
+      m_initialHopLimit (64),
+      m_activeStart (Seconds (0)),
+      m_activeStop (Time::Max ()),
+      m_checkedSamples (0),
+      m_fired (0)
+  {
+  }
+
+  /*
+   * Read a spec as described above. False if it has a condition this
+   * does not know.
+   */
+  bool Parse (std::string spec)
+  {
+    std::istringstream in (spec);
+    std::string item;
+    while (std::getline (in, item, ','))
+      {
+        double value;
+        uint32_t hops;
+        double x0, x1, y0, y1;
+        char end;
+        if (std::sscanf (item.c_str (), "goodput<%lf%c", &value, &end) == 1)
+          {
+            m_goodputMbps = value;
+          }
+        else if (std::sscanf (item.c_str (), "hops>%u%c", &hops, &end) == 1)
+          {
+            m_hopsEnabled = true;
+            m_hops = hops;
+          }
+        else if (std::sscanf (item.c_str (), "region=%lf:%lf:%lf:%lf%c", &x0, &x1, &y0, &y1, &end) == 4
+                 && x0 < x1 && y0 < y1)
+          {
+            m_region = true;
+            m_x0 = x0;
+            m_x1 = x1;
+            m_y0 = y0;
+            m_y1 = y1;
+          }
+        else
+          {
+            return false;
+          }
+      }
+    return true;
+  }
+
+  /*
+   * Hop limit the senders start from, 64 unless the scenario changes it.
+   */
+  void SetInitialHopLimit (uint8_t hopLimit)
+  {
+    m_initialHopLimit = hopLimit;
+  }
+
+  /*
+   * When the applications send; goodput samples outside it are ignored.
+   */
+  void SetActivePeriod (Time start, Time stop)
+  {
+    m_activeStart = start;
+    m_activeStop = stop;
+  }
+
+  /*
+   * Watch nodes (and sampler, for goodput) and trigger capture. Checks run
+   * every interval from now until stop.
+   */
+  void Install (CrowdPcapngCapture *capture, NodeContainer nodes, const GoodputSampler *sampler,
+                Time interval, Time stop)
+  {
+    m_capture = capture;
+    m_sampler = sampler;
+    m_interval = interval;
+    m_stop = stop;
+    m_checkedSamples = 0;
+    m_flowSeen.assign (sampler ? sampler->GetFlowCount () : 0, false);
+    if (m_hopsEnabled)
+      {
+        CrowdTraceConnect<Ipv6L3Protocol> (nodes, "LocalDeliver", &CrowdCaptureTrigger::Delivered, this);
+      }
+    if (m_region)
+      {
+        for (NodeContainer::Iterator n = nodes.Begin (); n != nodes.End (); ++n)
+          {
+            Ptr<MobilityModel> mobility = (*n)->GetObject<MobilityModel> ();
+            NS_ABORT_MSG_UNLESS (mobility, "region trigger needs mobility on every node");
+            m_mobility.push_back (mobility);
+            m_inside.push_back (Inside (mobility->GetPosition ()));
+          }
+      }
+    if (m_region || m_goodputMbps >= 0)
+      {
+        Simulator::Schedule (m_interval, &CrowdCaptureTrigger::Check, this);
+      }
+  }
+
+  uint64_t GetFired (void) const
+  {
+    return m_fired;
+  }
+
+private:
+  bool Inside (const Vector &pos) const
+  {
+    return pos.x >= m_x0 && pos.x <= m_x1 && pos.y >= m_y0 && pos.y <= m_y1;
+  }
+
+  void Fire (std::string reason)
+  {
+    m_fired++;
+    m_capture->Trigger (reason);
+  }
+
+  void Check (void)
+  {
+    if (m_goodputMbps >= 0)
+      {
+        CheckGoodput ();
+      }
+    for (uint32_t n = 0; n < m_mobility.size (); n++)
+      {
+        bool inside = Inside (m_mobility[n]->GetPosition ());
+        if (inside && !m_inside[n])
+          {
+            std::ostringstream reason;
+            reason << "node " << m_mobility[n]->GetObject<Node> ()->GetId () << " entered region";
+            Fire (reason.str ());
+          }
+        m_inside[n] = inside;
+      }
+    if (Simulator::Now () + m_interval <= m_stop)
+      {
+        Simulator::Schedule (m_interval, &CrowdCaptureTrigger::Check, this);
+      }
+  }
+
+  void CheckGoodput (void)
+  {
+    // Only a complete sample says anything; the one in progress is partial,
+    // and so is one the applications were not running for all of
+    for (; m_checkedSamples < m_sampler->GetSampleCount (); m_checkedSamples++)
+      {
+        uint32_t i = m_checkedSamples;
+        Time end = Seconds (m_sampler->GetTime (i));
+        bool active = end - m_sampler->GetInterval () >= m_activeStart && end <= m_activeStop;
+        if (m_flowSeen.empty ())
+          {
+            if (active && m_sampler->GetGoodput (i) < m_goodputMbps)
+              {
+                std::ostringstream reason;
+                reason << "goodput " << m_sampler->GetGoodput (i) << " Mbps < " << m_goodputMbps;
+                Fire (reason.str ());
+              }
+            continue;
+          }
+        for (uint32_t f = 0; f < m_flowSeen.size (); f++)
+          {
+            double mbps = m_sampler->GetFlowGoodput (i, f);
+            if (active && m_flowSeen[f] && mbps < m_goodputMbps)
+              {
+                std::ostringstream reason;
+                reason << "flow " << f << " goodput " << mbps << " Mbps < " << m_goodputMbps;
+                Fire (reason.str ());
+              }
+            m_flowSeen[f] = m_flowSeen[f] || mbps > 0;
+          }
+      }
+  }
+
+  static void Delivered (CrowdCaptureTrigger *trigger, uint32_t node, const Ipv6Header &header,
+                         Ptr<const Packet> packet, uint32_t interface)
+  {
+    // Protocols that start elsewhere (RIPng uses 255) say nothing here
+    uint8_t hopLimit = header.GetHopLimit ();
+    if (hopLimit > trigger->m_initialHopLimit)
+      {
+        return;
+      }
+    uint32_t hops = trigger->m_initialHopLimit - hopLimit + 1;
+    if (hops > trigger->m_hops)
+      {
+        std::ostringstream reason;
+        reason << "node " << node << " got a packet after " << hops << " hops";
+        trigger->Fire (reason.str ());
+      }
+  }
+
+  CrowdPcapngCapture *m_capture;
+  const GoodputSampler *m_sampler;
+  double m_goodputMbps;         // negative: off
+  bool m_hopsEnabled;
+  uint32_t m_hops;
+  bool m_region;
+  double m_x0, m_x1, m_y0, m_y1;
+  uint8_t m_initialHopLimit;
+  Time m_activeStart;
+  Time m_activeStop;
+  Time m_interval;
+  Time m_stop;
+  uint32_t m_checkedSamples;
+  std::vector<bool> m_flowSeen;
+  std::vector<Ptr<MobilityModel> > m_mobility;
+  std::vector<bool> m_inside;
+  uint64_t m_fired;
+};
+
+} // namespace ns3
+
+#endif /* CROWD_CAPTURE_TRIGGER_H */
@@ -0,0 +1,328 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Batched versus per-receiver propagation in CrowdSpectrumChannel.
+//
+// ./waf --run "crowd-channel-bench --nodes=200,2000 --tx=20000"
+// ./waf --run "crowd-channel-bench --nodes=2000 --validate=1"
+//
+// Nodes stand at random on a square holding them at the crowd's density
+// (about 20 on 200 m x 200 m), on the channel crowdsrc-adhoc builds with
+// --channel=grid: log-distance loss, constant-speed delay, isotropic
+// antennas and the spatial index. Random nodes then transmit, one every
+// millisecond, straight into the channel; the receivers only count what
+// arrives and fold its receiver, arrival time and power into a digest, so
+// that the time is the channel's. Each node count runs once with Batched
+// off (every candidate through the models' virtual calls) and once with
+// it on, each in its own process, and the two must deliver the same
+// frames at the same times and powers: same count, same digest.
+// --validate also has each run check every delivery against an
+// exhaustive scalar evaluation.
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/spectrum-module.h"
+#include "ns3/propagation-module.h"
+#include "ns3/antenna-module.h"
+
+#include <sys/time.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include "crowd-worker-pool.h"
+#include "crowd-spectrum-channel.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("CrowdChannelBench");
+
+/*
+ * A receiver that only counts and digests what the channel delivers.
+ */
+class BenchPhy : public SpectrumPhy
+{
+public:
+  static TypeId GetTypeId (void)
+  {
+    static TypeId tid = TypeId ("ns3::CrowdChannelBenchPhy")
+      .SetParent<SpectrumPhy> ()
+      .SetGroupName ("Spectrum")
+    ;
+    return tid;
+  }
+
+  BenchPhy ()
+    : m_id (0),
+      m_received (0),
+      m_digest (0)
+  {
+  }
+
+  void SetId (uint32_t id)
+  {
+    m_id = id;
+  }
+
+  virtual void SetDevice (Ptr<NetDevice> d)
+  {
+    m_device = d;
+  }
+  virtual Ptr<NetDevice> GetDevice (void) const
+  {
+    return m_device;
+  }
+  virtual void SetMobility (Ptr<MobilityModel> m)
+  {
+    m_mobility = m;
+  }
+  virtual Ptr<MobilityModel> GetMobility (void)
+  {
+    return m_mobility;
+  }
+  virtual void SetChannel (Ptr<SpectrumChannel> c)
+  {
+  }
+  virtual Ptr<const SpectrumModel> GetRxSpectrumModel (void) const
+  {
+    return 0;
+  }
+  virtual Ptr<AntennaModel> GetRxAntenna (void)
+  {
+    return m_antenna;
+  }
+  void SetAntenna (Ptr<AntennaModel> a)
+  {
+    m_antenna = a;
+  }
+
+  virtual void StartRx (Ptr<SpectrumSignalParameters> params)
+  {
+    double power = (*params->psd)[0];
+    uint64_t bits;
+    std::memcpy (&bits, &power, sizeof (bits));
+    uint64_t h = m_id * 0x9e3779b97f4a7c15ULL ^ Simulator::Now ().GetTimeStep () ^ (bits * 0xff51afd7ed558ccdULL);
+    // Order-independent, so equal deliveries give equal digests
+    m_digest += h ^ (h >> 29);
+    m_received++;
+  }
+
+  uint64_t GetReceived (void) const
+  {
+    return m_received;
+  }
+  uint64_t GetDigest (void) const
+  {
+    return m_digest;
+  }
+
+protected:
+  virtual void DoDispose (void)
+  {
+    m_device = 0;
+    m_mobility = 0;
+    m_antenna = 0;
+    SpectrumPhy::DoDispose ();
+  }
+
+private:
+  uint32_t m_id;
+  Ptr<NetDevice> m_device;
+  Ptr<MobilityModel> m_mobility;
+  Ptr<AntennaModel> m_antenna;
+  uint64_t m_received;
+  uint64_t m_digest;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (BenchPhy);
+
+static double
+WallSeconds (void)
+{
+  struct timeval tv;
+  gettimeofday (&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static std::string
+ResultFile (std::string mode, uint32_t nodes)
+{
+  std::ostringstream oss;
+  oss << "crowd-channel-bench-" << mode << "-" << nodes << ".out";
+  return oss.str ();
+}
+
+static int
+RunBench (std::string mode, uint32_t nodes, uint32_t txCount, bool validate)
+{
+  Ptr<CrowdSpectrumChannel> channel = CreateObject<CrowdSpectrumChannel> ();
+  channel->AddPropagationLossModel (CreateObject<LogDistancePropagationLossModel> ());
+  channel->SetPropagationDelayModel (CreateObject<ConstantSpeedPropagationDelayModel> ());
+  channel->SetAttribute ("Batched", BooleanValue (mode == "batched"));
+  channel->SetAttribute ("Validate", BooleanValue (validate));
+
+  // One 20 MHz band at 5.18 GHz carrying 16.0206 dBm, the Wi-Fi default
+  BandInfo band;
+  band.fl = 5.17e9;
+  band.fc = 5.18e9;
+  band.fh = 5.19e9;
+  Bands bands;
+  bands.push_back (band);
+  Ptr<SpectrumModel> model = Create<SpectrumModel> (bands);
+
+  double side = std::sqrt (double (nodes) * 2000.0);
+  Ptr<UniformRandomVariable> coordinate = CreateObject<UniformRandomVariable> ();
+  coordinate->SetAttribute ("Max", DoubleValue (side));
+  std::vector<Ptr<BenchPhy> > phys;
+  std::vector<Ptr<SpectrumSignalParameters> > txParams;
+  for (uint32_t n = 0; n < nodes; n++)
+    {
+      Ptr<Node> node = CreateObject<Node> ();
+      Ptr<SimpleNetDevice> device = CreateObject<SimpleNetDevice> ();
+      node->AddDevice (device);
+      Ptr<ConstantPositionMobilityModel> mobility = CreateObject<ConstantPositionMobilityModel> ();
+      mobility->SetPosition (Vector (coordinate->GetValue (), coordinate->GetValue (), 0));
+      node->AggregateObject (mobility);
+      Ptr<BenchPhy> phy = CreateObject<BenchPhy> ();
+      phy->SetId (n);
+      phy->SetDevice (device);
+      phy->SetMobility (mobility);
+      phy->SetAntenna (CreateObject<IsotropicAntennaModel> ());
+      channel->AddRx (phy);
+      phys.push_back (phy);
+
+      Ptr<SpectrumSignalParameters> params = Create<SpectrumSignalParameters> ();
+      params->psd = Create<SpectrumValue> (model);
+      (*params->psd)[0] = std::pow (10.0, (16.0206 - 30) / 10) / (band.fh - band.fl);
+      params->duration = MicroSeconds (100);
+      params->txPhy = phy;
+      params->txAntenna = phy->GetRxAntenna ();
+      txParams.push_back (params);
+    }
+
+  Ptr<UniformRandomVariable> sender = CreateObject<UniformRandomVariable> ();
+  sender->SetAttribute ("Max", DoubleValue (nodes));
+  for (uint32_t k = 0; k < txCount; k++)
+    {
+      uint32_t n = std::min<uint32_t> (sender->GetInteger (), nodes - 1);
+      Simulator::Schedule (MilliSeconds (k), &CrowdSpectrumChannel::StartTx, channel, txParams[n]);
+    }
+
+  double start = WallSeconds ();
+  Simulator::Run ();
+  double run = WallSeconds () - start;
+
+  uint64_t received = 0;
+  uint64_t digest = 0;
+  for (uint32_t n = 0; n < nodes; n++)
+    {
+      received += phys[n]->GetReceived ();
+      digest += phys[n]->GetDigest ();
+    }
+  std::printf ("mode=%-7s nodes=%-5u %u transmissions  run %.3f s  %.2f us per transmission  "
+               "%llu deliveries  digest %016llx\n",
+               mode.c_str (), nodes, txCount, run, run * 1e6 / txCount,
+               (unsigned long long) received, (unsigned long long) digest);
+  channel->PrintStats (std::cout);
+  std::fflush (stdout);
+  Simulator::Destroy ();
+
+  std::ofstream out (ResultFile (mode, nodes).c_str ());
+  out << "run_s " << run << std::endl;
+  out << "deliveries " << received << std::endl;
+  out << "digest " << digest << std::endl;
+  return out ? 0 : 1;
+}
+
+static std::map<std::string, double>
+ReadResult (std::string mode, uint32_t nodes, uint64_t &digest)
+{
+  std::map<std::string, double> values;
+  std::ifstream in (ResultFile (mode, nodes).c_str ());
+  std::string name;
+  while (in >> name)
+    {
+      if (name == "digest")
+        {
+          in >> digest;
+        }
+      else
+        {
+          in >> values[name];
+        }
+    }
+  return values;
+}
+
+int main (int argc, char *argv[])
+{
+  std::string nodeList ("200,2000");
+  uint32_t txCount = 20000;
+  bool validate = false;
+
+  CommandLine cmd;
+  cmd.AddValue ("nodes", "comma-separated node counts", nodeList);
+  cmd.AddValue ("tx", "transmissions per run", txCount);
+  cmd.AddValue ("validate", "also check every delivery against an exhaustive scalar evaluation", validate);
+  cmd.Parse (argc, argv);
+
+  std::vector<uint32_t> counts;
+  std::istringstream in (nodeList);
+  std::string item;
+  while (std::getline (in, item, ','))
+    {
+      counts.push_back (std::atoi (item.c_str ()));
+    }
+
+  // One process per configuration, so that each starts from a clean heap
+  CrowdWorkerPool pool (1);
+  const char *modes[] = { "scalar", "batched" };
+  for (uint32_t i = 0; i < counts.size (); i++)
+    {
+      for (uint32_t m = 0; m < 2; m++)
+        {
+          std::string mode = modes[m];
+          uint32_t nodes = counts[i];
+          pool.Submit ([=] () { return RunBench (mode, nodes, txCount, validate); });
+        }
+    }
+  pool.WaitAll ();
+
+  std::printf ("\nnodes  scalar s  batched s  speedup  identical\n");
+  for (uint32_t i = 0; i < counts.size (); i++)
+    {
+      uint64_t scalarDigest = 0;
+      uint64_t batchedDigest = 0;
+      std::map<std::string, double> scalar = ReadResult ("scalar", counts[i], scalarDigest);
+      std::map<std::string, double> batched = ReadResult ("batched", counts[i], batchedDigest);
+      if (scalar["run_s"] <= 0 || batched["run_s"] <= 0)
+        {
+          std::printf ("%5u  FAILED\n", counts[i]);
+          continue;
+        }
+      bool identical = scalar["deliveries"] == batched["deliveries"] && scalarDigest == batchedDigest;
+      std::printf ("%5u  %8.3f  %9.3f  %6.2fx  %s\n", counts[i], scalar["run_s"], batched["run_s"],
+                   scalar["run_s"] / batched["run_s"], identical ? "yes" : "NO");
+    }
+  return 0;
+}
@@ -0,0 +1,456 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Warm-start checkpoints of a converged scenario.
+ *
+ * ns-3 cannot serialise a running simulation, so this keeps what can be
+ * read and written back through public interfaces:
+ *
+ *  - each node's position;
+ *  - each node's next hop towards every other node's unicast addresses,
+ *    as answered by its routing protocol's RouteOutput, whatever that
+ *    protocol is;
+ *  - the resolved entries of each node's neighbour (NDP) caches.
+ *
+ * On restore, positions seed the mobility models through a
+ * ListPositionAllocator. Neighbour entries go back into the caches as
+ * STALE, so they are used right away and confirmed by NUD in the normal
+ * way. Next hops become host routes in the node's Ipv6StaticRouting, which
+ * sits below the dynamic protocol in the Ipv6ListRouting. They carry
+ * traffic only while that protocol has no route of its own, and are
+ * removed after holdTime so that they cannot outlive the topology.
+ *
+ * Not kept: velocities, as RandomWalk2d draws a new direction and speed
+ * when it starts whatever it is given; random variable stream positions
+ * (RngStream state is private), the remaining time of random walk legs,
+ * and the routing protocol's internal tables and timers. A restored run
+ * is therefore a new sample that starts from the checkpointed topology.
+ * It does not continue the saved one.
+ *
+ * File layout ("CCKP" version 2, little endian):
+ *
+ *   file      := magic "CCKP" | u32 version | u64 timeNs | u32 nodes | node*
+ *   node      := f64 position[3] | u32 neighbours | neighbour*
+ *                | u32 routes | route*
+ *   neighbour := u32 interface | address[16] | mac[6]
+ *   route     := destination[16] | gateway[16] | u32 interface
+ */
+
+#ifndef CROWD_CHECKPOINT_H
+#define CROWD_CHECKPOINT_H
+
+#include "ns3/ipv6-l3-protocol.h"
+#include "ns3/ipv6-static-routing.h"
+#include "ns3/ipv6-static-routing-helper.h"
+#include "ns3/ipv6-routing-protocol.h"
+#include "ns3/ipv6-route.h"
+#include "ns3/ipv6-header.h"
+#include "ns3/socket.h"
+#include "ns3/packet.h"
+#include "ns3/icmpv6-l4-protocol.h"
+#include "ns3/ndisc-cache.h"
+#include "ns3/mac48-address.h"
+#include "ns3/mobility-model.h"
+#include "ns3/position-allocator.h"
+#include "ns3/node-container.h"
+#include "ns3/simulator.h"
+#include "ns3/abort.h"
+
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "crowd-trajectory.h"
+
+namespace ns3 {
+
+static const char CHECKPOINT_MAGIC[4] = { 'C', 'C', 'K', 'P' };
+static const uint32_t CHECKPOINT_VERSION = 2;
+
+class CrowdCheckpoint
+{
+public:
+  CrowdCheckpoint ();
+
+  /*
+   * Record the state of nodes as of now.
+   */
+  void Capture (NodeContainer nodes);
+  bool Save (std::string filename) const;
+  bool Load (std::string filename);
+
+  uint32_t GetNNodes (void) const;
+  Time GetTime (void) const;
+  /*
+   * Initial positions for MobilityHelper::SetPositionAllocator.
+   */
+  Ptr<ListPositionAllocator> GetPositionAllocator (void) const;
+  /*
+   * Put the recorded neighbour entries and next hops into nodes, which
+   * must have their internet stack and addresses in place. The routes are
+   * removed again after holdTime.
+   */
+  void Restore (NodeContainer nodes, Time holdTime);
+  void PrintStats (std::ostream &os) const;
+
+private:
+  struct Neighbour
+  {
+    uint32_t interface;
+    uint8_t address[16];
+    uint8_t mac[6];
+  };
+
+  struct Route
+  {
+    uint8_t destination[16];
+    uint8_t gateway[16];
+    uint32_t interface;
+  };
+
+  struct NodeState
+  {
+    double position[3];
+    std::vector<Neighbour> neighbours;
+    std::vector<Route> routes;
+  };
+
+  static void PutF64 (std::vector<uint8_t> &out, double v);
+  static double GetF64 (const uint8_t *p);
+  static void ExpireRoutes (Ptr<Ipv6StaticRouting> routing, std::vector<Route> routes);
+
+  int64_t m_timeNs;
+  std::vector<NodeState> m_nodes;
+  uint64_t m_neighbours;
+  uint64_t m_routes;
+};
+
+CrowdCheckpoint::CrowdCheckpoint ()
+  : m_timeNs (0),
+    m_neighbours (0),
+    m_routes (0)
+{
+}
+
+void
+CrowdCheckpoint::Capture (NodeContainer nodes)
+{
+  m_timeNs = Simulator::Now ().GetNanoSeconds ();
+  m_nodes.assign (nodes.GetN (), NodeState ());
+  m_neighbours = m_routes = 0;
+
+  // Every unicast address in the scenario, link-local included
+  std::vector<Ipv6Address> addresses;
+  std::vector<uint32_t> owner;
+  for (uint32_t n = 0; n < nodes.GetN (); n++)
+    {
+      Ptr<Ipv6L3Protocol> ipv6 = nodes.Get (n)->GetObject<Ipv6L3Protocol> ();
+      NS_ABORT_MSG_UNLESS (ipv6, "CrowdCheckpoint needs an IPv6 stack on every node");
+      for (uint32_t i = 1; i < ipv6->GetNInterfaces (); i++)
+        {
+          for (uint32_t a = 0; a < ipv6->GetNAddresses (i); a++)
+            {
+              addresses.push_back (ipv6->GetAddress (i, a).GetAddress ());
+              owner.push_back (n);
+            }
+        }
+    }
+
+  for (uint32_t n = 0; n < nodes.GetN (); n++)
+    {
+      NodeState &state = m_nodes[n];
+      Ptr<MobilityModel> mobility = nodes.Get (n)->GetObject<MobilityModel> ();
+      Vector p = mobility ? mobility->GetPosition () : Vector ();
+      state.position[0] = p.x;
+      state.position[1] = p.y;
+      state.position[2] = p.z;
+
+      Ptr<Ipv6L3Protocol> ipv6 = nodes.Get (n)->GetObject<Ipv6L3Protocol> ();
+      Ptr<Icmpv6L4Protocol> icmp = ipv6->GetIcmpv6 ();
+      for (uint32_t i = 1; i < ipv6->GetNInterfaces (); i++)
+        {
+          Ptr<NdiscCache> cache = icmp->FindCache (ipv6->GetNetDevice (i));
+          if (!cache)
+            {
+              continue;
+            }
+          for (uint32_t a = 0; a < addresses.size (); a++)
+            {
+              NdiscCache::Entry *entry = owner[a] == n ? 0 : cache->Lookup (addresses[a]);
+              if (!entry || entry->IsIncomplete ())
+                {
+                  continue;
+                }
+              Neighbour nb;
+              nb.interface = i;
+              addresses[a].Serialize (nb.address);
+              Mac48Address::ConvertFrom (entry->GetMacAddress ()).CopyTo (nb.mac);
+              state.neighbours.push_back (nb);
+            }
+        }
+
+      Ptr<Ipv6RoutingProtocol> routing = ipv6->GetRoutingProtocol ();
+      for (uint32_t a = 0; a < addresses.size (); a++)
+        {
+          if (owner[a] == n || addresses[a].IsLinkLocal ())
+            {
+              continue;
+            }
+          Ipv6Header header;
+          header.SetDestinationAddress (addresses[a]);
+          Socket::SocketErrno err;
+          Ptr<Ipv6Route> route = routing->RouteOutput (Create<Packet> (), header, 0, err);
+          if (!route || route->GetGateway () == Ipv6Address::GetAny ())
+            {
+              continue;         // unreachable, or on-link and covered by the connected route
+            }
+          Route r;
+          addresses[a].Serialize (r.destination);
+          route->GetGateway ().Serialize (r.gateway);
+          r.interface = ipv6->GetInterfaceForDevice (route->GetOutputDevice ());
+          state.routes.push_back (r);
+        }
+      m_neighbours += state.neighbours.size ();
+      m_routes += state.routes.size ();
+    }
+}
+
+void
+CrowdCheckpoint::PutF64 (std::vector<uint8_t> &out, double v)
+{
+  uint64_t u;
+  std::memcpy (&u, &v, 8);
+  crowd::PutU32 (out, static_cast<uint32_t> (u));
+  crowd::PutU32 (out, static_cast<uint32_t> (u >> 32));
+}
+
+double
+CrowdCheckpoint::GetF64 (const uint8_t *p)
+{
+  uint64_t u = crowd::GetU32 (p) | (static_cast<uint64_t> (crowd::GetU32 (p + 4)) << 32);
+  double v;
+  std::memcpy (&v, &u, 8);
+  return v;
+}
+
+bool
+CrowdCheckpoint::Save (std::string filename) const
+{
+  std::vector<uint8_t> out;
+  out.insert (out.end (), CHECKPOINT_MAGIC, CHECKPOINT_MAGIC + 4);
+  crowd::PutU32 (out, CHECKPOINT_VERSION);
+  crowd::PutU32 (out, static_cast<uint32_t> (m_timeNs));
+  crowd::PutU32 (out, static_cast<uint32_t> (static_cast<uint64_t> (m_timeNs) >> 32));
+  crowd::PutU32 (out, m_nodes.size ());
+  for (uint32_t n = 0; n < m_nodes.size (); n++)
+    {
+      const NodeState &s = m_nodes[n];
+      for (int k = 0; k < 3; k++)
+        {
+          PutF64 (out, s.position[k]);
+        }
+      crowd::PutU32 (out, s.neighbours.size ());
+      for (uint32_t i = 0; i < s.neighbours.size (); i++)
+        {
+          crowd::PutU32 (out, s.neighbours[i].interface);
+          out.insert (out.end (), s.neighbours[i].address, s.neighbours[i].address + 16);
+          out.insert (out.end (), s.neighbours[i].mac, s.neighbours[i].mac + 6);
+        }
+      crowd::PutU32 (out, s.routes.size ());
+      for (uint32_t i = 0; i < s.routes.size (); i++)
+        {
+          out.insert (out.end (), s.routes[i].destination, s.routes[i].destination + 16);
+          out.insert (out.end (), s.routes[i].gateway, s.routes[i].gateway + 16);
+          crowd::PutU32 (out, s.routes[i].interface);
+        }
+    }
+  std::FILE *file = std::fopen (filename.c_str (), "wb");
+  if (!file)
+    {
+      return false;
+    }
+  bool ok = std::fwrite (&out[0], 1, out.size (), file) == out.size ();
+  return std::fclose (file) == 0 && ok;
+}
+
+bool
+CrowdCheckpoint::Load (std::string filename)
+{
+  std::FILE *file = std::fopen (filename.c_str (), "rb");
+  if (!file)
+    {
+      return false;
+    }
+  std::vector<uint8_t> data;
+  uint8_t buf[65536];
+  size_t got;
+  while ((got = std::fread (buf, 1, sizeof (buf), file)) > 0)
+    {
+      data.insert (data.end (), buf, buf + got);
+    }
+  std::fclose (file);
+
+  size_t size = data.size ();
+  if (size < 20 || std::memcmp (&data[0], CHECKPOINT_MAGIC, 4) != 0
+      || crowd::GetU32 (&data[4]) != CHECKPOINT_VERSION)
+    {
+      return false;
+    }
+  m_timeNs = static_cast<int64_t> (crowd::GetU32 (&data[8])
+                                   | (static_cast<uint64_t> (crowd::GetU32 (&data[12])) << 32));
+  uint32_t nodes = crowd::GetU32 (&data[16]);
+  size_t off = 20;
+  m_nodes.assign (nodes, NodeState ());
+  m_neighbours = m_routes = 0;
+  for (uint32_t n = 0; n < nodes; n++)
+    {
+      NodeState &s = m_nodes[n];
+      if (off + 28 > size)
+        {
+          return false;
+        }
+      for (int k = 0; k < 3; k++)
+        {
+          s.position[k] = GetF64 (&data[off + 8 * k]);
+        }
+      uint32_t count = crowd::GetU32 (&data[off + 24]);
+      off += 28;
+      if (off + static_cast<uint64_t> (count) * 26 + 4 > size)
+        {
+          return false;
+        }
+      s.neighbours.resize (count);
+      for (uint32_t i = 0; i < count; i++, off += 26)
+        {
+          s.neighbours[i].interface = crowd::GetU32 (&data[off]);
+          std::memcpy (s.neighbours[i].address, &data[off + 4], 16);
+          std::memcpy (s.neighbours[i].mac, &data[off + 20], 6);
+        }
+      count = crowd::GetU32 (&data[off]);
+      off += 4;
+      if (off + static_cast<uint64_t> (count) * 36 > size)
+        {
+          return false;
+        }
+      s.routes.resize (count);
+      for (uint32_t i = 0; i < count; i++, off += 36)
+        {
+          std::memcpy (s.routes[i].destination, &data[off], 16);
+          std::memcpy (s.routes[i].gateway, &data[off + 16], 16);
+          s.routes[i].interface = crowd::GetU32 (&data[off + 32]);
+        }
+      m_neighbours += s.neighbours.size ();
+      m_routes += s.routes.size ();
+    }
+  return true;
+}
+
+uint32_t
+CrowdCheckpoint::GetNNodes (void) const
+{
+  return m_nodes.size ();
+}
+
+Time
+CrowdCheckpoint::GetTime (void) const
+{
+  return NanoSeconds (m_timeNs);
+}
+
+Ptr<ListPositionAllocator>
+CrowdCheckpoint::GetPositionAllocator (void) const
+{
+  Ptr<ListPositionAllocator> alloc = CreateObject<ListPositionAllocator> ();
+  for (uint32_t n = 0; n < m_nodes.size (); n++)
+    {
+      alloc->Add (Vector (m_nodes[n].position[0], m_nodes[n].position[1], m_nodes[n].position[2]));
+    }
+  return alloc;
+}
+
+void
+CrowdCheckpoint::Restore (NodeContainer nodes, Time holdTime)
+{
+  NS_ABORT_MSG_UNLESS (nodes.GetN () == m_nodes.size (),
+                       "checkpoint has " << m_nodes.size () << " nodes, scenario " << nodes.GetN ());
+  Ipv6StaticRoutingHelper staticHelper;
+  for (uint32_t n = 0; n < nodes.GetN (); n++)
+    {
+      const NodeState &s = m_nodes[n];
+      Ptr<Ipv6L3Protocol> ipv6 = nodes.Get (n)->GetObject<Ipv6L3Protocol> ();
+      NS_ABORT_MSG_UNLESS (ipv6, "CrowdCheckpoint needs an IPv6 stack on every node");
+      Ptr<Icmpv6L4Protocol> icmp = ipv6->GetIcmpv6 ();
+      for (uint32_t i = 0; i < s.neighbours.size (); i++)
+        {
+          const Neighbour &nb = s.neighbours[i];
+          if (nb.interface >= ipv6->GetNInterfaces ())
+            {
+              continue;
+            }
+          Ptr<NdiscCache> cache = icmp->FindCache (ipv6->GetNetDevice (nb.interface));
+          if (!cache)
+            {
+              continue;
+            }
+          Ipv6Address address = Ipv6Address::Deserialize (nb.address);
+          Mac48Address mac;
+          mac.CopyFrom (nb.mac);
+          NdiscCache::Entry *entry = cache->Lookup (address);
+          if (!entry)
+            {
+              entry = cache->Add (address);
+            }
+          entry->MarkStale (mac);
+        }
+
+      Ptr<Ipv6StaticRouting> routing = staticHelper.GetStaticRouting (ipv6);
+      if (!routing || s.routes.empty ())
+        {
+          continue;
+        }
+      for (uint32_t i = 0; i < s.routes.size (); i++)
+        {
+          const Route &r = s.routes[i];
+          routing->AddHostRouteTo (Ipv6Address::Deserialize (r.destination),
+                                   Ipv6Address::Deserialize (r.gateway), r.interface);
+        }
+      Simulator::Schedule (holdTime, &CrowdCheckpoint::ExpireRoutes, routing, s.routes);
+    }
+}
+
+void
+CrowdCheckpoint::ExpireRoutes (Ptr<Ipv6StaticRouting> routing, std::vector<Route> routes)
+{
+  for (uint32_t i = 0; i < routes.size (); i++)
+    {
+      routing->RemoveRoute (Ipv6Address::Deserialize (routes[i].destination), Ipv6Prefix (128),
+                            routes[i].interface, Ipv6Address::GetAny ());
+    }
+}
+
+void
+CrowdCheckpoint::PrintStats (std::ostream &os) const
+{
+  os << "checkpoint: " << m_nodes.size () << " nodes at " << m_timeNs / 1e9 << " s, "
+     << m_neighbours << " neighbour entries, " << m_routes << " routes" << std::endl;
+}
+
+} // namespace ns3
+
+#endif /* CROWD_CHECKPOINT_H */
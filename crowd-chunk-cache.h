@@ -0,0 +1,295 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Fixed-capacity containers for the content application.
+ *
+ * FlatIdMap is an open-addressing hash map from non-zero 64-bit ids to
+ * 32-bit values, with linear probing and backward-shift deletion (no
+ * tombstones). ChunkLru is a least-recently-used set of chunk descriptors
+ * taken from a pool sized at construction. Neither allocates after Reserve
+ * (resp. the constructor), so they can sit on a per-packet receive path.
+ */
+
+#ifndef CROWD_CHUNK_CACHE_H
+#define CROWD_CHUNK_CACHE_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+namespace crowd {
+
+/*
+ * splitmix64 finaliser; used both to derive chunk ids and to spread them
+ * over the hash table.
+ */
+inline uint64_t
+MixId (uint64_t x)
+{
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+/*
+ * Content-addressed id of chunk index of content; never 0.
+ */
+inline uint64_t
+ChunkId (uint32_t content, uint32_t index)
+{
+  uint64_t id = MixId ((static_cast<uint64_t> (content) << 32) | index);
+  return id ? id : 1;
+}
+
+class FlatIdMap
+{
+public:
+  enum { NONE = 0xffffffffu };
+
+  FlatIdMap ()
+    : m_mask (0),
+      m_size (0)
+  {
+  }
+
+  /*
+   * Size the table for up to maxEntries keys at most half full.
+   */
+  void Reserve (uint32_t maxEntries)
+  {
+    size_t cap = 8;
+    while (cap < 2 * static_cast<size_t> (maxEntries))
+      {
+        cap <<= 1;
+      }
+    m_keys.assign (cap, 0);
+    m_values.assign (cap, NONE);
+    m_mask = cap - 1;
+    m_size = 0;
+  }
+
+  uint32_t Find (uint64_t key) const
+  {
+    for (size_t i = MixId (key) & m_mask; ; i = (i + 1) & m_mask)
+      {
+        if (m_keys[i] == key)
+          {
+            return m_values[i];
+          }
+        if (m_keys[i] == 0)
+          {
+            return NONE;
+          }
+      }
+  }
+
+  /*
+   * Insert or overwrite. The caller keeps the map within its reserved size.
+   */
+  void Insert (uint64_t key, uint32_t value)
+  {
+    size_t i = MixId (key) & m_mask;
+    while (m_keys[i] != 0 && m_keys[i] != key)
+      {
+        i = (i + 1) & m_mask;
+      }
+    if (m_keys[i] == 0)
+      {
+        m_size++;
+      }
+    m_keys[i] = key;
+    m_values[i] = value;
+  }
+
+  void Erase (uint64_t key)
+  {
+    size_t i = MixId (key) & m_mask;
+    while (m_keys[i] != key)
+      {
+        if (m_keys[i] == 0)
+          {
+            return;
+          }
+        i = (i + 1) & m_mask;
+      }
+    // Shift later members of the probe run back into the hole so that
+    // lookups never stop early
+    size_t hole = i;
+    for (size_t j = (hole + 1) & m_mask; m_keys[j] != 0; j = (j + 1) & m_mask)
+      {
+        size_t home = MixId (m_keys[j]) & m_mask;
+        if (((j - home) & m_mask) >= ((j - hole) & m_mask))
+          {
+            m_keys[hole] = m_keys[j];
+            m_values[hole] = m_values[j];
+            hole = j;
+          }
+      }
+    m_keys[hole] = 0;
+    m_values[hole] = NONE;
+    m_size--;
+  }
+
+  uint32_t GetSize (void) const
+  {
+    return m_size;
+  }
+
+private:
+  std::vector<uint64_t> m_keys;     // 0 marks an empty slot
+  std::vector<uint32_t> m_values;
+  size_t m_mask;
+  uint32_t m_size;
+};
+
+class ChunkLru
+{
+public:
+  enum { NONE = 0xffffffffu };
+
+  struct Chunk
+  {
+    uint64_t id;
+    uint32_t index;       // position of the chunk in its content
+    uint32_t prev;
+    uint32_t next;
+  };
+
+  explicit ChunkLru (uint32_t capacity = 0)
+  {
+    Reset (capacity);
+  }
+
+  void Reset (uint32_t capacity)
+  {
+    m_pool.assign (capacity, Chunk ());
+    m_free.clear ();
+    m_free.reserve (capacity);
+    for (uint32_t i = capacity; i > 0; i--)
+      {
+        m_free.push_back (i - 1);
+      }
+    m_map.Reserve (capacity);
+    m_head = m_tail = NONE;
+  }
+
+  /*
+   * Slot of id, marked most recently used; NONE on a miss.
+   */
+  uint32_t Lookup (uint64_t id)
+  {
+    uint32_t slot = m_map.Find (id);
+    if (slot != NONE)
+      {
+        Unlink (slot);
+        PushFront (slot);
+      }
+    return slot;
+  }
+
+  bool Contains (uint64_t id) const
+  {
+    return m_map.Find (id) != NONE;
+  }
+
+  /*
+   * Add id as most recently used. If the cache is full the least recently
+   * used chunk is evicted and its index returned through evicted (NONE
+   * otherwise). Re-inserting a cached id only refreshes it.
+   */
+  void Insert (uint64_t id, uint32_t index, uint32_t &evicted)
+  {
+    evicted = NONE;
+    if (m_pool.empty () || Lookup (id) != NONE)
+      {
+        return;
+      }
+    if (m_free.empty ())
+      {
+        uint32_t victim = m_tail;
+        evicted = m_pool[victim].index;
+        Unlink (victim);
+        m_map.Erase (m_pool[victim].id);
+        m_free.push_back (victim);
+      }
+    uint32_t slot = m_free.back ();
+    m_free.pop_back ();
+    m_pool[slot].id = id;
+    m_pool[slot].index = index;
+    PushFront (slot);
+    m_map.Insert (id, slot);
+  }
+
+  const Chunk &Get (uint32_t slot) const
+  {
+    return m_pool[slot];
+  }
+
+  uint32_t GetSize (void) const
+  {
+    return m_map.GetSize ();
+  }
+
+private:
+  void Unlink (uint32_t slot)
+  {
+    Chunk &c = m_pool[slot];
+    if (c.prev != NONE)
+      {
+        m_pool[c.prev].next = c.next;
+      }
+    else
+      {
+        m_head = c.next;
+      }
+    if (c.next != NONE)
+      {
+        m_pool[c.next].prev = c.prev;
+      }
+    else
+      {
+        m_tail = c.prev;
+      }
+  }
+
+  void PushFront (uint32_t slot)
+  {
+    Chunk &c = m_pool[slot];
+    c.prev = NONE;
+    c.next = m_head;
+    if (m_head != NONE)
+      {
+        m_pool[m_head].prev = slot;
+      }
+    m_head = slot;
+    if (m_tail == NONE)
+      {
+        m_tail = slot;
+      }
+  }
+
+  std::vector<Chunk> m_pool;
+  std::vector<uint32_t> m_free;
+  FlatIdMap m_map;
+  uint32_t m_head;      // most recently used
+  uint32_t m_tail;      // least recently used
+};
+
+} // namespace crowd
+
+#endif /* CROWD_CHUNK_CACHE_H */
@@ -0,0 +1,590 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Store-and-forward content sharing between neighbours.
+ *
+ * One content item is split into Chunks chunks of ChunkSize bytes, each
+ * named by a hash of (ContentId, index). Seed nodes hold every chunk; the
+ * others keep the chunks they have received in an LRU cache of CacheChunks
+ * entries. Over UDP on the link:
+ *
+ *  - every HelloInterval (jittered) a node multicasts to ff02::1 a bitmap
+ *    of the chunks it can serve;
+ *  - on a hello, a node requests up to MaxBatch chunks it still misses from
+ *    that neighbour in one REQUEST, skipping chunks already requested from
+ *    someone else within RequestTimeout (pull), and sends up to
+ *    PushPerHello chunks the neighbour lacks unasked (push);
+ *  - a REQUEST is answered with one DATA per chunk that is still cached.
+ *
+ * Counters cover cache hits and misses on requests, duplicate chunks
+ * received, requests suppressed as already pending, and the time at which
+ * a node had received every chunk. The cache, the chunk catalogue and the
+ * request bookkeeping are preallocated at start, so the receive path does
+ * not allocate beyond the packets ns-3 itself hands over.
+ */
+
+#ifndef CROWD_CONTENT_APP_H
+#define CROWD_CONTENT_APP_H
+
+#include "ns3/application.h"
+#include "ns3/application-container.h"
+#include "ns3/socket.h"
+#include "ns3/inet6-socket-address.h"
+#include "ns3/ipv6.h"
+#include "ns3/abort.h"
+#include "ns3/packet.h"
+#include "ns3/simulator.h"
+#include "ns3/random-variable-stream.h"
+#include "ns3/traced-callback.h"
+#include "ns3/uinteger.h"
+#include "ns3/boolean.h"
+#include "ns3/nstime.h"
+
+#include <algorithm>
+#include <ostream>
+#include <vector>
+
+#include "crowd-chunk-cache.h"
+
+namespace ns3 {
+
+class CrowdContentApp : public Application
+{
+public:
+  static TypeId GetTypeId (void);
+
+  CrowdContentApp ();
+
+  bool IsComplete (void) const;
+  /*
+   * Time from application start until every chunk had been received.
+   */
+  Time GetCompletionTime (void) const;
+  uint32_t GetReceivedChunks (void) const;
+
+  /*
+   * Totals over the CrowdContentApps in apps.
+   */
+  static void PrintSummary (const ApplicationContainer &apps, std::ostream &os);
+
+protected:
+  virtual void DoDispose (void);
+
+private:
+  enum
+  {
+    HELLO = 1,
+    REQUEST = 2,
+    DATA = 3
+  };
+
+  virtual void StartApplication (void);
+  virtual void StopApplication (void);
+
+  void SendHello (void);
+  void HandleRead (Ptr<Socket> socket);
+  void HandleHello (const uint8_t *msg, uint32_t len, const Address &from);
+  void HandleRequest (const uint8_t *msg, uint32_t len, const Address &from);
+  void HandleData (const uint8_t *msg, uint32_t len, Ptr<const Packet> packet, const Address &from);
+  void SendData (uint32_t index, const Address &to);
+  bool Holds (uint32_t index) const;
+  void SetHeld (uint32_t index, bool held);
+
+  static void Put16 (uint8_t *p, uint16_t v);
+  static void Put32 (uint8_t *p, uint32_t v);
+  static void Put64 (uint8_t *p, uint64_t v);
+  static uint16_t Get16 (const uint8_t *p);
+  static uint32_t Get32 (const uint8_t *p);
+  static uint64_t Get64 (const uint8_t *p);
+
+  uint16_t m_port;
+  uint32_t m_contentId;
+  uint32_t m_chunks;
+  uint32_t m_chunkSize;
+  uint32_t m_cacheChunks;
+  Time m_helloInterval;
+  uint32_t m_maxBatch;
+  uint32_t m_pushPerHello;
+  Time m_requestTimeout;
+  bool m_seed;
+
+  Ptr<Socket> m_socket;
+  EventId m_helloEvent;
+  Ptr<UniformRandomVariable> m_jitter;
+  Time m_started;
+
+  std::vector<uint64_t> m_ids;            // chunk index -> id
+  crowd::FlatIdMap m_catalogue;           // chunk id -> index
+  crowd::ChunkLru m_cache;
+  std::vector<uint8_t> m_received;        // per chunk
+  std::vector<uint8_t> m_held;            // bitmap, as sent in hellos
+  std::vector<int64_t> m_pendingUntil;    // per chunk, ns
+  std::vector<uint8_t> m_rxBuffer;
+  std::vector<uint8_t> m_txBuffer;
+  uint32_t m_pullCursor;
+  uint32_t m_pushCursor;
+
+  uint32_t m_receivedCount;
+  Time m_completed;
+  uint64_t m_hits;
+  uint64_t m_misses;
+  uint64_t m_duplicates;
+  uint64_t m_suppressed;
+  uint64_t m_requestsSent;
+  uint64_t m_chunksSent;
+  uint64_t m_pushed;
+
+  TracedCallback<Ptr<const Packet>, const Address &> m_rxTrace;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (CrowdContentApp);
+
+TypeId
+CrowdContentApp::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::CrowdContentApp")
+    .SetParent<Application> ()
+    .SetGroupName ("Applications")
+    .AddConstructor<CrowdContentApp> ()
+    .AddAttribute ("Port", "UDP port of the content protocol.",
+                   UintegerValue (9000),
+                   MakeUintegerAccessor (&CrowdContentApp::m_port),
+                   MakeUintegerChecker<uint16_t> ())
+    .AddAttribute ("ContentId", "Id of the shared content item.",
+                   UintegerValue (1),
+                   MakeUintegerAccessor (&CrowdContentApp::m_contentId),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("Chunks", "Number of chunks in the content.",
+                   UintegerValue (256),
+                   MakeUintegerAccessor (&CrowdContentApp::m_chunks),
+                   MakeUintegerChecker<uint32_t> (1, 8192))
+    .AddAttribute ("ChunkSize", "Chunk payload in bytes.",
+                   UintegerValue (1024),
+                   MakeUintegerAccessor (&CrowdContentApp::m_chunkSize),
+                   MakeUintegerChecker<uint32_t> (1, 65000))
+    .AddAttribute ("CacheChunks", "Chunks a non-seed node keeps for its neighbours.",
+                   UintegerValue (64),
+                   MakeUintegerAccessor (&CrowdContentApp::m_cacheChunks),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("HelloInterval", "Mean time between chunk advertisements.",
+                   TimeValue (Seconds (1.0)),
+                   MakeTimeAccessor (&CrowdContentApp::m_helloInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("MaxBatch", "Most chunks asked for in one request.",
+                   UintegerValue (16),
+                   MakeUintegerAccessor (&CrowdContentApp::m_maxBatch),
+                   MakeUintegerChecker<uint32_t> (1, 1024))
+    .AddAttribute ("PushPerHello", "Chunks sent unasked to a neighbour that lacks them, per hello heard.",
+                   UintegerValue (2),
+                   MakeUintegerAccessor (&CrowdContentApp::m_pushPerHello),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("RequestTimeout", "Time before a chunk already asked for may be asked for again.",
+                   TimeValue (MilliSeconds (500)),
+                   MakeTimeAccessor (&CrowdContentApp::m_requestTimeout),
+                   MakeTimeChecker ())
+    .AddAttribute ("Seed", "Start with, and always serve, the whole content.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&CrowdContentApp::m_seed),
+                   MakeBooleanChecker ())
+    .AddTraceSource ("Rx", "A new chunk was received.",
+                     MakeTraceSourceAccessor (&CrowdContentApp::m_rxTrace),
+                     "ns3::Packet::AddressTracedCallback")
+  ;
+  return tid;
+}
+
+CrowdContentApp::CrowdContentApp ()
+  : m_pullCursor (0),
+    m_pushCursor (0),
+    m_receivedCount (0),
+    m_hits (0),
+    m_misses (0),
+    m_duplicates (0),
+    m_suppressed (0),
+    m_requestsSent (0),
+    m_chunksSent (0),
+    m_pushed (0)
+{
+  m_jitter = CreateObject<UniformRandomVariable> ();
+}
+
+void
+CrowdContentApp::DoDispose (void)
+{
+  m_socket = 0;
+  m_jitter = 0;
+  Application::DoDispose ();
+}
+
+void
+CrowdContentApp::StartApplication (void)
+{
+  m_started = Simulator::Now ();
+  m_ids.resize (m_chunks);
+  m_catalogue.Reserve (m_chunks);
+  for (uint32_t i = 0; i < m_chunks; i++)
+    {
+      m_ids[i] = crowd::ChunkId (m_contentId, i);
+      m_catalogue.Insert (m_ids[i], i);
+    }
+  m_cache.Reset (m_seed ? 0 : m_cacheChunks);
+  m_received.assign (m_chunks, m_seed ? 1 : 0);
+  m_receivedCount = m_seed ? m_chunks : 0;
+  m_completed = m_seed ? Seconds (0) : Seconds (-1);
+  m_held.assign ((m_chunks + 7) / 8, m_seed ? 0xff : 0);
+  m_pendingUntil.assign (m_chunks, 0);
+  uint32_t bitmapOffset = 13;
+  m_rxBuffer.resize (std::max (bitmapOffset + static_cast<uint32_t> (m_held.size ()), 7 + 8 * m_maxBatch));
+  m_txBuffer.resize (m_rxBuffer.size ());
+  m_pullCursor = m_jitter->GetInteger (0, m_chunks - 1);
+
+  if (!m_socket)
+    {
+      m_socket = Socket::CreateSocket (GetNode (), TypeId::LookupByName ("ns3::UdpSocketFactory"));
+      m_socket->Bind (Inet6SocketAddress (Ipv6Address::GetAny (), m_port));
+      // Link-local multicast needs an outgoing device: routing asserts on
+      // ff02::1 without one. Interface 0 is the loopback, 1 the Wi-Fi.
+      Ptr<Ipv6> ipv6 = GetNode ()->GetObject<Ipv6> ();
+      NS_ABORT_MSG_UNLESS (ipv6 && ipv6->GetNInterfaces () > 1, "content app needs an IPv6 interface");
+      m_socket->BindToNetDevice (ipv6->GetNetDevice (1));
+      m_socket->SetRecvCallback (MakeCallback (&CrowdContentApp::HandleRead, this));
+    }
+  m_helloEvent = Simulator::Schedule (Seconds (m_jitter->GetValue (0, m_helloInterval.GetSeconds ())),
+                                      &CrowdContentApp::SendHello, this);
+}
+
+void
+CrowdContentApp::StopApplication (void)
+{
+  Simulator::Cancel (m_helloEvent);
+  if (m_socket)
+    {
+      m_socket->Close ();
+      m_socket->SetRecvCallback (MakeNullCallback<void, Ptr<Socket> > ());
+      m_socket = 0;
+    }
+}
+
+bool
+CrowdContentApp::Holds (uint32_t index) const
+{
+  return m_held[index / 8] & (1 << (index % 8));
+}
+
+void
+CrowdContentApp::SetHeld (uint32_t index, bool held)
+{
+  if (held)
+    {
+      m_held[index / 8] |= 1 << (index % 8);
+    }
+  else
+    {
+      m_held[index / 8] &= ~(1 << (index % 8));
+    }
+}
+
+void
+CrowdContentApp::SendHello (void)
+{
+  uint8_t *p = &m_txBuffer[0];
+  p[0] = HELLO;
+  Put32 (p + 1, GetNode ()->GetId ());
+  Put32 (p + 5, m_contentId);
+  Put32 (p + 9, m_chunks);
+  std::copy (m_held.begin (), m_held.end (), p + 13);
+  m_socket->SendTo (Create<Packet> (p, 13 + m_held.size ()), 0,
+                    Inet6SocketAddress (Ipv6Address::GetAllNodesMulticast (), m_port));
+  // +-10% so that neighbours do not stay in step
+  Time next = Seconds (m_helloInterval.GetSeconds () * m_jitter->GetValue (0.9, 1.1));
+  m_helloEvent = Simulator::Schedule (next, &CrowdContentApp::SendHello, this);
+}
+
+void
+CrowdContentApp::HandleRead (Ptr<Socket> socket)
+{
+  Ptr<Packet> packet;
+  Address from;
+  while ((packet = socket->RecvFrom (from)))
+    {
+      uint32_t len = std::min (packet->GetSize (), static_cast<uint32_t> (m_rxBuffer.size ()));
+      if (len < 5)
+        {
+          continue;
+        }
+      packet->CopyData (&m_rxBuffer[0], len);
+      switch (m_rxBuffer[0])
+        {
+        case HELLO:
+          HandleHello (&m_rxBuffer[0], len, from);
+          break;
+        case REQUEST:
+          HandleRequest (&m_rxBuffer[0], len, from);
+          break;
+        case DATA:
+          HandleData (&m_rxBuffer[0], len, packet, from);
+          break;
+        default:
+          break;
+        }
+    }
+}
+
+void
+CrowdContentApp::HandleHello (const uint8_t *msg, uint32_t len, const Address &from)
+{
+  if (len < 13 + m_held.size () || Get32 (msg + 5) != m_contentId || Get32 (msg + 9) != m_chunks)
+    {
+      return;
+    }
+  const uint8_t *bitmap = msg + 13;
+  int64_t now = Simulator::Now ().GetNanoSeconds ();
+
+  // Pull: one batched request for chunks we miss and the neighbour has
+  if (m_receivedCount < m_chunks)
+    {
+      uint8_t *p = &m_txBuffer[0];
+      uint16_t count = 0;
+      for (uint32_t n = 0; n < m_chunks && count < m_maxBatch; n++)
+        {
+          uint32_t i = (m_pullCursor + n) % m_chunks;
+          if (m_received[i] || !(bitmap[i / 8] & (1 << (i % 8))))
+            {
+              continue;
+            }
+          if (m_pendingUntil[i] > now)
+            {
+              m_suppressed++;
+              continue;
+            }
+          m_pendingUntil[i] = now + m_requestTimeout.GetNanoSeconds ();
+          Put64 (p + 7 + 8 * count, m_ids[i]);
+          count++;
+        }
+      m_pullCursor = (m_pullCursor + 1) % m_chunks;
+      if (count > 0)
+        {
+          p[0] = REQUEST;
+          Put32 (p + 1, GetNode ()->GetId ());
+          Put16 (p + 5, count);
+          m_socket->SendTo (Create<Packet> (p, 7 + 8 * count), 0, from);
+          m_requestsSent++;
+        }
+    }
+
+  // Push: a few chunks the neighbour lacks, without waiting to be asked
+  uint32_t pushed = 0;
+  for (uint32_t n = 0; n < m_chunks && pushed < m_pushPerHello; n++)
+    {
+      uint32_t i = (m_pushCursor + n) % m_chunks;
+      if (Holds (i) && !(bitmap[i / 8] & (1 << (i % 8))))
+        {
+          SendData (i, from);
+          pushed++;
+          m_pushCursor = (i + 1) % m_chunks;
+        }
+    }
+  m_pushed += pushed;
+}
+
+void
+CrowdContentApp::HandleRequest (const uint8_t *msg, uint32_t len, const Address &from)
+{
+  if (len < 7)
+    {
+      return;
+    }
+  uint32_t count = std::min (static_cast<uint32_t> (Get16 (msg + 5)), (len - 7) / 8);
+  for (uint32_t c = 0; c < count; c++)
+    {
+      uint32_t index = m_catalogue.Find (Get64 (msg + 7 + 8 * c));
+      if (index == crowd::FlatIdMap::NONE)
+        {
+          continue;
+        }
+      if (m_seed)
+        {
+          SendData (index, from);
+        }
+      else if (m_cache.Lookup (m_ids[index]) != crowd::ChunkLru::NONE)
+        {
+          m_hits++;
+          SendData (index, from);
+        }
+      else
+        {
+          // Evicted since our last hello
+          m_misses++;
+        }
+    }
+}
+
+void
+CrowdContentApp::HandleData (const uint8_t *msg, uint32_t len, Ptr<const Packet> packet,
+                             const Address &from)
+{
+  if (len < 13)
+    {
+      return;
+    }
+  uint64_t id = Get64 (msg + 5);
+  uint32_t index = m_catalogue.Find (id);
+  if (index == crowd::FlatIdMap::NONE)
+    {
+      return;
+    }
+  if (m_received[index])
+    {
+      m_duplicates++;
+      return;
+    }
+  m_received[index] = 1;
+  m_receivedCount++;
+  m_pendingUntil[index] = 0;
+  uint32_t evicted;
+  m_cache.Insert (id, index, evicted);
+  if (evicted != crowd::ChunkLru::NONE)
+    {
+      SetHeld (evicted, false);
+    }
+  SetHeld (index, true);
+  if (m_receivedCount == m_chunks)
+    {
+      m_completed = Simulator::Now () - m_started;
+    }
+  m_rxTrace (packet, from);
+}
+
+void
+CrowdContentApp::SendData (uint32_t index, const Address &to)
+{
+  uint8_t header[13];
+  header[0] = DATA;
+  Put32 (header + 1, GetNode ()->GetId ());
+  Put64 (header + 5, m_ids[index]);
+  // Appending a zero-area packet to one that ends in real bytes extends the
+  // zero area; the chunk payload is never allocated
+  Ptr<Packet> packet = Create<Packet> (header, sizeof (header));
+  packet->AddAtEnd (Create<Packet> (m_chunkSize));
+  m_socket->SendTo (packet, 0, to);
+  m_chunksSent++;
+}
+
+bool
+CrowdContentApp::IsComplete (void) const
+{
+  return m_receivedCount == m_chunks && m_chunks > 0;
+}
+
+Time
+CrowdContentApp::GetCompletionTime (void) const
+{
+  return m_completed;
+}
+
+uint32_t
+CrowdContentApp::GetReceivedChunks (void) const
+{
+  return m_receivedCount;
+}
+
+void
+CrowdContentApp::PrintSummary (const ApplicationContainer &apps, std::ostream &os)
+{
+  uint32_t nodes = 0, complete = 0;
+  double sum = 0, worst = 0;
+  uint64_t hits = 0, misses = 0, duplicates = 0, suppressed = 0, requests = 0, sent = 0, pushed = 0;
+  for (ApplicationContainer::Iterator i = apps.Begin (); i != apps.End (); ++i)
+    {
+      Ptr<CrowdContentApp> app = DynamicCast<CrowdContentApp> (*i);
+      if (!app)
+        {
+          continue;
+        }
+      sent += app->m_chunksSent;
+      pushed += app->m_pushed;
+      if (app->m_seed)
+        {
+          continue;
+        }
+      nodes++;
+      if (app->IsComplete ())
+        {
+          complete++;
+          sum += app->m_completed.GetSeconds ();
+          worst = std::max (worst, app->m_completed.GetSeconds ());
+        }
+      hits += app->m_hits;
+      misses += app->m_misses;
+      duplicates += app->m_duplicates;
+      suppressed += app->m_suppressed;
+      requests += app->m_requestsSent;
+    }
+  os << "content: " << complete << "/" << nodes << " nodes complete";
+  if (complete > 0)
+    {
+      os << ", completion mean " << sum / complete << " s, max " << worst << " s";
+    }
+  os << std::endl << "content: cache hit ratio "
+     << (hits + misses > 0 ? double (hits) / (hits + misses) : 0.0)
+     << " (" << hits << " hits, " << misses << " misses), " << requests << " requests, "
+     << sent << " chunks sent (" << pushed << " pushed), " << duplicates
+     << " duplicates received, " << suppressed << " requests suppressed" << std::endl;
+}
+
+void
+CrowdContentApp::Put16 (uint8_t *p, uint16_t v)
+{
+  p[0] = v >> 8;
+  p[1] = v;
+}
+
+void
+CrowdContentApp::Put32 (uint8_t *p, uint32_t v)
+{
+  Put16 (p, v >> 16);
+  Put16 (p + 2, v);
+}
+
+void
+CrowdContentApp::Put64 (uint8_t *p, uint64_t v)
+{
+  Put32 (p, v >> 32);
+  Put32 (p + 4, v);
+}
+
+uint16_t
+CrowdContentApp::Get16 (const uint8_t *p)
+{
+  return (p[0] << 8) | p[1];
+}
+
+uint32_t
+CrowdContentApp::Get32 (const uint8_t *p)
+{
+  return (static_cast<uint32_t> (Get16 (p)) << 16) | Get16 (p + 2);
+}
+
+uint64_t
+CrowdContentApp::Get64 (const uint8_t *p)
+{
+  return (static_cast<uint64_t> (Get32 (p)) << 32) | Get32 (p + 4);
+}
+
+} // namespace ns3
+
+#endif /* CROWD_CONTENT_APP_H */
@@ -0,0 +1,445 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Event-loop profiling as a scheduler.
+ *
+ * CrowdProfilingScheduler wraps another Scheduler (Inner, a MapScheduler
+ * by default, as DefaultSimulatorImpl uses) and is installed with
+ * CrowdProfilingScheduler::Enable () before the run. The simulator calls
+ * RemoveNext right before it invokes an event, so the wall time from one
+ * RemoveNext to the next is what the previous event cost, including the
+ * events it scheduled. Events are told apart by the dynamic type of their
+ * EventImpl, one per MakeEvent instantiation, and labelled with the
+ * function pointer type it was made for, such as "void (ns3::RipNg::*)()";
+ * member functions of one class with the same signature share a label.
+ * Cancelled events, which the simulator still dequeues, count as
+ * "(cancelled)".
+ *
+ * Per type it keeps the count, the total and a log2 histogram of the
+ * durations, from which the percentiles are read (to within a factor of
+ * two). The queue depth is sampled every DepthInterval of simulated time.
+ * Report prints the types sorted by total time and writes a folded-stacks
+ * file (one "scenario;class;function nanoseconds" line per type, for
+ * flamegraph.pl) and a CSV of the queue depth.
+ *
+ * The cost per event is one clock_gettime and one hash lookup on the
+ * type, small next to any real event.
+ */
+
+#ifndef CROWD_EVENT_PROFILER_H
+#define CROWD_EVENT_PROFILER_H
+
+#include "ns3/scheduler.h"
+#include "ns3/map-scheduler.h"
+#include "ns3/event-impl.h"
+#include "ns3/simulator.h"
+#include "ns3/object-factory.h"
+#include "ns3/type-id.h"
+#include "ns3/nstime.h"
+
+#include <cxxabi.h>
+#include <time.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ns3 {
+
+class CrowdProfilingScheduler : public Scheduler
+{
+public:
+  static TypeId GetTypeId (void);
+
+  CrowdProfilingScheduler ();
+  virtual ~CrowdProfilingScheduler ();
+
+  /*
+   * Make the simulator use a profiling scheduler from now on.
+   */
+  static void Enable (void);
+  /*
+   * The scheduler installed by the last Enable, or 0.
+   */
+  static CrowdProfilingScheduler *Get (void);
+
+  /*
+   * Stop timing, print the report to os and write the folded stacks and
+   * the queue depth; scenario is the root frame. Call before
+   * Simulator::Destroy, which dequeues what is left.
+   */
+  void Report (std::ostream &os, std::string scenario, std::string foldedFile,
+               std::string depthFile);
+
+  virtual void Insert (const Event &ev);
+  virtual bool IsEmpty (void) const;
+  virtual Event PeekNext (void) const;
+  virtual Event RemoveNext (void);
+  virtual void Remove (const Event &ev);
+
+protected:
+  virtual void NotifyConstructionCompleted (void);
+
+private:
+  enum { BUCKETS = 40 };
+
+  struct EventType
+  {
+    std::string label;
+    uint64_t count;
+    uint64_t totalNs;
+    uint64_t hist[BUCKETS];     // [2^i, 2^(i+1)) ns
+  };
+
+  static int64_t WallNs (void);
+  static std::string Label (const std::type_info &type);
+  uint32_t Classify (const Event &ev);
+  void Close (int64_t now);
+  uint64_t Percentile (const EventType &type, double p) const;
+
+  static CrowdProfilingScheduler *g_current;
+
+  TypeId m_innerType;
+  Time m_depthInterval;
+  Ptr<Scheduler> m_inner;
+  bool m_timing;
+  std::unordered_map<std::type_index, uint32_t> m_ids;
+  std::vector<EventType> m_types;
+  uint32_t m_running;           // type of the event being executed
+  int64_t m_startedNs;
+  uint64_t m_depth;
+  uint64_t m_maxDepth;
+  uint64_t m_events;
+  int64_t m_nextDepthTs;
+  std::vector<std::pair<double, uint64_t> > m_depthSeries;
+};
+
+CrowdProfilingScheduler *CrowdProfilingScheduler::g_current = 0;
+
+NS_OBJECT_ENSURE_REGISTERED (CrowdProfilingScheduler);
+
+TypeId
+CrowdProfilingScheduler::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::CrowdProfilingScheduler")
+    .SetParent<Scheduler> ()
+    .SetGroupName ("Core")
+    .AddConstructor<CrowdProfilingScheduler> ()
+    .AddAttribute ("Inner", "Scheduler that actually keeps the events.",
+                   TypeIdValue (MapScheduler::GetTypeId ()),
+                   MakeTypeIdAccessor (&CrowdProfilingScheduler::m_innerType),
+                   MakeTypeIdChecker ())
+    .AddAttribute ("DepthInterval", "Simulated time between queue depth samples.",
+                   TimeValue (Seconds (1.0)),
+                   MakeTimeAccessor (&CrowdProfilingScheduler::m_depthInterval),
+                   MakeTimeChecker ())
+  ;
+  return tid;
+}
+
+CrowdProfilingScheduler::CrowdProfilingScheduler ()
+  : m_timing (true),
+    m_running (0),
+    m_startedNs (0),
+    m_depth (0),
+    m_maxDepth (0),
+    m_events (0),
+    m_nextDepthTs (0)
+{
+  g_current = this;
+}
+
+CrowdProfilingScheduler::~CrowdProfilingScheduler ()
+{
+  if (g_current == this)
+    {
+      g_current = 0;
+    }
+}
+
+void
+CrowdProfilingScheduler::NotifyConstructionCompleted (void)
+{
+  Scheduler::NotifyConstructionCompleted ();
+  ObjectFactory factory;
+  factory.SetTypeId (m_innerType);
+  m_inner = factory.Create<Scheduler> ();
+  // Type 0 is the time before the first event
+  EventType setup = EventType ();
+  setup.label = "(before first event)";
+  m_types.push_back (setup);
+  m_startedNs = WallNs ();
+}
+
+void
+CrowdProfilingScheduler::Enable (void)
+{
+  ObjectFactory factory;
+  factory.SetTypeId (GetTypeId ());
+  Simulator::SetScheduler (factory);
+}
+
+CrowdProfilingScheduler *
+CrowdProfilingScheduler::Get (void)
+{
+  return g_current;
+}
+
+int64_t
+CrowdProfilingScheduler::WallNs (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t> (ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * The type of the function MakeEvent was called with, its first parameter,
+ * e.g. "void (ns3::RipNg::*)()" or "void (*)(ns3::Ptr<ns3::Socket>)"; the
+ * whole demangled name for any other EventImpl.
+ */
+std::string
+CrowdProfilingScheduler::Label (const std::type_info &type)
+{
+  int status = 0;
+  char *demangled = abi::__cxa_demangle (type.name (), 0, 0, &status);
+  std::string name = status == 0 && demangled ? demangled : type.name ();
+  std::free (demangled);
+  std::string::size_type i = name.find ("MakeEvent<");
+  if (i == std::string::npos)
+    {
+      return name;
+    }
+  // Skip the template arguments to the parameter list
+  int depth = 0;
+  for (i += 9; i < name.size (); i++)
+    {
+      if (name[i] == '<')
+        {
+          depth++;
+        }
+      else if (name[i] == '>' && --depth == 0)
+        {
+          break;
+        }
+    }
+  if (i + 1 >= name.size () || name[i + 1] != '(')
+    {
+      return name;
+    }
+  std::string::size_type start = i + 2;
+  depth = 0;
+  for (i = start; i < name.size (); i++)
+    {
+      char c = name[i];
+      if (c == '<' || c == '(')
+        {
+          depth++;
+        }
+      else if ((c == '>' || c == ')') && depth > 0)
+        {
+          depth--;
+        }
+      else if ((c == ',' || c == ')') && depth == 0)
+        {
+          return name.substr (start, i - start);
+        }
+    }
+  return name;
+}
+
+uint32_t
+CrowdProfilingScheduler::Classify (const Event &ev)
+{
+  if (ev.impl->IsCancelled ())
+    {
+      std::type_index key (typeid (void));
+      std::unordered_map<std::type_index, uint32_t>::iterator i = m_ids.find (key);
+      if (i != m_ids.end ())
+        {
+          return i->second;
+        }
+      EventType type = EventType ();
+      type.label = "(cancelled)";
+      m_types.push_back (type);
+      return m_ids[key] = m_types.size () - 1;
+    }
+  std::type_index key (typeid (*ev.impl));
+  std::unordered_map<std::type_index, uint32_t>::iterator i = m_ids.find (key);
+  if (i != m_ids.end ())
+    {
+      return i->second;
+    }
+  EventType type = EventType ();
+  type.label = Label (typeid (*ev.impl));
+  m_types.push_back (type);
+  return m_ids[key] = m_types.size () - 1;
+}
+
+/*
+ * Charge the time since the running event started to its type.
+ */
+void
+CrowdProfilingScheduler::Close (int64_t now)
+{
+  EventType &type = m_types[m_running];
+  uint64_t ns = now > m_startedNs ? now - m_startedNs : 0;
+  type.count++;
+  type.totalNs += ns;
+  uint32_t bucket = 0;
+  while (bucket + 1 < BUCKETS && (ns >> (bucket + 1)) != 0)
+    {
+      bucket++;
+    }
+  type.hist[bucket]++;
+}
+
+void
+CrowdProfilingScheduler::Insert (const Event &ev)
+{
+  m_depth++;
+  m_maxDepth = std::max (m_maxDepth, m_depth);
+  m_inner->Insert (ev);
+}
+
+bool
+CrowdProfilingScheduler::IsEmpty (void) const
+{
+  return m_inner->IsEmpty ();
+}
+
+Scheduler::Event
+CrowdProfilingScheduler::PeekNext (void) const
+{
+  return m_inner->PeekNext ();
+}
+
+Scheduler::Event
+CrowdProfilingScheduler::RemoveNext (void)
+{
+  Event ev = m_inner->RemoveNext ();
+  m_depth--;
+  if (!m_timing)
+    {
+      return ev;
+    }
+  int64_t now = WallNs ();
+  Close (now);
+  m_events++;
+  m_running = Classify (ev);
+  if (static_cast<int64_t> (ev.key.m_ts) >= m_nextDepthTs)
+    {
+      m_depthSeries.push_back (std::make_pair (TimeStep (ev.key.m_ts).GetSeconds (), m_depth));
+      m_nextDepthTs = ev.key.m_ts + m_depthInterval.GetTimeStep ();
+    }
+  // The bookkeeping above is charged to the event about to run
+  m_startedNs = now;
+  return ev;
+}
+
+void
+CrowdProfilingScheduler::Remove (const Event &ev)
+{
+  m_depth--;
+  m_inner->Remove (ev);
+}
+
+uint64_t
+CrowdProfilingScheduler::Percentile (const EventType &type, double p) const
+{
+  uint64_t rank = static_cast<uint64_t> (p * type.count);
+  uint64_t seen = 0;
+  for (uint32_t b = 0; b < BUCKETS; b++)
+    {
+      seen += type.hist[b];
+      if (seen > rank)
+        {
+          return uint64_t (1) << (b + 1);
+        }
+    }
+  return uint64_t (1) << BUCKETS;
+}
+
+void
+CrowdProfilingScheduler::Report (std::ostream &os, std::string scenario, std::string foldedFile,
+                                 std::string depthFile)
+{
+  if (m_timing)
+    {
+      Close (WallNs ());
+      m_timing = false;
+    }
+  std::vector<uint32_t> order;
+  uint64_t totalNs = 0;
+  for (uint32_t t = 0; t < m_types.size (); t++)
+    {
+      if (m_types[t].count > 0)
+        {
+          order.push_back (t);
+          totalNs += m_types[t].totalNs;
+        }
+    }
+  std::sort (order.begin (), order.end (), [this] (uint32_t a, uint32_t b)
+    {
+      return m_types[a].totalNs > m_types[b].totalNs;
+    });
+
+  os << "profile: " << m_events << " events, " << totalNs / 1e9 << " s wall, queue depth max "
+     << m_maxDepth << std::endl;
+  os << "profile:   share     total s       count    mean us  p50<us  p99<us  event" << std::endl;
+  std::ofstream folded (foldedFile.c_str ());
+  for (uint32_t k = 0; k < order.size (); k++)
+    {
+      const EventType &type = m_types[order[k]];
+      char line[160];
+      std::snprintf (line, sizeof (line), "profile: %6.2f%% %11.3f %11llu %10.3f %7.1f %7.1f  ",
+                     totalNs > 0 ? 100.0 * type.totalNs / totalNs : 0.0, type.totalNs / 1e9,
+                     (unsigned long long) type.count, type.totalNs / 1e3 / type.count,
+                     Percentile (type, 0.5) / 1e3, Percentile (type, 0.99) / 1e3);
+      os << line << type.label << std::endl;
+
+      // Member functions get their class as a frame of its own
+      std::string frames = type.label;
+      std::string::size_type member = frames.find ("::*)");
+      std::string::size_type open = frames.find ('(');
+      if (member != std::string::npos && open != std::string::npos && open < member)
+        {
+          frames = frames.substr (open + 1, member - open - 1) + ";" + frames;
+        }
+      folded << scenario << ";" << frames << " " << type.totalNs << "\n";
+    }
+
+  std::ofstream depth (depthFile.c_str ());
+  depth << "time_s,queue_depth\n";
+  for (uint32_t i = 0; i < m_depthSeries.size (); i++)
+    {
+      depth << m_depthSeries[i].first << "," << m_depthSeries[i].second << "\n";
+    }
+  os << "profile: wrote " << foldedFile << " and " << depthFile << std::endl;
+}
+
+} // namespace ns3
+
+#endif /* CROWD_EVENT_PROFILER_H */
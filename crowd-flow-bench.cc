@@ -0,0 +1,265 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Timer wheel versus one self-rescheduling event per flow.
+//
+// ./waf --run "crowd-flow-bench --nodes=50 --flows=100 --simTime=10"
+// ./waf --run "crowd-flow-bench --mode=reschedule --arrival=ns3::ConstantRandomVariable[Constant=0.5]"
+//
+// Every node runs flows UDP flows to random other nodes over 802.11a ad
+// hoc. With --mode=wheel they come from one CrowdFlowGenerator per node,
+// which keeps a single pending event for all its flows. With reschedule
+// every flow is its own application and socket that, like GenerateTraffic
+// in simple-adhoc-modified, schedules itself once per packet, so nodes x
+// flows events are pending at any time. Both draw the same interval and
+// size variables and send the same CrowdFlowHeader packets to the same
+// receivers. --mode=both (the default) runs each in its own process, one
+// after the other, so that the peak RSS figures are separate. "source
+// events" counts the events the traffic sources themselves executed.
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/wifi-module.h"
+
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "crowd-worker-pool.h"
+#include "crowd-flow-generator.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("CrowdFlowBench");
+
+class RescheduleFlowSource : public Application
+{
+public:
+  RescheduleFlowSource ()
+    : m_flow (0),
+      m_seq (0),
+      m_sent (0)
+  {
+  }
+
+  void Setup (Address peer, uint32_t flow, Ptr<RandomVariableStream> interval,
+              Ptr<RandomVariableStream> size)
+  {
+    m_peer = peer;
+    m_flow = flow;
+    m_interval = interval;
+    m_size = size;
+  }
+
+  uint64_t GetSent (void) const
+  {
+    return m_sent;
+  }
+
+private:
+  virtual void StartApplication (void)
+  {
+    m_socket = Socket::CreateSocket (GetNode (), UdpSocketFactory::GetTypeId ());
+    m_socket->Bind6 ();
+    m_event = Simulator::Schedule (Seconds (m_interval->GetValue ()), &RescheduleFlowSource::Send, this);
+  }
+
+  virtual void StopApplication (void)
+  {
+    Simulator::Cancel (m_event);
+    m_socket->Close ();
+  }
+
+  void Send (void)
+  {
+    CrowdFlowHeader header;
+    header.Set (GetNode ()->GetId (), m_flow, m_seq++, Simulator::Now ().GetNanoSeconds ());
+    uint32_t size = std::max (m_size->GetInteger (), header.GetSerializedSize ());
+    Ptr<Packet> packet = Create<Packet> (size - header.GetSerializedSize ());
+    packet->AddHeader (header);
+    if (m_socket->SendTo (packet, 0, m_peer) >= 0)
+      {
+        m_sent++;
+      }
+    m_event = Simulator::Schedule (Seconds (m_interval->GetValue ()), &RescheduleFlowSource::Send, this);
+  }
+
+  Ptr<Socket> m_socket;
+  Address m_peer;
+  uint32_t m_flow;
+  Ptr<RandomVariableStream> m_interval;
+  Ptr<RandomVariableStream> m_size;
+  EventId m_event;
+  uint32_t m_seq;
+  uint64_t m_sent;
+};
+
+static double
+WallSeconds (void)
+{
+  struct timeval tv;
+  gettimeofday (&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int
+RunBench (std::string mode, uint32_t nodes, uint32_t flows, std::string arrival, uint32_t packetSize,
+          double simTime)
+{
+  bool wheel = mode == "wheel";
+  double start = WallSeconds ();
+
+  NodeContainer c;
+  c.Create (nodes);
+
+  WifiHelper wifi;
+  wifi.SetStandard (WIFI_PHY_STANDARD_80211a);
+  wifi.SetRemoteStationManager ("ns3::ConstantRateWifiManager",
+                                "DataMode", StringValue ("OfdmRate54Mbps"));
+  YansWifiPhyHelper phy = YansWifiPhyHelper::Default ();
+  YansWifiChannelHelper channel = YansWifiChannelHelper::Default ();
+  phy.SetChannel (channel.Create ());
+  WifiMacHelper mac;
+  mac.SetType ("ns3::AdhocWifiMac");
+  NetDeviceContainer devices = wifi.Install (phy, mac, c);
+
+  // A tight grid, so that every node hears every other one
+  MobilityHelper mobility;
+  mobility.SetPositionAllocator ("ns3::GridPositionAllocator",
+                                 "DeltaX", DoubleValue (2.0), "DeltaY", DoubleValue (2.0),
+                                 "GridWidth", UintegerValue (10));
+  mobility.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
+  mobility.Install (c);
+
+  InternetStackHelper internet;
+  internet.Install (c);
+  Ipv6AddressHelper ipv6;
+  ipv6.SetBase (Ipv6Address ("2001:1::"), Ipv6Prefix (64));
+  Ipv6InterfaceContainer interfaces = ipv6.Assign (devices);
+
+  std::ostringstream size;
+  size << "ns3::ConstantRandomVariable[Constant=" << packetSize << "]";
+  ObjectFactory generator;
+  generator.SetTypeId ("ns3::CrowdFlowGenerator");
+  generator.Set ("Flows", UintegerValue (wheel ? flows : 0));
+  generator.Set ("Interval", StringValue (arrival));
+  generator.Set ("Size", StringValue (size.str ()));
+  // With no flows of their own the generators are just the receivers
+  ApplicationContainer generators = CrowdFlowGenerator::Install (generator, c, interfaces);
+  generators.Start (Seconds (0.1));
+  generators.Stop (Seconds (simTime));
+
+  std::vector<Ptr<RescheduleFlowSource> > sources;
+  if (!wheel)
+    {
+      ObjectFactory interval;
+      std::istringstream parse (arrival);
+      parse >> interval;
+      Ptr<UniformRandomVariable> peerChoice = CreateObject<UniformRandomVariable> ();
+      for (uint32_t n = 0; n < nodes; n++)
+        {
+          for (uint32_t f = 0; f < flows; f++)
+            {
+              uint32_t peer = peerChoice->GetInteger (0, nodes - 2);
+              peer += peer >= n ? 1 : 0;
+              Ptr<ConstantRandomVariable> bytes = CreateObject<ConstantRandomVariable> ();
+              bytes->SetAttribute ("Constant", DoubleValue (packetSize));
+              Ptr<RescheduleFlowSource> source = CreateObject<RescheduleFlowSource> ();
+              source->Setup (Inet6SocketAddress (interfaces.GetAddress (peer, 1), 9100), f,
+                             interval.Create<RandomVariableStream> (), bytes);
+              source->SetStartTime (Seconds (0.1));
+              source->SetStopTime (Seconds (simTime));
+              c.Get (n)->AddApplication (source);
+              sources.push_back (source);
+            }
+        }
+    }
+
+  double setup = WallSeconds ();
+  uint64_t eventsBefore = Simulator::GetEventCount ();
+  Simulator::Stop (Seconds (simTime));
+  Simulator::Run ();
+  double run = WallSeconds () - setup;
+  uint64_t events = Simulator::GetEventCount () - eventsBefore;
+
+  // A rescheduling source runs one event per packet
+  uint64_t sourceEvents = 0;
+  for (uint32_t n = 0; n < sources.size (); n++)
+    {
+      sourceEvents += sources[n]->GetSent ();
+    }
+  for (uint32_t n = 0; n < generators.GetN (); n++)
+    {
+      sourceEvents += DynamicCast<CrowdFlowGenerator> (generators.Get (n))->GetWakeUps ();
+    }
+  std::ostringstream summary;
+  CrowdFlowGenerator::PrintSummary (generators, summary);
+  Simulator::Destroy ();
+
+  struct rusage usage;
+  getrusage (RUSAGE_SELF, &usage);
+  std::printf ("mode=%-10s nodes=%u flows=%u  setup %.2f s  run %.2f s  %.3f wall s per simulated s  "
+               "events %llu  source events %llu  pending source events %u  peak RSS %.1f MB\n",
+               mode.c_str (), nodes, flows, setup - start, run, run / simTime,
+               (unsigned long long) events, (unsigned long long) sourceEvents,
+               wheel ? nodes : nodes * flows, usage.ru_maxrss / 1024.0);
+  std::cout << summary.str ();
+  std::fflush (stdout);
+  return 0;
+}
+
+int main (int argc, char *argv[])
+{
+  std::string mode ("both");
+  uint32_t nodes = 50;
+  uint32_t flows = 100;
+  std::string arrival ("ns3::ExponentialRandomVariable[Mean=1.0]");
+  uint32_t packetSize = 256;
+  double simTime = 10.0;
+
+  CommandLine cmd;
+  cmd.AddValue ("mode", "wheel, reschedule or both", mode);
+  cmd.AddValue ("nodes", "number of nodes", nodes);
+  cmd.AddValue ("flows", "flows sourced by each node", flows);
+  cmd.AddValue ("arrival", "random variable for the seconds between a flow's packets", arrival);
+  cmd.AddValue ("packetSize", "UDP payload bytes", packetSize);
+  cmd.AddValue ("simTime", "simulated seconds", simTime);
+  cmd.Parse (argc, argv);
+  NS_ABORT_MSG_UNLESS (nodes >= 2, "need at least two nodes");
+
+  if (mode != "both")
+    {
+      NS_ABORT_MSG_UNLESS (mode == "wheel" || mode == "reschedule", "unknown mode " << mode);
+      return RunBench (mode, nodes, flows, arrival, packetSize, simTime);
+    }
+
+  // One process per mode: ru_maxrss only ever grows within a process
+  CrowdWorkerPool pool (1);
+  const char *modes[] = { "wheel", "reschedule" };
+  for (uint32_t m = 0; m < 2; m++)
+    {
+      std::string one = modes[m];
+      pool.Submit ([=] () { return RunBench (one, nodes, flows, arrival, packetSize, simTime); });
+    }
+  pool.WaitAll ();
+  return 0;
+}
@@ -0,0 +1,395 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Streaming replacement for FlowMonitor on IPv6 scenarios.
+ *
+ * Packets are classified at their source by the 5-tuple, as FlowMonitor
+ * does, and tagged with the flow id and send time. Forwarding, local
+ * delivery and drops look the tag up and update fixed-size per-flow
+ * counters (see crowd-flow-log.h). Every interval the flows that changed
+ * are appended to a CFLW log, so memory depends on the number of flows
+ * only, and a run that dies keeps everything up to its last snapshot.
+ * A multicast packet counts as received once per node it reaches, and its
+ * jitter is taken against the previous delivery to the same node.
+ */
+
+#ifndef CROWD_FLOW_EXPORT_H
+#define CROWD_FLOW_EXPORT_H
+
+#include "ns3/ipv6-l3-protocol.h"
+#include "ns3/ipv6-header.h"
+#include "ns3/udp-header.h"
+#include "ns3/tcp-header.h"
+#include "ns3/udp-l4-protocol.h"
+#include "ns3/tcp-l4-protocol.h"
+#include "ns3/node-container.h"
+#include "ns3/packet.h"
+#include "ns3/tag.h"
+#include "ns3/simulator.h"
+#include "ns3/abort.h"
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "crowd-flow-log.h"
+
+namespace ns3 {
+
+class CrowdFlowTag : public Tag
+{
+public:
+  static TypeId GetTypeId (void);
+  virtual TypeId GetInstanceTypeId (void) const;
+  virtual uint32_t GetSerializedSize (void) const;
+  virtual void Serialize (TagBuffer buf) const;
+  virtual void Deserialize (TagBuffer buf);
+  virtual void Print (std::ostream &os) const;
+
+  uint32_t flow;
+  int64_t txNs;
+};
+
+class CrowdFlowExporter
+{
+public:
+  CrowdFlowExporter ();
+  ~CrowdFlowExporter ();
+
+  /*
+   * Snapshot every interval into filename, starting one interval from now.
+   */
+  bool Open (std::string filename, Time interval);
+  /*
+   * Hook the IPv6 traces of every node. Call after the internet stack is
+   * installed.
+   */
+  void Install (NodeContainer nodes);
+  /*
+   * Write a last snapshot and close the log.
+   */
+  void Close (void);
+  void PrintStats (std::ostream &os) const;
+  /*
+   * Counters summed over every flow seen so far; histograms are left
+   * empty.
+   */
+  crowd::FlowCounters GetTotals (void) const;
+
+private:
+  CrowdFlowExporter (const CrowdFlowExporter &);
+  CrowdFlowExporter &operator= (const CrowdFlowExporter &);
+
+  struct Flow
+  {
+    crowd::FlowCounters counters;
+    int64_t lastDelayNs;        // -1 until the first delivery
+    std::map<uint32_t, int64_t> lastDelayByNode;  // multicast: per receiving node
+    bool dirty;
+  };
+
+  static void SendOutgoing (CrowdFlowExporter *exporter, const Ipv6Header &header,
+                            Ptr<const Packet> payload, uint32_t interface);
+  static void Forward (CrowdFlowExporter *exporter, const Ipv6Header &header,
+                       Ptr<const Packet> payload, uint32_t interface);
+  static void LocalDeliver (CrowdFlowExporter *exporter, uint32_t node, const Ipv6Header &header,
+                            Ptr<const Packet> payload, uint32_t interface);
+  static void Drop (CrowdFlowExporter *exporter, const Ipv6Header &header, Ptr<const Packet> payload,
+                    Ipv6L3Protocol::DropReason reason, Ptr<Ipv6> ipv6, uint32_t interface);
+
+  uint32_t Classify (const Ipv6Header &header, Ptr<const Packet> payload);
+  Flow *Find (Ptr<const Packet> payload, CrowdFlowTag &tag);
+  void Write (void);
+  void Snapshot (void);
+
+  crowd::FlowLogWriter m_log;
+  Time m_interval;
+  EventId m_event;
+  std::map<crowd::FlowKey, uint32_t> m_ids;
+  std::vector<Flow> m_flows;
+  uint64_t m_untagged;          // deliveries and drops of packets sent before Install
+};
+
+NS_OBJECT_ENSURE_REGISTERED (CrowdFlowTag);
+
+TypeId
+CrowdFlowTag::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::CrowdFlowTag")
+    .SetParent<Tag> ()
+    .AddConstructor<CrowdFlowTag> ()
+  ;
+  return tid;
+}
+
+TypeId
+CrowdFlowTag::GetInstanceTypeId (void) const
+{
+  return GetTypeId ();
+}
+
+uint32_t
+CrowdFlowTag::GetSerializedSize (void) const
+{
+  return 4 + 8;
+}
+
+void
+CrowdFlowTag::Serialize (TagBuffer buf) const
+{
+  buf.WriteU32 (flow);
+  buf.WriteU64 (static_cast<uint64_t> (txNs));
+}
+
+void
+CrowdFlowTag::Deserialize (TagBuffer buf)
+{
+  flow = buf.ReadU32 ();
+  txNs = static_cast<int64_t> (buf.ReadU64 ());
+}
+
+void
+CrowdFlowTag::Print (std::ostream &os) const
+{
+  os << "flow=" << flow << " txNs=" << txNs;
+}
+
+CrowdFlowExporter::CrowdFlowExporter ()
+  : m_untagged (0)
+{
+}
+
+CrowdFlowExporter::~CrowdFlowExporter ()
+{
+  Close ();
+}
+
+bool
+CrowdFlowExporter::Open (std::string filename, Time interval)
+{
+  NS_ABORT_MSG_UNLESS (interval.IsStrictlyPositive (), "flow export interval must be positive");
+  if (!m_log.Open (filename))
+    {
+      return false;
+    }
+  m_interval = interval;
+  m_event = Simulator::Schedule (interval, &CrowdFlowExporter::Snapshot, this);
+  return true;
+}
+
+void
+CrowdFlowExporter::Install (NodeContainer nodes)
+{
+  for (NodeContainer::Iterator i = nodes.Begin (); i != nodes.End (); ++i)
+    {
+      Ptr<Ipv6L3Protocol> ipv6 = (*i)->GetObject<Ipv6L3Protocol> ();
+      NS_ABORT_MSG_UNLESS (ipv6, "CrowdFlowExporter needs an IPv6 stack on every node");
+      ipv6->TraceConnectWithoutContext ("SendOutgoing",
+                                        MakeBoundCallback (&CrowdFlowExporter::SendOutgoing, this));
+      ipv6->TraceConnectWithoutContext ("UnicastForward",
+                                        MakeBoundCallback (&CrowdFlowExporter::Forward, this));
+      ipv6->TraceConnectWithoutContext ("LocalDeliver",
+                                        MakeBoundCallback (&CrowdFlowExporter::LocalDeliver, this, (*i)->GetId ()));
+      ipv6->TraceConnectWithoutContext ("Drop",
+                                        MakeBoundCallback (&CrowdFlowExporter::Drop, this));
+    }
+}
+
+void
+CrowdFlowExporter::Close (void)
+{
+  if (!m_log.IsOpen ())
+    {
+      return;
+    }
+  Simulator::Cancel (m_event);
+  Write ();
+  m_log.Close ();
+}
+
+void
+CrowdFlowExporter::PrintStats (std::ostream &os) const
+{
+  os << "flow export: " << m_flows.size () << " flows, " << m_log.GetBlocks () << " snapshots, "
+     << m_log.GetBytesWritten () << " bytes, " << m_untagged << " untagged packets" << std::endl;
+}
+
+crowd::FlowCounters
+CrowdFlowExporter::GetTotals (void) const
+{
+  crowd::FlowCounters totals;
+  for (uint32_t f = 0; f < m_flows.size (); f++)
+    {
+      for (uint32_t i = 0; i < crowd::FlowCounters::COUNTERS; i++)
+        {
+          *totals.Counter (i) += *m_flows[f].counters.Counter (i);
+        }
+    }
+  return totals;
+}
+
+uint32_t
+CrowdFlowExporter::Classify (const Ipv6Header &header, Ptr<const Packet> payload)
+{
+  crowd::FlowKey key;
+  header.GetSourceAddress ().Serialize (key.src);
+  header.GetDestinationAddress ().Serialize (key.dst);
+  key.proto = header.GetNextHeader ();
+  key.sport = key.dport = 0;
+  if (key.proto == UdpL4Protocol::PROT_NUMBER && payload->GetSize () >= 8)
+    {
+      UdpHeader udp;
+      payload->PeekHeader (udp);
+      key.sport = udp.GetSourcePort ();
+      key.dport = udp.GetDestinationPort ();
+    }
+  else if (key.proto == TcpL4Protocol::PROT_NUMBER && payload->GetSize () >= 20)
+    {
+      TcpHeader tcp;
+      payload->PeekHeader (tcp);
+      key.sport = tcp.GetSourcePort ();
+      key.dport = tcp.GetDestinationPort ();
+    }
+  std::map<crowd::FlowKey, uint32_t>::const_iterator i = m_ids.find (key);
+  if (i != m_ids.end ())
+    {
+      return i->second;
+    }
+  uint32_t id = m_flows.size ();
+  m_ids[key] = id;
+  Flow flow;
+  flow.lastDelayNs = -1;
+  flow.dirty = true;
+  m_flows.push_back (flow);
+  m_log.Define (id, key);
+  return id;
+}
+
+CrowdFlowExporter::Flow *
+CrowdFlowExporter::Find (Ptr<const Packet> payload, CrowdFlowTag &tag)
+{
+  if (!payload->FindFirstMatchingByteTag (tag) || tag.flow >= m_flows.size ())
+    {
+      m_untagged++;
+      return 0;
+    }
+  return &m_flows[tag.flow];
+}
+
+void
+CrowdFlowExporter::SendOutgoing (CrowdFlowExporter *exporter, const Ipv6Header &header,
+                                 Ptr<const Packet> payload, uint32_t interface)
+{
+  CrowdFlowTag tag;
+  if (payload->FindFirstMatchingByteTag (tag))
+    {
+      return;                   // already counted, e.g. sent again after fragmentation
+    }
+  tag.flow = exporter->Classify (header, payload);
+  tag.txNs = Simulator::Now ().GetNanoSeconds ();
+  payload->AddByteTag (tag);
+  Flow &flow = exporter->m_flows[tag.flow];
+  flow.counters.txPackets++;
+  flow.counters.txBytes += payload->GetSize () + header.GetSerializedSize ();
+  flow.dirty = true;
+}
+
+void
+CrowdFlowExporter::Forward (CrowdFlowExporter *exporter, const Ipv6Header &header,
+                            Ptr<const Packet> payload, uint32_t interface)
+{
+  CrowdFlowTag tag;
+  Flow *flow = exporter->Find (payload, tag);
+  if (flow)
+    {
+      flow->counters.forwarded++;
+      flow->dirty = true;
+    }
+}
+
+void
+CrowdFlowExporter::LocalDeliver (CrowdFlowExporter *exporter, uint32_t node, const Ipv6Header &header,
+                                 Ptr<const Packet> payload, uint32_t interface)
+{
+  CrowdFlowTag tag;
+  Flow *flow = exporter->Find (payload, tag);
+  if (!flow)
+    {
+      return;
+    }
+  crowd::FlowCounters &c = flow->counters;
+  uint32_t size = payload->GetSize () + header.GetSerializedSize ();
+  int64_t delay = Simulator::Now ().GetNanoSeconds () - tag.txNs;
+  c.rxPackets++;
+  c.rxBytes += size;
+  c.delaySumNs += delay;
+  c.delayHist[crowd::FlowHistBucket (delay / 1000)]++;
+  c.sizeHist[crowd::FlowHistBucket (size)]++;
+  // A unicast flow has one receiver; a multicast one is tracked per node
+  int64_t *lastDelayNs = &flow->lastDelayNs;
+  if (header.GetDestinationAddress ().IsMulticast ())
+    {
+      lastDelayNs = &flow->lastDelayByNode.insert (std::make_pair (node, int64_t (-1))).first->second;
+    }
+  if (*lastDelayNs >= 0)
+    {
+      int64_t jitter = delay > *lastDelayNs ? delay - *lastDelayNs : *lastDelayNs - delay;
+      c.jitterSumNs += jitter;
+      c.jitterHist[crowd::FlowHistBucket (jitter / 1000)]++;
+    }
+  *lastDelayNs = delay;
+  flow->dirty = true;
+}
+
+void
+CrowdFlowExporter::Drop (CrowdFlowExporter *exporter, const Ipv6Header &header, Ptr<const Packet> payload,
+                         Ipv6L3Protocol::DropReason reason, Ptr<Ipv6> ipv6, uint32_t interface)
+{
+  CrowdFlowTag tag;
+  Flow *flow = exporter->Find (payload, tag);
+  if (flow)
+    {
+      flow->counters.dropped++;
+      flow->dirty = true;
+    }
+}
+
+void
+CrowdFlowExporter::Write (void)
+{
+  for (uint32_t f = 0; f < m_flows.size (); f++)
+    {
+      if (m_flows[f].dirty)
+        {
+          m_log.Add (f, m_flows[f].counters);
+          m_flows[f].dirty = false;
+        }
+    }
+  m_log.Flush (Simulator::Now ().GetNanoSeconds ());
+}
+
+void
+CrowdFlowExporter::Snapshot (void)
+{
+  Write ();
+  m_event = Simulator::Schedule (m_interval, &CrowdFlowExporter::Snapshot, this);
+}
+
+} // namespace ns3
+
+#endif /* CROWD_FLOW_EXPORT_H */
@@ -0,0 +1,508 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Many small UDP flows per node from one timer wheel.
+ *
+ * A CrowdFlowGenerator on every node runs Flows flows, each to a peer
+ * drawn at random from the other nodes. A flow sends a packet of Size
+ * bytes, then waits Interval before the next one; both are random
+ * variable attributes, so constant, exponential (Poisson arrivals), Pareto
+ * and so on are all a string away. After FlowPackets packets (0: never) a
+ * flow ends and a new one starts towards another random peer.
+ *
+ * Instead of one pending simulator event per flow, as a self-rescheduling
+ * source like GenerateTraffic would need, the flows of a node are timers on
+ * a crowd::TimerWheel with a resolution of Tick. The application keeps a
+ * single event, for the next tick at which any flow is due, and sends for
+ * all flows due then in one go; send times are rounded up to Tick. The same
+ * socket, bound to Port, sends for every flow and receives the other
+ * nodes' packets, which carry a CrowdFlowHeader so that the receiver can
+ * tell the delay.
+ */
+
+#ifndef CROWD_FLOW_GENERATOR_H
+#define CROWD_FLOW_GENERATOR_H
+
+#include "ns3/application.h"
+#include "ns3/application-container.h"
+#include "ns3/header.h"
+#include "ns3/socket.h"
+#include "ns3/inet6-socket-address.h"
+#include "ns3/ipv6-interface-container.h"
+#include "ns3/node-container.h"
+#include "ns3/object-factory.h"
+#include "ns3/packet.h"
+#include "ns3/pointer.h"
+#include "ns3/simulator.h"
+#include "ns3/random-variable-stream.h"
+#include "ns3/traced-callback.h"
+#include "ns3/string.h"
+#include "ns3/uinteger.h"
+#include "ns3/nstime.h"
+
+#include <algorithm>
+#include <ostream>
+#include <vector>
+
+#include "crowd-timer-wheel.h"
+
+namespace ns3 {
+
+class CrowdFlowHeader : public Header
+{
+public:
+  static TypeId GetTypeId (void);
+  virtual TypeId GetInstanceTypeId (void) const;
+
+  CrowdFlowHeader ();
+
+  void Set (uint32_t node, uint32_t flow, uint32_t seq, int64_t txNs);
+  uint32_t GetNode (void) const;
+  uint32_t GetFlow (void) const;
+  uint32_t GetSeq (void) const;
+  int64_t GetTxNs (void) const;
+
+  virtual uint32_t GetSerializedSize (void) const;
+  virtual void Serialize (Buffer::Iterator start) const;
+  virtual uint32_t Deserialize (Buffer::Iterator start);
+  virtual void Print (std::ostream &os) const;
+
+private:
+  uint32_t m_node;
+  uint32_t m_flow;
+  uint32_t m_seq;
+  int64_t m_txNs;
+};
+
+class CrowdFlowGenerator : public Application
+{
+public:
+  static TypeId GetTypeId (void);
+
+  CrowdFlowGenerator ();
+
+  /*
+   * Global addresses flows may go to; the node's own is skipped.
+   */
+  void SetPeers (const std::vector<Ipv6Address> &peers);
+  /*
+   * Events the generator has run to send, one per tick with flows due.
+   */
+  uint64_t GetWakeUps (void) const;
+
+  /*
+   * A generator made by factory on every node, each with the interface
+   * addresses (index 1, the global one) of all the others as peers.
+   */
+  static ApplicationContainer Install (ObjectFactory &factory, NodeContainer nodes,
+                                       const Ipv6InterfaceContainer &interfaces);
+  /*
+   * Totals over the CrowdFlowGenerators in apps.
+   */
+  static void PrintSummary (const ApplicationContainer &apps, std::ostream &os);
+
+protected:
+  virtual void DoDispose (void);
+
+private:
+  virtual void StartApplication (void);
+  virtual void StopApplication (void);
+
+  void Wake (void);
+  void ScheduleWake (void);
+  void StartFlow (uint32_t flow);
+  uint64_t TickAfter (Time delay) const;
+  void HandleRead (Ptr<Socket> socket);
+
+  uint16_t m_port;
+  uint32_t m_flows;
+  Ptr<RandomVariableStream> m_interval;
+  Ptr<RandomVariableStream> m_size;
+  uint32_t m_flowPackets;
+  Time m_tick;
+  uint32_t m_wheelBits;
+
+  Ptr<Socket> m_socket;
+  EventId m_wakeEvent;
+  Ptr<UniformRandomVariable> m_peerChoice;
+  std::vector<Ipv6Address> m_peers;
+  crowd::TimerWheel m_wheel;
+  std::vector<uint32_t> m_due;
+  std::vector<uint32_t> m_flowPeer;
+  std::vector<uint32_t> m_flowSeq;
+  std::vector<uint32_t> m_flowId;
+
+  uint32_t m_nextFlowId;
+  uint64_t m_sent;
+  uint64_t m_sentBytes;
+  uint64_t m_received;
+  uint64_t m_receivedBytes;
+  double m_delaySum;
+  uint64_t m_wakeUps;
+  uint32_t m_maxBatch;
+
+  TracedCallback<Ptr<const Packet>, const Address &> m_rxTrace;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (CrowdFlowHeader);
+
+TypeId
+CrowdFlowHeader::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::CrowdFlowHeader")
+    .SetParent<Header> ()
+    .SetGroupName ("Applications")
+    .AddConstructor<CrowdFlowHeader> ()
+  ;
+  return tid;
+}
+
+TypeId
+CrowdFlowHeader::GetInstanceTypeId (void) const
+{
+  return GetTypeId ();
+}
+
+CrowdFlowHeader::CrowdFlowHeader ()
+  : m_node (0),
+    m_flow (0),
+    m_seq (0),
+    m_txNs (0)
+{
+}
+
+void
+CrowdFlowHeader::Set (uint32_t node, uint32_t flow, uint32_t seq, int64_t txNs)
+{
+  m_node = node;
+  m_flow = flow;
+  m_seq = seq;
+  m_txNs = txNs;
+}
+
+uint32_t
+CrowdFlowHeader::GetNode (void) const
+{
+  return m_node;
+}
+
+uint32_t
+CrowdFlowHeader::GetFlow (void) const
+{
+  return m_flow;
+}
+
+uint32_t
+CrowdFlowHeader::GetSeq (void) const
+{
+  return m_seq;
+}
+
+int64_t
+CrowdFlowHeader::GetTxNs (void) const
+{
+  return m_txNs;
+}
+
+uint32_t
+CrowdFlowHeader::GetSerializedSize (void) const
+{
+  return 20;
+}
+
+void
+CrowdFlowHeader::Serialize (Buffer::Iterator start) const
+{
+  start.WriteHtonU32 (m_node);
+  start.WriteHtonU32 (m_flow);
+  start.WriteHtonU32 (m_seq);
+  start.WriteHtonU64 (m_txNs);
+}
+
+uint32_t
+CrowdFlowHeader::Deserialize (Buffer::Iterator start)
+{
+  m_node = start.ReadNtohU32 ();
+  m_flow = start.ReadNtohU32 ();
+  m_seq = start.ReadNtohU32 ();
+  m_txNs = start.ReadNtohU64 ();
+  return 20;
+}
+
+void
+CrowdFlowHeader::Print (std::ostream &os) const
+{
+  os << "node=" << m_node << " flow=" << m_flow << " seq=" << m_seq << " tx=" << m_txNs << "ns";
+}
+
+NS_OBJECT_ENSURE_REGISTERED (CrowdFlowGenerator);
+
+TypeId
+CrowdFlowGenerator::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::CrowdFlowGenerator")
+    .SetParent<Application> ()
+    .SetGroupName ("Applications")
+    .AddConstructor<CrowdFlowGenerator> ()
+    .AddAttribute ("Port", "UDP port flows are sent from and to.",
+                   UintegerValue (9100),
+                   MakeUintegerAccessor (&CrowdFlowGenerator::m_port),
+                   MakeUintegerChecker<uint16_t> ())
+    .AddAttribute ("Flows", "Concurrent flows sourced by this node.",
+                   UintegerValue (100),
+                   MakeUintegerAccessor (&CrowdFlowGenerator::m_flows),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("Interval", "Seconds from one packet of a flow to its next.",
+                   StringValue ("ns3::ExponentialRandomVariable[Mean=1.0]"),
+                   MakePointerAccessor (&CrowdFlowGenerator::m_interval),
+                   MakePointerChecker<RandomVariableStream> ())
+    .AddAttribute ("Size", "Packet payload in bytes, at least the 20 byte header.",
+                   StringValue ("ns3::ConstantRandomVariable[Constant=256]"),
+                   MakePointerAccessor (&CrowdFlowGenerator::m_size),
+                   MakePointerChecker<RandomVariableStream> ())
+    .AddAttribute ("FlowPackets", "Packets after which a flow moves to a new peer (0: never).",
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&CrowdFlowGenerator::m_flowPackets),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("Tick", "Timer wheel resolution; send times are rounded up to it.",
+                   TimeValue (MicroSeconds (100)),
+                   MakeTimeAccessor (&CrowdFlowGenerator::m_tick),
+                   MakeTimeChecker (NanoSeconds (1)))
+    .AddAttribute ("WheelBits", "The timer wheel has 2^WheelBits slots.",
+                   UintegerValue (12),
+                   MakeUintegerAccessor (&CrowdFlowGenerator::m_wheelBits),
+                   MakeUintegerChecker<uint32_t> (6, 24))
+    .AddTraceSource ("Rx", "A flow packet was received.",
+                     MakeTraceSourceAccessor (&CrowdFlowGenerator::m_rxTrace),
+                     "ns3::Packet::AddressTracedCallback")
+  ;
+  return tid;
+}
+
+CrowdFlowGenerator::CrowdFlowGenerator ()
+  : m_nextFlowId (0),
+    m_sent (0),
+    m_sentBytes (0),
+    m_received (0),
+    m_receivedBytes (0),
+    m_delaySum (0.0),
+    m_wakeUps (0),
+    m_maxBatch (0)
+{
+  m_peerChoice = CreateObject<UniformRandomVariable> ();
+}
+
+void
+CrowdFlowGenerator::SetPeers (const std::vector<Ipv6Address> &peers)
+{
+  m_peers = peers;
+}
+
+uint64_t
+CrowdFlowGenerator::GetWakeUps (void) const
+{
+  return m_wakeUps;
+}
+
+ApplicationContainer
+CrowdFlowGenerator::Install (ObjectFactory &factory, NodeContainer nodes,
+                             const Ipv6InterfaceContainer &interfaces)
+{
+  ApplicationContainer apps;
+  for (uint32_t n = 0; n < nodes.GetN (); n++)
+    {
+      std::vector<Ipv6Address> peers;
+      for (uint32_t p = 0; p < interfaces.GetN (); p++)
+        {
+          if (p != n)
+            {
+              peers.push_back (interfaces.GetAddress (p, 1));
+            }
+        }
+      Ptr<CrowdFlowGenerator> app = factory.Create<CrowdFlowGenerator> ();
+      app->SetPeers (peers);
+      nodes.Get (n)->AddApplication (app);
+      apps.Add (app);
+    }
+  return apps;
+}
+
+void
+CrowdFlowGenerator::DoDispose (void)
+{
+  m_socket = 0;
+  m_interval = 0;
+  m_size = 0;
+  m_peerChoice = 0;
+  Application::DoDispose ();
+}
+
+void
+CrowdFlowGenerator::StartApplication (void)
+{
+  if (!m_socket)
+    {
+      m_socket = Socket::CreateSocket (GetNode (), TypeId::LookupByName ("ns3::UdpSocketFactory"));
+      m_socket->Bind (Inet6SocketAddress (Ipv6Address::GetAny (), m_port));
+      m_socket->SetRecvCallback (MakeCallback (&CrowdFlowGenerator::HandleRead, this));
+    }
+  if (m_peers.empty () || m_flows == 0)
+    {
+      return;
+    }
+  m_wheel.Reset (m_flows, m_wheelBits, Simulator::Now ().GetTimeStep () / m_tick.GetTimeStep ());
+  m_due.clear ();
+  m_due.reserve (m_flows);
+  m_flowPeer.assign (m_flows, 0);
+  m_flowSeq.assign (m_flows, 0);
+  m_flowId.assign (m_flows, 0);
+  for (uint32_t f = 0; f < m_flows; f++)
+    {
+      StartFlow (f);
+      m_wheel.Schedule (f, TickAfter (Seconds (m_interval->GetValue ())));
+    }
+  ScheduleWake ();
+}
+
+void
+CrowdFlowGenerator::StopApplication (void)
+{
+  Simulator::Cancel (m_wakeEvent);
+  if (m_socket)
+    {
+      m_socket->Close ();
+      m_socket->SetRecvCallback (MakeNullCallback<void, Ptr<Socket> > ());
+      m_socket = 0;
+    }
+}
+
+void
+CrowdFlowGenerator::StartFlow (uint32_t flow)
+{
+  m_flowPeer[flow] = m_peerChoice->GetInteger (0, m_peers.size () - 1);
+  m_flowSeq[flow] = 0;
+  m_flowId[flow] = m_nextFlowId++;
+}
+
+/*
+ * First tick at or after now + delay.
+ */
+uint64_t
+CrowdFlowGenerator::TickAfter (Time delay) const
+{
+  int64_t at = (Simulator::Now () + delay).GetTimeStep ();
+  int64_t tick = m_tick.GetTimeStep ();
+  return (at + tick - 1) / tick;
+}
+
+void
+CrowdFlowGenerator::ScheduleWake (void)
+{
+  uint64_t tick;
+  if (m_wheel.NextDue (tick))
+    {
+      Time at = TimeStep (tick * m_tick.GetTimeStep ());
+      m_wakeEvent = Simulator::Schedule (at - Simulator::Now (), &CrowdFlowGenerator::Wake, this);
+    }
+}
+
+void
+CrowdFlowGenerator::Wake (void)
+{
+  m_wakeUps++;
+  m_due.clear ();
+  m_wheel.Advance (Simulator::Now ().GetTimeStep () / m_tick.GetTimeStep (), m_due);
+  m_maxBatch = std::max (m_maxBatch, static_cast<uint32_t> (m_due.size ()));
+  int64_t now = Simulator::Now ().GetNanoSeconds ();
+  for (uint32_t i = 0; i < m_due.size (); i++)
+    {
+      uint32_t f = m_due[i];
+      CrowdFlowHeader header;
+      header.Set (GetNode ()->GetId (), m_flowId[f], m_flowSeq[f]++, now);
+      uint32_t size = std::max (m_size->GetInteger (), header.GetSerializedSize ());
+      // The payload stays a zero area, as with OnOffApplication
+      Ptr<Packet> packet = Create<Packet> (size - header.GetSerializedSize ());
+      packet->AddHeader (header);
+      if (m_socket->SendTo (packet, 0, Inet6SocketAddress (m_peers[m_flowPeer[f]], m_port)) >= 0)
+        {
+          m_sent++;
+          m_sentBytes += size;
+        }
+      if (m_flowPackets > 0 && m_flowSeq[f] >= m_flowPackets)
+        {
+          StartFlow (f);
+        }
+      m_wheel.Schedule (f, TickAfter (Seconds (m_interval->GetValue ())));
+    }
+  ScheduleWake ();
+}
+
+void
+CrowdFlowGenerator::HandleRead (Ptr<Socket> socket)
+{
+  Ptr<Packet> packet;
+  Address from;
+  while ((packet = socket->RecvFrom (from)))
+    {
+      if (packet->GetSize () < 20)
+        {
+          continue;
+        }
+      m_rxTrace (packet, from);
+      CrowdFlowHeader header;
+      packet->PeekHeader (header);
+      m_received++;
+      m_receivedBytes += packet->GetSize ();
+      m_delaySum += (Simulator::Now ().GetNanoSeconds () - header.GetTxNs ()) / 1e9;
+    }
+}
+
+void
+CrowdFlowGenerator::PrintSummary (const ApplicationContainer &apps, std::ostream &os)
+{
+  uint32_t nodes = 0, maxBatch = 0;
+  uint64_t flows = 0, sent = 0, sentBytes = 0, received = 0, receivedBytes = 0, wakeUps = 0;
+  double delaySum = 0;
+  for (ApplicationContainer::Iterator i = apps.Begin (); i != apps.End (); ++i)
+    {
+      Ptr<CrowdFlowGenerator> app = DynamicCast<CrowdFlowGenerator> (*i);
+      if (!app)
+        {
+          continue;
+        }
+      nodes++;
+      flows += app->m_nextFlowId;
+      sent += app->m_sent;
+      sentBytes += app->m_sentBytes;
+      received += app->m_received;
+      receivedBytes += app->m_receivedBytes;
+      delaySum += app->m_delaySum;
+      wakeUps += app->m_wakeUps;
+      maxBatch = std::max (maxBatch, app->m_maxBatch);
+    }
+  os << "flows: " << flows << " flows on " << nodes << " nodes, " << sent << " packets ("
+     << sentBytes << " bytes) sent, " << received << " (" << receivedBytes << " bytes) received, "
+     << "delivery " << (sent > 0 ? double (received) / sent : 0.0)
+     << ", mean delay " << (received > 0 ? delaySum / received * 1e3 : 0.0) << " ms" << std::endl;
+  os << "flows: " << wakeUps << " wake-ups for " << sent << " sends ("
+     << (wakeUps > 0 ? double (sent) / wakeUps : 0.0) << " per wake-up, at most " << maxBatch << ")"
+     << std::endl;
+}
+
+} // namespace ns3
+
+#endif /* CROWD_FLOW_GENERATOR_H */
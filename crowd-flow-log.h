@@ -0,0 +1,452 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Periodic per-flow statistics log.
+ *
+ * Each snapshot is one block holding the flows first seen since the
+ * previous one and the cumulative counters of every flow that changed.
+ * Histograms have FLOW_HIST_BUCKETS power-of-two buckets, so a flow costs
+ * the same however long it runs.
+ *
+ * File layout ("CFLW" version 1, little endian):
+ *
+ *   file     := magic "CFLW" | u32 version | block*
+ *   block    := u32 payloadBytes | u32 records | varint timeNs
+ *               | varint defs | def* | record*
+ *   def      := varint flow | src[16] | dst[16] | u8 proto
+ *               | varint sport | varint dport
+ *   record   := varint flow | varint counter[8] | hist delay
+ *               | hist jitter | hist size
+ *   hist     := varint nonZero | (varint bucket | varint count)*
+ *
+ * Every block is written and flushed as a whole, so a run that is killed
+ * leaves a file readable up to its last snapshot.
+ *
+ * Like crowd-trajectory.h this has no ns-3 dependency, for the benefit of
+ * crowd-trace-to-csv.
+ */
+
+#ifndef CROWD_FLOW_LOG_H
+#define CROWD_FLOW_LOG_H
+
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "crowd-trajectory.h"
+
+namespace crowd {
+
+static const char FLOWLOG_MAGIC[4] = { 'C', 'F', 'L', 'W' };
+static const uint32_t FLOWLOG_VERSION = 1;
+
+enum { FLOW_HIST_BUCKETS = 32 };
+
+/*
+ * Bucket 0 holds 0, bucket b > 0 holds [2^(b-1), 2^b); the last one is
+ * open-ended.
+ */
+inline uint32_t
+FlowHistBucket (uint64_t v)
+{
+  uint32_t b = 0;
+  while (v != 0 && b < FLOW_HIST_BUCKETS - 1)
+    {
+      v >>= 1;
+      b++;
+    }
+  return b;
+}
+
+struct FlowKey
+{
+  uint8_t src[16];
+  uint8_t dst[16];
+  uint8_t proto;
+  uint16_t sport;
+  uint16_t dport;
+
+  bool operator< (const FlowKey &o) const
+  {
+    int c = std::memcmp (src, o.src, 16);
+    if (c == 0)
+      {
+        c = std::memcmp (dst, o.dst, 16);
+      }
+    if (c != 0)
+      {
+        return c < 0;
+      }
+    if (proto != o.proto)
+      {
+        return proto < o.proto;
+      }
+    return sport != o.sport ? sport < o.sport : dport < o.dport;
+  }
+};
+
+struct FlowCounters
+{
+  enum { COUNTERS = 8 };
+
+  uint64_t txPackets;
+  uint64_t txBytes;
+  uint64_t rxPackets;
+  uint64_t rxBytes;
+  uint64_t dropped;
+  uint64_t forwarded;         // forwarding hops taken by received and dropped packets alike
+  uint64_t delaySumNs;
+  uint64_t jitterSumNs;
+  uint32_t delayHist[FLOW_HIST_BUCKETS];    // microseconds
+  uint32_t jitterHist[FLOW_HIST_BUCKETS];   // microseconds
+  uint32_t sizeHist[FLOW_HIST_BUCKETS];     // IPv6 packet bytes
+
+  FlowCounters ()
+  {
+    std::memset (this, 0, sizeof (*this));
+  }
+
+  uint64_t *Counter (uint32_t i)
+  {
+    return &txPackets + i;
+  }
+
+  const uint64_t *Counter (uint32_t i) const
+  {
+    return &txPackets + i;
+  }
+};
+
+struct FlowSnapshotRecord
+{
+  int64_t timeNs;
+  uint32_t flow;
+  FlowKey key;
+  FlowCounters counters;
+};
+
+class FlowLogWriter
+{
+public:
+  FlowLogWriter ()
+    : m_file (0),
+      m_defCount (0),
+      m_records (0),
+      m_blocks (0),
+      m_bytes (0)
+  {
+  }
+
+  ~FlowLogWriter ()
+  {
+    Close ();
+  }
+
+  bool Open (const std::string &filename)
+  {
+    Close ();
+    m_file = std::fopen (filename.c_str (), "wb");
+    if (!m_file)
+      {
+        return false;
+      }
+    std::vector<uint8_t> header (FLOWLOG_MAGIC, FLOWLOG_MAGIC + 4);
+    PutU32 (header, FLOWLOG_VERSION);
+    std::fwrite (&header[0], 1, header.size (), m_file);
+    std::fflush (m_file);
+    m_bytes = header.size ();
+    m_blocks = 0;
+    return true;
+  }
+
+  bool IsOpen (void) const
+  {
+    return m_file != 0;
+  }
+
+  /*
+   * Flow ids must be defined, in the current or an earlier block, before
+   * the first record that uses them.
+   */
+  void Define (uint32_t flow, const FlowKey &key)
+  {
+    PutVarint (m_defs, flow);
+    m_defs.insert (m_defs.end (), key.src, key.src + 16);
+    m_defs.insert (m_defs.end (), key.dst, key.dst + 16);
+    m_defs.push_back (key.proto);
+    PutVarint (m_defs, key.sport);
+    PutVarint (m_defs, key.dport);
+    m_defCount++;
+  }
+
+  void Add (uint32_t flow, const FlowCounters &c)
+  {
+    PutVarint (m_body, flow);
+    for (uint32_t i = 0; i < FlowCounters::COUNTERS; i++)
+      {
+        PutVarint (m_body, *c.Counter (i));
+      }
+    PutHist (c.delayHist);
+    PutHist (c.jitterHist);
+    PutHist (c.sizeHist);
+    m_records++;
+  }
+
+  /*
+   * Write everything defined and added since the last call as one block
+   * stamped timeNs.
+   */
+  void Flush (int64_t timeNs)
+  {
+    if (!m_file)
+      {
+        return;
+      }
+    m_block.clear ();
+    PutU32 (m_block, 0);       // payload size, patched below
+    PutU32 (m_block, m_records);
+    PutVarint (m_block, static_cast<uint64_t> (timeNs));
+    PutVarint (m_block, m_defCount);
+    m_block.insert (m_block.end (), m_defs.begin (), m_defs.end ());
+    m_block.insert (m_block.end (), m_body.begin (), m_body.end ());
+    uint32_t payload = m_block.size () - 8;
+    for (int i = 0; i < 4; i++)
+      {
+        m_block[i] = static_cast<uint8_t> (payload >> (8 * i));
+      }
+    std::fwrite (&m_block[0], 1, m_block.size (), m_file);
+    std::fflush (m_file);
+    m_bytes += m_block.size ();
+    m_blocks++;
+    m_defs.clear ();
+    m_body.clear ();
+    m_defCount = 0;
+    m_records = 0;
+  }
+
+  void Close (void)
+  {
+    if (m_file)
+      {
+        std::fclose (m_file);
+        m_file = 0;
+      }
+  }
+
+  uint64_t GetBlocks (void) const
+  {
+    return m_blocks;
+  }
+
+  uint64_t GetBytesWritten (void) const
+  {
+    return m_bytes;
+  }
+
+private:
+  FlowLogWriter (const FlowLogWriter &);
+  FlowLogWriter &operator= (const FlowLogWriter &);
+
+  void PutHist (const uint32_t *hist)
+  {
+    uint32_t nonZero = 0;
+    for (uint32_t b = 0; b < FLOW_HIST_BUCKETS; b++)
+      {
+        nonZero += hist[b] != 0;
+      }
+    PutVarint (m_body, nonZero);
+    for (uint32_t b = 0; b < FLOW_HIST_BUCKETS; b++)
+      {
+        if (hist[b] != 0)
+          {
+            PutVarint (m_body, b);
+            PutVarint (m_body, hist[b]);
+          }
+      }
+  }
+
+  std::FILE *m_file;
+  std::vector<uint8_t> m_defs;
+  std::vector<uint8_t> m_body;
+  std::vector<uint8_t> m_block;
+  uint32_t m_defCount;
+  uint32_t m_records;
+  uint64_t m_blocks;
+  uint64_t m_bytes;
+};
+
+/*
+ * Sequential reader for CFLW files: one record per flow and snapshot it
+ * changed in, with cumulative counters.
+ */
+class FlowLogReader
+{
+public:
+  FlowLogReader ()
+    : m_file (0),
+      m_left (0),
+      m_timeNs (0)
+  {
+  }
+
+  ~FlowLogReader ()
+  {
+    if (m_file)
+      {
+        std::fclose (m_file);
+      }
+  }
+
+  bool Open (const std::string &filename)
+  {
+    m_file = std::fopen (filename.c_str (), "rb");
+    if (!m_file)
+      {
+        return false;
+      }
+    uint8_t header[8];
+    if (std::fread (header, 1, 8, m_file) != 8
+        || std::memcmp (header, FLOWLOG_MAGIC, 4) != 0
+        || GetU32 (header + 4) != FLOWLOG_VERSION)
+      {
+        std::fclose (m_file);
+        m_file = 0;
+        return false;
+      }
+    return true;
+  }
+
+  /*
+   * Returns false at end of file or at the first truncated block.
+   */
+  bool Next (FlowSnapshotRecord &r)
+  {
+    while (m_left == 0)
+      {
+        if (!LoadBlock ())
+          {
+            return false;
+          }
+      }
+    const uint8_t *end = &m_data[0] + m_data.size ();
+    uint64_t flow;
+    if (!GetVarint (m_cursor, end, flow) || flow >= m_keys.size ())
+      {
+        return false;
+      }
+    r.timeNs = m_timeNs;
+    r.flow = static_cast<uint32_t> (flow);
+    r.key = m_keys[flow];
+    for (uint32_t i = 0; i < FlowCounters::COUNTERS; i++)
+      {
+        if (!GetVarint (m_cursor, end, *r.counters.Counter (i)))
+          {
+            return false;
+          }
+      }
+    if (!GetHist (end, r.counters.delayHist) || !GetHist (end, r.counters.jitterHist)
+        || !GetHist (end, r.counters.sizeHist))
+      {
+        return false;
+      }
+    m_left--;
+    return true;
+  }
+
+private:
+  bool GetHist (const uint8_t *end, uint32_t *hist)
+  {
+    std::memset (hist, 0, FLOW_HIST_BUCKETS * sizeof (uint32_t));
+    uint64_t nonZero;
+    if (!GetVarint (m_cursor, end, nonZero))
+      {
+        return false;
+      }
+    for (uint64_t i = 0; i < nonZero; i++)
+      {
+        uint64_t b, count;
+        if (!GetVarint (m_cursor, end, b) || !GetVarint (m_cursor, end, count) || b >= FLOW_HIST_BUCKETS)
+          {
+            return false;
+          }
+        hist[b] = static_cast<uint32_t> (count);
+      }
+    return true;
+  }
+
+  bool LoadBlock (void)
+  {
+    uint8_t header[8];
+    if (std::fread (header, 1, 8, m_file) != 8)
+      {
+        return false;
+      }
+    uint32_t payload = GetU32 (header);
+    m_data.resize (payload);
+    if (payload == 0 || std::fread (&m_data[0], 1, payload, m_file) != payload)
+      {
+        return false;
+      }
+    m_left = GetU32 (header + 4);
+    m_cursor = &m_data[0];
+    const uint8_t *end = m_cursor + payload;
+    uint64_t time, defs;
+    if (!GetVarint (m_cursor, end, time) || !GetVarint (m_cursor, end, defs))
+      {
+        return false;
+      }
+    m_timeNs = static_cast<int64_t> (time);
+    for (uint64_t d = 0; d < defs; d++)
+      {
+        uint64_t flow, sport, dport;
+        if (!GetVarint (m_cursor, end, flow) || end - m_cursor < 33)
+          {
+            return false;
+          }
+        FlowKey key;
+        std::memcpy (key.src, m_cursor, 16);
+        std::memcpy (key.dst, m_cursor + 16, 16);
+        key.proto = m_cursor[32];
+        m_cursor += 33;
+        if (!GetVarint (m_cursor, end, sport) || !GetVarint (m_cursor, end, dport))
+          {
+            return false;
+          }
+        key.sport = static_cast<uint16_t> (sport);
+        key.dport = static_cast<uint16_t> (dport);
+        if (flow >= m_keys.size ())
+          {
+            m_keys.resize (flow + 1, FlowKey ());
+          }
+        m_keys[flow] = key;
+      }
+    return true;
+  }
+
+  std::FILE *m_file;
+  std::vector<uint8_t> m_data;
+  const uint8_t *m_cursor;
+  uint32_t m_left;
+  int64_t m_timeNs;
+  std::vector<FlowKey> m_keys;
+};
+
+} // namespace crowd
+
+#endif /* CROWD_FLOW_LOG_H */
@@ -0,0 +1,224 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Periodic goodput sampling.
+ *
+ * Receive paths call Record (), which only adds to counters. One event per
+ * interval moves the counters into preallocated per-interval arrays, so the
+ * event cost does not depend on the packet rate. Per-node and per-flow
+ * series are optional; flows are small integer ids handed out by the caller.
+ */
+
+#ifndef CROWD_GOODPUT_SAMPLER_H
+#define CROWD_GOODPUT_SAMPLER_H
+
+#include "ns3/simulator.h"
+#include "ns3/nstime.h"
+#include "ns3/event-id.h"
+#include "ns3/abort.h"
+
+#include <fstream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+class GoodputSampler
+{
+public:
+  GoodputSampler ()
+    : m_nodes (0),
+      m_flows (0),
+      m_samples (0),
+      m_capacity (0),
+      m_current (0)
+  {
+  }
+
+  /*
+   * Sample every interval from start until stop. nodes and flows size the
+   * optional per-node and per-flow series; 0 disables them.
+   */
+  void Start (Time interval, Time start, Time stop, uint32_t nodes = 0, uint32_t flows = 0)
+  {
+    NS_ABORT_MSG_UNLESS (interval.IsStrictlyPositive (), "sampling interval must be positive");
+    m_interval = interval;
+    m_start = start;
+    m_nodes = nodes;
+    m_flows = flows;
+    m_samples = 0;
+    m_capacity = static_cast<uint32_t> ((stop - start).GetDouble () / interval.GetDouble ()) + 1;
+    m_total.assign (m_capacity, 0);
+    m_nodeCurrent.assign (m_nodes, 0);
+    m_flowCurrent.assign (m_flows, 0);
+    m_perNode.assign (static_cast<size_t> (m_capacity) * m_nodes, 0);
+    m_perFlow.assign (static_cast<size_t> (m_capacity) * m_flows, 0);
+    m_current = 0;
+    m_event = Simulator::Schedule (start + interval - Simulator::Now (), &GoodputSampler::Sample, this);
+  }
+
+  void Stop (void)
+  {
+    Simulator::Cancel (m_event);
+  }
+
+  void Record (uint32_t bytes)
+  {
+    m_current += bytes;
+  }
+
+  void Record (uint32_t bytes, uint32_t node, uint32_t flow)
+  {
+    m_current += bytes;
+    if (node < m_nodes)
+      {
+        m_nodeCurrent[node] += bytes;
+      }
+    if (flow < m_flows)
+      {
+        m_flowCurrent[flow] += bytes;
+      }
+  }
+
+  uint32_t GetSampleCount (void) const
+  {
+    return m_samples;
+  }
+
+  Time GetInterval (void) const
+  {
+    return m_interval;
+  }
+
+  /*
+   * Flows with a series of their own, 0 if there is none.
+   */
+  uint32_t GetFlowCount (void) const
+  {
+    return m_flows;
+  }
+
+  /*
+   * End of sample i, in seconds.
+   */
+  double GetTime (uint32_t i) const
+  {
+    return (m_start + m_interval * (i + 1)).GetSeconds ();
+  }
+
+  /*
+   * Goodput of sample i in Mbit/s.
+   */
+  double GetGoodput (uint32_t i) const
+  {
+    return ToMbps (m_total[i]);
+  }
+
+  /*
+   * Goodput of flow in sample i in Mbit/s.
+   */
+  double GetFlowGoodput (uint32_t i, uint32_t flow) const
+  {
+    return ToMbps (m_perFlow[static_cast<size_t> (i) * m_flows + flow]);
+  }
+
+  /*
+   * Long-format CSV: one "total" row per sample, plus one row per node and
+   * flow that received anything in that sample.
+   */
+  bool WriteCsv (std::string filename) const
+  {
+    std::ofstream out (filename.c_str ());
+    if (!out)
+      {
+        return false;
+      }
+    out << "time_s,scope,id,bytes,mbps\n";
+    for (uint32_t i = 0; i < m_samples; i++)
+      {
+        double t = GetTime (i);
+        out << t << ",total,," << m_total[i] << "," << ToMbps (m_total[i]) << "\n";
+        for (uint32_t n = 0; n < m_nodes; n++)
+          {
+            uint64_t b = m_perNode[static_cast<size_t> (i) * m_nodes + n];
+            if (b > 0)
+              {
+                out << t << ",node," << n << "," << b << "," << ToMbps (b) << "\n";
+              }
+          }
+        for (uint32_t f = 0; f < m_flows; f++)
+          {
+            uint64_t b = m_perFlow[static_cast<size_t> (i) * m_flows + f];
+            if (b > 0)
+              {
+                out << t << ",flow," << f << "," << b << "," << ToMbps (b) << "\n";
+              }
+          }
+      }
+    return out.good ();
+  }
+
+private:
+  double ToMbps (uint64_t bytes) const
+  {
+    return bytes * 8.0 / m_interval.GetSeconds () / 1e6;
+  }
+
+  void Sample (void)
+  {
+    if (m_samples == m_capacity)
+      {
+        return;
+      }
+    uint32_t i = m_samples++;
+    m_total[i] = m_current;
+    m_current = 0;
+    for (uint32_t n = 0; n < m_nodes; n++)
+      {
+        m_perNode[static_cast<size_t> (i) * m_nodes + n] = m_nodeCurrent[n];
+        m_nodeCurrent[n] = 0;
+      }
+    for (uint32_t f = 0; f < m_flows; f++)
+      {
+        m_perFlow[static_cast<size_t> (i) * m_flows + f] = m_flowCurrent[f];
+        m_flowCurrent[f] = 0;
+      }
+    if (m_samples < m_capacity)
+      {
+        m_event = Simulator::Schedule (m_interval, &GoodputSampler::Sample, this);
+      }
+  }
+
+  Time m_interval;
+  Time m_start;
+  uint32_t m_nodes;
+  uint32_t m_flows;
+  uint32_t m_samples;
+  uint32_t m_capacity;
+  uint64_t m_current;
+  std::vector<uint64_t> m_nodeCurrent;
+  std::vector<uint64_t> m_flowCurrent;
+  std::vector<uint64_t> m_total;
+  std::vector<uint64_t> m_perNode;   // sample-major
+  std::vector<uint64_t> m_perFlow;   // sample-major
+  EventId m_event;
+};
+
+} // namespace ns3
+
+#endif /* CROWD_GOODPUT_SAMPLER_H */
@@ -0,0 +1,210 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Memory and setup time per node of the full and lite node profiles.
+//
+// ./waf --run "crowd-node-bench --nodes=100,1000,10000,100000"
+// ./waf --run "crowd-node-bench --profile=lite --nodes=100000"
+//
+// For every node count, and for each profile, a fresh process builds the
+// crowdsrc-adhoc nodes the way Experiment::Run does: 802.11a ad hoc Wi-Fi
+// on a YansWifiChannel, random walk mobility, then the CrowdStackHelper
+// stack with RIPng (full) or the position oracle (lite) as routing, then
+// runs the simulator to time zero so that every object has been
+// initialized (RIPng opens its sockets there). The oracle only builds its
+// link state on the first lookup, so lite finally routes one packet's
+// worth, from the first node to the last. The resident set is read from
+// /proc/self/statm after every stage; the growth divided by the node count
+// is the cost per node, allocator overhead included.
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/wifi-module.h"
+#include "ns3/ripng-helper.h"
+#include "ns3/ipv6-static-routing-helper.h"
+#include "ns3/ipv6-list-routing-helper.h"
+
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "crowd-worker-pool.h"
+#include "crowd-oracle-routing.h"
+#include "crowd-stack-helper.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("CrowdNodeBench");
+
+static double
+WallSeconds (void)
+{
+  struct timeval tv;
+  gettimeofday (&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static double
+ResidentBytes (void)
+{
+  std::ifstream statm ("/proc/self/statm");
+  double size = 0, resident = 0;
+  statm >> size >> resident;
+  return resident * sysconf (_SC_PAGESIZE);
+}
+
+static int
+RunBench (std::string profile, uint32_t nodes)
+{
+  double start = WallSeconds ();
+  double rss0 = ResidentBytes ();
+  NodeContainer c;
+  c.Create (nodes);
+
+  WifiHelper wifi;
+  wifi.SetStandard (WIFI_PHY_STANDARD_80211a);
+  wifi.SetRemoteStationManager ("ns3::ConstantRateWifiManager",
+                                "DataMode", StringValue ("OfdmRate54Mbps"));
+  YansWifiPhyHelper phy = YansWifiPhyHelper::Default ();
+  YansWifiChannelHelper channel = YansWifiChannelHelper::Default ();
+  phy.SetChannel (channel.Create ());
+  WifiMacHelper mac;
+  mac.SetType ("ns3::AdhocWifiMac");
+  NetDeviceContainer devices = wifi.Install (phy, mac, c);
+  double rssWifi = ResidentBytes ();
+
+  // The crowd's density (about 20 nodes on 200 m x 200 m) kept as it grows
+  uint32_t width = static_cast<uint32_t> (std::ceil (std::sqrt (double (nodes))));
+  double spacing = 45.0;
+  std::ostringstream bounds;
+  bounds << "0|" << width * spacing << "|0|" << width * spacing;
+  MobilityHelper mobility;
+  mobility.SetPositionAllocator ("ns3::GridPositionAllocator",
+                                 "DeltaX", DoubleValue (spacing), "DeltaY", DoubleValue (spacing),
+                                 "GridWidth", UintegerValue (width));
+  mobility.SetMobilityModel ("ns3::RandomWalk2dMobilityModel",
+                             "Speed", StringValue ("ns3::ConstantRandomVariable[Constant=2.0]"),
+                             "Bounds", StringValue (bounds.str ()));
+  mobility.Install (c);
+  double rssMobility = ResidentBytes ();
+
+  RipNgHelper ripNg;
+  Ipv6StaticRoutingHelper staticRouting;
+  Ipv6ListRoutingHelper list;
+  list.Add (staticRouting, 0);
+  Ptr<CrowdOracle> oracle;
+  if (profile == "lite")
+    {
+      oracle = CreateObject<CrowdOracle> ();
+      oracle->SetAttribute ("Range", DoubleValue (100.0));
+      list.Add (CrowdOracleRoutingHelper (oracle), 10);
+    }
+  else
+    {
+      list.Add (ripNg, 10);
+    }
+  CrowdStackHelper internet;
+  internet.SetProfile (profile);
+  internet.SetRoutingHelper (list);
+  Ipv6InterfaceContainer interfaces = internet.Install (c, devices);
+  double rssStack = ResidentBytes ();
+  double setup = WallSeconds () - start;
+
+  Simulator::Stop (Seconds (0));
+  Simulator::Run ();
+  double rssStarted = ResidentBytes ();
+  bool routed = true;
+  if (oracle && nodes > 1)
+    {
+      Ipv6Address gateway;
+      uint32_t interface;
+      routed = oracle->GetNextHop (0, interfaces.GetAddress (nodes - 1, 1), gateway, interface);
+    }
+  double rssRouted = ResidentBytes ();
+  double total = WallSeconds () - start;
+
+  std::printf ("profile=%-4s nodes=%-6u  bytes per node: wifi %6.0f  mobility %5.0f  stack %6.0f  "
+               "initialized %6.0f  routes %6.0f  total %6.0f   setup %.2f s (%.1f us per node), "
+               "with start and first route %.2f s%s\n",
+               profile.c_str (), nodes, (rssWifi - rss0) / nodes, (rssMobility - rssWifi) / nodes,
+               (rssStack - rssMobility) / nodes, (rssStarted - rssStack) / nodes,
+               (rssRouted - rssStarted) / nodes, (rssRouted - rss0) / nodes, setup, setup * 1e6 / nodes,
+               total, routed ? "" : "  (last node unreachable)");
+  std::fflush (stdout);
+  Simulator::Destroy ();
+  return interfaces.GetN () == nodes ? 0 : 1;
+}
+
+int main (int argc, char *argv[])
+{
+  std::string nodeList ("100,1000,10000,100000");
+  std::string profile ("both");
+
+  CommandLine cmd;
+  cmd.AddValue ("nodes", "comma-separated node counts", nodeList);
+  cmd.AddValue ("profile", "full, lite or both", profile);
+  cmd.Parse (argc, argv);
+  NS_ABORT_MSG_UNLESS (profile == "full" || profile == "lite" || profile == "both",
+                       "unknown profile " << profile);
+
+  std::vector<uint32_t> counts;
+  std::istringstream in (nodeList);
+  std::string item;
+  while (std::getline (in, item, ','))
+    {
+      counts.push_back (std::atoi (item.c_str ()));
+    }
+
+  // One process per configuration, so that each starts from a clean heap
+  CrowdWorkerPool pool (1);
+  uint32_t failed = 0;
+  pool.SetDoneCallback ([&] (uint32_t id, int exitStatus)
+    {
+      if (exitStatus != 0)
+        {
+          failed++;
+        }
+    });
+  const char *profiles[] = { "full", "lite" };
+  for (uint32_t i = 0; i < counts.size (); i++)
+    {
+      for (uint32_t p = 0; p < 2; p++)
+        {
+          std::string one = profiles[p];
+          if (profile != "both" && profile != one)
+            {
+              continue;
+            }
+          uint32_t nodes = counts[i];
+          pool.Submit ([=] () { return RunBench (one, nodes); });
+        }
+    }
+  pool.WaitAll ();
+  if (failed > 0)
+    {
+      std::printf ("%u runs FAILED\n", failed);
+      return 1;
+    }
+  return 0;
+}
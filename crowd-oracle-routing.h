@@ -0,0 +1,796 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Oracle IPv6 routing from node positions.
+ *
+ * One CrowdOracle per simulation knows every node's position and treats
+ * two nodes within Range metres of each other as linked. It keeps, for
+ * every destination, a breadth-first (fewest hops) tree rooted at that
+ * destination, so the next hop of any node towards it is its parent in the
+ * tree. No control packets are sent: this separates the data plane from
+ * the cost of a routing protocol.
+ *
+ * Links are kept from where each node stood when they were last checked,
+ * in a grid of Range-sized cells, so re-checking a node only looks at the
+ * nine cells around it. A CourseChange re-checks the node that turned.
+ * Since nodes also drift between course changes, lookups poll every
+ * position once per Margin / (2 MaxSpeed) and re-check only the nodes that
+ * have moved more than Margin / 2 since: no node is then more than Margin
+ * from where its links say, and a poll costs one position read per node.
+ * A MaxSpeed of 0 leaves links to course changes alone.
+ *
+ * Trees are repaired incrementally. A link change only invalidates the
+ * trees it can affect: a lost link only matters to trees that used it, a
+ * new link only to trees in which its ends are more than one hop apart.
+ * Invalid trees are rebuilt when next asked for. A destination only gets a
+ * tree once something is routed to it, at 6 bytes per node, so the tables
+ * grow with nodes times destinations in use: all-to-all traffic among N
+ * nodes needs 6 N^2 bytes, 600 MB at 10,000 nodes, which is about as far
+ * as that pattern goes.
+ *
+ * Each node runs a CrowdOracleRouting instance that answers RouteOutput
+ * and RouteInput for the global unicast addresses it knows; anything else
+ * (link-local, multicast, unknown destinations) is left to the next
+ * protocol in the Ipv6ListRouting.
+ */
+
+#ifndef CROWD_ORACLE_ROUTING_H
+#define CROWD_ORACLE_ROUTING_H
+
+#include "ns3/ipv6-routing-protocol.h"
+#include "ns3/ipv6-routing-helper.h"
+#include "ns3/ipv6-route.h"
+#include "ns3/ipv6.h"
+#include "ns3/ipv6-interface-address.h"
+#include "ns3/mobility-model.h"
+#include "ns3/node.h"
+#include "ns3/object.h"
+#include "ns3/simulator.h"
+#include "ns3/double.h"
+#include "ns3/nstime.h"
+#include "ns3/abort.h"
+#include "ns3/output-stream-wrapper.h"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+namespace ns3 {
+
+class CrowdOracle : public Object
+{
+public:
+  static TypeId GetTypeId (void);
+
+  CrowdOracle ();
+
+  /*
+   * Returns the node's oracle index.
+   */
+  uint32_t AddNode (Ptr<Node> node);
+  void AddAddress (uint32_t index, Ipv6Address address, uint32_t interface);
+
+  /*
+   * Next hop from node index towards dst: fills the gateway address and
+   * the interface it is reached on. False if dst is unknown or unreachable.
+   */
+  bool GetNextHop (uint32_t index, Ipv6Address dst, Ipv6Address &gateway, uint32_t &interface);
+
+  uint32_t GetNNodes (void) const;
+  void PrintTable (uint32_t index, std::ostream &os);
+  void PrintStats (std::ostream &os) const;
+
+protected:
+  virtual void DoDispose (void);
+
+private:
+  static const uint32_t NONE = 0xffffffff;
+  static const uint16_t UNREACHABLE = 0xffff;
+
+  struct Member
+  {
+    Ptr<Node> node;
+    Ptr<MobilityModel> mobility;
+    Ipv6Address address;
+    uint32_t interface;
+    bool addressed;
+    int64_t cell;
+    uint32_t slot;       // position inside m_cells[cell]
+    uint32_t tree;       // row in m_hops and m_next, or NONE
+  };
+
+  typedef std::unordered_map<int64_t, std::vector<uint32_t> > CellMap;
+
+  void Build (void);
+  void Refresh (void);
+  void UpdateNode (uint32_t k, const Vector &pos);
+  void SetLink (uint32_t a, uint32_t b, bool linked);
+  void RebuildTree (uint32_t d);
+  bool InRange (const Vector &a, const Vector &b) const;
+  int64_t CellOf (const Vector &pos) const;
+  static int64_t CellKey (int64_t ix, int64_t iy);
+  void Candidates (uint32_t k);
+  static void CourseChanged (CrowdOracle *oracle, uint32_t index, Ptr<const MobilityModel> mobility);
+
+  double m_range;
+  double m_margin;
+  double m_maxSpeed;
+
+  std::vector<Member> m_members;
+  std::map<Ipv6Address, uint32_t> m_byAddress;
+  bool m_built;
+  Time m_lastPoll;
+  double m_cellSize;
+  CellMap m_cells;
+  std::vector<Vector> m_pos;                     // where links were last checked
+  std::vector<std::vector<uint32_t> > m_neighbors;
+  std::vector<uint32_t> m_trees;                 // destination of each tree
+  std::vector<uint16_t> m_hops;                  // [tree * N + node]
+  std::vector<uint32_t> m_next;                  // [tree * N + node]
+  std::vector<uint8_t> m_dirty;                  // per destination
+  std::deque<uint32_t> m_queue;
+  std::vector<uint32_t> m_candidates;
+  std::vector<uint32_t> m_old;
+  std::vector<uint8_t> m_mark;
+
+  uint64_t m_courseChanges;
+  uint64_t m_polls;
+  uint64_t m_nodeUpdates;
+  uint64_t m_linkChanges;
+  uint64_t m_rebuilds;
+};
+
+class CrowdOracleRouting : public Ipv6RoutingProtocol
+{
+public:
+  static TypeId GetTypeId (void);
+
+  CrowdOracleRouting ();
+
+  void SetOracle (Ptr<CrowdOracle> oracle);
+
+  // Ipv6RoutingProtocol
+  virtual Ptr<Ipv6Route> RouteOutput (Ptr<Packet> p, const Ipv6Header &header, Ptr<NetDevice> oif,
+                                      Socket::SocketErrno &sockerr);
+  virtual bool RouteInput (Ptr<const Packet> p, const Ipv6Header &header, Ptr<const NetDevice> idev,
+                           UnicastForwardCallback ucb, MulticastForwardCallback mcb,
+                           LocalDeliverCallback lcb, ErrorCallback ecb);
+  virtual void NotifyInterfaceUp (uint32_t interface);
+  virtual void NotifyInterfaceDown (uint32_t interface);
+  virtual void NotifyAddAddress (uint32_t interface, Ipv6InterfaceAddress address);
+  virtual void NotifyRemoveAddress (uint32_t interface, Ipv6InterfaceAddress address);
+  virtual void NotifyAddRoute (Ipv6Address dst, Ipv6Prefix mask, Ipv6Address nextHop,
+                               uint32_t interface, Ipv6Address prefixToUse = Ipv6Address::GetZero ());
+  virtual void NotifyRemoveRoute (Ipv6Address dst, Ipv6Prefix mask, Ipv6Address nextHop,
+                                  uint32_t interface, Ipv6Address prefixToUse = Ipv6Address::GetZero ());
+  virtual void SetIpv6 (Ptr<Ipv6> ipv6);
+  virtual void PrintRoutingTable (Ptr<OutputStreamWrapper> stream, Time::Unit unit = Time::S) const;
+
+protected:
+  virtual void DoDispose (void);
+
+private:
+  Ptr<Ipv6Route> Lookup (Ipv6Address dst, Ptr<const NetDevice> oif);
+
+  Ptr<CrowdOracle> m_oracle;
+  Ptr<Ipv6> m_ipv6;
+  uint32_t m_index;
+};
+
+class CrowdOracleRoutingHelper : public Ipv6RoutingHelper
+{
+public:
+  /*
+   * Every node the helper is installed on shares this oracle.
+   */
+  CrowdOracleRoutingHelper (Ptr<CrowdOracle> oracle)
+    : m_oracle (oracle)
+  {
+  }
+
+  virtual CrowdOracleRoutingHelper *Copy (void) const
+  {
+    return new CrowdOracleRoutingHelper (*this);
+  }
+
+  virtual Ptr<Ipv6RoutingProtocol> Create (Ptr<Node> node) const
+  {
+    Ptr<CrowdOracleRouting> routing = CreateObject<CrowdOracleRouting> ();
+    routing->SetOracle (m_oracle);
+    node->AggregateObject (routing);
+    return routing;
+  }
+
+private:
+  Ptr<CrowdOracle> m_oracle;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (CrowdOracle);
+
+TypeId
+CrowdOracle::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::CrowdOracle")
+    .SetParent<Object> ()
+    .SetGroupName ("Internet")
+    .AddConstructor<CrowdOracle> ()
+    .AddAttribute ("Range",
+                   "Nodes closer than this many metres are linked.",
+                   DoubleValue (50.0),
+                   MakeDoubleAccessor (&CrowdOracle::m_range),
+                   MakeDoubleChecker<double> (0.0))
+    .AddAttribute ("Margin",
+                   "How far (m) a node may be from where its links were last checked.",
+                   DoubleValue (5.0),
+                   MakeDoubleAccessor (&CrowdOracle::m_margin),
+                   MakeDoubleChecker<double> (0.0))
+    .AddAttribute ("MaxSpeed",
+                   "Fastest any node moves (m/s); 0 if nodes only move at course changes.",
+                   DoubleValue (2.0),
+                   MakeDoubleAccessor (&CrowdOracle::m_maxSpeed),
+                   MakeDoubleChecker<double> (0.0))
+  ;
+  return tid;
+}
+
+CrowdOracle::CrowdOracle ()
+  : m_built (false),
+    m_cellSize (1.0),
+    m_courseChanges (0),
+    m_polls (0),
+    m_nodeUpdates (0),
+    m_linkChanges (0),
+    m_rebuilds (0)
+{
+}
+
+void
+CrowdOracle::DoDispose (void)
+{
+  m_members.clear ();
+  m_byAddress.clear ();
+  m_cells.clear ();
+  Object::DoDispose ();
+}
+
+uint32_t
+CrowdOracle::AddNode (Ptr<Node> node)
+{
+  Member m;
+  m.node = node;
+  m.interface = 0;
+  m.addressed = false;
+  m.cell = 0;
+  m.slot = 0;
+  m.tree = NONE;
+  m_members.push_back (m);
+  m_built = false;
+  return m_members.size () - 1;
+}
+
+void
+CrowdOracle::AddAddress (uint32_t index, Ipv6Address address, uint32_t interface)
+{
+  Member &m = m_members[index];
+  if (m.addressed)
+    {
+      // Only the first global address is used as this node's gateway address
+      m_byAddress[address] = index;
+      return;
+    }
+  m.address = address;
+  m.interface = interface;
+  m.addressed = true;
+  m_byAddress[address] = index;
+}
+
+uint32_t
+CrowdOracle::GetNNodes (void) const
+{
+  return m_members.size ();
+}
+
+bool
+CrowdOracle::InRange (const Vector &a, const Vector &b) const
+{
+  double dx = a.x - b.x;
+  double dy = a.y - b.y;
+  double dz = a.z - b.z;
+  return dx * dx + dy * dy + dz * dz <= m_range * m_range;
+}
+
+int64_t
+CrowdOracle::CellKey (int64_t ix, int64_t iy)
+{
+  // Shifted unsigned, as cells left of or below the origin are negative
+  return static_cast<int64_t> ((static_cast<uint64_t> (ix) << 32) ^ (static_cast<uint64_t> (iy) & 0xffffffff));
+}
+
+int64_t
+CrowdOracle::CellOf (const Vector &pos) const
+{
+  return CellKey (static_cast<int64_t> (std::floor (pos.x / m_cellSize)),
+                  static_cast<int64_t> (std::floor (pos.y / m_cellSize)));
+}
+
+void
+CrowdOracle::Candidates (uint32_t k)
+{
+  // Cells are Range wide, so whatever is in range is in the nine around k
+  m_candidates.clear ();
+  int64_t cx = static_cast<int64_t> (std::floor (m_pos[k].x / m_cellSize));
+  int64_t cy = static_cast<int64_t> (std::floor (m_pos[k].y / m_cellSize));
+  for (int64_t ix = cx - 1; ix <= cx + 1; ix++)
+    {
+      for (int64_t iy = cy - 1; iy <= cy + 1; iy++)
+        {
+          CellMap::const_iterator cell = m_cells.find (CellKey (ix, iy));
+          if (cell == m_cells.end ())
+            {
+              continue;
+            }
+          for (std::vector<uint32_t>::const_iterator j = cell->second.begin (); j != cell->second.end (); ++j)
+            {
+              if (*j != k && InRange (m_pos[k], m_pos[*j]))
+                {
+                  m_candidates.push_back (*j);
+                }
+            }
+        }
+    }
+}
+
+void
+CrowdOracle::Build (void)
+{
+  uint32_t n = m_members.size ();
+  m_cellSize = m_range > 0 ? m_range : 1.0;
+  m_cells.clear ();
+  m_pos.resize (n);
+  for (uint32_t i = 0; i < n; i++)
+    {
+      Member &m = m_members[i];
+      if (!m.mobility)
+        {
+          m.mobility = m.node->GetObject<MobilityModel> ();
+          NS_ABORT_MSG_UNLESS (m.mobility, "CrowdOracle needs a MobilityModel on node " << m.node->GetId ());
+          m.mobility->TraceConnectWithoutContext ("CourseChange",
+                                                  MakeBoundCallback (&CrowdOracle::CourseChanged, this, i));
+        }
+      m_pos[i] = m.mobility->GetPosition ();
+      m.cell = CellOf (m_pos[i]);
+      std::vector<uint32_t> &members = m_cells[m.cell];
+      m.slot = members.size ();
+      members.push_back (i);
+      m.tree = NONE;
+    }
+  m_neighbors.assign (n, std::vector<uint32_t> ());
+  for (uint32_t a = 0; a < n; a++)
+    {
+      Candidates (a);
+      m_neighbors[a] = m_candidates;
+    }
+  m_trees.clear ();
+  m_hops.clear ();
+  m_next.clear ();
+  m_dirty.assign (n, 1);
+  m_mark.assign (n, 0);
+  m_lastPoll = Simulator::Now ();
+  m_built = true;
+}
+
+void
+CrowdOracle::SetLink (uint32_t a, uint32_t b, bool linked)
+{
+  uint32_t n = m_members.size ();
+  m_linkChanges++;
+  if (linked)
+    {
+      m_neighbors[a].push_back (b);
+      m_neighbors[b].push_back (a);
+    }
+  else
+    {
+      std::vector<uint32_t> &na = m_neighbors[a];
+      std::vector<uint32_t> &nb = m_neighbors[b];
+      na.erase (std::find (na.begin (), na.end (), b));
+      nb.erase (std::find (nb.begin (), nb.end (), a));
+    }
+  for (uint32_t t = 0; t < m_trees.size (); t++)
+    {
+      uint32_t d = m_trees[t];
+      if (m_dirty[d])
+        {
+          continue;
+        }
+      size_t row = static_cast<size_t> (t) * n;
+      if (linked)
+        {
+          // A new link shortens the tree only if its ends were more than
+          // one hop apart in it (unreachable counts as far)
+          int ha = m_hops[row + a];
+          int hb = m_hops[row + b];
+          if (ha - hb > 1 || hb - ha > 1)
+            {
+              m_dirty[d] = 1;
+            }
+        }
+      else if (m_next[row + a] == b || m_next[row + b] == a)
+        {
+          m_dirty[d] = 1;
+        }
+    }
+}
+
+void
+CrowdOracle::UpdateNode (uint32_t k, const Vector &pos)
+{
+  Member &m = m_members[k];
+  m_pos[k] = pos;
+  int64_t cell = CellOf (pos);
+  if (cell != m.cell)
+    {
+      // Swap-remove from the old cell
+      std::vector<uint32_t> &old = m_cells[m.cell];
+      uint32_t moved = old.back ();
+      old[m.slot] = moved;
+      m_members[moved].slot = m.slot;
+      old.pop_back ();
+
+      std::vector<uint32_t> &members = m_cells[cell];
+      m.cell = cell;
+      m.slot = members.size ();
+      members.push_back (k);
+    }
+  m_nodeUpdates++;
+
+  // Bit 1: linked before, bit 2: in range now
+  Candidates (k);
+  m_old = m_neighbors[k];
+  for (uint32_t i = 0; i < m_old.size (); i++)
+    {
+      m_mark[m_old[i]] |= 1;
+    }
+  for (uint32_t i = 0; i < m_candidates.size (); i++)
+    {
+      m_mark[m_candidates[i]] |= 2;
+    }
+  for (uint32_t i = 0; i < m_old.size (); i++)
+    {
+      if (m_mark[m_old[i]] == 1)
+        {
+          SetLink (k, m_old[i], false);
+        }
+    }
+  for (uint32_t i = 0; i < m_candidates.size (); i++)
+    {
+      if (m_mark[m_candidates[i]] == 2)
+        {
+          SetLink (k, m_candidates[i], true);
+        }
+    }
+  for (uint32_t i = 0; i < m_old.size (); i++)
+    {
+      m_mark[m_old[i]] = 0;
+    }
+  for (uint32_t i = 0; i < m_candidates.size (); i++)
+    {
+      m_mark[m_candidates[i]] = 0;
+    }
+}
+
+void
+CrowdOracle::Refresh (void)
+{
+  if (!m_built)
+    {
+      Build ();
+      return;
+    }
+  Time now = Simulator::Now ();
+  if (m_maxSpeed <= 0 || now == m_lastPoll || now - m_lastPoll < Seconds (m_margin / (2 * m_maxSpeed)))
+    {
+      return;
+    }
+  double slack = m_margin / 2;
+  for (uint32_t k = 0; k < m_members.size (); k++)
+    {
+      Vector pos = m_members[k].mobility->GetPosition ();
+      double dx = pos.x - m_pos[k].x;
+      double dy = pos.y - m_pos[k].y;
+      double dz = pos.z - m_pos[k].z;
+      if (dx * dx + dy * dy + dz * dz > slack * slack)
+        {
+          UpdateNode (k, pos);
+        }
+    }
+  m_lastPoll = now;
+  m_polls++;
+}
+
+void
+CrowdOracle::CourseChanged (CrowdOracle *oracle, uint32_t index, Ptr<const MobilityModel> mobility)
+{
+  if (oracle->m_built)
+    {
+      oracle->m_courseChanges++;
+      oracle->UpdateNode (index, mobility->GetPosition ());
+    }
+}
+
+void
+CrowdOracle::RebuildTree (uint32_t d)
+{
+  uint32_t n = m_members.size ();
+  if (m_members[d].tree == NONE)
+    {
+      m_members[d].tree = m_trees.size ();
+      m_trees.push_back (d);
+      m_hops.resize (m_trees.size () * static_cast<size_t> (n));
+      m_next.resize (m_trees.size () * static_cast<size_t> (n));
+    }
+  size_t row = static_cast<size_t> (m_members[d].tree) * n;
+  std::fill (m_hops.begin () + row, m_hops.begin () + row + n, static_cast<uint16_t> (UNREACHABLE));
+  std::fill (m_next.begin () + row, m_next.begin () + row + n, static_cast<uint32_t> (NONE));
+  m_hops[row + d] = 0;
+  m_queue.clear ();
+  m_queue.push_back (d);
+  while (!m_queue.empty ())
+    {
+      uint32_t u = m_queue.front ();
+      m_queue.pop_front ();
+      const std::vector<uint32_t> &nu = m_neighbors[u];
+      for (std::vector<uint32_t>::const_iterator v = nu.begin (); v != nu.end (); ++v)
+        {
+          if (m_hops[row + *v] == UNREACHABLE)
+            {
+              m_hops[row + *v] = m_hops[row + u] + 1;
+              m_next[row + *v] = u;
+              m_queue.push_back (*v);
+            }
+        }
+    }
+  m_dirty[d] = 0;
+  m_rebuilds++;
+}
+
+bool
+CrowdOracle::GetNextHop (uint32_t index, Ipv6Address dst, Ipv6Address &gateway, uint32_t &interface)
+{
+  std::map<Ipv6Address, uint32_t>::const_iterator it = m_byAddress.find (dst);
+  if (it == m_byAddress.end () || it->second == index)
+    {
+      return false;
+    }
+  Refresh ();
+  uint32_t d = it->second;
+  if (m_dirty[d])
+    {
+      RebuildTree (d);
+    }
+  uint32_t next = m_next[static_cast<size_t> (m_members[d].tree) * m_members.size () + index];
+  if (next == NONE || !m_members[next].addressed || !m_members[index].addressed)
+    {
+      return false;
+    }
+  gateway = next == d ? dst : m_members[next].address;
+  interface = m_members[index].interface;
+  return true;
+}
+
+void
+CrowdOracle::PrintTable (uint32_t index, std::ostream &os)
+{
+  Refresh ();
+  uint32_t n = m_members.size ();
+  os << "Node: " << m_members[index].node->GetId () << ", Time: " << Simulator::Now ().GetSeconds ()
+     << "s, CrowdOracleRouting table" << std::endl;
+  os << "Destination                    Next Hop                       Hops" << std::endl;
+  for (uint32_t d = 0; d < n; d++)
+    {
+      if (d == index || !m_members[d].addressed)
+        {
+          continue;
+        }
+      if (m_dirty[d])
+        {
+          RebuildTree (d);
+        }
+      size_t row = static_cast<size_t> (m_members[d].tree) * n;
+      uint32_t next = m_next[row + index];
+      std::ostringstream dst, hop;
+      dst << m_members[d].address;
+      if (next == NONE)
+        {
+          hop << "unreachable";
+        }
+      else
+        {
+          hop << m_members[next].address;
+        }
+      os << std::setiosflags (std::ios::left) << std::setw (31) << dst.str ()
+         << std::setw (31) << hop.str () << m_hops[row + index] << std::endl;
+    }
+}
+
+void
+CrowdOracle::PrintStats (std::ostream &os) const
+{
+  os << "oracle routing: " << m_members.size () << " nodes, range " << m_range << " m, margin "
+     << m_margin << " m, " << m_trees.size () << " trees, " << m_courseChanges << " course changes, "
+     << m_polls << " polls, " << m_nodeUpdates << " node updates, " << m_linkChanges << " link changes, "
+     << m_rebuilds << " tree rebuilds" << std::endl;
+}
+
+NS_OBJECT_ENSURE_REGISTERED (CrowdOracleRouting);
+
+TypeId
+CrowdOracleRouting::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::CrowdOracleRouting")
+    .SetParent<Ipv6RoutingProtocol> ()
+    .SetGroupName ("Internet")
+    .AddConstructor<CrowdOracleRouting> ()
+  ;
+  return tid;
+}
+
+CrowdOracleRouting::CrowdOracleRouting ()
+  : m_index (0)
+{
+}
+
+void
+CrowdOracleRouting::DoDispose (void)
+{
+  m_oracle = 0;
+  m_ipv6 = 0;
+  Ipv6RoutingProtocol::DoDispose ();
+}
+
+void
+CrowdOracleRouting::SetOracle (Ptr<CrowdOracle> oracle)
+{
+  m_oracle = oracle;
+}
+
+void
+CrowdOracleRouting::SetIpv6 (Ptr<Ipv6> ipv6)
+{
+  NS_ABORT_MSG_UNLESS (m_oracle, "CrowdOracleRouting needs an oracle before SetIpv6");
+  m_ipv6 = ipv6;
+  m_index = m_oracle->AddNode (ipv6->GetObject<Node> ());
+  for (uint32_t i = 0; i < m_ipv6->GetNInterfaces (); i++)
+    {
+      for (uint32_t j = 0; j < m_ipv6->GetNAddresses (i); j++)
+        {
+          NotifyAddAddress (i, m_ipv6->GetAddress (i, j));
+        }
+    }
+}
+
+Ptr<Ipv6Route>
+CrowdOracleRouting::Lookup (Ipv6Address dst, Ptr<const NetDevice> oif)
+{
+  if (dst.IsMulticast () || dst.IsLinkLocal ())
+    {
+      return 0;
+    }
+  Ipv6Address gateway;
+  uint32_t interface;
+  if (!m_oracle->GetNextHop (m_index, dst, gateway, interface))
+    {
+      return 0;
+    }
+  Ptr<NetDevice> dev = m_ipv6->GetNetDevice (interface);
+  if (oif && oif != dev)
+    {
+      return 0;
+    }
+  Ptr<Ipv6Route> route = Create<Ipv6Route> ();
+  route->SetDestination (dst);
+  route->SetGateway (gateway);
+  route->SetSource (m_ipv6->SourceAddressSelection (interface, dst));
+  route->SetOutputDevice (dev);
+  return route;
+}
+
+Ptr<Ipv6Route>
+CrowdOracleRouting::RouteOutput (Ptr<Packet> p, const Ipv6Header &header, Ptr<NetDevice> oif,
+                                 Socket::SocketErrno &sockerr)
+{
+  Ptr<Ipv6Route> route = Lookup (header.GetDestinationAddress (), oif);
+  sockerr = route ? Socket::ERROR_NOTERROR : Socket::ERROR_NOROUTETOHOST;
+  return route;
+}
+
+bool
+CrowdOracleRouting::RouteInput (Ptr<const Packet> p, const Ipv6Header &header, Ptr<const NetDevice> idev,
+                                UnicastForwardCallback ucb, MulticastForwardCallback mcb,
+                                LocalDeliverCallback lcb, ErrorCallback ecb)
+{
+  Ipv6Address dst = header.GetDestinationAddress ();
+  if (dst.IsMulticast () || dst.IsLinkLocal () || header.GetSourceAddress ().IsLinkLocal ())
+    {
+      return false;
+    }
+  uint32_t iif = m_ipv6->GetInterfaceForDevice (idev);
+  if (!m_ipv6->IsForwarding (iif))
+    {
+      ecb (p, header, Socket::ERROR_NOROUTETOHOST);
+      return true;
+    }
+  Ptr<Ipv6Route> route = Lookup (dst, 0);
+  if (!route)
+    {
+      return false;
+    }
+  ucb (idev, route, p, header);
+  return true;
+}
+
+void
+CrowdOracleRouting::NotifyAddAddress (uint32_t interface, Ipv6InterfaceAddress address)
+{
+  if (address.GetScope () == Ipv6InterfaceAddress::GLOBAL)
+    {
+      m_oracle->AddAddress (m_index, address.GetAddress (), interface);
+    }
+}
+
+void
+CrowdOracleRouting::NotifyInterfaceUp (uint32_t interface)
+{
+}
+
+void
+CrowdOracleRouting::NotifyInterfaceDown (uint32_t interface)
+{
+}
+
+void
+CrowdOracleRouting::NotifyRemoveAddress (uint32_t interface, Ipv6InterfaceAddress address)
+{
+}
+
+void
+CrowdOracleRouting::NotifyAddRoute (Ipv6Address dst, Ipv6Prefix mask, Ipv6Address nextHop,
+                                    uint32_t interface, Ipv6Address prefixToUse)
+{
+}
+
+void
+CrowdOracleRouting::NotifyRemoveRoute (Ipv6Address dst, Ipv6Prefix mask, Ipv6Address nextHop,
+                                       uint32_t interface, Ipv6Address prefixToUse)
+{
+}
+
+void
+CrowdOracleRouting::PrintRoutingTable (Ptr<OutputStreamWrapper> stream, Time::Unit unit) const
+{
+  m_oracle->PrintTable (m_index, *stream->GetStream ());
+}
+
+} // namespace ns3
+
+#endif /* CROWD_ORACLE_ROUTING_H */
@@ -0,0 +1,248 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Virtual versus materialized packet payloads.
+//
+// ./waf --run "crowd-payload-bench --nodes=20 --simTime=10"
+// ./waf --run "crowd-payload-bench --payload=materialized --pcap=1"
+//
+// Every node saturates a UDP flow to its neighbour over 802.11a ad hoc, as
+// in crowdsrc-adhoc. With --payload=virtual packets are Create<Packet>
+// (size): the payload is a zero area that only records its length, and
+// stays so through the MAC queues, the per-receiver channel copies and the
+// header pushes and pops. Consumers that read the bytes (pcap, CopyData)
+// get zeros written straight into their own buffer. With materialized the
+// same packets are built from a byte array, which is what a source that
+// carries real data costs. --payload=both (the default) runs each mode in
+// its own process, one after the other, so that the peak RSS figures are
+// separate.
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/wifi-module.h"
+
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#include "crowd-worker-pool.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("CrowdPayloadBench");
+
+class PayloadSource : public Application
+{
+public:
+  PayloadSource ()
+    : m_size (0),
+      m_materialize (false),
+      m_sent (0)
+  {
+  }
+
+  void Setup (Address peer, uint32_t size, DataRate rate, bool materialize)
+  {
+    m_peer = peer;
+    m_size = size;
+    m_interval = Seconds (size * 8.0 / rate.GetBitRate ());
+    m_materialize = materialize;
+    if (materialize)
+      {
+        m_bytes.resize (size);
+        for (uint32_t i = 0; i < size; i++)
+          {
+            m_bytes[i] = static_cast<uint8_t> (i);
+          }
+      }
+  }
+
+  uint64_t GetSent (void) const
+  {
+    return m_sent;
+  }
+
+private:
+  virtual void StartApplication (void)
+  {
+    m_socket = Socket::CreateSocket (GetNode (), UdpSocketFactory::GetTypeId ());
+    m_socket->Connect (m_peer);
+    Send ();
+  }
+
+  virtual void StopApplication (void)
+  {
+    Simulator::Cancel (m_event);
+    m_socket->Close ();
+  }
+
+  void Send (void)
+  {
+    Ptr<Packet> packet = m_materialize ? Create<Packet> (m_bytes.data (), m_size)
+                                       : Create<Packet> (m_size);
+    m_socket->Send (packet);
+    m_sent++;
+    m_event = Simulator::Schedule (m_interval, &PayloadSource::Send, this);
+  }
+
+  Ptr<Socket> m_socket;
+  Address m_peer;
+  uint32_t m_size;
+  Time m_interval;
+  bool m_materialize;
+  std::vector<uint8_t> m_bytes;
+  EventId m_event;
+  uint64_t m_sent;
+};
+
+static uint64_t g_received = 0;
+
+static void
+Received (Ptr<const Packet> packet, const Address &from)
+{
+  g_received += packet->GetSize ();
+}
+
+static double
+WallSeconds (void)
+{
+  struct timeval tv;
+  gettimeofday (&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int
+RunBench (std::string payload, uint32_t nodes, uint32_t packetSize, double rateMbps,
+          double simTime, bool pcap)
+{
+  bool materialize = payload == "materialized";
+  double start = WallSeconds ();
+
+  NodeContainer c;
+  c.Create (nodes);
+
+  WifiHelper wifi;
+  wifi.SetStandard (WIFI_PHY_STANDARD_80211a);
+  wifi.SetRemoteStationManager ("ns3::ConstantRateWifiManager",
+                                "DataMode", StringValue ("OfdmRate54Mbps"));
+  YansWifiPhyHelper phy = YansWifiPhyHelper::Default ();
+  phy.SetPcapDataLinkType (WifiPhyHelper::DLT_IEEE802_11_RADIO);
+  YansWifiChannelHelper channel = YansWifiChannelHelper::Default ();
+  phy.SetChannel (channel.Create ());
+  WifiMacHelper mac;
+  mac.SetType ("ns3::AdhocWifiMac");
+  NetDeviceContainer devices = wifi.Install (phy, mac, c);
+
+  // A tight grid, so that every node hears every other one
+  MobilityHelper mobility;
+  mobility.SetPositionAllocator ("ns3::GridPositionAllocator",
+                                 "DeltaX", DoubleValue (2.0), "DeltaY", DoubleValue (2.0),
+                                 "GridWidth", UintegerValue (10));
+  mobility.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
+  mobility.Install (c);
+
+  InternetStackHelper internet;
+  internet.Install (c);
+  Ipv4AddressHelper ipv4;
+  ipv4.SetBase ("10.1.0.0", "255.255.0.0");
+  Ipv4InterfaceContainer interfaces = ipv4.Assign (devices);
+
+  std::vector<Ptr<PayloadSource> > sources;
+  for (uint32_t n = 0; n < nodes; n++)
+    {
+      uint32_t peer = (n + 1) % nodes;
+      PacketSinkHelper sink ("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), 9));
+      ApplicationContainer sinkApp = sink.Install (c.Get (peer));
+      sinkApp.Get (0)->TraceConnectWithoutContext ("Rx", MakeCallback (&Received));
+
+      Ptr<PayloadSource> source = CreateObject<PayloadSource> ();
+      source->Setup (InetSocketAddress (interfaces.GetAddress (peer), 9), packetSize,
+                     DataRate (static_cast<uint64_t> (rateMbps * 1e6)), materialize);
+      source->SetStartTime (Seconds (0.1 + 0.001 * n));
+      source->SetStopTime (Seconds (simTime));
+      c.Get (n)->AddApplication (source);
+      sources.push_back (source);
+    }
+  if (pcap)
+    {
+      phy.EnablePcap ("crowd-payload-bench-" + payload, devices);
+    }
+
+  double setup = WallSeconds ();
+  Simulator::Stop (Seconds (simTime));
+  Simulator::Run ();
+  double run = WallSeconds () - setup;
+
+  uint64_t sent = 0;
+  for (uint32_t n = 0; n < sources.size (); n++)
+    {
+      sent += sources[n]->GetSent ();
+    }
+  Simulator::Destroy ();
+
+  struct rusage usage;
+  getrusage (RUSAGE_SELF, &usage);
+  std::printf ("payload=%-12s nodes=%u size=%u pcap=%d  setup %.2f s  run %.2f s  "
+               "%.3f wall s per simulated s  peak RSS %.1f MB  sent %llu  received %.1f MB\n",
+               payload.c_str (), nodes, packetSize, pcap ? 1 : 0, setup - start, run,
+               run / simTime, usage.ru_maxrss / 1024.0, (unsigned long long) sent,
+               g_received / 1e6);
+  std::fflush (stdout);
+  return 0;
+}
+
+int main (int argc, char *argv[])
+{
+  std::string payload ("both");
+  uint32_t nodes = 20;
+  uint32_t packetSize = 4096;
+  double rateMbps = 60.0;
+  double simTime = 10.0;
+  bool pcap = false;
+
+  CommandLine cmd;
+  cmd.AddValue ("payload", "virtual, materialized or both", payload);
+  cmd.AddValue ("nodes", "number of nodes, each with one saturating flow", nodes);
+  cmd.AddValue ("packetSize", "UDP payload bytes", packetSize);
+  cmd.AddValue ("rate", "offered load per flow in Mbit/s", rateMbps);
+  cmd.AddValue ("simTime", "simulated seconds", simTime);
+  cmd.AddValue ("pcap", "also write full per-device pcap files", pcap);
+  cmd.Parse (argc, argv);
+  NS_ABORT_MSG_UNLESS (packetSize > 0, "packetSize must be positive");
+
+  if (payload != "both")
+    {
+      NS_ABORT_MSG_UNLESS (payload == "virtual" || payload == "materialized",
+                           "unknown payload mode " << payload);
+      return RunBench (payload, nodes, packetSize, rateMbps, simTime, pcap);
+    }
+
+  // One process per mode: ru_maxrss only ever grows within a process
+  CrowdWorkerPool pool (1);
+  const char *modes[] = { "virtual", "materialized" };
+  for (uint32_t m = 0; m < 2; m++)
+    {
+      std::string mode = modes[m];
+      pool.Submit ([=] () { return RunBench (mode, nodes, packetSize, rateMbps, simTime, pcap); });
+    }
+  pool.WaitAll ();
+  return 0;
+}
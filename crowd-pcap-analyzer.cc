@@ -0,0 +1,976 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Flow, airtime, retransmission and hop statistics from crowd captures.
+//
+// ./waf --run "crowd-pcap-analyzer crowdsrc-adhoc-*-0.pcap"
+// ./waf --run "crowd-pcap-analyzer --threads=4 --csv=run1 crowdsrc-adhoc-*-0.pcap"
+// ./waf --run "crowd-pcap-analyzer crowdsrc-adhoc.pcapng"
+//
+// Reads the per-device radiotap pcap files written by WifiPhyHelper
+// (node id taken from the "<prefix>-<node>-<device>.pcap" name) and the
+// merged pcapng written by CrowdPcapngCapture (node ids from the interface
+// names, receivers from the packet comments). Each file is mmap()ed and
+// parsed in place by one worker thread; the per-thread tables are merged
+// at the end.
+//
+// In a per-device pcap, frames without a radiotap signal field are the
+// device's own transmissions and the others are receptions. Airtime is
+// computed from frame length and rate (OFDM or DSSS). A reception is a
+// delivery when it reaches the node the IPv6 destination belongs to (its
+// EUI-64 interface id gives the MAC), or any node for multicast; repeated
+// receptions of a retried frame are counted as duplicates instead. Hops are
+// derived from the delivered hop limit, assuming the sender started from
+// 64, or 255 for higher values. A flow's kbit/s is its delivered bytes over
+// the capture span, so that flows of a packet or two do not show a burst
+// rate; "-" if the capture has a single timestamp.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+struct FlowKey
+{
+  uint8_t src[16];
+  uint8_t dst[16];
+  uint16_t sport;
+  uint16_t dport;
+  uint8_t proto;
+
+  bool operator== (const FlowKey &o) const
+  {
+    return std::memcmp (src, o.src, 16) == 0 && std::memcmp (dst, o.dst, 16) == 0
+           && sport == o.sport && dport == o.dport && proto == o.proto;
+  }
+};
+
+struct FlowKeyHash
+{
+  size_t operator() (const FlowKey &k) const
+  {
+    // FNV-1a over the fields
+    uint64_t h = 1469598103934665603ULL;
+    const uint8_t *parts[2] = { k.src, k.dst };
+    for (int p = 0; p < 2; p++)
+      {
+        for (int i = 0; i < 16; i++)
+          {
+            h = (h ^ parts[p][i]) * 1099511628211ULL;
+          }
+      }
+    h = (h ^ k.sport) * 1099511628211ULL;
+    h = (h ^ k.dport) * 1099511628211ULL;
+    h = (h ^ k.proto) * 1099511628211ULL;
+    return h;
+  }
+};
+
+struct FlowStats
+{
+  uint64_t packets;
+  uint64_t bytes;            // IPv6 payload
+  uint64_t firstNs;
+  uint64_t lastNs;
+  uint64_t hopSum;
+  uint32_t hopMax;
+
+  FlowStats ()
+    : packets (0), bytes (0), firstNs (UINT64_MAX), lastNs (0), hopSum (0), hopMax (0)
+  {
+  }
+};
+
+struct NodeStats
+{
+  uint64_t mac;
+  uint64_t txFrames;
+  uint64_t txBytes;
+  uint64_t txData;
+  uint64_t txRetries;
+  uint64_t airtimeNs;
+  uint64_t rxFrames;
+  uint64_t rxDuplicates;
+  uint64_t delivered;
+
+  NodeStats ()
+    : mac (0), txFrames (0), txBytes (0), txData (0), txRetries (0), airtimeNs (0),
+      rxFrames (0), rxDuplicates (0), delivered (0)
+  {
+  }
+};
+
+typedef std::unordered_map<FlowKey, FlowStats, FlowKeyHash> FlowTable;
+
+/*
+ * Everything one worker learns; merged by the main thread.
+ */
+struct Partial
+{
+  std::map<uint32_t, NodeStats> nodes;
+  FlowTable flows;
+  // Last sequence control seen per (receiver, transmitter), for duplicates
+  std::unordered_map<uint64_t, uint16_t> lastSeq;
+  uint64_t records;
+  uint64_t bytes;
+  uint64_t firstNs;
+  uint64_t lastNs;
+  std::string error;
+
+  Partial ()
+    : records (0), bytes (0), firstNs (UINT64_MAX), lastNs (0)
+  {
+  }
+};
+
+struct Radiotap
+{
+  bool fcs;
+  bool hasSignal;
+  uint32_t rate500k;
+};
+
+inline uint16_t
+Le16 (const uint8_t *p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+inline uint32_t
+Le32 (const uint8_t *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t> (p[3]) << 24);
+}
+
+inline uint16_t
+Be16 (const uint8_t *p)
+{
+  return (p[0] << 8) | p[1];
+}
+
+inline uint64_t
+Mac48 (const uint8_t *p)
+{
+  uint64_t m = 0;
+  for (int i = 0; i < 6; i++)
+    {
+      m = (m << 8) | p[i];
+    }
+  return m;
+}
+
+/*
+ * Fields 0 (TSFT) to 6 (antenna noise) of a radiotap header; that is all
+ * ns-3 and CrowdPcapngCapture write, and all we need.
+ */
+bool
+ParseRadiotap (const uint8_t *p, uint32_t len, Radiotap &rt, uint32_t &headerLen)
+{
+  if (len < 8 || p[0] != 0)
+    {
+      return false;
+    }
+  headerLen = Le16 (p + 2);
+  if (headerLen > len)
+    {
+      return false;
+    }
+  uint32_t present = Le32 (p + 4);
+  uint32_t off = 8;
+  while (Le32 (p + off - 4) & 0x80000000u)
+    {
+      off += 4;          // extended bitmaps
+      if (off > headerLen)
+        {
+          return false;
+        }
+    }
+  rt.fcs = false;
+  rt.hasSignal = false;
+  rt.rate500k = 0;
+  static const uint8_t align[7] = { 8, 1, 1, 2, 1, 1, 1 };
+  static const uint8_t size[7] = { 8, 1, 1, 4, 2, 1, 1 };
+  for (int bit = 0; bit < 7; bit++)
+    {
+      if (!(present & (1u << bit)))
+        {
+          continue;
+        }
+      off = (off + align[bit] - 1) & ~(align[bit] - 1u);
+      if (off + size[bit] > headerLen)
+        {
+          return false;
+        }
+      if (bit == 1)
+        {
+          rt.fcs = p[off] & 0x10;
+        }
+      else if (bit == 2)
+        {
+          rt.rate500k = p[off];
+        }
+      else if (bit == 5)
+        {
+          rt.hasSignal = true;
+        }
+      off += size[bit];
+    }
+  return true;
+}
+
+/*
+ * PPDU duration of a frame of len bytes (FCS included).
+ */
+uint64_t
+AirtimeNs (uint32_t len, uint32_t rate500k)
+{
+  if (rate500k == 0)
+    {
+      return 0;
+    }
+  if (rate500k == 2 || rate500k == 4 || rate500k == 11 || rate500k == 22)
+    {
+      // DSSS / HR-DSSS, long preamble
+      return 192000 + static_cast<uint64_t> (len) * 8 * 2000 / rate500k;
+    }
+  // OFDM: 20 us preamble and SIGNAL, 4 us symbols of 16 service + 6 tail bits
+  uint32_t bitsPerSymbol = rate500k * 2;        // Mbit/s * 4 us
+  uint32_t symbols = (16 + 8 * len + 6 + bitsPerSymbol - 1) / bitsPerSymbol;
+  return 20000 + 4000ULL * symbols;
+}
+
+/*
+ * One 802.11 frame seen by node, either sent (tx) or received.
+ */
+struct FrameInfo
+{
+  bool valid;
+  bool data;
+  bool retry;
+  uint64_t addr1;
+  uint64_t addr2;
+  uint16_t seqCtl;
+  const uint8_t *ipv6;       // 0 unless an IPv6 packet follows LLC/SNAP
+  uint32_t ipv6Len;
+};
+
+FrameInfo
+ParseFrame (const uint8_t *w, uint32_t len)
+{
+  FrameInfo f;
+  std::memset (&f, 0, sizeof (f));
+  if (len < 10)
+    {
+      return f;
+    }
+  f.valid = true;
+  uint8_t type = (w[0] >> 2) & 3;
+  f.retry = w[1] & 0x08;
+  f.addr1 = Mac48 (w + 4);
+  if (type == 1 || len < 24)
+    {
+      return f;               // control frames carry no transmitter address we need
+    }
+  f.addr2 = Mac48 (w + 10);
+  f.seqCtl = Le16 (w + 22);
+  if (type != 2)
+    {
+      return f;
+    }
+  f.data = true;
+  uint32_t hdr = 24;
+  if ((w[1] & 0x03) == 0x03)
+    {
+      hdr += 6;
+    }
+  if (w[0] & 0x80)
+    {
+      hdr += 2;              // QoS control
+    }
+  if (len >= hdr + 8 + 40 && w[hdr] == 0xaa && w[hdr + 1] == 0xaa && Be16 (w + hdr + 6) == 0x86dd)
+    {
+      f.ipv6 = w + hdr + 8;
+      f.ipv6Len = len - hdr - 8;
+    }
+  return f;
+}
+
+/*
+ * MAC that ns-3 derives an IPv6 autoconfigured address from (EUI-64 with
+ * ff:fe in the middle); 0 if the interface id is not EUI-64 shaped.
+ */
+uint64_t
+MacOfIpv6 (const uint8_t *addr)
+{
+  if (addr[11] != 0xff || addr[12] != 0xfe)
+    {
+      return 0;
+    }
+  uint8_t mac[6] = { static_cast<uint8_t> (addr[8] ^ 0x02), addr[9], addr[10], addr[13], addr[14], addr[15] };
+  return Mac48 (mac);
+}
+
+class Accumulator
+{
+public:
+  Accumulator (Partial &out)
+    : m_out (out)
+  {
+  }
+
+  void Transmitted (uint32_t node, uint64_t tNs, const FrameInfo &f, uint32_t frameLen, uint32_t rate500k)
+  {
+    NodeStats &n = m_out.nodes[node];
+    Span (tNs);
+    n.txFrames++;
+    n.txBytes += frameLen;
+    n.airtimeNs += AirtimeNs (frameLen, rate500k);
+    if (f.data)
+      {
+        n.txData++;
+        n.mac = f.addr2;
+        if (f.retry)
+          {
+            n.txRetries++;
+          }
+      }
+  }
+
+  void Received (uint32_t node, uint64_t nodeMac, uint64_t tNs, const FrameInfo &f)
+  {
+    NodeStats &n = m_out.nodes[node];
+    Span (tNs);
+    n.rxFrames++;
+    if (!f.data)
+      {
+        return;
+      }
+    // 802.11 duplicate detection: same transmitter, same sequence control
+    uint64_t key = (static_cast<uint64_t> (node) << 48) ^ f.addr2;
+    std::unordered_map<uint64_t, uint16_t>::iterator it = m_out.lastSeq.find (key);
+    if (it != m_out.lastSeq.end () && it->second == f.seqCtl && f.retry)
+      {
+        n.rxDuplicates++;
+        return;
+      }
+    m_out.lastSeq[key] = f.seqCtl;
+    if (!f.ipv6)
+      {
+        return;
+      }
+    const uint8_t *ip = f.ipv6;
+    bool multicast = ip[24] == 0xff;
+    if (!multicast && (nodeMac == 0 || f.addr1 != nodeMac || MacOfIpv6 (ip + 24) != nodeMac))
+      {
+        return;               // overheard, or forwarded on towards someone else
+      }
+    FlowKey k;
+    std::memcpy (k.src, ip + 8, 16);
+    std::memcpy (k.dst, ip + 24, 16);
+    k.proto = ip[6];
+    k.sport = k.dport = 0;
+    if ((k.proto == 17 || k.proto == 6) && f.ipv6Len >= 44)
+      {
+        k.sport = Be16 (ip + 40);
+        k.dport = Be16 (ip + 42);
+      }
+    FlowStats &s = m_out.flows[k];
+    s.packets++;
+    s.bytes += Be16 (ip + 4);
+    s.firstNs = std::min (s.firstNs, tNs);
+    s.lastNs = std::max (s.lastNs, tNs);
+    uint32_t hopLimit = ip[7];
+    uint32_t hops = (hopLimit <= 64 ? 64 : 255) - hopLimit + 1;
+    s.hopSum += hops;
+    s.hopMax = std::max (s.hopMax, hops);
+    n.delivered++;
+  }
+
+private:
+  void Span (uint64_t tNs)
+  {
+    m_out.records++;
+    m_out.firstNs = std::min (m_out.firstNs, tNs);
+    m_out.lastNs = std::max (m_out.lastNs, tNs);
+  }
+
+  Partial &m_out;
+};
+
+/*
+ * Read-only mapping of a whole file.
+ */
+class MappedFile
+{
+public:
+  MappedFile ()
+    : m_data (0), m_size (0)
+  {
+  }
+
+  ~MappedFile ()
+  {
+    if (m_data)
+      {
+        munmap (const_cast<uint8_t *> (m_data), m_size);
+      }
+  }
+
+  bool Open (const std::string &name)
+  {
+    int fd = open (name.c_str (), O_RDONLY);
+    if (fd < 0)
+      {
+        return false;
+      }
+    struct stat st;
+    if (fstat (fd, &st) != 0 || st.st_size == 0)
+      {
+        close (fd);
+        return false;
+      }
+    void *p = mmap (0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (p == MAP_FAILED)
+      {
+        return false;
+      }
+    madvise (p, st.st_size, MADV_SEQUENTIAL);
+    m_data = static_cast<const uint8_t *> (p);
+    m_size = st.st_size;
+    return true;
+  }
+
+  const uint8_t *GetData (void) const
+  {
+    return m_data;
+  }
+
+  size_t GetSize (void) const
+  {
+    return m_size;
+  }
+
+private:
+  const uint8_t *m_data;
+  size_t m_size;
+};
+
+/*
+ * "<prefix>-<node>-<device>.pcap" -> node.
+ */
+bool
+NodeFromName (const std::string &file, uint32_t &node)
+{
+  std::string base = file.substr (file.find_last_of ('/') + 1);
+  size_t dot = base.rfind ('.');
+  size_t dash2 = base.rfind ('-', dot);
+  if (dash2 == std::string::npos || dash2 == 0)
+    {
+      return false;
+    }
+  size_t dash1 = base.rfind ('-', dash2 - 1);
+  if (dash1 == std::string::npos)
+    {
+      return false;
+    }
+  std::string digits = base.substr (dash1 + 1, dash2 - dash1 - 1);
+  if (digits.empty () || digits.find_first_not_of ("0123456789") != std::string::npos)
+    {
+      return false;
+    }
+  node = std::atoi (digits.c_str ());
+  return true;
+}
+
+void
+AnalyzePcap (const MappedFile &map, uint32_t node, Partial &out)
+{
+  const uint8_t *p = map.GetData ();
+  size_t size = map.GetSize ();
+  uint32_t magic = Le32 (p);
+  bool nanos = magic == 0xa1b23c4d;
+  if (magic != 0xa1b2c3d4 && !nanos)
+    {
+      out.error = "not a little-endian pcap file";
+      return;
+    }
+  uint32_t linkType = Le32 (p + 20);
+  if (linkType != 127 && linkType != 105)
+    {
+      out.error = "link type is neither 802.11 nor radiotap";
+      return;
+    }
+
+  // The node's own MAC, from its first transmitted data frame
+  uint64_t nodeMac = 0;
+  for (size_t off = 24; off + 16 <= size && nodeMac == 0; )
+    {
+      uint32_t incl = Le32 (p + off + 8);
+      const uint8_t *rec = p + off + 16;
+      if (off + 16 + incl > size)
+        {
+          break;
+        }
+      Radiotap rt = { false, false, 0 };
+      uint32_t rtLen = 0;
+      if (linkType == 105 || ParseRadiotap (rec, incl, rt, rtLen))
+        {
+          FrameInfo f = ParseFrame (rec + rtLen, incl - rtLen);
+          if (f.data && !rt.hasSignal)
+            {
+              nodeMac = f.addr2;
+            }
+        }
+      off += 16 + incl;
+    }
+
+  Accumulator acc (out);
+  for (size_t off = 24; off + 16 <= size; )
+    {
+      uint64_t tNs = Le32 (p + off) * 1000000000ULL + Le32 (p + off + 4) * (nanos ? 1ULL : 1000ULL);
+      uint32_t incl = Le32 (p + off + 8);
+      uint32_t orig = Le32 (p + off + 12);
+      const uint8_t *rec = p + off + 16;
+      if (off + 16 + incl > size)
+        {
+          break;             // truncated last record
+        }
+      off += 16 + incl;
+      out.bytes += 16 + incl;
+      Radiotap rt = { false, false, 0 };
+      uint32_t rtLen = 0;
+      if (linkType == 127 && !ParseRadiotap (rec, incl, rt, rtLen))
+        {
+          continue;
+        }
+      uint32_t frameLen = orig - rtLen;
+      FrameInfo f = ParseFrame (rec + rtLen, incl - rtLen - (rt.fcs && incl - rtLen >= 4 ? 4 : 0));
+      if (!f.valid)
+        {
+          continue;
+        }
+      if (rt.hasSignal)
+        {
+          acc.Received (node, nodeMac, tNs, f);
+        }
+      else
+        {
+          acc.Transmitted (node, tNs, f, frameLen, rt.rate500k);
+        }
+    }
+}
+
+/*
+ * Merged capture from CrowdPcapngCapture: every frame once, on the
+ * sender's interface, with "rx=<node>:<dBm>,..." in the comment.
+ */
+void
+AnalyzePcapng (const MappedFile &map, Partial &out)
+{
+  const uint8_t *p = map.GetData ();
+  size_t size = map.GetSize ();
+  std::vector<uint32_t> ifaceNode;
+  std::vector<uint64_t> ifaceMac;
+  std::map<uint32_t, uint64_t> nodeMac;
+
+  // First pass: interfaces and the MAC each one transmits from
+  for (size_t off = 0; off + 12 <= size; )
+    {
+      uint32_t type = Le32 (p + off);
+      uint32_t len = Le32 (p + off + 4);
+      if (len < 12 || off + len > size)
+        {
+          break;
+        }
+      if (type == 1)
+        {
+          uint32_t node = ifaceNode.size ();
+          for (uint32_t o = 16; o + 4 <= len - 4; )
+            {
+              uint16_t code = Le16 (p + off + o);
+              uint16_t olen = Le16 (p + off + o + 2);
+              if (code == 0)
+                {
+                  break;
+                }
+              if (code == 2 && olen > 4 && std::memcmp (p + off + o + 4, "node", 4) == 0)
+                {
+                  node = std::atoi (std::string (reinterpret_cast<const char *> (p + off + o + 8), olen - 4).c_str ());
+                }
+              o += 4 + ((olen + 3) & ~3u);
+            }
+          ifaceNode.push_back (node);
+          ifaceMac.push_back (0);
+        }
+      else if (type == 6 && len >= 32)
+        {
+          uint32_t iface = Le32 (p + off + 8);
+          uint32_t cap = Le32 (p + off + 20);
+          Radiotap rt;
+          uint32_t rtLen;
+          // The captured length must fit in the block (len >= 32 here)
+          if (cap <= len - 28 && iface < ifaceMac.size () && ifaceMac[iface] == 0
+              && ParseRadiotap (p + off + 28, cap, rt, rtLen))
+            {
+              FrameInfo f = ParseFrame (p + off + 28 + rtLen, cap - rtLen);
+              if (f.data && !rt.hasSignal)
+                {
+                  ifaceMac[iface] = f.addr2;
+                  nodeMac[ifaceNode[iface]] = f.addr2;
+                }
+            }
+        }
+      off += len;
+    }
+
+  Accumulator acc (out);
+  for (size_t off = 0; off + 12 <= size; )
+    {
+      uint32_t type = Le32 (p + off);
+      uint32_t len = Le32 (p + off + 4);
+      if (len < 12 || off + len > size)
+        {
+          break;
+        }
+      const uint8_t *b = p + off;
+      off += len;
+      out.bytes += len;
+      if (type != 6 || len < 32)
+        {
+          continue;
+        }
+      uint32_t iface = Le32 (b + 8);
+      if (iface >= ifaceNode.size ())
+        {
+          continue;
+        }
+      uint64_t tNs = (static_cast<uint64_t> (Le32 (b + 12)) << 32) | Le32 (b + 16);
+      uint32_t cap = Le32 (b + 20);
+      uint32_t orig = Le32 (b + 24);
+      Radiotap rt;
+      uint32_t rtLen;
+      if (cap > len - 28 || !ParseRadiotap (b + 28, cap, rt, rtLen))
+        {
+          continue;
+        }
+      uint32_t frameLen = orig - rtLen;
+      FrameInfo f = ParseFrame (b + 28 + rtLen, cap - rtLen - (rt.fcs && cap - rtLen >= 4 && cap == orig ? 4 : 0));
+      if (!f.valid)
+        {
+          continue;
+        }
+      // The frame may be cut to the snap length: addresses and the IPv6
+      // header are what we read, and those are well within it
+      const char *comment = 0;
+      uint32_t commentLen = 0;
+      for (uint32_t o = 28 + ((cap + 3) & ~3u); o + 4 <= len - 4; )
+        {
+          uint16_t code = Le16 (b + o);
+          uint16_t olen = Le16 (b + o + 2);
+          if (code == 0)
+            {
+              break;
+            }
+          if (code == 1)
+            {
+              comment = reinterpret_cast<const char *> (b + o + 4);
+              commentLen = olen;
+            }
+          o += 4 + ((olen + 3) & ~3u);
+        }
+      uint32_t node = ifaceNode[iface];
+      if (commentLen >= 7 && std::strncmp (comment, "rx-only", 7) == 0)
+        {
+          acc.Received (node, nodeMac[node], tNs, f);
+          continue;
+        }
+      acc.Transmitted (node, tNs, f, frameLen, rt.rate500k);
+      if (commentLen < 3 || std::strncmp (comment, "rx=", 3) != 0)
+        {
+          continue;
+        }
+      for (uint32_t i = 3; i < commentLen; )
+        {
+          uint32_t rx = 0;
+          while (i < commentLen && comment[i] >= '0' && comment[i] <= '9')
+            {
+              rx = rx * 10 + (comment[i++] - '0');
+            }
+          acc.Received (rx, nodeMac[rx], tNs, f);
+          while (i < commentLen && comment[i] != ',')
+            {
+              i++;
+            }
+          i++;
+        }
+    }
+}
+
+void
+AnalyzeFile (const std::string &file, uint32_t fallbackNode, Partial &out)
+{
+  MappedFile map;
+  if (!map.Open (file))
+    {
+      out.error = "cannot map";
+      return;
+    }
+  if (map.GetSize () >= 4 && Le32 (map.GetData ()) == 0x0a0d0d0a)
+    {
+      AnalyzePcapng (map, out);
+      return;
+    }
+  if (map.GetSize () < 24)
+    {
+      out.error = "too short for a pcap file";
+      return;
+    }
+  uint32_t node = fallbackNode;
+  NodeFromName (file, node);
+  AnalyzePcap (map, node, out);
+}
+
+void
+Merge (Partial &into, const Partial &from)
+{
+  for (std::map<uint32_t, NodeStats>::const_iterator i = from.nodes.begin (); i != from.nodes.end (); ++i)
+    {
+      NodeStats &n = into.nodes[i->first];
+      const NodeStats &m = i->second;
+      n.mac = n.mac ? n.mac : m.mac;
+      n.txFrames += m.txFrames;
+      n.txBytes += m.txBytes;
+      n.txData += m.txData;
+      n.txRetries += m.txRetries;
+      n.airtimeNs += m.airtimeNs;
+      n.rxFrames += m.rxFrames;
+      n.rxDuplicates += m.rxDuplicates;
+      n.delivered += m.delivered;
+    }
+  for (FlowTable::const_iterator i = from.flows.begin (); i != from.flows.end (); ++i)
+    {
+      FlowStats &s = into.flows[i->first];
+      s.packets += i->second.packets;
+      s.bytes += i->second.bytes;
+      s.firstNs = std::min (s.firstNs, i->second.firstNs);
+      s.lastNs = std::max (s.lastNs, i->second.lastNs);
+      s.hopSum += i->second.hopSum;
+      s.hopMax = std::max (s.hopMax, i->second.hopMax);
+    }
+  into.records += from.records;
+  into.bytes += from.bytes;
+  into.firstNs = std::min (into.firstNs, from.firstNs);
+  into.lastNs = std::max (into.lastNs, from.lastNs);
+}
+
+std::string
+FormatIpv6 (const uint8_t *a)
+{
+  char buf[48];
+  std::snprintf (buf, sizeof (buf), "%x:%x:%x:%x:%x:%x:%x:%x",
+                 Be16 (a), Be16 (a + 2), Be16 (a + 4), Be16 (a + 6),
+                 Be16 (a + 8), Be16 (a + 10), Be16 (a + 12), Be16 (a + 14));
+  return buf;
+}
+
+std::string
+FormatMac (uint64_t mac)
+{
+  char buf[24];
+  std::snprintf (buf, sizeof (buf), "%02x:%02x:%02x:%02x:%02x:%02x",
+                 unsigned (mac >> 40) & 0xff, unsigned (mac >> 32) & 0xff, unsigned (mac >> 24) & 0xff,
+                 unsigned (mac >> 16) & 0xff, unsigned (mac >> 8) & 0xff, unsigned (mac) & 0xff);
+  return buf;
+}
+
+double
+Now (void)
+{
+  struct timeval tv;
+  gettimeofday (&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+void
+Report (const Partial &all, std::ostream &os, std::ostream *nodesCsv, std::ostream *flowsCsv)
+{
+  double span = all.lastNs > all.firstNs ? (all.lastNs - all.firstNs) / 1e9 : 0.0;
+  char line[256];
+
+  os << "Nodes (capture span " << span << " s)" << std::endl;
+  std::snprintf (line, sizeof (line), "%5s %-17s %9s %9s %8s %10s %7s %9s %7s %9s\n",
+                 "node", "mac", "tx", "tx MB", "retry%", "airtime s", "air%", "rx", "dup", "delivered");
+  os << line;
+  if (nodesCsv)
+    {
+      *nodesCsv << "node,mac,tx_frames,tx_bytes,tx_data,tx_retries,airtime_s,rx_frames,rx_duplicates,delivered\n";
+    }
+  for (std::map<uint32_t, NodeStats>::const_iterator i = all.nodes.begin (); i != all.nodes.end (); ++i)
+    {
+      const NodeStats &n = i->second;
+      double air = n.airtimeNs / 1e9;
+      std::snprintf (line, sizeof (line), "%5u %-17s %9llu %9.2f %8.2f %10.3f %7.2f %9llu %7llu %9llu\n",
+                     i->first, FormatMac (n.mac).c_str (), (unsigned long long) n.txFrames,
+                     n.txBytes / 1e6, n.txData ? 100.0 * n.txRetries / n.txData : 0.0, air,
+                     span > 0 ? 100.0 * air / span : 0.0, (unsigned long long) n.rxFrames,
+                     (unsigned long long) n.rxDuplicates, (unsigned long long) n.delivered);
+      os << line;
+      if (nodesCsv)
+        {
+          *nodesCsv << i->first << "," << FormatMac (n.mac) << "," << n.txFrames << "," << n.txBytes << ","
+                    << n.txData << "," << n.txRetries << "," << air << "," << n.rxFrames << ","
+                    << n.rxDuplicates << "," << n.delivered << "\n";
+        }
+    }
+
+  // Busiest flows first
+  std::vector<std::pair<uint64_t, FlowTable::const_iterator> > order;
+  for (FlowTable::const_iterator i = all.flows.begin (); i != all.flows.end (); ++i)
+    {
+      order.push_back (std::make_pair (i->second.bytes, i));
+    }
+  std::sort (order.begin (), order.end (),
+             [] (const std::pair<uint64_t, FlowTable::const_iterator> &a,
+                 const std::pair<uint64_t, FlowTable::const_iterator> &b) { return a.first > b.first; });
+
+  os << std::endl << "Flows (delivered at the destination)" << std::endl;
+  std::snprintf (line, sizeof (line), "%-40s %-40s %5s %11s %9s %11s %9s %7s\n",
+                 "source", "destination", "proto", "ports", "packets", "bytes", "kbit/s", "hops");
+  os << line;
+  if (flowsCsv)
+    {
+      *flowsCsv << "src,dst,proto,sport,dport,packets,bytes,first_s,last_s,kbps,mean_hops,max_hops\n";
+    }
+  for (size_t j = 0; j < order.size (); j++)
+    {
+      const FlowKey &k = order[j].second->first;
+      const FlowStats &s = order[j].second->second;
+      double kbps = span > 0 ? s.bytes * 8 / span / 1e3 : 0.0;
+      char kbpsText[24];
+      std::snprintf (kbpsText, sizeof (kbpsText), span > 0 ? "%.3f" : "-", kbps);
+      double hops = s.packets ? double (s.hopSum) / s.packets : 0.0;
+      char ports[16];
+      std::snprintf (ports, sizeof (ports), "%u>%u", k.sport, k.dport);
+      char hopText[16];
+      std::snprintf (hopText, sizeof (hopText), "%.1f/%u", hops, s.hopMax);
+      std::snprintf (line, sizeof (line), "%-40s %-40s %5u %11s %9llu %11llu %9s %7s\n",
+                     FormatIpv6 (k.src).c_str (), FormatIpv6 (k.dst).c_str (), k.proto, ports,
+                     (unsigned long long) s.packets, (unsigned long long) s.bytes, kbpsText, hopText);
+      os << line;
+      if (flowsCsv)
+        {
+          *flowsCsv << FormatIpv6 (k.src) << "," << FormatIpv6 (k.dst) << "," << unsigned (k.proto) << ","
+                    << k.sport << "," << k.dport << "," << s.packets << "," << s.bytes << ","
+                    << s.firstNs / 1e9 << "," << s.lastNs / 1e9 << ","
+                    << (span > 0 ? kbpsText : "") << "," << hops << ","
+                    << s.hopMax << "\n";
+        }
+    }
+}
+
+} // namespace
+
+int main (int argc, char *argv[])
+{
+  unsigned threads = std::max (1u, std::thread::hardware_concurrency ());
+  std::string csv;
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; i++)
+    {
+      std::string arg = argv[i];
+      if (arg.compare (0, 10, "--threads=") == 0)
+        {
+          threads = std::max (1, std::atoi (arg.c_str () + 10));
+        }
+      else if (arg.compare (0, 6, "--csv=") == 0)
+        {
+          csv = arg.substr (6);
+        }
+      else
+        {
+          files.push_back (arg);
+        }
+    }
+  if (files.empty ())
+    {
+      std::cerr << "usage: " << argv[0] << " [--threads=N] [--csv=prefix] <capture>..." << std::endl;
+      return 2;
+    }
+
+  double start = Now ();
+  std::vector<Partial> partials (files.size ());
+  std::atomic<size_t> next (0);
+  std::vector<std::thread> workers;
+  threads = std::min<unsigned> (threads, files.size ());
+  for (unsigned t = 0; t < threads; t++)
+    {
+      workers.push_back (std::thread ([&] ()
+        {
+          for (size_t f = next++; f < files.size (); f = next++)
+            {
+              AnalyzeFile (files[f], f, partials[f]);
+            }
+        }));
+    }
+  for (size_t t = 0; t < workers.size (); t++)
+    {
+      workers[t].join ();
+    }
+  double parsed = Now ();
+
+  Partial all;
+  int status = 0;
+  for (size_t f = 0; f < files.size (); f++)
+    {
+      if (!partials[f].error.empty ())
+        {
+          std::cerr << files[f] << ": " << partials[f].error << std::endl;
+          status = 1;
+          continue;
+        }
+      Merge (all, partials[f]);
+    }
+
+  std::ofstream nodesCsv, flowsCsv;
+  if (!csv.empty ())
+    {
+      nodesCsv.open ((csv + "-nodes.csv").c_str ());
+      flowsCsv.open ((csv + "-flows.csv").c_str ());
+    }
+  Report (all, std::cout, csv.empty () ? 0 : &nodesCsv, csv.empty () ? 0 : &flowsCsv);
+  std::fprintf (stderr, "%zu files, %llu records, %.1f MB parsed in %.3f s (%.0f MB/s, %u threads)\n",
+                files.size (), (unsigned long long) all.records, all.bytes / 1e6, parsed - start,
+                (parsed - start) > 0 ? all.bytes / 1e6 / (parsed - start) : 0.0, threads);
+  return status;
+}
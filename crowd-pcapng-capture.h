@@ -0,0 +1,430 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Single-file pcapng capture for all Wi-Fi devices of a scenario.
+ *
+ * WifiPhyHelper::EnablePcap writes one pcap per device, synchronously and in
+ * full, so a frame heard by twenty nodes is written twenty-one times. Here
+ * every device becomes one pcapng interface, and each transmitted frame is
+ * written once, on the sender's interface, with the nodes that received it
+ * (and at what signal level) in the packet comment. Frames are cut to
+ * snapLen bytes, which by default keeps the 802.11, LLC, IP and transport
+ * headers and drops the payload.
+ *
+ * A frame is held for holdTime after its transmission to collect the
+ * receptions, then handed to the asynchronous writer. A reception whose
+ * transmission was not seen is held as a frame of its own, on the
+ * receiver's interface, so that the file stays in time order.
+ *
+ * With SetTriggered nothing is written until Trigger () is called (see
+ * crowd-capture-trigger.h for the conditions). Until then each device
+ * keeps its last preTrigger worth of frames, at most ringFrames of them,
+ * in a ring. A trigger opens a window from preTrigger before it to
+ * postTrigger after it, flushes the rings' frames in that window and
+ * writes everything else that falls inside; a trigger within an open
+ * window extends it. The first frame after the trigger that opened a
+ * window carries the trigger's reason in its comment.
+ */
+
+#ifndef CROWD_PCAPNG_CAPTURE_H
+#define CROWD_PCAPNG_CAPTURE_H
+
+#include "ns3/wifi-net-device.h"
+#include "ns3/wifi-phy.h"
+#include "ns3/wifi-tx-vector.h"
+#include "ns3/net-device-container.h"
+#include "ns3/node.h"
+#include "ns3/packet.h"
+#include "ns3/simulator.h"
+#include "ns3/abort.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "crowd-pcapng-writer.h"
+
+namespace ns3 {
+
+class CrowdPcapngCapture
+{
+public:
+  CrowdPcapngCapture ()
+    : m_snapLen (128),
+      m_frames (0),
+      m_receptions (0),
+      m_orphans (0),
+      m_triggered (false),
+      m_preNs (0),
+      m_postNs (0),
+      m_ringFrames (0),
+      m_windowFrom (0),
+      m_windowUntil (-1),
+      m_noteNs (0),
+      m_triggers (0),
+      m_discarded (0)
+  {
+  }
+
+  ~CrowdPcapngCapture ()
+  {
+    Close ();
+  }
+
+  bool Open (std::string filename, uint32_t snapLen = 128, Time holdTime = MilliSeconds (50))
+  {
+    m_snapLen = snapLen;
+    m_holdNs = holdTime.GetNanoSeconds ();
+    return m_writer.Open (filename);
+  }
+
+  /*
+   * Only write frames around triggers, keeping preTrigger of lead-up per
+   * device. Call before Install ().
+   */
+  void SetTriggered (Time preTrigger, Time postTrigger, uint32_t ringFrames = 256)
+  {
+    m_triggered = true;
+    m_preNs = preTrigger.GetNanoSeconds ();
+    m_postNs = postTrigger.GetNanoSeconds ();
+    m_ringFrames = ringFrames;
+  }
+
+  /*
+   * Open, or extend, a capture window around now.
+   */
+  void Trigger (std::string reason)
+  {
+    if (!m_triggered || !m_writer.IsOpen ())
+      {
+        return;
+      }
+    int64_t now = Simulator::Now ().GetNanoSeconds ();
+    m_triggers++;
+    if (now - m_preNs > m_windowUntil)
+      {
+        m_windowFrom = now - m_preNs;
+        m_noteNs = now;
+        std::ostringstream note;
+        note << "trigger " << reason << " at " << Simulator::Now ().GetSeconds () << " s";
+        m_note = note.str ();
+      }
+    m_windowUntil = std::max (m_windowUntil, now + m_postNs);
+    // The lead-up, oldest first
+    m_flush.clear ();
+    for (uint32_t r = 0; r < m_rings.size (); r++)
+      {
+        for (std::deque<uint32_t>::const_iterator i = m_rings[r].begin (); i != m_rings[r].end (); ++i)
+          {
+            if (InWindow (m_slots[*i].timeNs))
+              {
+                m_flush.push_back (std::make_pair (m_slots[*i].timeNs, *i));
+              }
+            else
+              {
+                m_discarded++;
+                m_free.push_back (*i);
+              }
+          }
+        m_rings[r].clear ();
+      }
+    std::sort (m_flush.begin (), m_flush.end ());
+    for (uint32_t i = 0; i < m_flush.size (); i++)
+      {
+        Write (m_slots[m_flush[i].second]);
+        m_free.push_back (m_flush[i].second);
+      }
+  }
+
+  /*
+   * Add one interface per device and hook its sniffer traces. Call once,
+   * after Open () and before the simulation starts.
+   */
+  void Install (NetDeviceContainer devices)
+  {
+    NS_ABORT_MSG_UNLESS (m_writer.IsOpen (), "CrowdPcapngCapture::Install before Open");
+    for (NetDeviceContainer::Iterator i = devices.Begin (); i != devices.End (); ++i)
+      {
+        Ptr<WifiNetDevice> dev = DynamicCast<WifiNetDevice> (*i);
+        NS_ABORT_MSG_UNLESS (dev, "CrowdPcapngCapture only handles Wi-Fi devices");
+        uint32_t node = dev->GetNode ()->GetId ();
+        std::ostringstream name;
+        name << "node" << node << "-dev" << dev->GetIfIndex ();
+        uint32_t iface = m_writer.AddInterface (name.str (),
+                                                crowd::PcapngWriter::LINKTYPE_IEEE802_11_RADIOTAP,
+                                                m_snapLen + RADIOTAP_LEN);
+        m_ifaceNode.push_back (node);
+        Ptr<WifiPhy> phy = dev->GetPhy ();
+        phy->TraceConnectWithoutContext ("MonitorSnifferTx",
+                                         MakeBoundCallback (&CrowdPcapngCapture::SnifferTx, this, iface));
+        phy->TraceConnectWithoutContext ("MonitorSnifferRx",
+                                         MakeBoundCallback (&CrowdPcapngCapture::SnifferRx, this, iface));
+      }
+    m_rings.resize (m_ifaceNode.size ());
+    m_writer.Start ();
+  }
+
+  /*
+   * Write out the frames still held and close the file.
+   */
+  void Close (void)
+  {
+    if (!m_writer.IsOpen ())
+      {
+        return;
+      }
+    while (!m_fifo.empty ())
+      {
+        EmitOldest ();
+      }
+    for (uint32_t r = 0; r < m_rings.size (); r++)
+      {
+        m_discarded += m_rings[r].size ();
+        m_rings[r].clear ();
+      }
+    m_writer.Close ();
+  }
+
+  void PrintStats (std::ostream &os) const
+  {
+    os << "capture: " << m_frames << " frames, " << m_receptions << " receptions folded into them, "
+       << m_orphans << " unmatched receptions, " << m_writer.GetDropped () << " dropped, "
+       << m_writer.GetBytes () << " bytes";
+    if (m_triggered)
+      {
+        os << ", " << m_triggers << " triggers, " << m_discarded << " frames outside the windows not written";
+      }
+    os << std::endl;
+  }
+
+private:
+  enum { RADIOTAP_LEN = 14 };
+
+  struct Pending
+  {
+    uint64_t uid;
+    uint32_t iface;
+    int64_t timeNs;
+    uint8_t radiotap[RADIOTAP_LEN];
+    std::vector<uint8_t> bytes;
+    uint32_t origLen;
+    std::string receivers;
+    bool orphan;                // a reception without its transmission
+  };
+
+  static void FillRadiotap (uint8_t *rt, uint16_t freqMhz, const WifiTxVector &txVector)
+  {
+    uint64_t rate = txVector.GetMode ().GetDataRate (txVector);
+    uint16_t chanFlags = freqMhz >= 5000 ? 0x0100 : 0x0080;   // 5 GHz : 2 GHz
+    chanFlags |= txVector.GetMode ().GetModulationClass () == WIFI_MOD_CLASS_DSSS
+      || txVector.GetMode ().GetModulationClass () == WIFI_MOD_CLASS_HR_DSSS ? 0x0020 : 0x0040;
+    rt[0] = 0;                      // version
+    rt[1] = 0;
+    rt[2] = RADIOTAP_LEN;
+    rt[3] = 0;
+    rt[4] = 0x0e;                   // flags, rate, channel
+    rt[5] = rt[6] = rt[7] = 0;
+    rt[8] = 0x10;                   // frame includes FCS
+    rt[9] = static_cast<uint8_t> (rate / 500000);
+    rt[10] = static_cast<uint8_t> (freqMhz);
+    rt[11] = static_cast<uint8_t> (freqMhz >> 8);
+    rt[12] = static_cast<uint8_t> (chanFlags);
+    rt[13] = static_cast<uint8_t> (chanFlags >> 8);
+  }
+
+  static void SnifferTx (CrowdPcapngCapture *capture, uint32_t iface, Ptr<const Packet> packet,
+                         uint16_t channelFreqMhz, WifiTxVector txVector, MpduInfo aMpdu)
+  {
+    capture->Transmitted (iface, packet, channelFreqMhz, txVector);
+  }
+
+  static void SnifferRx (CrowdPcapngCapture *capture, uint32_t iface, Ptr<const Packet> packet,
+                         uint16_t channelFreqMhz, WifiTxVector txVector, MpduInfo aMpdu,
+                         SignalNoiseDbm signalNoise)
+  {
+    capture->Received (iface, packet, channelFreqMhz, txVector, signalNoise.signal);
+  }
+
+  void Transmitted (uint32_t iface, Ptr<const Packet> packet, uint16_t freqMhz,
+                    const WifiTxVector &txVector)
+  {
+    int64_t now = Simulator::Now ().GetNanoSeconds ();
+    Expire (now);
+    uint32_t slot = Hold (iface, now, packet, freqMhz, txVector);
+    // A retransmission replaces the older entry as the match for receptions
+    m_byUid[m_slots[slot].uid] = slot;
+  }
+
+  /*
+   * Copy a frame into a free slot at the back of the hold queue.
+   */
+  uint32_t Hold (uint32_t iface, int64_t now, Ptr<const Packet> packet, uint16_t freqMhz,
+                 const WifiTxVector &txVector)
+  {
+    uint32_t slot;
+    if (m_free.empty ())
+      {
+        slot = m_slots.size ();
+        m_slots.push_back (Pending ());
+      }
+    else
+      {
+        slot = m_free.back ();
+        m_free.pop_back ();
+      }
+    Pending &p = m_slots[slot];
+    p.uid = packet->GetUid ();
+    p.iface = iface;
+    p.timeNs = now;
+    FillRadiotap (p.radiotap, freqMhz, txVector);
+    p.origLen = packet->GetSize ();
+    p.bytes.resize (std::min (m_snapLen, p.origLen));
+    if (!p.bytes.empty ())
+      {
+        packet->CopyData (&p.bytes[0], p.bytes.size ());
+      }
+    p.receivers.clear ();
+    p.orphan = false;
+    m_fifo.push_back (slot);
+    return slot;
+  }
+
+  void Received (uint32_t iface, Ptr<const Packet> packet, uint16_t freqMhz,
+                 const WifiTxVector &txVector, double signalDbm)
+  {
+    int64_t now = Simulator::Now ().GetNanoSeconds ();
+    char note[48];
+    std::snprintf (note, sizeof (note), "%u:%.1f", m_ifaceNode[iface], signalDbm);
+    std::unordered_map<uint64_t, uint32_t>::iterator it = m_byUid.find (packet->GetUid ());
+    if (it != m_byUid.end ())
+      {
+        Pending &p = m_slots[it->second];
+        p.receivers += p.receivers.empty () ? "rx=" : ",";
+        p.receivers += note;
+        m_receptions++;
+        Expire (now);
+        return;
+      }
+    // The transmission was not seen (or has already been written out):
+    // queued behind the frames still held, as it is newer than all of them
+    Expire (now);
+    Pending &p = m_slots[Hold (iface, now, packet, freqMhz, txVector)];
+    p.receivers = std::string ("rx-only ") + note;
+    p.orphan = true;
+    m_orphans++;
+  }
+
+  void Expire (int64_t now)
+  {
+    while (!m_fifo.empty () && now - m_slots[m_fifo.front ()].timeNs > m_holdNs)
+      {
+        EmitOldest ();
+      }
+  }
+
+  void EmitOldest (void)
+  {
+    uint32_t slot = m_fifo.front ();
+    m_fifo.pop_front ();
+    Pending &p = m_slots[slot];
+    std::unordered_map<uint64_t, uint32_t>::iterator it = m_byUid.find (p.uid);
+    if (it != m_byUid.end () && it->second == slot)
+      {
+        m_byUid.erase (it);
+      }
+    if (m_triggered && !InWindow (p.timeNs))
+      {
+        Keep (slot);
+        return;
+      }
+    Write (p);
+    m_free.push_back (slot);
+  }
+
+  void Write (const Pending &p)
+  {
+    std::string comment = p.receivers;
+    if (!m_note.empty () && p.timeNs >= m_noteNs)
+      {
+        comment = comment.empty () ? m_note : m_note + " " + comment;
+        m_note.clear ();
+      }
+    m_writer.WritePacket (p.iface, p.timeNs, p.radiotap, RADIOTAP_LEN,
+                          p.bytes.empty () ? 0 : &p.bytes[0], p.bytes.size (), p.origLen,
+                          comment);
+    if (!p.orphan)
+      {
+        m_frames++;
+      }
+  }
+
+  bool InWindow (int64_t timeNs) const
+  {
+    return timeNs >= m_windowFrom && timeNs <= m_windowUntil;
+  }
+
+  /*
+   * Put a frame outside any window in its device's ring, dropping what
+   * has aged past preTrigger or overflows it.
+   */
+  void Keep (uint32_t slot)
+  {
+    std::deque<uint32_t> &ring = m_rings[m_slots[slot].iface];
+    ring.push_back (slot);
+    int64_t oldest = m_slots[slot].timeNs - m_preNs;
+    while (!ring.empty () && (ring.size () > m_ringFrames || m_slots[ring.front ()].timeNs < oldest))
+      {
+        m_free.push_back (ring.front ());
+        ring.pop_front ();
+        m_discarded++;
+      }
+  }
+
+  crowd::PcapngWriter m_writer;
+  uint32_t m_snapLen;
+  int64_t m_holdNs;
+  std::vector<uint32_t> m_ifaceNode;
+  std::vector<Pending> m_slots;
+  std::vector<uint32_t> m_free;
+  std::deque<uint32_t> m_fifo;
+  std::unordered_map<uint64_t, uint32_t> m_byUid;
+  uint64_t m_frames;
+  uint64_t m_receptions;
+  uint64_t m_orphans;
+
+  bool m_triggered;
+  int64_t m_preNs;
+  int64_t m_postNs;
+  uint32_t m_ringFrames;
+  std::vector<std::deque<uint32_t> > m_rings;     // slots, per interface
+  std::vector<std::pair<int64_t, uint32_t> > m_flush;
+  int64_t m_windowFrom;
+  int64_t m_windowUntil;
+  std::string m_note;
+  int64_t m_noteNs;
+  uint64_t m_triggers;
+  uint64_t m_discarded;
+};
+
+} // namespace ns3
+
+#endif /* CROWD_PCAPNG_CAPTURE_H */
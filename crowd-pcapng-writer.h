@@ -0,0 +1,396 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Asynchronous pcapng file writer.
+ *
+ * The caller (the simulator thread) serializes each Enhanced Packet Block
+ * into a scratch buffer and pushes it into a single-producer single-consumer
+ * byte ring; a dedicated thread drains the ring to disk. The producer never
+ * takes a lock and never waits: if the ring is full the block is dropped and
+ * counted, so size the ring for the capture rate.
+ *
+ * All interfaces must be added before the first packet is written, since
+ * pcapng wants every Interface Description Block ahead of the packets that
+ * refer to it. Timestamps are in nanoseconds (if_tsresol 9).
+ */
+
+#ifndef CROWD_PCAPNG_WRITER_H
+#define CROWD_PCAPNG_WRITER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace crowd {
+
+/*
+ * Lock-free ring of length-prefixed byte records, one producer thread and
+ * one consumer thread.
+ */
+class SpscByteRing
+{
+public:
+  explicit SpscByteRing (size_t capacityLog2 = 24)
+    : m_buf (size_t (1) << capacityLog2),
+      m_mask ((size_t (1) << capacityLog2) - 1),
+      m_head (0),
+      m_tail (0)
+  {
+  }
+
+  bool TryPush (const uint8_t *data, uint32_t len)
+  {
+    uint64_t head = m_head.load (std::memory_order_relaxed);
+    uint64_t tail = m_tail.load (std::memory_order_acquire);
+    if (m_buf.size () - (head - tail) < len + 4u)
+      {
+        return false;
+      }
+    uint8_t prefix[4];
+    std::memcpy (prefix, &len, 4);
+    Copy (head, prefix, 4);
+    Copy (head + 4, data, len);
+    m_head.store (head + 4 + len, std::memory_order_release);
+    return true;
+  }
+
+  /*
+   * Pop one record into out; false if the ring is empty.
+   */
+  bool TryPop (std::vector<uint8_t> &out)
+  {
+    uint64_t tail = m_tail.load (std::memory_order_relaxed);
+    uint64_t head = m_head.load (std::memory_order_acquire);
+    if (head == tail)
+      {
+        return false;
+      }
+    uint32_t len;
+    uint8_t prefix[4];
+    Read (tail, prefix, 4);
+    std::memcpy (&len, prefix, 4);
+    out.resize (len);
+    if (len > 0)
+      {
+        Read (tail + 4, &out[0], len);
+      }
+    m_tail.store (tail + 4 + len, std::memory_order_release);
+    return true;
+  }
+
+private:
+  void Copy (uint64_t pos, const uint8_t *src, size_t len)
+  {
+    size_t off = pos & m_mask;
+    size_t first = std::min (len, m_buf.size () - off);
+    std::memcpy (&m_buf[off], src, first);
+    std::memcpy (&m_buf[0], src + first, len - first);
+  }
+
+  void Read (uint64_t pos, uint8_t *dst, size_t len) const
+  {
+    size_t off = pos & m_mask;
+    size_t first = std::min (len, m_buf.size () - off);
+    std::memcpy (dst, &m_buf[off], first);
+    std::memcpy (dst + first, &m_buf[0], len - first);
+  }
+
+  std::vector<uint8_t> m_buf;
+  size_t m_mask;
+  std::atomic<uint64_t> m_head;
+  std::atomic<uint64_t> m_tail;
+};
+
+class PcapngWriter
+{
+public:
+  enum
+  {
+    LINKTYPE_IEEE802_11 = 105,
+    LINKTYPE_IEEE802_11_RADIOTAP = 127
+  };
+
+  PcapngWriter ()
+    : m_file (0),
+      m_ring (0),
+      m_stop (false),
+      m_interfaces (0),
+      m_written (0),
+      m_dropped (0),
+      m_bytes (0)
+  {
+  }
+
+  ~PcapngWriter ()
+  {
+    Close ();
+    delete m_ring;
+  }
+
+  /*
+   * ringLog2 sizes the queue between the simulator and the writer thread
+   * (2^ringLog2 bytes).
+   */
+  bool Open (const std::string &filename, size_t ringLog2 = 24)
+  {
+    Close ();
+    m_file = std::fopen (filename.c_str (), "wb");
+    if (!m_file)
+      {
+        return false;
+      }
+    delete m_ring;
+    m_ring = new SpscByteRing (ringLog2);
+    m_interfaces = 0;
+    m_written = 0;
+    m_dropped = 0;
+    m_bytes = 0;
+
+    // Section Header Block
+    m_block.clear ();
+    Put32 (0x0A0D0D0A);
+    Put32 (0);
+    Put32 (0x1A2B3C4D);
+    Put16 (1);
+    Put16 (0);
+    Put32 (0xffffffff);   // section length unknown
+    Put32 (0xffffffff);
+    EndOptions ();
+    FinishBlock ();
+    WriteDirect ();
+    return true;
+  }
+
+  bool IsOpen (void) const
+  {
+    return m_file != 0;
+  }
+
+  /*
+   * Returns the interface id used by WritePacket.
+   */
+  uint32_t AddInterface (const std::string &name, uint16_t linkType, uint32_t snapLen)
+  {
+    m_block.clear ();
+    Put32 (1);
+    Put32 (0);
+    Put16 (linkType);
+    Put16 (0);
+    Put32 (snapLen);
+    PutOption (2, reinterpret_cast<const uint8_t *> (name.data ()), name.size ());
+    uint8_t tsresol = 9;
+    PutOption (9, &tsresol, 1);
+    EndOptions ();
+    FinishBlock ();
+    WriteDirect ();
+    return m_interfaces++;
+  }
+
+  /*
+   * Start the writer thread; call once all interfaces are added.
+   */
+  void Start (void)
+  {
+    m_stop = false;
+    m_thread = std::thread (&PcapngWriter::WriterLoop, this);
+  }
+
+  /*
+   * Queue one Enhanced Packet Block holding prefix followed by the first
+   * capLen of origLen frame bytes. prefix is an optional pseudo-header such
+   * as radiotap and counts towards both lengths; comment may be empty.
+   */
+  void WritePacket (uint32_t interface, uint64_t timeNs,
+                    const uint8_t *prefix, uint32_t prefixLen,
+                    const uint8_t *data, uint32_t capLen, uint32_t origLen,
+                    const std::string &comment)
+  {
+    m_block.clear ();
+    Put32 (6);
+    Put32 (0);
+    Put32 (interface);
+    Put32 (static_cast<uint32_t> (timeNs >> 32));
+    Put32 (static_cast<uint32_t> (timeNs));
+    Put32 (prefixLen + capLen);
+    Put32 (prefixLen + origLen);
+    PutBytes (prefix, prefixLen);
+    PutBytes (data, capLen);
+    Pad ();
+    if (!comment.empty ())
+      {
+        PutOption (1, reinterpret_cast<const uint8_t *> (comment.data ()), comment.size ());
+        EndOptions ();
+      }
+    FinishBlock ();
+    if (m_ring->TryPush (&m_block[0], m_block.size ()))
+      {
+        m_written++;
+      }
+    else
+      {
+        m_dropped++;
+      }
+  }
+
+  /*
+   * Drain the queue, stop the writer thread and close the file.
+   */
+  void Close (void)
+  {
+    if (!m_file)
+      {
+        return;
+      }
+    m_stop = true;
+    if (m_thread.joinable ())
+      {
+        m_thread.join ();
+      }
+    else
+      {
+        WriterLoop ();
+      }
+    std::fclose (m_file);
+    m_file = 0;
+  }
+
+  uint64_t GetWritten (void) const
+  {
+    return m_written;
+  }
+
+  uint64_t GetDropped (void) const
+  {
+    return m_dropped;
+  }
+
+  /*
+   * Bytes that reached the file; only stable after Close ().
+   */
+  uint64_t GetBytes (void) const
+  {
+    return m_bytes;
+  }
+
+private:
+  PcapngWriter (const PcapngWriter &);
+  PcapngWriter &operator= (const PcapngWriter &);
+
+  void Put16 (uint16_t v)
+  {
+    m_block.push_back (static_cast<uint8_t> (v));
+    m_block.push_back (static_cast<uint8_t> (v >> 8));
+  }
+
+  void Put32 (uint32_t v)
+  {
+    for (int i = 0; i < 4; i++)
+      {
+        m_block.push_back (static_cast<uint8_t> (v >> (8 * i)));
+      }
+  }
+
+  void PutBytes (const uint8_t *p, size_t len)
+  {
+    if (len > 0)
+      {
+        m_block.insert (m_block.end (), p, p + len);
+      }
+  }
+
+  void Pad (void)
+  {
+    while (m_block.size () % 4)
+      {
+        m_block.push_back (0);
+      }
+  }
+
+  void PutOption (uint16_t code, const uint8_t *value, size_t len)
+  {
+    Put16 (code);
+    Put16 (static_cast<uint16_t> (len));
+    PutBytes (value, len);
+    Pad ();
+  }
+
+  void EndOptions (void)
+  {
+    Put16 (0);
+    Put16 (0);
+  }
+
+  void FinishBlock (void)
+  {
+    uint32_t total = m_block.size () + 4;
+    Put32 (total);
+    for (int i = 0; i < 4; i++)
+      {
+        m_block[4 + i] = static_cast<uint8_t> (total >> (8 * i));
+      }
+  }
+
+  void WriteDirect (void)
+  {
+    std::fwrite (&m_block[0], 1, m_block.size (), m_file);
+    m_bytes += m_block.size ();
+  }
+
+  void WriterLoop (void)
+  {
+    std::vector<uint8_t> record;
+    for (;;)
+      {
+        bool stopping = m_stop.load ();
+        bool any = false;
+        while (m_ring->TryPop (record))
+          {
+            std::fwrite (&record[0], 1, record.size (), m_file);
+            m_bytes += record.size ();
+            any = true;
+          }
+        if (stopping)
+          {
+            return;
+          }
+        if (!any)
+          {
+            std::this_thread::sleep_for (std::chrono::microseconds (500));
+          }
+      }
+  }
+
+  std::FILE *m_file;
+  SpscByteRing *m_ring;
+  std::thread m_thread;
+  std::atomic<bool> m_stop;
+  std::vector<uint8_t> m_block;
+  uint32_t m_interfaces;
+  uint64_t m_written;
+  uint64_t m_dropped;
+  uint64_t m_bytes;
+};
+
+} // namespace crowd
+
+#endif /* CROWD_PCAPNG_WRITER_H */
@@ -0,0 +1,379 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Performance regression benchmark for the two crowd scenarios.
+//
+// ./waf build
+// ./waf --run "crowd-perf-bench --save"                 (record a baseline)
+// ./waf --run "crowd-perf-bench"                        (compare against it)
+// ./waf --run "crowd-perf-bench --cases=crowdsrc --tolerance=0.2"
+//
+// Runs the built crowdsrc-adhoc and simple-adhoc-modified programs over a
+// fixed matrix of node counts and traffic loads, every run with the same
+// RngSeed and RngRun and without capture or animation output. Each case
+// is its own process, one at a time, repeated --repeat times; the fastest
+// repetition counts. For each case the table gives the process wall and
+// CPU time, simulated seconds per wall second and events per second of
+// the event loop (from the scenario's --loopStats file), and the peak RSS
+// from wait4.
+//
+// --save writes the results to the baseline file. Otherwise they are
+// compared with it: a case whose wall time, CPU time or peak RSS grew, or
+// whose event rate fell, by more than the tolerance is flagged, and the
+// exit status is 1 if any was. A baseline is only meaningful on the
+// machine and build (optimized, not debug) it was recorded with, so it is
+// not kept in the repository; record one before changing anything.
+// Scenario output goes to crowd-perf-bench-<case>.log.
+
+#include "ns3/core-module.h"
+
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "crowd-worker-pool.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("CrowdPerfBench");
+
+struct BenchCase
+{
+  std::string name;
+  std::string program;
+  std::vector<std::string> args;
+};
+
+struct BenchResult
+{
+  double wallSeconds;
+  double cpuSeconds;
+  double simPerWall;
+  double eventsPerSecond;
+  double rssMb;
+};
+
+static double
+WallSeconds (void)
+{
+  struct timeval tv;
+  gettimeofday (&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static std::string
+Arg (std::string name, double value)
+{
+  std::ostringstream oss;
+  oss << "--" << name << "=" << value;
+  return oss.str ();
+}
+
+/*
+ * The fixed matrix: node counts times traffic loads for each scenario.
+ */
+static std::vector<BenchCase>
+MakeCases (void)
+{
+  std::vector<BenchCase> cases;
+  uint32_t crowdNodes[] = { 20, 100 };
+  for (uint32_t n = 0; n < 2; n++)
+    {
+      // One saturating flow, then ten small flows per node
+      for (uint32_t load = 0; load < 2; load++)
+        {
+          BenchCase c;
+          std::ostringstream name;
+          name << "crowdsrc-adhoc-n" << crowdNodes[n] << (load == 0 ? "-onoff" : "-flows10");
+          c.name = name.str ();
+          c.program = "crowdsrc-adhoc";
+          c.args.push_back (Arg ("nodes", crowdNodes[n]));
+          c.args.push_back (load == 0 ? "--app=onoff" : "--app=flows");
+          c.args.push_back (Arg ("flows", 10));
+          c.args.push_back ("--capture=off");
+          c.args.push_back ("--anim=off");
+          c.args.push_back ("--flowExport=off");
+          c.args.push_back (Arg ("stopTime", 60));
+          cases.push_back (c);
+        }
+    }
+  uint32_t simpleNodes[] = { 50, 200 };
+  for (uint32_t n = 0; n < 2; n++)
+    {
+      // 100 broadcasts at 20/s, then 1000 at 200/s, all within the 5 s of traffic
+      for (uint32_t load = 0; load < 2; load++)
+        {
+          BenchCase c;
+          std::ostringstream name;
+          name << "simple-adhoc-n" << simpleNodes[n] << (load == 0 ? "-p100" : "-p1000");
+          c.name = name.str ();
+          c.program = "simple-adhoc-modified";
+          c.args.push_back (Arg ("numNodes", simpleNodes[n]));
+          c.args.push_back (Arg ("numPackets", load == 0 ? 100 : 1000));
+          c.args.push_back (Arg ("interval", load == 0 ? 0.05 : 0.005));
+          c.args.push_back ("--capture=off");
+          c.args.push_back ("--anim=off");
+          cases.push_back (c);
+        }
+    }
+  return cases;
+}
+
+/*
+ * Runs in the forked child: becomes the scenario, its output in logFile.
+ */
+static int
+ExecCase (std::string path, std::vector<std::string> args, std::string logFile)
+{
+  int fd = open (logFile.c_str (), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    {
+      perror (logFile.c_str ());
+      return 126;
+    }
+  dup2 (fd, STDOUT_FILENO);
+  dup2 (fd, STDERR_FILENO);
+  close (fd);
+  std::vector<char *> argv;
+  argv.push_back (const_cast<char *> (path.c_str ()));
+  for (uint32_t i = 0; i < args.size (); i++)
+    {
+      argv.push_back (const_cast<char *> (args[i].c_str ()));
+    }
+  argv.push_back (0);
+  execv (path.c_str (), &argv[0]);
+  perror (path.c_str ());
+  return 127;
+}
+
+/*
+ * Run c once; false if it failed or left no loop statistics.
+ */
+static bool
+RunCase (const BenchCase &c, std::string binDir, BenchResult &result)
+{
+  std::string statsFile = "crowd-perf-bench-" + c.name + ".loop";
+  std::string logFile = "crowd-perf-bench-" + c.name + ".log";
+  std::remove (statsFile.c_str ());
+  std::vector<std::string> args = c.args;
+  args.push_back ("--RngSeed=1");
+  args.push_back ("--RngRun=1");
+  args.push_back ("--loopStats=" + statsFile);
+  std::string path = binDir + "/" + c.program;
+
+  int status = -1;
+  struct rusage usage;
+  CrowdWorkerPool pool (1);
+  pool.SetDoneCallback ([&] (uint32_t id, int exitStatus)
+    {
+      status = exitStatus;
+      usage = pool.GetLastUsage ();
+    });
+  double start = WallSeconds ();
+  pool.Submit ([=] () { return ExecCase (path, args, logFile); });
+  pool.WaitAll ();
+  double wall = WallSeconds () - start;
+  if (status != 0)
+    {
+      std::fprintf (stderr, "%s: %s exited with status %d, see %s\n", c.name.c_str (), path.c_str (),
+                    status, logFile.c_str ());
+      return false;
+    }
+
+  std::map<std::string, double> values;
+  std::ifstream in (statsFile.c_str ());
+  std::string name;
+  double value;
+  while (in >> name >> value)
+    {
+      values[name] = value;
+    }
+  if (values["loop_s"] <= 0)
+    {
+      std::fprintf (stderr, "%s: no event loop statistics in %s\n", c.name.c_str (), statsFile.c_str ());
+      return false;
+    }
+  result.wallSeconds = wall;
+  result.cpuSeconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+    + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+  result.simPerWall = values["sim_s"] / values["loop_s"];
+  result.eventsPerSecond = values["events"] / values["loop_s"];
+  result.rssMb = usage.ru_maxrss / 1024.0;
+  return true;
+}
+
+static std::map<std::string, BenchResult>
+ReadBaseline (std::string filename)
+{
+  std::map<std::string, BenchResult> baseline;
+  std::ifstream in (filename.c_str ());
+  std::string line;
+  while (std::getline (in, line))
+    {
+      if (line.empty () || line[0] == '#')
+        {
+          continue;
+        }
+      std::istringstream fields (line);
+      std::string name;
+      BenchResult r;
+      if (fields >> name >> r.wallSeconds >> r.cpuSeconds >> r.simPerWall >> r.eventsPerSecond >> r.rssMb)
+        {
+          baseline[name] = r;
+        }
+    }
+  return baseline;
+}
+
+static bool
+WriteBaseline (std::string filename, const std::vector<std::string> &names,
+               const std::vector<BenchResult> &results)
+{
+  std::ofstream out (filename.c_str ());
+  out << "# case wall_s cpu_s sim_per_wall events_per_s rss_mb" << std::endl;
+  for (uint32_t i = 0; i < names.size (); i++)
+    {
+      const BenchResult &r = results[i];
+      out << names[i] << " " << r.wallSeconds << " " << r.cpuSeconds << " " << r.simPerWall
+          << " " << r.eventsPerSecond << " " << r.rssMb << std::endl;
+    }
+  return bool (out);
+}
+
+int main (int argc, char *argv[])
+{
+  std::string binDir ("build/scratch");
+  std::string baselineFile ("crowd-perf-baseline.txt");
+  std::string filter ("");
+  uint32_t repeat = 3;
+  double tolerance = 0.10;
+  bool save = false;
+
+  CommandLine cmd;
+  cmd.AddValue ("bin", "directory holding the built scenario programs", binDir);
+  cmd.AddValue ("baseline", "baseline file to compare against, or to write with --save", baselineFile);
+  cmd.AddValue ("cases", "only run the cases whose name contains this", filter);
+  cmd.AddValue ("repeat", "runs per case; the fastest counts", repeat);
+  cmd.AddValue ("tolerance", "flag a case whose time or memory grew (or event rate fell) by more than this fraction", tolerance);
+  cmd.AddValue ("save", "write the results as the new baseline instead of comparing", save);
+  cmd.Parse (argc, argv);
+  NS_ABORT_MSG_UNLESS (repeat >= 1, "need at least one run per case");
+  NS_ABORT_MSG_UNLESS (tolerance >= 0, "tolerance must not be negative");
+
+  std::map<std::string, BenchResult> baseline;
+  if (!save)
+    {
+      baseline = ReadBaseline (baselineFile);
+      if (baseline.empty ())
+        {
+          std::fprintf (stderr, "no baseline in %s; record one with --save\n", baselineFile.c_str ());
+        }
+    }
+
+  std::vector<BenchCase> cases = MakeCases ();
+  std::vector<std::string> names;
+  std::vector<BenchResult> results;
+  uint32_t failed = 0;
+  uint32_t flagged = 0;
+  std::printf ("%-28s %8s %8s %10s %12s %8s  %s\n", "case", "wall s", "cpu s", "sim/wall",
+               "events/s", "RSS MB", "vs baseline");
+  for (uint32_t i = 0; i < cases.size (); i++)
+    {
+      const BenchCase &c = cases[i];
+      if (c.name.find (filter) == std::string::npos)
+        {
+          continue;
+        }
+      BenchResult best = BenchResult ();
+      bool ok = false;
+      for (uint32_t k = 0; k < repeat; k++)
+        {
+          BenchResult r;
+          if (!RunCase (c, binDir, r))
+            {
+              ok = false;
+              break;
+            }
+          if (!ok || r.wallSeconds < best.wallSeconds)
+            {
+              best = r;
+            }
+          ok = true;
+        }
+      if (!ok)
+        {
+          failed++;
+          continue;
+        }
+      names.push_back (c.name);
+      results.push_back (best);
+
+      std::string verdict ("");
+      std::map<std::string, BenchResult>::const_iterator base = baseline.find (c.name);
+      if (base != baseline.end ())
+        {
+          const BenchResult &b = base->second;
+          std::ostringstream oss;
+          oss.precision (2);
+          oss << std::fixed << "wall x" << best.wallSeconds / b.wallSeconds
+              << " events/s x" << best.eventsPerSecond / b.eventsPerSecond
+              << " RSS x" << best.rssMb / b.rssMb;
+          bool slower = best.wallSeconds > b.wallSeconds * (1 + tolerance)
+            || best.cpuSeconds > b.cpuSeconds * (1 + tolerance)
+            || best.eventsPerSecond * (1 + tolerance) < b.eventsPerSecond;
+          bool bigger = best.rssMb > b.rssMb * (1 + tolerance);
+          if (slower || bigger)
+            {
+              flagged++;
+              oss << (slower ? "  SLOWER" : "") << (bigger ? "  MORE MEMORY" : "");
+            }
+          verdict = oss.str ();
+        }
+      else if (!save)
+        {
+          verdict = "(not in baseline)";
+        }
+      std::printf ("%-28s %8.2f %8.2f %10.1f %12.0f %8.1f  %s\n", c.name.c_str (), best.wallSeconds,
+                   best.cpuSeconds, best.simPerWall, best.eventsPerSecond, best.rssMb, verdict.c_str ());
+      std::fflush (stdout);
+    }
+
+  if (save)
+    {
+      if (failed > 0 || !WriteBaseline (baselineFile, names, results))
+        {
+          std::fprintf (stderr, "baseline not written\n");
+          return 1;
+        }
+      std::printf ("baseline written to %s\n", baselineFile.c_str ());
+      return 0;
+    }
+  if (failed > 0 || flagged > 0)
+    {
+      std::printf ("%u cases failed, %u beyond the %.0f%% tolerance\n", failed, flagged, tolerance * 100);
+      return 1;
+    }
+  return 0;
+}
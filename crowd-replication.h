@@ -0,0 +1,251 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Online statistics over independent replications.
+ *
+ * Welford keeps the count, mean and sum of squared deviations of a metric
+ * in one pass, without the cancellation of the sum-of-squares formula.
+ * ReplicationStats holds one per named metric and tells, from Student's t
+ * distribution, whether every metric's confidence interval is already
+ * narrow enough: half-width at most relWidth times the magnitude of the
+ * mean. Metric files are "name value" lines, one metric per line.
+ */
+
+#ifndef CROWD_REPLICATION_H
+#define CROWD_REPLICATION_H
+
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+
+namespace crowd {
+
+class Welford
+{
+public:
+  Welford ()
+    : m_count (0),
+      m_mean (0.0),
+      m_m2 (0.0)
+  {
+  }
+
+  void Add (double x)
+  {
+    m_count++;
+    double delta = x - m_mean;
+    m_mean += delta / m_count;
+    m_m2 += delta * (x - m_mean);
+  }
+
+  uint32_t GetCount (void) const
+  {
+    return m_count;
+  }
+
+  double GetMean (void) const
+  {
+    return m_mean;
+  }
+
+  /*
+   * Sample (n - 1) variance; 0 below two values.
+   */
+  double GetVariance (void) const
+  {
+    return m_count > 1 ? m_m2 / (m_count - 1) : 0.0;
+  }
+
+private:
+  uint32_t m_count;
+  double m_mean;
+  double m_m2;
+};
+
+/*
+ * Regularised incomplete beta function I_x(a, b), by Lentz's continued
+ * fraction.
+ */
+inline double
+IncompleteBeta (double x, double a, double b)
+{
+  if (x <= 0.0)
+    {
+      return 0.0;
+    }
+  if (x >= 1.0)
+    {
+      return 1.0;
+    }
+  // The fraction converges quickly only for x below the mean
+  if (x > (a + 1.0) / (a + b + 2.0))
+    {
+      return 1.0 - IncompleteBeta (1.0 - x, b, a);
+    }
+  const double tiny = 1e-300;
+  double front = std::exp (std::lgamma (a + b) - std::lgamma (a) - std::lgamma (b)
+                           + a * std::log (x) + b * std::log (1.0 - x)) / a;
+  double f = 1.0, c = 1.0, d = 0.0;
+  for (int i = 0; i <= 400; i++)
+    {
+      int m = i / 2;
+      double numerator;
+      if (i == 0)
+        {
+          numerator = 1.0;
+        }
+      else if (i % 2 == 0)
+        {
+          numerator = (m * (b - m) * x) / ((a + 2.0 * m - 1.0) * (a + 2.0 * m));
+        }
+      else
+        {
+          numerator = -((a + m) * (a + b + m) * x) / ((a + 2.0 * m) * (a + 2.0 * m + 1.0));
+        }
+      d = 1.0 + numerator * d;
+      d = std::fabs (d) < tiny ? tiny : d;
+      d = 1.0 / d;
+      c = 1.0 + numerator / c;
+      c = std::fabs (c) < tiny ? tiny : c;
+      double cd = c * d;
+      f *= cd;
+      if (std::fabs (1.0 - cd) < 1e-12)
+        {
+          break;
+        }
+    }
+  return front * (f - 1.0);
+}
+
+/*
+ * t such that P(T <= t) = p for Student's t with df degrees of freedom,
+ * for p in (0.5, 1); by bisection on the distribution function.
+ */
+inline double
+StudentTQuantile (double p, uint32_t df)
+{
+  double lo = 0.0, hi = 1.0;
+  while (1.0 - 0.5 * IncompleteBeta (df / (df + hi * hi), 0.5 * df, 0.5) < p && hi < 1e6)
+    {
+      hi *= 2.0;
+    }
+  for (int i = 0; i < 100 && hi - lo > 1e-9; i++)
+    {
+      double mid = 0.5 * (lo + hi);
+      if (1.0 - 0.5 * IncompleteBeta (df / (df + mid * mid), 0.5 * df, 0.5) < p)
+        {
+          lo = mid;
+        }
+      else
+        {
+          hi = mid;
+        }
+    }
+  return 0.5 * (lo + hi);
+}
+
+class ReplicationStats
+{
+public:
+  ReplicationStats ()
+    : m_replications (0)
+  {
+  }
+
+  /*
+   * Add one replication's metric file. False if it cannot be read.
+   */
+  bool AddFile (const std::string &filename)
+  {
+    std::ifstream in (filename.c_str ());
+    if (!in)
+      {
+        return false;
+      }
+    std::string name;
+    double value;
+    while (in >> name >> value)
+      {
+        m_metrics[name].Add (value);
+      }
+    m_replications++;
+    return true;
+  }
+
+  uint32_t GetReplications (void) const
+  {
+    return m_replications;
+  }
+
+  /*
+   * Half-width of the two-sided confidence interval on the mean of
+   * metric; infinite below two values.
+   */
+  double GetHalfWidth (const std::string &metric, double confidence) const
+  {
+    std::map<std::string, Welford>::const_iterator i = m_metrics.find (metric);
+    if (i == m_metrics.end () || i->second.GetCount () < 2)
+      {
+        return HUGE_VAL;
+      }
+    uint32_t n = i->second.GetCount ();
+    double t = StudentTQuantile (0.5 + 0.5 * confidence, n - 1);
+    return t * std::sqrt (i->second.GetVariance () / n);
+  }
+
+  /*
+   * Whether every metric's interval is within relWidth of its mean. A
+   * metric whose mean is 0 only passes with a zero-width interval.
+   */
+  bool IsConverged (double confidence, double relWidth) const
+  {
+    if (m_metrics.empty ())
+      {
+        return false;
+      }
+    for (std::map<std::string, Welford>::const_iterator i = m_metrics.begin (); i != m_metrics.end (); ++i)
+      {
+        if (GetHalfWidth (i->first, confidence) > relWidth * std::fabs (i->second.GetMean ()))
+          {
+            return false;
+          }
+      }
+    return true;
+  }
+
+  void Print (std::ostream &os, double confidence) const
+  {
+    for (std::map<std::string, Welford>::const_iterator i = m_metrics.begin (); i != m_metrics.end (); ++i)
+      {
+        const Welford &w = i->second;
+        os << i->first << ": mean " << w.GetMean () << " +- " << GetHalfWidth (i->first, confidence)
+           << " (" << confidence * 100 << "% CI, n=" << w.GetCount () << ", sd "
+           << std::sqrt (w.GetVariance ()) << ")" << std::endl;
+      }
+  }
+
+private:
+  std::map<std::string, Welford> m_metrics;
+  uint32_t m_replications;
+};
+
+} // namespace crowd
+
+#endif /* CROWD_REPLICATION_H */
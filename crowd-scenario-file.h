@@ -0,0 +1,167 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Scenario files: command line options kept in a file.
+ *
+ * One option per line as "name = value" (the spaces and a leading "--"
+ * are optional), with blank lines and "#" comments ignored:
+ *
+ *   # 200 nodes on a 1 km square
+ *   nodes = 200
+ *   width = 1000
+ *   height = 1000
+ *   ns3::WifiRemoteStationManager::RtsCtsThreshold = 0
+ *
+ * ScenarioFile turns them into "--name=value" arguments, so that anything
+ * the program's CommandLine accepts, ns-3 attribute defaults included,
+ * can go in the file. The program parses them ahead of its own argv, so
+ * that the command line overrides the file. Write () saves the options a
+ * list of such arguments resolves to back in the same format, which
+ * records a run's settings as a scenario that repeats it.
+ */
+
+#ifndef CROWD_SCENARIO_FILE_H
+#define CROWD_SCENARIO_FILE_H
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace crowd {
+
+class ScenarioFile
+{
+public:
+  /*
+   * Read filename. False, with GetError () saying why, if it cannot be
+   * read or has a line that is not an option.
+   */
+  bool Read (std::string filename)
+  {
+    m_args.clear ();
+    m_error.clear ();
+    std::ifstream in (filename.c_str ());
+    if (!in)
+      {
+        m_error = "cannot read " + filename;
+        return false;
+      }
+    std::string line;
+    uint32_t lineNo = 0;
+    while (std::getline (in, line))
+      {
+        lineNo++;
+        std::string::size_type hash = line.find ('#');
+        if (hash != std::string::npos)
+          {
+            line.erase (hash);
+          }
+        line = Trim (line);
+        if (line.empty ())
+          {
+            continue;
+          }
+        if (line.compare (0, 2, "--") == 0)
+          {
+            line.erase (0, 2);
+          }
+        std::string::size_type eq = line.find ('=');
+        std::string name = Trim (line.substr (0, eq));
+        if (eq == std::string::npos || name.empty () || name.find_first_of (" \t") != std::string::npos)
+          {
+            std::ostringstream oss;
+            oss << filename << ":" << lineNo << ": expected name = value";
+            m_error = oss.str ();
+            return false;
+          }
+        m_args.push_back ("--" + name + "=" + Trim (line.substr (eq + 1)));
+      }
+    return true;
+  }
+
+  /*
+   * The options read, as "--name=value".
+   */
+  const std::vector<std::string> &GetArgs (void) const
+  {
+    return m_args;
+  }
+
+  std::string GetError (void) const
+  {
+    return m_error;
+  }
+
+  /*
+   * Write the options args resolve to as a scenario file: each named once,
+   * with the last value given, a bare "--flag" as "flag = true". Other
+   * arguments, such as the program name, and the options named in omit
+   * are left out.
+   */
+  static bool Write (std::string filename, const std::vector<std::string> &args,
+                     const std::vector<std::string> &omit = std::vector<std::string> ())
+  {
+    std::vector<std::string> names;
+    std::map<std::string, std::string> values;
+    for (uint32_t i = 0; i < args.size (); i++)
+      {
+        if (args[i].compare (0, 2, "--") != 0 || args[i].size () == 2)
+          {
+            continue;
+          }
+        std::string::size_type eq = args[i].find ('=');
+        std::string name = args[i].substr (2, eq == std::string::npos ? std::string::npos : eq - 2);
+        if (std::find (omit.begin (), omit.end (), name) != omit.end ())
+          {
+            continue;
+          }
+        if (values.find (name) == values.end ())
+          {
+            names.push_back (name);
+          }
+        values[name] = eq == std::string::npos ? "true" : args[i].substr (eq + 1);
+      }
+    std::ofstream out (filename.c_str ());
+    for (uint32_t i = 0; i < names.size (); i++)
+      {
+        out << names[i] << " = " << values[names[i]] << "\n";
+      }
+    return bool (out);
+  }
+
+private:
+  static std::string Trim (std::string s)
+  {
+    std::string::size_type first = s.find_first_not_of (" \t\r");
+    if (first == std::string::npos)
+      {
+        return "";
+      }
+    return s.substr (first, s.find_last_not_of (" \t\r") - first + 1);
+  }
+
+  std::vector<std::string> m_args;
+  std::string m_error;
+};
+
+} // namespace crowd
+
+#endif /* CROWD_SCENARIO_FILE_H */
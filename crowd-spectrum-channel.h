@@ -0,0 +1,1115 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Spatially indexed channel for large crowds.
+ *
+ * YansWifiChannel computes path loss and schedules a receive event for
+ * every other PHY on every transmission, which is O(N) per frame. Its Send
+ * is not virtual and YansWifiPhy is bound to the concrete class, so the
+ * index lives in a SpectrumChannel instead and the scenarios use
+ * SpectrumWifiPhy with it.
+ *
+ * Receivers are binned into square grid cells. A transmission only looks at
+ * cells within the reception cutoff range (plus a movement slack) of the
+ * sender, and only schedules a receive for signals at or above
+ * CutoffRxPower. The bins follow the MobilityModel CourseChange traces; as
+ * nodes also drift between course changes, every node is rebinned once the
+ * fastest node seen (or MaxSpeed, if higher) could have moved more than
+ * Slack metres. Mobility models that never fire CourseChange, such as
+ * CrowdTrackMobilityModel, need MaxSpeed set.
+ *
+ * The cutoff range is derived from the loss model by bisection unless given
+ * explicitly, so the loss model must be deterministic and decrease with
+ * distance (log-distance, Friis, range, ...). For a distance-independent
+ * model such as FixedRssLossModel the range is unbounded and every receiver
+ * is a candidate.
+ *
+ * The loss model is asked for the received power at the actual transmit
+ * power, so that FixedRssLossModel yields its fixed level here too.
+ *
+ * With ShareFanOut set (the default) a transmission reaching several
+ * receivers allocates one set of receive parameters per distinct gain
+ * rather than per receiver, which for a distance-independent loss model
+ * means one for the whole broadcast; the frame inside is shared as well,
+ * and ns-3's copy-on-write Packet gives a receiver its own bytes only once
+ * it changes them. Receivers must treat the parameters as read-only, as
+ * SpectrumWifiPhy does. The receive events themselves still go one per
+ * receiver, under that receiver's node context, but all of them point to
+ * a single FanOutEvent: they are scheduled in order of arrival time, which
+ * is the order the simulator runs them in, so its nth invocation is the
+ * nth receiver. Debug builds assert that the context of each invocation
+ * is that receiver's node.
+ *
+ * With Batched set (the default) and the models the scenarios use, a
+ * log-distance loss model on its own, a constant-speed (or no) delay
+ * model and isotropic antennas, the candidates are evaluated together.
+ * The channel keeps every receiver's position in x, y and z arrays of its
+ * own, stored at course changes and rebins and read again from the
+ * mobility model only when stale: once per simulated instant for a moving
+ * node, never for one that stood still at its last course change (with
+ * MaxSpeed 0, when course changes are all there is to go by). The
+ * candidates' positions are copied from there into batch arrays, one
+ * branch-free pass computes every squared distance (a loop the compiler
+ * vectorizes), and candidates beyond the distance at which even the
+ * strongest receive antenna falls below CutoffRxPower are dropped there.
+ * The rest go through the loss and delay formulas in further passes, one
+ * per step. Those formulas are the models' own, evaluated in the same
+ * order on the same distance, so the gains and delays are bit for bit
+ * those of the per-receiver virtual calls. Other models fall back to
+ * those calls.
+ *
+ * With Validate set, every transmission is also evaluated exhaustively and
+ * receivers the index missed, and deliveries whose gain or delay differs,
+ * are counted, see PrintStats ().
+ */
+
+#ifndef CROWD_SPECTRUM_CHANNEL_H
+#define CROWD_SPECTRUM_CHANNEL_H
+
+#include "ns3/spectrum-channel.h"
+#include "ns3/spectrum-phy.h"
+#include "ns3/spectrum-signal-parameters.h"
+#include "ns3/spectrum-value.h"
+#include "ns3/spectrum-propagation-loss-model.h"
+#include "ns3/propagation-loss-model.h"
+#include "ns3/propagation-delay-model.h"
+#include "ns3/antenna-model.h"
+#include "ns3/isotropic-antenna-model.h"
+#include "ns3/angles.h"
+#include "ns3/abort.h"
+#include "ns3/mobility-model.h"
+#include "ns3/constant-position-mobility-model.h"
+#include "ns3/net-device.h"
+#include "ns3/node.h"
+#include "ns3/simulator.h"
+#include "ns3/event-impl.h"
+#include "ns3/double.h"
+#include "ns3/boolean.h"
+#include "ns3/pointer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+namespace ns3 {
+
+class CrowdSpectrumChannel : public SpectrumChannel
+{
+public:
+  static TypeId GetTypeId (void);
+
+  CrowdSpectrumChannel ();
+
+  // SpectrumChannel
+  virtual void AddPropagationLossModel (Ptr<PropagationLossModel> loss);
+  virtual void AddSpectrumPropagationLossModel (Ptr<SpectrumPropagationLossModel> loss);
+  virtual void SetPropagationDelayModel (Ptr<PropagationDelayModel> delay);
+  virtual Ptr<SpectrumPropagationLossModel> GetSpectrumPropagationLossModel (void);
+  virtual void StartTx (Ptr<SpectrumSignalParameters> params);
+  virtual void AddRx (Ptr<SpectrumPhy> phy);
+
+  // Channel
+  virtual std::size_t GetNDevices (void) const;
+  virtual Ptr<NetDevice> GetDevice (std::size_t i) const;
+
+  /*
+   * Distance beyond which a transmission at maxTxPowerDbm falls below
+   * cutoffDbm under the given (deterministic, monotone) loss model, or
+   * infinity if it never does within 100 km.
+   */
+  static double ComputeCutoffRange (Ptr<PropagationLossModel> loss, double maxTxPowerDbm,
+                                    double cutoffDbm);
+
+  double GetCutoffRange (void) const;
+  void PrintStats (std::ostream &os) const;
+
+protected:
+  virtual void DoDispose (void);
+
+private:
+  struct Receiver
+  {
+    Ptr<SpectrumPhy> phy;
+    Ptr<MobilityModel> mobility;
+    uint32_t node;
+    int64_t cell;
+    uint32_t slot;       // position inside m_cells[cell]
+    bool hasAntenna;
+    double antennaGainDb; // of an isotropic receive antenna
+  };
+
+  typedef std::unordered_map<int64_t, std::vector<uint32_t> > CellMap;
+
+  struct Delivery
+  {
+    uint32_t receiver;
+    double gainDb;
+    Time delay;
+    Ptr<SpectrumSignalParameters> params;
+  };
+
+  class FanOutEvent : public EventImpl
+  {
+  public:
+    FanOutEvent ()
+      : m_next (0)
+    {
+    }
+
+    void Add (Ptr<SpectrumPhy> phy, Ptr<SpectrumSignalParameters> params, uint32_t node)
+    {
+      Rx rx;
+      rx.phy = phy;
+      rx.params = params;
+      rx.node = node;
+      m_rx.push_back (rx);
+    }
+
+  protected:
+    virtual void Notify (void)
+    {
+      Rx &rx = m_rx[m_next++];
+      NS_ASSERT_MSG (Simulator::GetContext () == rx.node,
+                     "fan-out invoked in context " << Simulator::GetContext ()
+                     << " for node " << rx.node);
+      rx.phy->StartRx (rx.params);
+    }
+
+  private:
+    struct Rx
+    {
+      Ptr<SpectrumPhy> phy;
+      Ptr<SpectrumSignalParameters> params;
+      uint32_t node;
+    };
+
+    std::vector<Rx> m_rx;
+    uint32_t m_next;
+  };
+
+  void BuildIndex (void);
+  void SetUpBatch (void);
+  void Rebin (uint32_t index);
+  void RebinAll (void);
+  /*
+   * Keep pos, read now, and velocity as receiver index's position.
+   */
+  void StorePosition (uint32_t index, const Vector &pos, const Vector &velocity);
+  int64_t CellOf (const Vector &pos) const;
+  static int64_t CellKey (int64_t ix, int64_t iy);
+  static void CourseChanged (CrowdSpectrumChannel *channel, uint32_t index,
+                             Ptr<const MobilityModel> mobility);
+  /*
+   * Evaluate one candidate receiver. Returns true and fills the gain and
+   * delay if the signal reaches the cutoff.
+   */
+  bool Evaluate (Ptr<SpectrumSignalParameters> txParams, Ptr<MobilityModel> senderMobility,
+                 double txPowerDbm, const Receiver &rx, double &gainDb, Time &delay) const;
+  /*
+   * Evaluate every candidate but the sender at once, calling Accept for
+   * the ones the signal reaches. False, having done nothing, if the
+   * transmit antenna is not isotropic.
+   */
+  bool EvaluateBatch (Ptr<SpectrumSignalParameters> txParams, Ptr<MobilityModel> senderMobility,
+                      double txPowerDbm);
+  void Accept (Ptr<SpectrumSignalParameters> txParams, uint32_t index, double gainDb, Time delay);
+  Ptr<SpectrumSignalParameters> MakeRxParams (Ptr<SpectrumSignalParameters> txParams,
+                                              const Receiver &rx, double gainDb) const;
+  void Deliver (Ptr<SpectrumSignalParameters> txParams, const Receiver &rx, double gainDb,
+                Time delay);
+  void FanOut (Ptr<SpectrumSignalParameters> txParams);
+  static bool LowerGain (const Delivery *a, const Delivery *b);
+  static bool ArrivesEarlier (const Delivery &a, const Delivery &b);
+  void Validate (Ptr<SpectrumSignalParameters> txParams, Ptr<MobilityModel> senderMobility,
+                 double txPowerDbm);
+  static void StartRx (Ptr<SpectrumSignalParameters> params, Ptr<SpectrumPhy> receiver);
+
+  Ptr<PropagationLossModel> m_loss;
+  Ptr<SpectrumPropagationLossModel> m_spectrumLoss;
+  Ptr<PropagationDelayModel> m_delay;
+
+  bool m_spatialIndex;
+  bool m_validate;
+  bool m_shareFanOut;
+  bool m_batched;
+  double m_cutoffDbm;
+  double m_maxTxPowerDbm;
+  double m_cutoffRange;       // attribute; 0 means derive from the loss model
+  double m_range;             // range actually in use
+  double m_cellSize;
+  double m_slack;
+  double m_speedBound;        // attribute; lower bound for m_maxSpeed
+
+  std::vector<Receiver> m_receivers;
+  CellMap m_cells;
+  bool m_indexed;
+  double m_maxSpeed;
+  Time m_lastRebinAll;
+
+  std::vector<uint32_t> m_candidates;
+  std::vector<uint32_t> m_stamp;
+  std::vector<Delivery> m_deliveries;
+  std::vector<Delivery *> m_byGain;
+  uint32_t m_txCount;
+
+  // The batch: models' parameters, every receiver's position by
+  // coordinate, and the candidates' positions and results per pass
+  bool m_batchable;
+  double m_exponent;
+  double m_referenceDistance;
+  double m_referenceLoss;
+  double m_speed;             // 0: no delay model
+  double m_maxRxGainDb;
+  std::vector<double> m_posX;
+  std::vector<double> m_posY;
+  std::vector<double> m_posZ;
+  std::vector<Time> m_posTime;
+  std::vector<uint8_t> m_posStill;
+  std::vector<uint32_t> m_batchIndex;
+  std::vector<double> m_batchX;
+  std::vector<double> m_batchY;
+  std::vector<double> m_batchZ;
+  std::vector<double> m_batchD2;
+  std::vector<double> m_batchRxDbm;
+  std::vector<double> m_batchDelay;
+  // Gain and delay of the receivers stamped by the transmission, for Validate
+  std::vector<double> m_lastGainDb;
+  std::vector<Time> m_lastDelay;
+
+  uint64_t m_evaluated;
+  uint64_t m_delivered;
+  uint64_t m_fanOuts;
+  uint64_t m_rxParams;
+  uint64_t m_batches;
+  uint64_t m_prefiltered;
+  uint64_t m_positionReads;
+  uint64_t m_rebinAll;
+  uint64_t m_missed;
+  uint64_t m_extra;
+  uint64_t m_mismatched;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (CrowdSpectrumChannel);
+
+TypeId
+CrowdSpectrumChannel::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::CrowdSpectrumChannel")
+    .SetParent<SpectrumChannel> ()
+    .SetGroupName ("Spectrum")
+    .AddConstructor<CrowdSpectrumChannel> ()
+    .AddAttribute ("SpatialIndex",
+                   "Only evaluate receivers in grid cells within the cutoff range.",
+                   BooleanValue (true),
+                   MakeBooleanAccessor (&CrowdSpectrumChannel::m_spatialIndex),
+                   MakeBooleanChecker ())
+    .AddAttribute ("Validate",
+                   "Also evaluate every receiver and count the ones the index missed.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&CrowdSpectrumChannel::m_validate),
+                   MakeBooleanChecker ())
+    .AddAttribute ("ShareFanOut",
+                   "Share receive parameters among receivers with the same gain, and one event "
+                   "implementation among all receivers of a transmission.",
+                   BooleanValue (true),
+                   MakeBooleanAccessor (&CrowdSpectrumChannel::m_shareFanOut),
+                   MakeBooleanChecker ())
+    .AddAttribute ("Batched",
+                   "Evaluate the candidate receivers of a transmission in one pass over their "
+                   "positions, where the loss, delay and antenna models allow it.",
+                   BooleanValue (true),
+                   MakeBooleanAccessor (&CrowdSpectrumChannel::m_batched),
+                   MakeBooleanChecker ())
+    .AddAttribute ("CutoffRxPower",
+                   "Signals below this power (dBm) are not delivered at all.",
+                   DoubleValue (-110.0),
+                   MakeDoubleAccessor (&CrowdSpectrumChannel::m_cutoffDbm),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("MaxTxPower",
+                   "Highest transmit power (dBm, antenna gains included) used to derive the cutoff range.",
+                   DoubleValue (20.0),
+                   MakeDoubleAccessor (&CrowdSpectrumChannel::m_maxTxPowerDbm),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("CutoffRange",
+                   "Reception cutoff range in metres; 0 derives it from the loss model.",
+                   DoubleValue (0.0),
+                   MakeDoubleAccessor (&CrowdSpectrumChannel::m_cutoffRange),
+                   MakeDoubleChecker<double> (0.0))
+    .AddAttribute ("CellSize",
+                   "Grid cell edge in metres; 0 uses the cutoff range.",
+                   DoubleValue (0.0),
+                   MakeDoubleAccessor (&CrowdSpectrumChannel::m_cellSize),
+                   MakeDoubleChecker<double> (0.0))
+    .AddAttribute ("Slack",
+                   "Distance in metres a node may drift from its cell before everything is rebinned.",
+                   DoubleValue (10.0),
+                   MakeDoubleAccessor (&CrowdSpectrumChannel::m_slack),
+                   MakeDoubleChecker<double> (0.0))
+    .AddAttribute ("MaxSpeed",
+                   "Speed in m/s no node exceeds; 0 relies on the velocities seen at course changes.",
+                   DoubleValue (0.0),
+                   MakeDoubleAccessor (&CrowdSpectrumChannel::m_speedBound),
+                   MakeDoubleChecker<double> (0.0))
+  ;
+  return tid;
+}
+
+CrowdSpectrumChannel::CrowdSpectrumChannel ()
+  : m_range (0.0),
+    m_indexed (false),
+    m_maxSpeed (0.0),
+    m_txCount (0),
+    m_batchable (false),
+    m_exponent (0.0),
+    m_referenceDistance (0.0),
+    m_referenceLoss (0.0),
+    m_speed (0.0),
+    m_maxRxGainDb (0.0),
+    m_evaluated (0),
+    m_delivered (0),
+    m_fanOuts (0),
+    m_rxParams (0),
+    m_batches (0),
+    m_prefiltered (0),
+    m_positionReads (0),
+    m_rebinAll (0),
+    m_missed (0),
+    m_extra (0),
+    m_mismatched (0)
+{
+}
+
+void
+CrowdSpectrumChannel::DoDispose (void)
+{
+  m_receivers.clear ();
+  m_cells.clear ();
+  m_loss = 0;
+  m_spectrumLoss = 0;
+  m_delay = 0;
+  SpectrumChannel::DoDispose ();
+}
+
+void
+CrowdSpectrumChannel::AddPropagationLossModel (Ptr<PropagationLossModel> loss)
+{
+  if (m_loss)
+    {
+      loss->SetNext (m_loss);
+    }
+  m_loss = loss;
+  m_indexed = false;
+}
+
+void
+CrowdSpectrumChannel::AddSpectrumPropagationLossModel (Ptr<SpectrumPropagationLossModel> loss)
+{
+  if (m_spectrumLoss)
+    {
+      loss->SetNext (m_spectrumLoss);
+    }
+  m_spectrumLoss = loss;
+}
+
+void
+CrowdSpectrumChannel::SetPropagationDelayModel (Ptr<PropagationDelayModel> delay)
+{
+  m_delay = delay;
+  m_indexed = false;
+}
+
+Ptr<SpectrumPropagationLossModel>
+CrowdSpectrumChannel::GetSpectrumPropagationLossModel (void)
+{
+  return m_spectrumLoss;
+}
+
+void
+CrowdSpectrumChannel::AddRx (Ptr<SpectrumPhy> phy)
+{
+  Receiver rx;
+  rx.phy = phy;
+  rx.node = 0xffffffff;
+  rx.cell = 0;
+  rx.slot = 0;
+  rx.hasAntenna = false;
+  rx.antennaGainDb = 0.0;
+  m_receivers.push_back (rx);
+  // Mobility is usually installed after the devices, so defer indexing
+  m_indexed = false;
+}
+
+std::size_t
+CrowdSpectrumChannel::GetNDevices (void) const
+{
+  return m_receivers.size ();
+}
+
+Ptr<NetDevice>
+CrowdSpectrumChannel::GetDevice (std::size_t i) const
+{
+  return m_receivers[i].phy->GetDevice ()->GetObject<NetDevice> ();
+}
+
+double
+CrowdSpectrumChannel::GetCutoffRange (void) const
+{
+  return m_range;
+}
+
+double
+CrowdSpectrumChannel::ComputeCutoffRange (Ptr<PropagationLossModel> loss, double maxTxPowerDbm,
+                                          double cutoffDbm)
+{
+  if (!loss)
+    {
+      return std::numeric_limits<double>::infinity ();
+    }
+  Ptr<ConstantPositionMobilityModel> a = CreateObject<ConstantPositionMobilityModel> ();
+  Ptr<ConstantPositionMobilityModel> b = CreateObject<ConstantPositionMobilityModel> ();
+  a->SetPosition (Vector (0, 0, 0));
+  double hi = 1e5;
+  b->SetPosition (Vector (hi, 0, 0));
+  if (loss->CalcRxPower (maxTxPowerDbm, a, b) >= cutoffDbm)
+    {
+      return std::numeric_limits<double>::infinity ();
+    }
+  double lo = 0.0;
+  while (hi - lo > 0.01)
+    {
+      double mid = 0.5 * (lo + hi);
+      b->SetPosition (Vector (mid, 0, 0));
+      if (loss->CalcRxPower (maxTxPowerDbm, a, b) >= cutoffDbm)
+        {
+          lo = mid;
+        }
+      else
+        {
+          hi = mid;
+        }
+    }
+  return hi;
+}
+
+int64_t
+CrowdSpectrumChannel::CellKey (int64_t ix, int64_t iy)
+{
+  // Shifted unsigned, as cells left of or below the origin are negative
+  return static_cast<int64_t> ((static_cast<uint64_t> (ix) << 32) ^ (static_cast<uint64_t> (iy) & 0xffffffff));
+}
+
+int64_t
+CrowdSpectrumChannel::CellOf (const Vector &pos) const
+{
+  return CellKey (static_cast<int64_t> (std::floor (pos.x / m_cellSize)),
+                  static_cast<int64_t> (std::floor (pos.y / m_cellSize)));
+}
+
+void
+CrowdSpectrumChannel::BuildIndex (void)
+{
+  m_range = m_cutoffRange > 0 ? m_cutoffRange
+    : ComputeCutoffRange (m_loss, m_maxTxPowerDbm, m_cutoffDbm);
+  if (m_cellSize <= 0)
+    {
+      m_cellSize = std::isinf (m_range) ? 1000.0 : std::max (m_range, 1.0);
+    }
+  m_stamp.assign (m_receivers.size (), 0);
+  m_lastGainDb.assign (m_receivers.size (), 0.0);
+  m_lastDelay.assign (m_receivers.size (), Seconds (0));
+  m_posX.assign (m_receivers.size (), 0.0);
+  m_posY.assign (m_receivers.size (), 0.0);
+  m_posZ.assign (m_receivers.size (), 0.0);
+  m_posTime.assign (m_receivers.size (), Time (-1));
+  m_posStill.assign (m_receivers.size (), 0);
+  for (uint32_t i = 0; i < m_receivers.size (); i++)
+    {
+      Receiver &rx = m_receivers[i];
+      if (!rx.mobility)
+        {
+          rx.mobility = rx.phy->GetMobility ();
+          NS_ABORT_MSG_UNLESS (rx.mobility, "CrowdSpectrumChannel needs a MobilityModel on every node");
+          rx.mobility->TraceConnectWithoutContext ("CourseChange",
+                                                   MakeBoundCallback (&CrowdSpectrumChannel::CourseChanged, this, i));
+          Ptr<NetDevice> dev = rx.phy->GetDevice ()->GetObject<NetDevice> ();
+          rx.node = dev ? dev->GetNode ()->GetId () : 0xffffffff;
+        }
+    }
+  SetUpBatch ();
+  m_indexed = true;
+  RebinAll ();
+}
+
+/*
+ * Whether the batch can stand in for the models, and their parameters.
+ */
+void
+CrowdSpectrumChannel::SetUpBatch (void)
+{
+  m_batchable = false;
+  Ptr<LogDistancePropagationLossModel> logDistance = DynamicCast<LogDistancePropagationLossModel> (m_loss);
+  if (!m_batched || !logDistance || logDistance->GetNext ())
+    {
+      return;
+    }
+  Ptr<ConstantSpeedPropagationDelayModel> constantSpeed = DynamicCast<ConstantSpeedPropagationDelayModel> (m_delay);
+  if (m_delay && !constantSpeed)
+    {
+      return;
+    }
+  m_maxRxGainDb = -std::numeric_limits<double>::infinity ();
+  for (uint32_t i = 0; i < m_receivers.size (); i++)
+    {
+      Receiver &rx = m_receivers[i];
+      Ptr<AntennaModel> antenna = rx.phy->GetRxAntenna ();
+      if (antenna && !DynamicCast<IsotropicAntennaModel> (antenna))
+        {
+          return;
+        }
+      rx.hasAntenna = antenna != 0;
+      // The same in every direction
+      rx.antennaGainDb = antenna ? antenna->GetGainDb (Angles ()) : 0.0;
+      m_maxRxGainDb = std::max (m_maxRxGainDb, rx.antennaGainDb);
+    }
+  DoubleValue value;
+  logDistance->GetAttribute ("ReferenceDistance", value);
+  m_referenceDistance = value.Get ();
+  logDistance->GetAttribute ("ReferenceLoss", value);
+  m_referenceLoss = value.Get ();
+  m_exponent = logDistance->GetPathLossExponent ();
+  m_speed = constantSpeed ? constantSpeed->GetSpeed () : 0.0;
+  // The distance bound below relies on the loss growing with distance
+  m_batchable = m_exponent > 0 && m_referenceDistance > 0;
+}
+
+void
+CrowdSpectrumChannel::RebinAll (void)
+{
+  m_cells.clear ();
+  m_maxSpeed = std::max (m_maxSpeed, m_speedBound);
+  for (uint32_t i = 0; i < m_receivers.size (); i++)
+    {
+      Receiver &rx = m_receivers[i];
+      Vector pos = rx.mobility->GetPosition ();
+      rx.cell = CellOf (pos);
+      std::vector<uint32_t> &members = m_cells[rx.cell];
+      rx.slot = members.size ();
+      members.push_back (i);
+      Vector v = rx.mobility->GetVelocity ();
+      m_maxSpeed = std::max (m_maxSpeed, std::sqrt (v.x * v.x + v.y * v.y + v.z * v.z));
+      StorePosition (i, pos, v);
+    }
+  m_lastRebinAll = Simulator::Now ();
+  m_rebinAll++;
+}
+
+void
+CrowdSpectrumChannel::Rebin (uint32_t index)
+{
+  Receiver &rx = m_receivers[index];
+  Vector v = rx.mobility->GetVelocity ();
+  m_maxSpeed = std::max (m_maxSpeed, std::sqrt (v.x * v.x + v.y * v.y + v.z * v.z));
+  Vector pos = rx.mobility->GetPosition ();
+  StorePosition (index, pos, v);
+  int64_t cell = CellOf (pos);
+  if (cell == rx.cell)
+    {
+      return;
+    }
+  // Swap-remove from the old cell
+  std::vector<uint32_t> &old = m_cells[rx.cell];
+  uint32_t moved = old.back ();
+  old[rx.slot] = moved;
+  m_receivers[moved].slot = rx.slot;
+  old.pop_back ();
+
+  std::vector<uint32_t> &members = m_cells[cell];
+  rx.cell = cell;
+  rx.slot = members.size ();
+  members.push_back (index);
+}
+
+void
+CrowdSpectrumChannel::StorePosition (uint32_t index, const Vector &pos, const Vector &velocity)
+{
+  m_posX[index] = pos.x;
+  m_posY[index] = pos.y;
+  m_posZ[index] = pos.z;
+  m_posTime[index] = Simulator::Now ();
+  // Without MaxSpeed only a course change moves a node that stands still;
+  // with it, the model may not report course changes at all
+  m_posStill[index] = m_speedBound == 0 && velocity.x == 0 && velocity.y == 0 && velocity.z == 0;
+}
+
+void
+CrowdSpectrumChannel::CourseChanged (CrowdSpectrumChannel *channel, uint32_t index,
+                                     Ptr<const MobilityModel> mobility)
+{
+  if (channel->m_indexed)
+    {
+      channel->Rebin (index);
+    }
+}
+
+bool
+CrowdSpectrumChannel::Evaluate (Ptr<SpectrumSignalParameters> txParams, Ptr<MobilityModel> senderMobility,
+                                double txPowerDbm, const Receiver &rx, double &gainDb, Time &delay) const
+{
+  gainDb = 0.0;
+  if (txParams->txAntenna)
+    {
+      Angles txAngles (rx.mobility->GetPosition (), senderMobility->GetPosition ());
+      gainDb += txParams->txAntenna->GetGainDb (txAngles);
+    }
+  Ptr<AntennaModel> rxAntenna = rx.phy->GetRxAntenna ();
+  if (rxAntenna)
+    {
+      Angles rxAngles (senderMobility->GetPosition (), rx.mobility->GetPosition ());
+      gainDb += rxAntenna->GetGainDb (rxAngles);
+    }
+  if (m_loss)
+    {
+      gainDb += m_loss->CalcRxPower (txPowerDbm, senderMobility, rx.mobility) - txPowerDbm;
+    }
+  if (txPowerDbm + gainDb < m_cutoffDbm)
+    {
+      return false;
+    }
+  delay = m_delay ? m_delay->GetDelay (senderMobility, rx.mobility) : Seconds (0);
+  return true;
+}
+
+bool
+CrowdSpectrumChannel::EvaluateBatch (Ptr<SpectrumSignalParameters> txParams, Ptr<MobilityModel> senderMobility,
+                                     double txPowerDbm)
+{
+  bool hasTxAntenna = txParams->txAntenna != 0;
+  double txGainDb = 0.0;
+  if (hasTxAntenna)
+    {
+      if (!DynamicCast<IsotropicAntennaModel> (txParams->txAntenna))
+        {
+          return false;
+        }
+      txGainDb = txParams->txAntenna->GetGainDb (Angles ());
+    }
+  m_batches++;
+
+  // Reading a moving node once per instant rather than once per
+  // transmission gives the same positions: a model that advances its state
+  // when read, as ConstantVelocityHelper does, adds nothing at an instant
+  // it has already reached
+  Time now = Simulator::Now ();
+  m_batchIndex.clear ();
+  m_batchX.clear ();
+  m_batchY.clear ();
+  m_batchZ.clear ();
+  for (std::vector<uint32_t>::const_iterator i = m_candidates.begin (); i != m_candidates.end (); ++i)
+    {
+      const Receiver &rx = m_receivers[*i];
+      if (rx.phy == txParams->txPhy)
+        {
+          continue;
+        }
+      if (m_posTime[*i] != now && !m_posStill[*i])
+        {
+          Vector pos = rx.mobility->GetPosition ();
+          m_posX[*i] = pos.x;
+          m_posY[*i] = pos.y;
+          m_posZ[*i] = pos.z;
+          m_posTime[*i] = now;
+          m_positionReads++;
+        }
+      m_batchIndex.push_back (*i);
+      m_batchX.push_back (m_posX[*i]);
+      m_batchY.push_back (m_posY[*i]);
+      m_batchZ.push_back (m_posZ[*i]);
+    }
+  uint32_t n = m_batchIndex.size ();
+  m_evaluated += n;
+  if (n == 0)
+    {
+      return true;
+    }
+
+  // Squared distances, in one pass the compiler can vectorize
+  Vector sender = senderMobility->GetPosition ();
+  m_batchD2.resize (n);
+  const double *__restrict__ x = &m_batchX[0];
+  const double *__restrict__ y = &m_batchY[0];
+  const double *__restrict__ z = &m_batchZ[0];
+  double *__restrict__ d2 = &m_batchD2[0];
+  for (uint32_t i = 0; i < n; i++)
+    {
+      double dx = x[i] - sender.x;
+      double dy = y[i] - sender.y;
+      double dz = z[i] - sender.z;
+      d2[i] = dx * dx + dy * dy + dz * dz;
+    }
+
+  // Past this distance the strongest receiver is below the cutoff, with a
+  // margin far wider than any rounding in the distance
+  double budgetDb = txPowerDbm + txGainDb + m_maxRxGainDb - m_referenceLoss - m_cutoffDbm;
+  double reach = m_referenceDistance * std::pow (10.0, std::max (budgetDb, 0.0) / (10 * m_exponent)) * (1 + 1e-6);
+  double reach2 = reach * reach;
+
+  // Compact the candidates within reach to the front
+  uint32_t m = 0;
+  for (uint32_t i = 0; i < n; i++)
+    {
+      if (d2[i] > reach2)
+        {
+          continue;
+        }
+      m_batchIndex[m] = m_batchIndex[i];
+      d2[m] = d2[i];
+      m++;
+    }
+  m_prefiltered += n - m;
+  if (m == 0)
+    {
+      return true;
+    }
+
+  // The models' formulas below are copied from ns-3.29's
+  // LogDistancePropagationLossModel::DoCalcRxPower and
+  // ConstantSpeedPropagationDelayModel::GetDelay, on the distance
+  // MobilityModel::GetDistanceFrom gives; they have to follow any change
+  // there to stay bit for bit equal to the models' virtual calls
+  m_batchRxDbm.resize (m);
+  m_batchDelay.resize (m);
+  double *__restrict__ rxDbm = &m_batchRxDbm[0];
+  double *__restrict__ delayS = &m_batchDelay[0];
+  for (uint32_t i = 0; i < m; i++)
+    {
+      d2[i] = std::sqrt (d2[i]);  // now the distance, as CalculateDistance
+    }
+  for (uint32_t i = 0; i < m; i++)
+    {
+      if (d2[i] <= m_referenceDistance)
+        {
+          rxDbm[i] = txPowerDbm - m_referenceLoss;
+        }
+      else
+        {
+          double pathLossDb = 10 * m_exponent * std::log10 (d2[i] / m_referenceDistance);
+          double rxc = -m_referenceLoss - pathLossDb;
+          rxDbm[i] = txPowerDbm + rxc;
+        }
+    }
+  if (m_speed > 0)
+    {
+      for (uint32_t i = 0; i < m; i++)
+        {
+          delayS[i] = d2[i] / m_speed;
+        }
+    }
+
+  for (uint32_t i = 0; i < m; i++)
+    {
+      const Receiver &rx = m_receivers[m_batchIndex[i]];
+      // Summed in Evaluate's order
+      double gainDb = 0.0;
+      if (hasTxAntenna)
+        {
+          gainDb += txGainDb;
+        }
+      if (rx.hasAntenna)
+        {
+          gainDb += rx.antennaGainDb;
+        }
+      gainDb += rxDbm[i] - txPowerDbm;
+      if (txPowerDbm + gainDb < m_cutoffDbm)
+        {
+          continue;
+        }
+      Accept (txParams, m_batchIndex[i], gainDb, m_speed > 0 ? Seconds (delayS[i]) : Seconds (0));
+    }
+  return true;
+}
+
+Ptr<SpectrumSignalParameters>
+CrowdSpectrumChannel::MakeRxParams (Ptr<SpectrumSignalParameters> txParams, const Receiver &rx,
+                                    double gainDb) const
+{
+  Ptr<SpectrumSignalParameters> rxParams = txParams->Copy ();
+  rxParams->psd = Copy<SpectrumValue> (txParams->psd);
+  *(rxParams->psd) *= std::pow (10.0, gainDb / 10.0);
+  if (m_spectrumLoss)
+    {
+      rxParams->psd = m_spectrumLoss->CalcRxPowerSpectralDensity (rxParams->psd,
+                                                                  txParams->txPhy->GetMobility (),
+                                                                  rx.mobility);
+    }
+  return rxParams;
+}
+
+void
+CrowdSpectrumChannel::Deliver (Ptr<SpectrumSignalParameters> txParams, const Receiver &rx,
+                               double gainDb, Time delay)
+{
+  Ptr<SpectrumSignalParameters> rxParams = MakeRxParams (txParams, rx, gainDb);
+  Simulator::ScheduleWithContext (rx.node, delay, &CrowdSpectrumChannel::StartRx, rxParams, rx.phy);
+  m_delivered++;
+  m_rxParams++;
+}
+
+bool
+CrowdSpectrumChannel::LowerGain (const Delivery *a, const Delivery *b)
+{
+  return a->gainDb < b->gainDb;
+}
+
+bool
+CrowdSpectrumChannel::ArrivesEarlier (const Delivery &a, const Delivery &b)
+{
+  return a.delay < b.delay;
+}
+
+/*
+ * Deliver m_deliveries through one FanOutEvent and one set of receive
+ * parameters per distinct gain.
+ */
+void
+CrowdSpectrumChannel::FanOut (Ptr<SpectrumSignalParameters> txParams)
+{
+  if (m_spectrumLoss)
+    {
+      // A spectrum model may shape every receiver's PSD differently
+      for (uint32_t i = 0; i < m_deliveries.size (); i++)
+        {
+          m_deliveries[i].params = MakeRxParams (txParams, m_receivers[m_deliveries[i].receiver],
+                                                 m_deliveries[i].gainDb);
+          m_rxParams++;
+        }
+    }
+  else
+    {
+      m_byGain.clear ();
+      for (uint32_t i = 0; i < m_deliveries.size (); i++)
+        {
+          m_byGain.push_back (&m_deliveries[i]);
+        }
+      std::sort (m_byGain.begin (), m_byGain.end (), &CrowdSpectrumChannel::LowerGain);
+      for (uint32_t i = 0; i < m_byGain.size (); i++)
+        {
+          if (i > 0 && m_byGain[i]->gainDb == m_byGain[i - 1]->gainDb)
+            {
+              m_byGain[i]->params = m_byGain[i - 1]->params;
+              continue;
+            }
+          m_byGain[i]->params = MakeRxParams (txParams, m_receivers[m_byGain[i]->receiver],
+                                              m_byGain[i]->gainDb);
+          m_rxParams++;
+        }
+    }
+
+  // Arrival order is invocation order; equal delays keep candidate order
+  std::stable_sort (m_deliveries.begin (), m_deliveries.end (), &CrowdSpectrumChannel::ArrivesEarlier);
+  Ptr<FanOutEvent> event = Create<FanOutEvent> ();
+  for (uint32_t i = 0; i < m_deliveries.size (); i++)
+    {
+      const Receiver &rx = m_receivers[m_deliveries[i].receiver];
+      event->Add (rx.phy, m_deliveries[i].params, rx.node);
+    }
+  for (uint32_t i = 0; i < m_deliveries.size (); i++)
+    {
+      // Every scheduled copy holds, and after running drops, a reference
+      event->Ref ();
+      Simulator::ScheduleWithContext (m_receivers[m_deliveries[i].receiver].node, m_deliveries[i].delay,
+                                      PeekPointer (event));
+      m_deliveries[i].params = 0;
+    }
+  m_delivered += m_deliveries.size ();
+  m_fanOuts++;
+}
+
+void
+CrowdSpectrumChannel::StartRx (Ptr<SpectrumSignalParameters> params, Ptr<SpectrumPhy> receiver)
+{
+  receiver->StartRx (params);
+}
+
+void
+CrowdSpectrumChannel::StartTx (Ptr<SpectrumSignalParameters> txParams)
+{
+  if (!m_indexed)
+    {
+      BuildIndex ();
+    }
+  Ptr<MobilityModel> senderMobility = txParams->txPhy->GetMobility ();
+  NS_ASSERT (senderMobility);
+  double txPowerDbm = 10.0 * std::log10 (Integral (*txParams->psd)) + 30.0;
+
+  m_txCount++;
+  m_candidates.clear ();
+  m_deliveries.clear ();
+  if (m_spatialIndex && !std::isinf (m_range))
+    {
+      if (m_maxSpeed * (Simulator::Now () - m_lastRebinAll).GetSeconds () > m_slack)
+        {
+          RebinAll ();
+        }
+      Vector pos = senderMobility->GetPosition ();
+      double reach = m_range + m_slack;
+      int64_t x0 = static_cast<int64_t> (std::floor ((pos.x - reach) / m_cellSize));
+      int64_t x1 = static_cast<int64_t> (std::floor ((pos.x + reach) / m_cellSize));
+      int64_t y0 = static_cast<int64_t> (std::floor ((pos.y - reach) / m_cellSize));
+      int64_t y1 = static_cast<int64_t> (std::floor ((pos.y + reach) / m_cellSize));
+      for (int64_t ix = x0; ix <= x1; ix++)
+        {
+          for (int64_t iy = y0; iy <= y1; iy++)
+            {
+              CellMap::const_iterator cell = m_cells.find (CellKey (ix, iy));
+              if (cell != m_cells.end ())
+                {
+                  m_candidates.insert (m_candidates.end (), cell->second.begin (), cell->second.end ());
+                }
+            }
+        }
+    }
+  else
+    {
+      for (uint32_t i = 0; i < m_receivers.size (); i++)
+        {
+          m_candidates.push_back (i);
+        }
+    }
+
+  if (!m_batchable || !EvaluateBatch (txParams, senderMobility, txPowerDbm))
+    {
+      for (std::vector<uint32_t>::const_iterator i = m_candidates.begin (); i != m_candidates.end (); ++i)
+        {
+          const Receiver &rx = m_receivers[*i];
+          if (rx.phy == txParams->txPhy)
+            {
+              continue;
+            }
+          m_evaluated++;
+          double gainDb;
+          Time delay;
+          if (Evaluate (txParams, senderMobility, txPowerDbm, rx, gainDb, delay))
+            {
+              Accept (txParams, *i, gainDb, delay);
+            }
+        }
+    }
+  if (m_deliveries.size () == 1)
+    {
+      Deliver (txParams, m_receivers[m_deliveries[0].receiver], m_deliveries[0].gainDb,
+               m_deliveries[0].delay);
+    }
+  else if (m_deliveries.size () > 1)
+    {
+      FanOut (txParams);
+    }
+
+  if (m_validate)
+    {
+      Validate (txParams, senderMobility, txPowerDbm);
+    }
+}
+
+void
+CrowdSpectrumChannel::Accept (Ptr<SpectrumSignalParameters> txParams, uint32_t index, double gainDb,
+                              Time delay)
+{
+  m_stamp[index] = m_txCount;
+  if (m_validate)
+    {
+      m_lastGainDb[index] = gainDb;
+      m_lastDelay[index] = delay;
+    }
+  if (m_shareFanOut)
+    {
+      Delivery delivery;
+      delivery.receiver = index;
+      delivery.gainDb = gainDb;
+      delivery.delay = delay;
+      m_deliveries.push_back (delivery);
+    }
+  else
+    {
+      Deliver (txParams, m_receivers[index], gainDb, delay);
+    }
+}
+
+void
+CrowdSpectrumChannel::Validate (Ptr<SpectrumSignalParameters> txParams, Ptr<MobilityModel> senderMobility,
+                                double txPowerDbm)
+{
+  for (uint32_t i = 0; i < m_receivers.size (); i++)
+    {
+      const Receiver &rx = m_receivers[i];
+      if (rx.phy == txParams->txPhy)
+        {
+          continue;
+        }
+      double gainDb;
+      Time delay;
+      bool exhaustive = Evaluate (txParams, senderMobility, txPowerDbm, rx, gainDb, delay);
+      bool indexed = m_stamp[i] == m_txCount;
+      if (exhaustive && !indexed)
+        {
+          m_missed++;
+        }
+      else if (!exhaustive && indexed)
+        {
+          m_extra++;
+        }
+      else if (exhaustive && (gainDb != m_lastGainDb[i] || delay != m_lastDelay[i]))
+        {
+          m_mismatched++;
+        }
+    }
+}
+
+void
+CrowdSpectrumChannel::PrintStats (std::ostream &os) const
+{
+  os << "channel: " << m_receivers.size () << " receivers, " << m_txCount << " transmissions, "
+     << m_evaluated << " receivers evaluated, " << m_delivered << " delivered with "
+     << m_rxParams << " receive parameter sets";
+  if (m_shareFanOut)
+    {
+      os << ", " << m_fanOuts << " shared fan-outs";
+    }
+  if (m_batchable)
+    {
+      os << ", " << m_batches << " batches dropping " << m_prefiltered << " candidates by distance, "
+         << m_positionReads << " positions read";
+    }
+  if (m_spatialIndex)
+    {
+      os << ", range " << m_range << " m, cell " << m_cellSize << " m, "
+         << m_cells.size () << " cells, " << m_rebinAll << " full rebins";
+    }
+  os << std::endl;
+  if (m_validate)
+    {
+      os << "channel validation: " << m_missed << " deliveries missed, "
+         << m_extra << " extra deliveries, " << m_mismatched
+         << " deliveries with another gain or delay against the exhaustive channel" << std::endl;
+    }
+}
+
+} // namespace ns3
+
+#endif /* CROWD_SPECTRUM_CHANNEL_H */
@@ -0,0 +1,137 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Internet stack and IPv6 addressing for the crowd nodes, by profile.
+ *
+ * "full" is what the scenarios always installed: InternetStackHelper with
+ * both IPv4 (ARP, ICMP, IPv4 routing) and IPv6, every address checked by
+ * duplicate address detection, and a pfifo_fast root queue disc with its
+ * three bands on every device.
+ *
+ * "lite" keeps only what the crowd workloads use, which all run over
+ * IPv6: no IPv4 stack at all, no DAD (the addresses come from one helper
+ * and cannot clash), and no queue disc, so packets go straight to the
+ * Wi-Fi MAC queue. The routing helper is the caller's as before. The
+ * oracle sends no control packets, but keeps a tree per destination in
+ * use, at 6 bytes per node each, so with many destinations its tables
+ * rather than the stack set the memory. crowd-node-bench measures what
+ * each profile costs per node, the oracle's tables included.
+ */
+
+#ifndef CROWD_STACK_HELPER_H
+#define CROWD_STACK_HELPER_H
+
+#include "ns3/internet-stack-helper.h"
+#include "ns3/ipv6-address-helper.h"
+#include "ns3/ipv6-routing-helper.h"
+#include "ns3/ipv6-interface-container.h"
+#include "ns3/icmpv6-l4-protocol.h"
+#include "ns3/traffic-control-helper.h"
+#include "ns3/node-container.h"
+#include "ns3/net-device-container.h"
+#include "ns3/boolean.h"
+#include "ns3/abort.h"
+
+#include <string>
+
+namespace ns3 {
+
+class CrowdStackHelper
+{
+public:
+  CrowdStackHelper ();
+
+  /*
+   * "full" or "lite".
+   */
+  void SetProfile (std::string profile);
+  /*
+   * As InternetStackHelper::SetRoutingHelper; the helper is copied.
+   */
+  void SetRoutingHelper (const Ipv6RoutingHelper &routing);
+  void SetBase (Ipv6Address network, Ipv6Prefix prefix);
+
+  /*
+   * Install the stack on nodes and give devices, one per node, their
+   * addresses.
+   */
+  Ipv6InterfaceContainer Install (NodeContainer nodes, NetDeviceContainer devices);
+
+private:
+  std::string m_profile;
+  InternetStackHelper m_internet;
+  Ipv6Address m_network;
+  Ipv6Prefix m_prefix;
+};
+
+CrowdStackHelper::CrowdStackHelper ()
+  : m_profile ("full"),
+    m_network ("2001:1::"),
+    m_prefix (64)
+{
+}
+
+void
+CrowdStackHelper::SetProfile (std::string profile)
+{
+  NS_ABORT_MSG_UNLESS (profile == "full" || profile == "lite", "unknown node profile " << profile);
+  m_profile = profile;
+}
+
+void
+CrowdStackHelper::SetRoutingHelper (const Ipv6RoutingHelper &routing)
+{
+  m_internet.SetRoutingHelper (routing);
+}
+
+void
+CrowdStackHelper::SetBase (Ipv6Address network, Ipv6Prefix prefix)
+{
+  m_network = network;
+  m_prefix = prefix;
+}
+
+Ipv6InterfaceContainer
+CrowdStackHelper::Install (NodeContainer nodes, NetDeviceContainer devices)
+{
+  bool lite = m_profile == "lite";
+  m_internet.SetIpv4StackInstall (!lite);
+  m_internet.Install (nodes);
+  if (lite)
+    {
+      // Read when an address is added, so this must precede Assign
+      for (NodeContainer::Iterator n = nodes.Begin (); n != nodes.End (); ++n)
+        {
+          (*n)->GetObject<Icmpv6L4Protocol> ()->SetAttribute ("DAD", BooleanValue (false));
+        }
+    }
+
+  Ipv6AddressHelper ipv6;
+  ipv6.SetBase (m_network, m_prefix);
+  Ipv6InterfaceContainer interfaces = ipv6.Assign (devices);
+  if (lite)
+    {
+      // Assign put the default root queue disc on every device
+      TrafficControlHelper tc;
+      tc.Uninstall (devices);
+    }
+  return interfaces;
+}
+
+} // namespace ns3
+
+#endif /* CROWD_STACK_HELPER_H */
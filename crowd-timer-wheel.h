@@ -0,0 +1,203 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Hashed timer wheel for a fixed set of timers.
+ *
+ * Timers are numbered 0..timers-1 and due at an integer tick. The wheel
+ * has a power-of-two number of slots; a timer sits in slot (due & mask) on
+ * an intrusive list, and a bitmap of non-empty slots lets NextDue skip
+ * empty ones a word at a time. Timers due more than one revolution ahead
+ * share their slot with nearer ones and are only taken out once their
+ * tick is reached. Nothing is allocated after Reset.
+ */
+
+#ifndef CROWD_TIMER_WHEEL_H
+#define CROWD_TIMER_WHEEL_H
+
+#include <stdint.h>
+#include <vector>
+
+namespace crowd {
+
+class TimerWheel
+{
+public:
+  enum { NONE = 0xffffffffu };
+
+  TimerWheel ()
+    : m_current (0),
+      m_mask (0),
+      m_pending (0)
+  {
+  }
+
+  /*
+   * Room for timers timers on 2^slotsLog2 slots (at least 64), all idle,
+   * with the wheel at tick now.
+   */
+  void Reset (uint32_t timers, uint32_t slotsLog2, uint64_t now)
+  {
+    uint32_t slots = 1u << (slotsLog2 < 6 ? 6 : slotsLog2);
+    m_head.assign (slots, NONE);
+    m_occupied.assign (slots / 64, 0);
+    m_next.assign (timers, NONE);
+    m_due.assign (timers, 0);
+    m_mask = slots - 1;
+    m_current = now;
+    m_pending = 0;
+  }
+
+  /*
+   * Arm an idle timer for tick; ticks already passed fire on the next
+   * Advance.
+   */
+  void Schedule (uint32_t timer, uint64_t tick)
+  {
+    if (tick < m_current)
+      {
+        tick = m_current;
+      }
+    uint32_t slot = tick & m_mask;
+    m_due[timer] = tick;
+    m_next[timer] = m_head[slot];
+    m_head[slot] = timer;
+    m_occupied[slot / 64] |= uint64_t (1) << (slot % 64);
+    m_pending++;
+  }
+
+  /*
+   * Earliest tick at which a timer is due; false if none is armed.
+   */
+  bool NextDue (uint64_t &tick) const
+  {
+    if (m_pending == 0)
+      {
+        return false;
+      }
+    // Within one revolution the first occupied slot holding a timer due
+    // in this revolution is the answer
+    uint32_t slots = m_mask + 1;
+    uint32_t start = m_current & m_mask;
+    for (uint32_t visited = 0; visited < slots; )
+      {
+        uint32_t slot = (start + visited) & m_mask;
+        uint64_t word = m_occupied[slot / 64] >> (slot % 64);
+        if (word == 0)
+          {
+            visited += 64 - slot % 64;
+            continue;
+          }
+        uint32_t skip = __builtin_ctzll (word);
+        visited += skip;
+        if (visited >= slots)
+          {
+            break;
+          }
+        slot = (start + visited) & m_mask;
+        uint64_t due = m_current + visited;
+        for (uint32_t t = m_head[slot]; t != NONE; t = m_next[t])
+          {
+            if (m_due[t] == due)
+              {
+                tick = due;
+                return true;
+              }
+          }
+        visited++;
+      }
+    // Only timers more than a revolution ahead are left
+    uint64_t best = ~uint64_t (0);
+    for (uint32_t slot = 0; slot < slots; slot++)
+      {
+        for (uint32_t t = m_head[slot]; t != NONE; t = m_next[t])
+          {
+            if (m_due[t] < best)
+              {
+                best = m_due[t];
+              }
+          }
+      }
+    tick = best;
+    return true;
+  }
+
+  /*
+   * Move the wheel to tick (not backwards), appending every timer due at
+   * or before it to expired. Expired timers are idle again.
+   */
+  void Advance (uint64_t tick, std::vector<uint32_t> &expired)
+  {
+    if (tick < m_current)
+      {
+        return;
+      }
+    uint64_t span = tick - m_current + 1;
+    uint32_t count = span > m_mask ? m_mask + 1 : static_cast<uint32_t> (span);
+    for (uint32_t i = 0; i < count && m_pending > 0; i++)
+      {
+        uint32_t slot = (m_current + i) & m_mask;
+        if (!(m_occupied[slot / 64] & (uint64_t (1) << (slot % 64))))
+          {
+            continue;
+          }
+        uint32_t *link = &m_head[slot];
+        while (*link != NONE)
+          {
+            uint32_t t = *link;
+            if (m_due[t] <= tick)
+              {
+                *link = m_next[t];
+                m_next[t] = NONE;
+                m_pending--;
+                expired.push_back (t);
+              }
+            else
+              {
+                link = &m_next[t];
+              }
+          }
+        if (m_head[slot] == NONE)
+          {
+            m_occupied[slot / 64] &= ~(uint64_t (1) << (slot % 64));
+          }
+      }
+    m_current = tick;
+  }
+
+  uint64_t GetCurrent (void) const
+  {
+    return m_current;
+  }
+
+  uint32_t GetPending (void) const
+  {
+    return m_pending;
+  }
+
+private:
+  std::vector<uint32_t> m_head;       // per slot, first timer or NONE
+  std::vector<uint64_t> m_occupied;   // bitmap of slots with a timer
+  std::vector<uint32_t> m_next;       // per timer, next in its slot
+  std::vector<uint64_t> m_due;        // per timer, tick
+  uint64_t m_current;
+  uint32_t m_mask;
+  uint32_t m_pending;
+};
+
+} // namespace crowd
+
+#endif /* CROWD_TIMER_WHEEL_H */
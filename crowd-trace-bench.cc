@@ -0,0 +1,167 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Wildcard Config::Connect versus CrowdTraceConnect.
+//
+// ./waf --run "crowd-trace-bench --nodes=1000,5000,10000,20000 --calls=10"
+//
+// For every node count, and for each way of connecting, a fresh process
+// creates the nodes with a ConstantPositionMobilityModel, hooks
+// CourseChange and then moves every node calls times. "config" is what
+// the scenarios used to do: Config::Connect on "/NodeList/*/$ns3::
+// MobilityModel/CourseChange" with a sink that takes the context string
+// and looks up the node id through GetObject<Node>. "direct" is
+// CrowdTraceConnect with the node id bound to the sink. Both sinks do the
+// same work on the position. Reported are the connect time and the cost
+// of one traced course change.
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/mobility-module.h"
+
+#include <sys/time.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+
+#include "crowd-worker-pool.h"
+#include "crowd-trace-bind.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("CrowdTraceBench");
+
+struct Totals
+{
+  double sum;
+  uint64_t calls;
+};
+
+static void
+ContextSink (Totals *totals, std::string context, Ptr<const MobilityModel> mobility)
+{
+  Vector pos = mobility->GetPosition ();
+  totals->sum += pos.x + mobility->GetObject<Node> ()->GetId ();
+  totals->calls++;
+}
+
+static void
+DirectSink (Totals *totals, uint32_t node, Ptr<const MobilityModel> mobility)
+{
+  Vector pos = mobility->GetPosition ();
+  totals->sum += pos.x + node;
+  totals->calls++;
+}
+
+static double
+WallSeconds (void)
+{
+  struct timeval tv;
+  gettimeofday (&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int
+RunBench (std::string mode, uint32_t nodes, uint32_t calls)
+{
+  double start = WallSeconds ();
+  NodeContainer c;
+  c.Create (nodes);
+  MobilityHelper mobility;
+  mobility.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
+  mobility.Install (c);
+  std::vector<Ptr<MobilityModel> > models;
+  models.reserve (nodes);
+  for (uint32_t n = 0; n < nodes; n++)
+    {
+      models.push_back (c.Get (n)->GetObject<MobilityModel> ());
+    }
+  double created = WallSeconds ();
+
+  Totals totals = { 0.0, 0 };
+  if (mode == "config")
+    {
+      Config::Connect ("/NodeList/*/$ns3::MobilityModel/CourseChange",
+                       MakeBoundCallback (&ContextSink, &totals));
+    }
+  else
+    {
+      CrowdTraceConnect<MobilityModel> (c, "CourseChange", &DirectSink, &totals);
+    }
+  double connected = WallSeconds ();
+
+  for (uint32_t k = 0; k < calls; k++)
+    {
+      for (uint32_t n = 0; n < nodes; n++)
+        {
+          models[n]->SetPosition (Vector (k, n, 0));
+        }
+    }
+  double moved = WallSeconds ();
+  Simulator::Destroy ();
+
+  std::printf ("mode=%-7s nodes=%-6u  create %.3f s  connect %.3f s (%.2f us per node)  "
+               "%.1f ns per traced course change  (%llu calls, checksum %.0f)\n",
+               mode.c_str (), nodes, created - start, connected - created,
+               (connected - created) * 1e6 / nodes,
+               totals.calls > 0 ? (moved - connected) * 1e9 / totals.calls : 0.0,
+               (unsigned long long) totals.calls, totals.sum);
+  std::fflush (stdout);
+  return totals.calls == static_cast<uint64_t> (nodes) * calls ? 0 : 1;
+}
+
+int main (int argc, char *argv[])
+{
+  std::string nodeList ("1000,5000,10000,20000");
+  uint32_t calls = 10;
+  std::string mode ("both");
+
+  CommandLine cmd;
+  cmd.AddValue ("nodes", "comma-separated node counts", nodeList);
+  cmd.AddValue ("calls", "course changes per node", calls);
+  cmd.AddValue ("mode", "config, direct or both", mode);
+  cmd.Parse (argc, argv);
+  NS_ABORT_MSG_UNLESS (mode == "config" || mode == "direct" || mode == "both", "unknown mode " << mode);
+
+  std::vector<uint32_t> counts;
+  std::istringstream in (nodeList);
+  std::string item;
+  while (std::getline (in, item, ','))
+    {
+      counts.push_back (std::atoi (item.c_str ()));
+    }
+
+  // One process per configuration: the NodeList is global
+  CrowdWorkerPool pool (1);
+  const char *modes[] = { "config", "direct" };
+  for (uint32_t i = 0; i < counts.size (); i++)
+    {
+      for (uint32_t m = 0; m < 2; m++)
+        {
+          std::string one = modes[m];
+          if (mode != "both" && mode != one)
+            {
+              continue;
+            }
+          uint32_t nodes = counts[i];
+          pool.Submit ([=] () { return RunBench (one, nodes, calls); });
+        }
+    }
+  pool.WaitAll ();
+  return 0;
+}
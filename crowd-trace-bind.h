@@ -0,0 +1,81 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Direct trace connection over a NodeContainer.
+ *
+ * A wildcard Config::Connect over /NodeList matches the path against every
+ * node, resolves the aggregate by name, and builds a context string per
+ * connection that every call then copies into the sink, which usually has
+ * to look the node up again from the model. CrowdTraceConnect<T> instead
+ * takes the T aggregated to each node, looks the trace source up once per
+ * TypeId and binds the sink to (context, node id):
+ *
+ *   static void Sink (Recorder *r, uint32_t node, Ptr<const MobilityModel> m);
+ *   CrowdTraceConnect<MobilityModel> (nodes, "CourseChange", &Sink, recorder);
+ *
+ * Nodes without a T are skipped. Like Config::Connect, only the nodes that
+ * exist at the time are connected.
+ */
+
+#ifndef CROWD_TRACE_BIND_H
+#define CROWD_TRACE_BIND_H
+
+#include "ns3/node-container.h"
+#include "ns3/callback.h"
+#include "ns3/trace-source-accessor.h"
+#include "ns3/type-id.h"
+#include "ns3/abort.h"
+
+#include <string>
+
+namespace ns3 {
+
+/*
+ * Connect fn (ctx, node id, trace arguments...) to traceSource of the T on
+ * every node. Returns the number of nodes connected.
+ */
+template <typename T, typename Fn, typename Ctx>
+uint32_t
+CrowdTraceConnect (NodeContainer nodes, std::string traceSource, Fn fn, Ctx ctx)
+{
+  uint32_t connected = 0;
+  TypeId lastType;
+  Ptr<const TraceSourceAccessor> accessor;
+  for (NodeContainer::Iterator i = nodes.Begin (); i != nodes.End (); ++i)
+    {
+      Ptr<T> object = (*i)->GetObject<T> ();
+      if (!object)
+        {
+          continue;
+        }
+      // Models of one kind share the lookup
+      TypeId type = object->GetInstanceTypeId ();
+      if (!accessor || type != lastType)
+        {
+          accessor = type.LookupTraceSourceByName (traceSource);
+          lastType = type;
+          NS_ABORT_MSG_UNLESS (accessor, type.GetName () << " has no trace source " << traceSource);
+        }
+      accessor->ConnectWithoutContext (PeekPointer (object), MakeBoundCallback (fn, ctx, (*i)->GetId ()));
+      connected++;
+    }
+  return connected;
+}
+
+} // namespace ns3
+
+#endif /* CROWD_TRACE_BIND_H */
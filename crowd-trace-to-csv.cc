@@ -0,0 +1,175 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Converts the binary traces written by the crowd scenarios back to CSV.
+//
+// ./waf --run "crowd-trace-to-csv crowdsrc-adhoc-trajectory.ctrj"
+// ./waf --run "crowd-trace-to-csv crowdsrc-adhoc-trajectory.ctrj out.csv"
+// ./waf --run "crowd-trace-to-csv flows.cflw flows.csv"
+//
+// The file type is detected from its magic number. Without an output file
+// the CSV goes to standard output.
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "crowd-trajectory.h"
+#include "crowd-flow-log.h"
+
+static int
+TrajectoryToCsv (const std::string &in, std::ostream &out)
+{
+  crowd::TrajectoryReader reader;
+  if (!reader.Open (in))
+    {
+      std::cerr << in << ": not a trajectory file" << std::endl;
+      return 1;
+    }
+  out << "node,time_s,x,y,z,vx,vy,vz\n";
+  crowd::TrajectoryRecord r;
+  char line[256];
+  while (reader.Next (r))
+    {
+      std::snprintf (line, sizeof (line), "%u,%.9f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+                     r.node, r.timeNs / 1e9, r.pos[0], r.pos[1], r.pos[2],
+                     r.vel[0], r.vel[1], r.vel[2]);
+      out << line;
+    }
+  return 0;
+}
+
+static std::string
+FormatIpv6 (const uint8_t *a)
+{
+  char buf[48];
+  std::snprintf (buf, sizeof (buf), "%x:%x:%x:%x:%x:%x:%x:%x",
+                 (a[0] << 8) | a[1], (a[2] << 8) | a[3], (a[4] << 8) | a[5], (a[6] << 8) | a[7],
+                 (a[8] << 8) | a[9], (a[10] << 8) | a[11], (a[12] << 8) | a[13], (a[14] << 8) | a[15]);
+  return buf;
+}
+
+/*
+ * Upper edge of the histogram bucket holding quantile q; the histograms
+ * are power-of-two buckets, so this is within a factor of two.
+ */
+static uint64_t
+HistCount (const uint32_t *hist)
+{
+  uint64_t total = 0;
+  for (uint32_t b = 0; b < crowd::FLOW_HIST_BUCKETS; b++)
+    {
+      total += hist[b];
+    }
+  return total;
+}
+
+static double
+HistQuantile (const uint32_t *hist, double q)
+{
+  uint64_t total = HistCount (hist);
+  if (total == 0)
+    {
+      return 0.0;
+    }
+  uint64_t seen = 0;
+  for (uint32_t b = 0; b < crowd::FLOW_HIST_BUCKETS; b++)
+    {
+      seen += hist[b];
+      if (seen >= q * total)
+        {
+          return b == 0 ? 0.0 : static_cast<double> (1ULL << b);
+        }
+    }
+  return static_cast<double> (1ULL << (crowd::FLOW_HIST_BUCKETS - 1));
+}
+
+static int
+FlowLogToCsv (const std::string &in, std::ostream &out)
+{
+  crowd::FlowLogReader reader;
+  if (!reader.Open (in))
+    {
+      std::cerr << in << ": not a flow log" << std::endl;
+      return 1;
+    }
+  out << "time_s,flow,src,dst,proto,sport,dport,tx_packets,tx_bytes,rx_packets,rx_bytes,"
+      << "dropped,forwarded,mean_delay_ms,mean_jitter_ms,delay_p50_ms,delay_p99_ms\n";
+  crowd::FlowSnapshotRecord r;
+  char line[512];
+  while (reader.Next (r))
+    {
+      const crowd::FlowCounters &c = r.counters;
+      // One jitter sample per delivery after a receiver's first
+      uint64_t jitters = HistCount (c.jitterHist);
+      std::snprintf (line, sizeof (line),
+                     "%.3f,%u,%s,%s,%u,%u,%u,%llu,%llu,%llu,%llu,%llu,%llu,%.3f,%.3f,%.3f,%.3f\n",
+                     r.timeNs / 1e9, r.flow, FormatIpv6 (r.key.src).c_str (), FormatIpv6 (r.key.dst).c_str (),
+                     r.key.proto, r.key.sport, r.key.dport,
+                     (unsigned long long) c.txPackets, (unsigned long long) c.txBytes,
+                     (unsigned long long) c.rxPackets, (unsigned long long) c.rxBytes,
+                     (unsigned long long) c.dropped, (unsigned long long) c.forwarded,
+                     c.rxPackets ? c.delaySumNs / 1e6 / c.rxPackets : 0.0,
+                     jitters ? c.jitterSumNs / 1e6 / jitters : 0.0,
+                     HistQuantile (c.delayHist, 0.5) / 1e3, HistQuantile (c.delayHist, 0.99) / 1e3);
+      out << line;
+    }
+  return 0;
+}
+
+int main (int argc, char *argv[])
+{
+  if (argc < 2 || argc > 3)
+    {
+      std::cerr << "usage: " << argv[0] << " <trace file> [output.csv]" << std::endl;
+      return 2;
+    }
+  std::string in = argv[1];
+
+  char magic[4] = { 0, 0, 0, 0 };
+  std::ifstream probe (in.c_str (), std::ios::binary);
+  if (!probe.read (magic, 4))
+    {
+      std::cerr << in << ": cannot read" << std::endl;
+      return 1;
+    }
+  probe.close ();
+
+  std::ofstream file;
+  if (argc == 3)
+    {
+      file.open (argv[2]);
+      if (!file)
+        {
+          std::cerr << argv[2] << ": cannot write" << std::endl;
+          return 1;
+        }
+    }
+  std::ostream &out = argc == 3 ? file : std::cout;
+
+  if (std::memcmp (magic, crowd::TRAJECTORY_MAGIC, 4) == 0)
+    {
+      return TrajectoryToCsv (in, out);
+    }
+  if (std::memcmp (magic, crowd::FLOWLOG_MAGIC, 4) == 0)
+    {
+      return FlowLogToCsv (in, out);
+    }
+  std::cerr << in << ": unknown trace format" << std::endl;
+  return 1;
+}
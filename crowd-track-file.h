@@ -0,0 +1,294 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Precomputed node tracks, memory-mapped.
+ *
+ * A track is a time-ordered list of waypoints; a node moves in a straight
+ * line at constant speed between consecutive ones, stays at the first one
+ * before it and at the last one after it. Unlike a CTRJ recording, the file
+ * is laid out for random access by node, so that it can be mapped as is
+ * and every node's waypoints are only paged in once that node is asked
+ * for its position.
+ *
+ * File layout ("CTRK" version 1, host byte order, every field 8-byte
+ * aligned so that the mapping is used as is):
+ *
+ *   file     := magic "CTRK" | u32 version | u32 nodes | u32 reserved
+ *               | f64 maxSpeed | index[nodes] | waypoint*
+ *   index    := u64 offset | u64 count         (offset from start of file)
+ *   waypoint := i64 timeNs | f64 x | f64 y | f64 z   (metres)
+ *
+ * maxSpeed is the highest speed over any segment, for consumers that need a
+ * bound on how far a node can get between two looks.
+ */
+
+#ifndef CROWD_TRACK_FILE_H
+#define CROWD_TRACK_FILE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace crowd {
+
+static const char TRACK_MAGIC[4] = { 'C', 'T', 'R', 'K' };
+static const uint32_t TRACK_VERSION = 1;
+
+struct Waypoint
+{
+  int64_t timeNs;
+  double x;
+  double y;
+  double z;
+};
+
+/*
+ * Position and velocity at timeNs on the track w[0..n). cursor is a hint
+ * kept by the caller: the segment found last time. Queries at
+ * non-decreasing times therefore cost O(1) amortised; going back in time
+ * falls back to a binary search.
+ */
+inline void
+TrackLocate (const Waypoint *w, uint64_t n, int64_t timeNs, uint64_t &cursor,
+             double pos[3], double vel[3])
+{
+  vel[0] = vel[1] = vel[2] = 0.0;
+  if (n == 0)
+    {
+      pos[0] = pos[1] = pos[2] = 0.0;
+      return;
+    }
+  if (timeNs <= w[0].timeNs || n == 1)
+    {
+      pos[0] = w[0].x;
+      pos[1] = w[0].y;
+      pos[2] = w[0].z;
+      cursor = 0;
+      return;
+    }
+  if (timeNs >= w[n - 1].timeNs)
+    {
+      pos[0] = w[n - 1].x;
+      pos[1] = w[n - 1].y;
+      pos[2] = w[n - 1].z;
+      cursor = n - 1;
+      return;
+    }
+  // Find i with w[i].timeNs <= timeNs < w[i + 1].timeNs
+  uint64_t i = cursor < n - 1 ? cursor : n - 2;
+  if (w[i].timeNs > timeNs)
+    {
+      uint64_t lo = 0, hi = i;
+      while (hi - lo > 1)
+        {
+          uint64_t mid = lo + (hi - lo) / 2;
+          if (w[mid].timeNs <= timeNs)
+            {
+              lo = mid;
+            }
+          else
+            {
+              hi = mid;
+            }
+        }
+      i = lo;
+    }
+  else
+    {
+      while (w[i + 1].timeNs <= timeNs)
+        {
+          i++;
+        }
+    }
+  cursor = i;
+  const Waypoint &a = w[i];
+  const Waypoint &b = w[i + 1];
+  double dt = (b.timeNs - a.timeNs) / 1e9;
+  double f = (timeNs - a.timeNs) / 1e9;
+  vel[0] = (b.x - a.x) / dt;
+  vel[1] = (b.y - a.y) / dt;
+  vel[2] = (b.z - a.z) / dt;
+  pos[0] = a.x + vel[0] * f;
+  pos[1] = a.y + vel[1] * f;
+  pos[2] = a.z + vel[2] * f;
+}
+
+/*
+ * Write one track per node. Tracks must be sorted by time.
+ */
+inline bool
+WriteTracks (const std::string &filename, const std::vector<std::vector<Waypoint> > &tracks)
+{
+  double maxSpeed = 0.0;
+  for (size_t n = 0; n < tracks.size (); n++)
+    {
+      const std::vector<Waypoint> &t = tracks[n];
+      for (size_t i = 1; i < t.size (); i++)
+        {
+          double dt = (t[i].timeNs - t[i - 1].timeNs) / 1e9;
+          if (dt > 0)
+            {
+              double dx = t[i].x - t[i - 1].x, dy = t[i].y - t[i - 1].y, dz = t[i].z - t[i - 1].z;
+              maxSpeed = std::max (maxSpeed, std::sqrt (dx * dx + dy * dy + dz * dz) / dt);
+            }
+        }
+    }
+  std::FILE *file = std::fopen (filename.c_str (), "wb");
+  if (!file)
+    {
+      return false;
+    }
+  uint32_t header[4] = { 0, TRACK_VERSION, static_cast<uint32_t> (tracks.size ()), 0 };
+  std::memcpy (&header[0], TRACK_MAGIC, 4);
+  bool ok = std::fwrite (header, sizeof (header), 1, file) == 1
+    && std::fwrite (&maxSpeed, sizeof (maxSpeed), 1, file) == 1;
+  uint64_t offset = 24 + 16 * static_cast<uint64_t> (tracks.size ());
+  for (size_t n = 0; n < tracks.size () && ok; n++)
+    {
+      uint64_t index[2] = { offset, tracks[n].size () };
+      ok = std::fwrite (index, sizeof (index), 1, file) == 1;
+      offset += sizeof (Waypoint) * tracks[n].size ();
+    }
+  for (size_t n = 0; n < tracks.size () && ok; n++)
+    {
+      ok = tracks[n].empty ()
+        || std::fwrite (&tracks[n][0], sizeof (Waypoint), tracks[n].size (), file) == tracks[n].size ();
+    }
+  return std::fclose (file) == 0 && ok;
+}
+
+/*
+ * Read-only mapping of a CTRK file.
+ */
+class TrackFile
+{
+public:
+  TrackFile ()
+    : m_data (0),
+      m_size (0),
+      m_nodes (0),
+      m_maxSpeed (0.0)
+  {
+  }
+
+  ~TrackFile ()
+  {
+    Close ();
+  }
+
+  bool Open (const std::string &filename)
+  {
+    Close ();
+    int fd = open (filename.c_str (), O_RDONLY);
+    if (fd < 0)
+      {
+        return false;
+      }
+    struct stat st;
+    if (fstat (fd, &st) != 0 || st.st_size < 24)
+      {
+        close (fd);
+        return false;
+      }
+    void *p = mmap (0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (p == MAP_FAILED)
+      {
+        return false;
+      }
+    // Nodes are looked up in no particular order
+    madvise (p, st.st_size, MADV_RANDOM);
+    m_data = static_cast<const uint8_t *> (p);
+    m_size = st.st_size;
+    uint32_t header[4];
+    std::memcpy (header, m_data, sizeof (header));
+    if (std::memcmp (m_data, TRACK_MAGIC, 4) != 0 || header[1] != TRACK_VERSION
+        || 24 + 16 * static_cast<uint64_t> (header[2]) > m_size)
+      {
+        Close ();
+        return false;
+      }
+    m_nodes = header[2];
+    std::memcpy (&m_maxSpeed, m_data + 16, sizeof (m_maxSpeed));
+    for (uint32_t n = 0; n < m_nodes; n++)
+      {
+        const uint64_t *index = Index (n);
+        if (index[0] % 8 != 0 || index[0] + index[1] * sizeof (Waypoint) > m_size)
+          {
+            Close ();
+            return false;
+          }
+      }
+    return true;
+  }
+
+  void Close (void)
+  {
+    if (m_data)
+      {
+        munmap (const_cast<uint8_t *> (m_data), m_size);
+        m_data = 0;
+      }
+    m_nodes = 0;
+  }
+
+  uint32_t GetNNodes (void) const
+  {
+    return m_nodes;
+  }
+
+  double GetMaxSpeed (void) const
+  {
+    return m_maxSpeed;
+  }
+
+  /*
+   * Waypoints of node, pointing into the mapping.
+   */
+  const Waypoint *GetTrack (uint32_t node, uint64_t &count) const
+  {
+    const uint64_t *index = Index (node);
+    count = index[1];
+    return reinterpret_cast<const Waypoint *> (m_data + index[0]);
+  }
+
+private:
+  TrackFile (const TrackFile &);
+  TrackFile &operator= (const TrackFile &);
+
+  const uint64_t *Index (uint32_t node) const
+  {
+    return reinterpret_cast<const uint64_t *> (m_data + 24 + 16 * static_cast<uint64_t> (node));
+  }
+
+  const uint8_t *m_data;
+  size_t m_size;
+  uint32_t m_nodes;
+  double m_maxSpeed;
+};
+
+} // namespace crowd
+
+#endif /* CROWD_TRACK_FILE_H */
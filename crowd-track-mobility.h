@@ -0,0 +1,200 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Mobility from precomputed tracks (see crowd-track-file.h).
+ *
+ * CrowdTrackSet maps a CTRK file once per simulation and gives node i the
+ * i-th track. Each CrowdTrackMobilityModel interpolates its position when
+ * asked, so no mobility event is ever scheduled and CourseChange never
+ * fires. Consumers that follow CourseChange must poll instead: the
+ * CrowdOracle does through MaxStaleness, and CrowdSpectrumChannel needs
+ * its MaxSpeed attribute set to GetMaxSpeed (). Every run that maps the
+ * same file sees the same movement, whatever its RngRun.
+ */
+
+#ifndef CROWD_TRACK_MOBILITY_H
+#define CROWD_TRACK_MOBILITY_H
+
+#include "ns3/mobility-model.h"
+#include "ns3/node-container.h"
+#include "ns3/object.h"
+#include "ns3/simulator.h"
+#include "ns3/abort.h"
+
+#include <string>
+
+#include "crowd-track-file.h"
+
+namespace ns3 {
+
+class CrowdTrackSet : public Object
+{
+public:
+  static TypeId GetTypeId (void);
+
+  bool Open (std::string filename);
+  uint32_t GetNNodes (void) const;
+  /*
+   * Highest speed on any track, in m/s.
+   */
+  double GetMaxSpeed (void) const;
+  /*
+   * Aggregate a CrowdTrackMobilityModel following track i to the i-th
+   * node. The file needs at least as many tracks as there are nodes.
+   */
+  void Install (NodeContainer nodes);
+  const crowd::TrackFile &GetFile (void) const;
+
+private:
+  crowd::TrackFile m_file;
+};
+
+class CrowdTrackMobilityModel : public MobilityModel
+{
+public:
+  static TypeId GetTypeId (void);
+
+  CrowdTrackMobilityModel ();
+
+  void SetTrack (Ptr<CrowdTrackSet> set, uint32_t track);
+
+protected:
+  virtual void DoDispose (void);
+
+private:
+  virtual Vector DoGetPosition (void) const;
+  virtual void DoSetPosition (const Vector &position);
+  virtual Vector DoGetVelocity (void) const;
+
+  Ptr<CrowdTrackSet> m_set;      // keeps the mapping alive
+  const crowd::Waypoint *m_track;
+  uint64_t m_count;
+  mutable uint64_t m_cursor;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (CrowdTrackSet);
+
+TypeId
+CrowdTrackSet::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::CrowdTrackSet")
+    .SetParent<Object> ()
+    .SetGroupName ("Mobility")
+    .AddConstructor<CrowdTrackSet> ()
+  ;
+  return tid;
+}
+
+bool
+CrowdTrackSet::Open (std::string filename)
+{
+  return m_file.Open (filename);
+}
+
+uint32_t
+CrowdTrackSet::GetNNodes (void) const
+{
+  return m_file.GetNNodes ();
+}
+
+double
+CrowdTrackSet::GetMaxSpeed (void) const
+{
+  return m_file.GetMaxSpeed ();
+}
+
+void
+CrowdTrackSet::Install (NodeContainer nodes)
+{
+  NS_ABORT_MSG_UNLESS (nodes.GetN () <= m_file.GetNNodes (),
+                       "track file has " << m_file.GetNNodes () << " tracks for " << nodes.GetN () << " nodes");
+  for (uint32_t n = 0; n < nodes.GetN (); n++)
+    {
+      Ptr<CrowdTrackMobilityModel> model = CreateObject<CrowdTrackMobilityModel> ();
+      model->SetTrack (Ptr<CrowdTrackSet> (this), n);
+      nodes.Get (n)->AggregateObject (model);
+    }
+}
+
+const crowd::TrackFile &
+CrowdTrackSet::GetFile (void) const
+{
+  return m_file;
+}
+
+NS_OBJECT_ENSURE_REGISTERED (CrowdTrackMobilityModel);
+
+TypeId
+CrowdTrackMobilityModel::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::CrowdTrackMobilityModel")
+    .SetParent<MobilityModel> ()
+    .SetGroupName ("Mobility")
+    .AddConstructor<CrowdTrackMobilityModel> ()
+  ;
+  return tid;
+}
+
+CrowdTrackMobilityModel::CrowdTrackMobilityModel ()
+  : m_track (0),
+    m_count (0),
+    m_cursor (0)
+{
+}
+
+void
+CrowdTrackMobilityModel::SetTrack (Ptr<CrowdTrackSet> set, uint32_t track)
+{
+  m_set = set;
+  m_track = set->GetFile ().GetTrack (track, m_count);
+  m_cursor = 0;
+}
+
+void
+CrowdTrackMobilityModel::DoDispose (void)
+{
+  m_set = 0;
+  m_track = 0;
+  m_count = 0;
+  MobilityModel::DoDispose ();
+}
+
+Vector
+CrowdTrackMobilityModel::DoGetPosition (void) const
+{
+  double pos[3], vel[3];
+  crowd::TrackLocate (m_track, m_count, Simulator::Now ().GetNanoSeconds (), m_cursor, pos, vel);
+  return Vector (pos[0], pos[1], pos[2]);
+}
+
+void
+CrowdTrackMobilityModel::DoSetPosition (const Vector &position)
+{
+  NS_FATAL_ERROR ("CrowdTrackMobilityModel positions come from the track file");
+}
+
+Vector
+CrowdTrackMobilityModel::DoGetVelocity (void) const
+{
+  double pos[3], vel[3];
+  crowd::TrackLocate (m_track, m_count, Simulator::Now ().GetNanoSeconds (), m_cursor, pos, vel);
+  return Vector (vel[0], vel[1], vel[2]);
+}
+
+} // namespace ns3
+
+#endif /* CROWD_TRACK_MOBILITY_H */
@@ -0,0 +1,386 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Builds CTRK track files for --mobility=track.
+//
+// ./waf --run "crowd-trajectory-gen --nodes=20 --duration=600 crowd.ctrk"
+// ./waf --run "crowd-trajectory-gen --from=crowdsrc-adhoc-trajectory.ctrj --duration=600 crowd.ctrk"
+// ./waf --run "crowd-trajectory-gen --from=measured.csv crowd.ctrk"
+//
+// Without --from, every node gets the crowdsrc-adhoc random walk: a start
+// point from a disc around --centre, then legs of --legTime seconds at
+// --speed m/s in a uniformly random direction, reflected at the --bounds
+// rectangle. Each node draws from its own generator seeded by (--seed,
+// node), so a file does not depend on --threads, which only splits the
+// nodes between worker threads.
+//
+// --from converts movement that already exists: a CTRJ recording of an
+// earlier run (its course changes are the waypoints) or a CSV of
+// "node,time_s,x,y[,z]" samples such as a measured crowd trace. Lines that
+// do not parse, like a header, are skipped. With --duration, the last
+// recorded velocity of a CTRJ node is carried on until then.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "crowd-trajectory.h"
+#include "crowd-track-file.h"
+
+namespace {
+
+struct WalkParams
+{
+  uint32_t nodes;
+  double duration;
+  uint64_t seed;
+  double speed;
+  double legTime;
+  double xMin, xMax, yMin, yMax;
+  double centreX, centreY;
+  double radius;
+};
+
+void
+AddWaypoint (std::vector<crowd::Waypoint> &track, double t, double x, double y)
+{
+  crowd::Waypoint w;
+  w.timeNs = static_cast<int64_t> (std::llround (t * 1e9));
+  w.x = x;
+  w.y = y;
+  w.z = 0.0;
+  track.push_back (w);
+}
+
+/*
+ * The RandomWalk2dMobilityModel "Time" mode, with a waypoint at every leg
+ * start and every rebound.
+ */
+void
+Walk (const WalkParams &p, uint32_t node, std::vector<crowd::Waypoint> &track)
+{
+  std::seed_seq seq = { static_cast<uint32_t> (p.seed), static_cast<uint32_t> (p.seed >> 32), node };
+  std::mt19937_64 rng (seq);
+  std::uniform_real_distribution<double> unit (0.0, 1.0);
+  const double twoPi = 2.0 * M_PI;
+
+  double theta = unit (rng) * twoPi;
+  double rho = unit (rng) * p.radius;
+  double x = std::min (std::max (p.centreX + std::cos (theta) * rho, p.xMin), p.xMax);
+  double y = std::min (std::max (p.centreY + std::sin (theta) * rho, p.yMin), p.yMax);
+  double t = 0.0;
+  AddWaypoint (track, t, x, y);
+  while (t < p.duration)
+    {
+      double direction = unit (rng) * twoPi;
+      double vx = std::cos (direction) * p.speed;
+      double vy = std::sin (direction) * p.speed;
+      double left = std::min (p.legTime, p.duration - t);
+      while (left > 0)
+        {
+          // Time until the first wall, if any, is hit within this leg
+          double hit = left;
+          if (vx > 0)
+            {
+              hit = std::min (hit, (p.xMax - x) / vx);
+            }
+          else if (vx < 0)
+            {
+              hit = std::min (hit, (p.xMin - x) / vx);
+            }
+          if (vy > 0)
+            {
+              hit = std::min (hit, (p.yMax - y) / vy);
+            }
+          else if (vy < 0)
+            {
+              hit = std::min (hit, (p.yMin - y) / vy);
+            }
+          hit = std::max (hit, 0.0);
+          x += vx * hit;
+          y += vy * hit;
+          t += hit;
+          left -= hit;
+          AddWaypoint (track, t, x, y);
+          if (left <= 0)
+            {
+              break;
+            }
+          if (x <= p.xMin || x >= p.xMax)
+            {
+              vx = -vx;
+            }
+          if (y <= p.yMin || y >= p.yMax)
+            {
+              vy = -vy;
+            }
+        }
+    }
+}
+
+bool
+ReadRecording (const std::string &file, double duration, std::vector<std::vector<crowd::Waypoint> > &tracks)
+{
+  crowd::TrajectoryReader reader;
+  if (!reader.Open (file))
+    {
+      return false;
+    }
+  std::vector<crowd::TrajectoryRecord> last;
+  crowd::TrajectoryRecord r;
+  while (reader.Next (r))
+    {
+      if (r.node >= tracks.size ())
+        {
+          tracks.resize (r.node + 1);
+          last.resize (r.node + 1);
+        }
+      crowd::Waypoint w;
+      w.timeNs = r.timeNs;
+      w.x = r.pos[0];
+      w.y = r.pos[1];
+      w.z = r.pos[2];
+      tracks[r.node].push_back (w);
+      last[r.node] = r;
+    }
+  int64_t endNs = static_cast<int64_t> (std::llround (duration * 1e9));
+  for (uint32_t n = 0; n < tracks.size (); n++)
+    {
+      if (tracks[n].empty () || endNs <= last[n].timeNs)
+        {
+          continue;
+        }
+      double dt = (endNs - last[n].timeNs) / 1e9;
+      crowd::Waypoint w;
+      w.timeNs = endNs;
+      w.x = last[n].pos[0] + last[n].vel[0] * dt;
+      w.y = last[n].pos[1] + last[n].vel[1] * dt;
+      w.z = last[n].pos[2] + last[n].vel[2] * dt;
+      tracks[n].push_back (w);
+    }
+  return true;
+}
+
+bool
+ReadCsv (const std::string &file, std::vector<std::vector<crowd::Waypoint> > &tracks)
+{
+  std::ifstream in (file.c_str ());
+  if (!in)
+    {
+      return false;
+    }
+  std::string line;
+  while (std::getline (in, line))
+    {
+      unsigned node;
+      double t, x, y, z = 0.0;
+      int fields = std::sscanf (line.c_str (), "%u,%lf,%lf,%lf,%lf", &node, &t, &x, &y, &z);
+      if (fields < 4)
+        {
+          continue;
+        }
+      if (node >= tracks.size ())
+        {
+          tracks.resize (node + 1);
+        }
+      crowd::Waypoint w;
+      w.timeNs = static_cast<int64_t> (std::llround (t * 1e9));
+      w.x = x;
+      w.y = y;
+      w.z = z;
+      tracks[node].push_back (w);
+    }
+  for (uint32_t n = 0; n < tracks.size (); n++)
+    {
+      std::stable_sort (tracks[n].begin (), tracks[n].end (),
+                        [] (const crowd::Waypoint &a, const crowd::Waypoint &b) { return a.timeNs < b.timeNs; });
+    }
+  return true;
+}
+
+bool
+ParseList (const std::string &s, double *out, int n)
+{
+  std::istringstream in (s);
+  std::string item;
+  int i = 0;
+  while (i < n && std::getline (in, item, ','))
+    {
+      out[i++] = std::atof (item.c_str ());
+    }
+  return i == n;
+}
+
+} // namespace
+
+int main (int argc, char *argv[])
+{
+  WalkParams p;
+  p.nodes = 20;
+  p.duration = 600.0;
+  p.seed = 1;
+  p.speed = 2.0;
+  p.legTime = 2.0;
+  p.xMin = 0.0;
+  p.xMax = 200.0;
+  p.yMin = 0.0;
+  p.yMax = 200.0;
+  p.centreX = 100.0;
+  p.centreY = 100.0;
+  p.radius = 30.0;
+  unsigned threads = std::max (1u, std::thread::hardware_concurrency ());
+  bool durationGiven = false;
+  std::string from;
+  std::string out;
+
+  for (int i = 1; i < argc; i++)
+    {
+      std::string arg = argv[i];
+      std::string value = arg.substr (arg.find ('=') + 1);
+      bool ok = true;
+      if (arg.compare (0, 8, "--nodes=") == 0)
+        {
+          p.nodes = std::atoi (value.c_str ());
+        }
+      else if (arg.compare (0, 11, "--duration=") == 0)
+        {
+          p.duration = std::atof (value.c_str ());
+          durationGiven = true;
+        }
+      else if (arg.compare (0, 7, "--seed=") == 0)
+        {
+          p.seed = std::strtoull (value.c_str (), 0, 10);
+        }
+      else if (arg.compare (0, 10, "--threads=") == 0)
+        {
+          threads = std::max (1, std::atoi (value.c_str ()));
+        }
+      else if (arg.compare (0, 8, "--speed=") == 0)
+        {
+          p.speed = std::atof (value.c_str ());
+        }
+      else if (arg.compare (0, 10, "--legTime=") == 0)
+        {
+          p.legTime = std::atof (value.c_str ());
+        }
+      else if (arg.compare (0, 9, "--bounds=") == 0)
+        {
+          double b[4];
+          ok = ParseList (value, b, 4);
+          p.xMin = b[0];
+          p.xMax = b[1];
+          p.yMin = b[2];
+          p.yMax = b[3];
+        }
+      else if (arg.compare (0, 9, "--centre=") == 0)
+        {
+          double c[2];
+          ok = ParseList (value, c, 2);
+          p.centreX = c[0];
+          p.centreY = c[1];
+        }
+      else if (arg.compare (0, 9, "--radius=") == 0)
+        {
+          p.radius = std::atof (value.c_str ());
+        }
+      else if (arg.compare (0, 7, "--from=") == 0)
+        {
+          from = value;
+        }
+      else if (arg.compare (0, 2, "--") != 0 && out.empty ())
+        {
+          out = arg;
+        }
+      else
+        {
+          ok = false;
+        }
+      if (!ok)
+        {
+          std::cerr << argv[0] << ": bad argument " << arg << std::endl;
+          return 2;
+        }
+    }
+  if (out.empty () || p.legTime <= 0 || p.xMax <= p.xMin || p.yMax <= p.yMin)
+    {
+      std::cerr << "usage: " << argv[0] << " [--nodes=N] [--duration=s] [--seed=N] [--threads=N]"
+                << " [--speed=m/s] [--legTime=s] [--bounds=x0,x1,y0,y1] [--centre=x,y] [--radius=m]"
+                << " [--from=recording.ctrj|trace.csv] <output.ctrk>" << std::endl;
+      return 2;
+    }
+
+  std::vector<std::vector<crowd::Waypoint> > tracks;
+  if (!from.empty ())
+    {
+      char magic[4] = { 0, 0, 0, 0 };
+      std::ifstream probe (from.c_str (), std::ios::binary);
+      probe.read (magic, 4);
+      probe.close ();
+      bool ok = std::memcmp (magic, crowd::TRAJECTORY_MAGIC, 4) == 0
+        ? ReadRecording (from, durationGiven ? p.duration : 0.0, tracks)
+        : ReadCsv (from, tracks);
+      if (!ok)
+        {
+          std::cerr << from << ": cannot read" << std::endl;
+          return 1;
+        }
+    }
+  else
+    {
+      tracks.resize (p.nodes);
+      std::vector<std::thread> workers;
+      threads = std::min<unsigned> (threads, std::max (1u, p.nodes));
+      for (unsigned t = 0; t < threads; t++)
+        {
+          workers.push_back (std::thread ([&p, &tracks, t, threads] ()
+            {
+              for (uint32_t n = t; n < p.nodes; n += threads)
+                {
+                  Walk (p, n, tracks[n]);
+                }
+            }));
+        }
+      for (unsigned t = 0; t < workers.size (); t++)
+        {
+          workers[t].join ();
+        }
+    }
+
+  if (!crowd::WriteTracks (out, tracks))
+    {
+      std::cerr << out << ": cannot write" << std::endl;
+      return 1;
+    }
+  uint64_t waypoints = 0;
+  for (uint32_t n = 0; n < tracks.size (); n++)
+    {
+      waypoints += tracks[n].size ();
+    }
+  crowd::TrackFile check;
+  check.Open (out);
+  std::cout << out << ": " << tracks.size () << " tracks, " << waypoints << " waypoints, max speed "
+            << check.GetMaxSpeed () << " m/s" << std::endl;
+  return 0;
+}
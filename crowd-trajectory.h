@@ -0,0 +1,525 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Buffered binary trajectory recording for the CourseChange traces.
+ *
+ * The recorder keeps two fixed-size column buffers (node id, time, position,
+ * velocity). The simulator thread only appends to the active one; when it
+ * fills up the buffers are swapped and a background thread encodes and
+ * writes the full one.
+ *
+ * File layout ("CTRJ" version 1, little endian):
+ *
+ *   file   := magic "CTRJ" | u32 version | block*
+ *   block  := u32 payloadBytes | u32 records | record*
+ *   record := varint node | svarint dTime | svarint dPos[3] | svarint vel[3]
+ *
+ * Time is in nanoseconds, delta-coded against the previous record of the
+ * block. Positions are in millimetres, delta-coded against the previous
+ * record of the same node in the block. Velocities are in mm/s and stored
+ * as is. All delta state restarts at every block, so a file cut short by a
+ * crash is readable up to its last complete block.
+ *
+ * This header has no ns-3 dependency so that crowd-trace-to-csv can use the
+ * reader on its own.
+ */
+
+#ifndef CROWD_TRAJECTORY_H
+#define CROWD_TRAJECTORY_H
+
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace crowd {
+
+static const char TRAJECTORY_MAGIC[4] = { 'C', 'T', 'R', 'J' };
+static const uint32_t TRAJECTORY_VERSION = 1;
+
+struct TrajectoryRecord
+{
+  uint32_t node;
+  int64_t timeNs;
+  double pos[3];   // metres
+  double vel[3];   // metres per second
+};
+
+/*
+ * Variable-length integer coding shared by the crowd binary formats.
+ */
+inline void
+PutU32 (std::vector<uint8_t> &out, uint32_t v)
+{
+  for (int i = 0; i < 4; i++)
+    {
+      out.push_back (static_cast<uint8_t> (v >> (8 * i)));
+    }
+}
+
+inline uint32_t
+GetU32 (const uint8_t *p)
+{
+  return uint32_t (p[0]) | (uint32_t (p[1]) << 8) | (uint32_t (p[2]) << 16) | (uint32_t (p[3]) << 24);
+}
+
+inline void
+PutVarint (std::vector<uint8_t> &out, uint64_t v)
+{
+  while (v >= 0x80)
+    {
+      out.push_back (static_cast<uint8_t> (v | 0x80));
+      v >>= 7;
+    }
+  out.push_back (static_cast<uint8_t> (v));
+}
+
+inline void
+PutSvarint (std::vector<uint8_t> &out, int64_t v)
+{
+  PutVarint (out, (static_cast<uint64_t> (v) << 1) ^ static_cast<uint64_t> (v >> 63));
+}
+
+/*
+ * Returns false if the varint runs past end.
+ */
+inline bool
+GetVarint (const uint8_t *&p, const uint8_t *end, uint64_t &v)
+{
+  v = 0;
+  for (int shift = 0; shift < 64 && p < end; shift += 7)
+    {
+      uint8_t b = *p++;
+      v |= static_cast<uint64_t> (b & 0x7f) << shift;
+      if (!(b & 0x80))
+        {
+          return true;
+        }
+    }
+  return false;
+}
+
+inline bool
+GetSvarint (const uint8_t *&p, const uint8_t *end, int64_t &v)
+{
+  uint64_t u;
+  if (!GetVarint (p, end, u))
+    {
+      return false;
+    }
+  v = static_cast<int64_t> (u >> 1) ^ -static_cast<int64_t> (u & 1);
+  return true;
+}
+
+inline int64_t
+Quantize (double metres)
+{
+  return static_cast<int64_t> (std::llround (metres * 1000.0));
+}
+
+class TrajectoryRecorder
+{
+public:
+  TrajectoryRecorder ()
+    : m_file (0),
+      m_capacity (0),
+      m_active (0),
+      m_pending (false),
+      m_closing (false),
+      m_records (0),
+      m_bytes (0),
+      m_stalls (0)
+  {
+  }
+
+  ~TrajectoryRecorder ()
+  {
+    Close ();
+  }
+
+  /*
+   * bufferRecords is the size of each of the two column buffers.
+   */
+  bool Open (const std::string &filename, uint32_t bufferRecords = 16384)
+  {
+    Close ();
+    m_file = std::fopen (filename.c_str (), "wb");
+    if (!m_file)
+      {
+        return false;
+      }
+    std::vector<uint8_t> header (TRAJECTORY_MAGIC, TRAJECTORY_MAGIC + 4);
+    PutU32 (header, TRAJECTORY_VERSION);
+    std::fwrite (&header[0], 1, header.size (), m_file);
+    m_bytes = header.size ();
+
+    m_capacity = bufferRecords > 0 ? bufferRecords : 1;
+    for (int b = 0; b < 2; b++)
+      {
+        m_buffers[b].Reserve (m_capacity);
+      }
+    m_active = 0;
+    m_pending = false;
+    m_closing = false;
+    m_records = 0;
+    m_stalls = 0;
+    m_writer = std::thread (&TrajectoryRecorder::WriterLoop, this);
+    return true;
+  }
+
+  bool IsOpen (void) const
+  {
+    return m_file != 0;
+  }
+
+  void Record (uint32_t node, int64_t timeNs, double px, double py, double pz,
+               double vx, double vy, double vz)
+  {
+    if (!m_file)
+      {
+        return;
+      }
+    Columns &c = m_buffers[m_active];
+    uint32_t i = c.size;
+    c.node[i] = node;
+    c.time[i] = timeNs;
+    c.pos[0][i] = px;
+    c.pos[1][i] = py;
+    c.pos[2][i] = pz;
+    c.vel[0][i] = vx;
+    c.vel[1][i] = vy;
+    c.vel[2][i] = vz;
+    c.size++;
+    m_records++;
+    if (c.size == m_capacity)
+      {
+        Submit ();
+      }
+  }
+
+  /*
+   * Flush what is buffered, stop the writer thread and close the file.
+   */
+  void Close (void)
+  {
+    if (!m_file)
+      {
+        return;
+      }
+    if (m_buffers[m_active].size > 0)
+      {
+        Submit ();
+      }
+    {
+      std::unique_lock<std::mutex> lock (m_mutex);
+      m_closing = true;
+    }
+    m_cv.notify_all ();
+    m_writer.join ();
+    std::fclose (m_file);
+    m_file = 0;
+  }
+
+  uint64_t GetRecordCount (void) const
+  {
+    return m_records;
+  }
+
+  /*
+   * Only stable after Close ().
+   */
+  uint64_t GetBytesWritten (void) const
+  {
+    return m_bytes;
+  }
+
+  /*
+   * Number of times the simulator thread had to wait for the writer.
+   */
+  uint64_t GetStalls (void) const
+  {
+    return m_stalls;
+  }
+
+private:
+  TrajectoryRecorder (const TrajectoryRecorder &);
+  TrajectoryRecorder &operator= (const TrajectoryRecorder &);
+
+  struct Columns
+  {
+    Columns () : size (0) {}
+    void Reserve (uint32_t n)
+    {
+      node.assign (n, 0);
+      time.assign (n, 0);
+      for (int k = 0; k < 3; k++)
+        {
+          pos[k].assign (n, 0.0);
+          vel[k].assign (n, 0.0);
+        }
+      size = 0;
+    }
+    std::vector<uint32_t> node;
+    std::vector<int64_t> time;
+    std::vector<double> pos[3];
+    std::vector<double> vel[3];
+    uint32_t size;
+  };
+
+  struct NodeState
+  {
+    uint32_t block;
+    int64_t pos[3];
+  };
+
+  /*
+   * Hand the active buffer to the writer, waiting only if it is still
+   * busy with the other one.
+   */
+  void Submit (void)
+  {
+    std::unique_lock<std::mutex> lock (m_mutex);
+    if (m_pending)
+      {
+        m_stalls++;
+        m_cv.wait (lock, [this] { return !m_pending; });
+      }
+    m_pending = true;
+    m_active ^= 1;
+    m_buffers[m_active].size = 0;
+    lock.unlock ();
+    m_cv.notify_all ();
+  }
+
+  void WriterLoop (void)
+  {
+    std::vector<uint8_t> out;
+    std::vector<NodeState> nodes;
+    uint32_t block = 0;
+    for (;;)
+      {
+        std::unique_lock<std::mutex> lock (m_mutex);
+        m_cv.wait (lock, [this] { return m_pending || m_closing; });
+        if (!m_pending)
+          {
+            return;
+          }
+        const Columns &c = m_buffers[m_active ^ 1];
+        lock.unlock ();
+
+        block++;
+        out.clear ();
+        PutU32 (out, 0);   // payload size, patched below
+        PutU32 (out, c.size);
+        int64_t lastTime = 0;
+        for (uint32_t i = 0; i < c.size; i++)
+          {
+            uint32_t id = c.node[i];
+            if (id >= nodes.size ())
+              {
+                nodes.resize (id + 1, NodeState ());
+              }
+            NodeState &ns = nodes[id];
+            if (ns.block != block)
+              {
+                ns.block = block;
+                ns.pos[0] = ns.pos[1] = ns.pos[2] = 0;
+              }
+            PutVarint (out, id);
+            PutSvarint (out, c.time[i] - lastTime);
+            lastTime = c.time[i];
+            for (int k = 0; k < 3; k++)
+              {
+                int64_t q = Quantize (c.pos[k][i]);
+                PutSvarint (out, q - ns.pos[k]);
+                ns.pos[k] = q;
+              }
+            for (int k = 0; k < 3; k++)
+              {
+                PutSvarint (out, Quantize (c.vel[k][i]));
+              }
+          }
+        uint32_t payload = out.size () - 8;
+        for (int i = 0; i < 4; i++)
+          {
+            out[i] = static_cast<uint8_t> (payload >> (8 * i));
+          }
+        std::fwrite (&out[0], 1, out.size (), m_file);
+        std::fflush (m_file);
+        m_bytes += out.size ();
+
+        lock.lock ();
+        m_pending = false;
+        lock.unlock ();
+        m_cv.notify_all ();
+      }
+  }
+
+  std::FILE *m_file;
+  uint32_t m_capacity;
+  Columns m_buffers[2];
+  uint32_t m_active;
+  bool m_pending;
+  bool m_closing;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::thread m_writer;
+  uint64_t m_records;
+  uint64_t m_bytes;
+  uint64_t m_stalls;
+};
+
+/*
+ * Sequential reader for CTRJ files.
+ */
+class TrajectoryReader
+{
+public:
+  TrajectoryReader ()
+    : m_file (0),
+      m_left (0),
+      m_lastTime (0),
+      m_block (0)
+  {
+  }
+
+  ~TrajectoryReader ()
+  {
+    if (m_file)
+      {
+        std::fclose (m_file);
+      }
+  }
+
+  bool Open (const std::string &filename)
+  {
+    m_file = std::fopen (filename.c_str (), "rb");
+    if (!m_file)
+      {
+        return false;
+      }
+    uint8_t header[8];
+    if (std::fread (header, 1, 8, m_file) != 8
+        || std::memcmp (header, TRAJECTORY_MAGIC, 4) != 0
+        || GetU32 (header + 4) != TRAJECTORY_VERSION)
+      {
+        std::fclose (m_file);
+        m_file = 0;
+        return false;
+      }
+    return true;
+  }
+
+  /*
+   * Returns false at end of file or at the first truncated block.
+   */
+  bool Next (TrajectoryRecord &r)
+  {
+    while (m_left == 0)
+      {
+        if (!LoadBlock ())
+          {
+            return false;
+          }
+      }
+    const uint8_t *end = m_data.empty () ? 0 : &m_data[0] + m_data.size ();
+    uint64_t id;
+    int64_t dt;
+    if (!GetVarint (m_cursor, end, id) || !GetSvarint (m_cursor, end, dt))
+      {
+        return false;
+      }
+    if (id >= m_nodes.size ())
+      {
+        m_nodes.resize (id + 1, NodeState ());
+      }
+    NodeState &ns = m_nodes[id];
+    if (ns.block != m_block)
+      {
+        ns.block = m_block;
+        ns.pos[0] = ns.pos[1] = ns.pos[2] = 0;
+      }
+    m_lastTime += dt;
+    r.node = static_cast<uint32_t> (id);
+    r.timeNs = m_lastTime;
+    for (int k = 0; k < 3; k++)
+      {
+        int64_t d;
+        if (!GetSvarint (m_cursor, end, d))
+          {
+            return false;
+          }
+        ns.pos[k] += d;
+        r.pos[k] = ns.pos[k] / 1000.0;
+      }
+    for (int k = 0; k < 3; k++)
+      {
+        int64_t v;
+        if (!GetSvarint (m_cursor, end, v))
+          {
+            return false;
+          }
+        r.vel[k] = v / 1000.0;
+      }
+    m_left--;
+    return true;
+  }
+
+private:
+  struct NodeState
+  {
+    uint32_t block;
+    int64_t pos[3];
+  };
+
+  bool LoadBlock (void)
+  {
+    uint8_t header[8];
+    if (std::fread (header, 1, 8, m_file) != 8)
+      {
+        return false;
+      }
+    uint32_t payload = GetU32 (header);
+    m_data.resize (payload);
+    if (payload > 0 && std::fread (&m_data[0], 1, payload, m_file) != payload)
+      {
+        return false;
+      }
+    m_left = GetU32 (header + 4);
+    m_cursor = m_data.empty () ? 0 : &m_data[0];
+    m_lastTime = 0;
+    m_block++;
+    return true;
+  }
+
+  std::FILE *m_file;
+  std::vector<uint8_t> m_data;
+  const uint8_t *m_cursor;
+  uint32_t m_left;
+  int64_t m_lastTime;
+  uint32_t m_block;
+  std::vector<NodeState> m_nodes;
+};
+
+} // namespace crowd
+
+#endif /* CROWD_TRAJECTORY_H */
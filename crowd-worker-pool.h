@@ -0,0 +1,189 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * A small fork()-based worker pool for the crowd scenarios.
+ *
+ * ns-3 keeps a single global Simulator per process, so the only way to run
+ * several Experiment::Run calls at the same time is to give each one its own
+ * process. Jobs are plain functions that run in the child and return an exit
+ * status; results travel back to the parent through files written by the
+ * job. The parent must not have started the simulator before submitting.
+ *
+ * Like the other crowd-*.h helpers this header is meant to be included from
+ * a single scratch program source file.
+ */
+
+#ifndef CROWD_WORKER_POOL_H
+#define CROWD_WORKER_POOL_H
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <cstring>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+class CrowdWorkerPool
+{
+public:
+  typedef std::function<int (void)> Job;
+  typedef std::function<void (uint32_t id, int status)> DoneCallback;
+
+  /*
+   * maxWorkers == 0 caps concurrency at the number of online cores.
+   */
+  CrowdWorkerPool (uint32_t maxWorkers = 0)
+    : m_maxWorkers (maxWorkers == 0 ? GetDefaultWorkers () : maxWorkers),
+      m_nextId (0)
+  {
+    std::memset (&m_lastUsage, 0, sizeof (m_lastUsage));
+  }
+
+  ~CrowdWorkerPool ()
+  {
+    WaitAll ();
+  }
+
+  static uint32_t GetDefaultWorkers (void)
+  {
+    long n = sysconf (_SC_NPROCESSORS_ONLN);
+    return n > 0 ? static_cast<uint32_t> (n) : 1;
+  }
+
+  uint32_t GetMaxWorkers (void) const
+  {
+    return m_maxWorkers;
+  }
+
+  uint32_t GetRunning (void) const
+  {
+    return m_running.size ();
+  }
+
+  /*
+   * Called in the parent, in reap order, once per finished job. The status
+   * is the job's return value, or -1 if the child died abnormally.
+   */
+  void SetDoneCallback (DoneCallback cb)
+  {
+    m_done = cb;
+  }
+
+  /*
+   * Resource usage of the child reaped last (its peak RSS, CPU time), as
+   * the done callback runs.
+   */
+  const struct rusage &GetLastUsage (void) const
+  {
+    return m_lastUsage;
+  }
+
+  /*
+   * Fork a child for the job, first reaping finished children until a slot
+   * is free. Returns the job id handed to the done callback.
+   */
+  uint32_t Submit (Job job)
+  {
+    while (m_running.size () >= m_maxWorkers)
+      {
+        WaitOne ();
+      }
+    // Anything still buffered would otherwise be printed by both processes
+    std::cout.flush ();
+    std::cerr.flush ();
+    fflush (NULL);
+
+    uint32_t id = m_nextId++;
+    pid_t pid = fork ();
+    if (pid < 0)
+      {
+        perror ("fork");
+        std::exit (1);
+      }
+    if (pid == 0)
+      {
+        int status = job ();
+        std::cout.flush ();
+        std::cerr.flush ();
+        fflush (NULL);
+        // Skip the parent's static destructors and atexit handlers
+        _exit (status & 0xff);
+      }
+    m_running[pid] = id;
+    return id;
+  }
+
+  /*
+   * Block until one child exits. Returns false if nothing is running.
+   */
+  bool WaitOne (void)
+  {
+    if (m_running.empty ())
+      {
+        return false;
+      }
+    int wstatus = 0;
+    pid_t pid;
+    do
+      {
+        pid = wait4 (-1, &wstatus, 0, &m_lastUsage);
+      }
+    while (pid < 0 && errno == EINTR);
+    if (pid < 0)
+      {
+        perror ("wait4");
+        m_running.clear ();
+        return false;
+      }
+    std::map<pid_t, uint32_t>::iterator it = m_running.find (pid);
+    if (it == m_running.end ())
+      {
+        // Not one of ours (should not happen in the scenarios)
+        return true;
+      }
+    uint32_t id = it->second;
+    m_running.erase (it);
+    int status = WIFEXITED (wstatus) ? WEXITSTATUS (wstatus) : -1;
+    if (m_done)
+      {
+        m_done (id, status);
+      }
+    return true;
+  }
+
+  void WaitAll (void)
+  {
+    while (WaitOne ())
+      {
+      }
+  }
+
+private:
+  uint32_t m_maxWorkers;
+  uint32_t m_nextId;
+  std::map<pid_t, uint32_t> m_running;
+  DoneCallback m_done;
+  struct rusage m_lastUsage;
+};
+
+#endif /* CROWD_WORKER_POOL_H */
@@ -46,6 +46,42 @@
 #include "ns3/ipv6-list-routing-helper.h"
 #include "ns3/internet-stack-helper.h"
 #include "ns3/flow-monitor-helper.h"
+#include "ns3/rng-seed-manager.h"
+#include "ns3/spectrum-wifi-helper.h"
+#include "ns3/wifi-net-device.h"
+#include "ns3/wifi-phy.h"
+#include "ns3/boolean.h"
+#include "ns3/data-rate.h"
+#include "ns3/system-path.h"
+
+#include <sys/time.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <vector>
+
+#include "crowd-worker-pool.h"
+#include "crowd-replication.h"
+#include "crowd-event-profiler.h"
+#include "crowd-bucket-scheduler.h"
+#include "crowd-trajectory.h"
+#include "crowd-trace-bind.h"
+#include "crowd-spectrum-channel.h"
+#include "crowd-goodput-sampler.h"
+#include "crowd-pcapng-capture.h"
+#include "crowd-capture-trigger.h"
+#include "crowd-anim-writer.h"
+#include "crowd-oracle-routing.h"
+#include "crowd-stack-helper.h"
+#include "crowd-content-app.h"
+#include "crowd-flow-generator.h"
+#include "crowd-flow-export.h"
+#include "crowd-checkpoint.h"
+#include "crowd-track-mobility.h"
+#include "crowd-scenario-file.h"
 
 using namespace ns3;
 
@@ -58,33 +94,573 @@ public:
   Experiment (std::string name);
   Gnuplot2dDataset Run (const WifiHelper &wifi, const YansWifiPhyHelper &wifiPhy,
                         const WifiMacHelper &wifiMac, const YansWifiChannelHelper &wifiChannel);
+  /*
+   * Prefix for every file the run writes (pcap, animation, flow monitor).
+   * Sweep workers get one each so that concurrent runs do not clobber
+   * each other's output.
+   */
+  void SetOutputPrefix (std::string prefix);
+  /*
+   * Directory every file the run writes goes to, its sweep and
+   * replication worker files included; it must exist. Empty is the
+   * current directory.
+   */
+  void SetOutputDir (std::string dir);
+  /*
+   * name inside the output directory.
+   */
+  std::string GetOutputPath (std::string name) const;
+  void SetTitle (std::string title);
+  void SetNodeCount (uint32_t nodes);
+  /*
+   * Width and height of the area the nodes walk in, at speed m/s; they
+   * start within 30 m of its centre.
+   */
+  void SetArea (double width, double height, double speed);
+  /*
+   * Rate and packet size of the saturating OnOff flow of --app=onoff, and
+   * when every application stops.
+   */
+  void SetTraffic (DataRate rate, uint32_t packetSize, Time appStop);
+  /*
+   * "yans" keeps the YansWifiChannel from main (). "grid" replaces it with
+   * the spatially indexed CrowdSpectrumChannel (same log-distance loss and
+   * constant-speed delay, on SpectrumWifiPhy); "grid-validate" also checks
+   * every transmission against an exhaustive evaluation.
+   */
+  void SetChannelMode (std::string mode);
+  /*
+   * Goodput sampling interval for the dataset and the goodput CSV, and
+   * whether to also keep per-node and per-flow series.
+   */
+  void SetSampling (Time interval, bool perNode, bool perFlow);
+  /*
+   * "pcapng" writes one merged, headers-only capture of all devices;
+   * "pcap" the classic one-file-per-device full capture; "off" nothing.
+   */
+  void SetCapture (std::string mode, uint32_t snapLen);
+  /*
+   * Only write the pcapng capture around the moments one of the spec's
+   * conditions holds (see crowd-capture-trigger.h), from pre before to
+   * post after; an empty spec captures the whole run. A spec needs
+   * SetCapture ("pcapng") first. Goodput conditions are per flow with
+   * per-flow sampling on, on the total otherwise.
+   */
+  void SetCaptureTrigger (std::string spec, Time pre, Time post);
+  /*
+   * "sampled" records one packet in sampleEvery, and node movement, only
+   * inside the given windows ("10-20,300-310", in seconds) into a NetAnim
+   * trace, gzipped when built with HAVE_ZLIB; "full" is the original AnimationInterface with packet
+   * metadata for the whole run; "off" writes nothing.
+   */
+  void SetAnimation (std::string mode, std::string windows, uint32_t sampleEvery);
+  /*
+   * "ripng" runs RIPng as before. "oracle" routes over the fewest hops
+   * between nodes within range metres of each other, straight from node
+   * positions and without control traffic; range 0 derives it from the
+   * log-distance loss, the PHY's transmit power and RxGain, and rxPowerDbm.
+   */
+  void SetRouting (std::string mode, double range, double rxPowerDbm);
+  /*
+   * "onoff" is the saturating node 0 -> node 1 flow. "content" instead
+   * runs CrowdContentApp on every node, node 0 seeding a content item of
+   * chunks chunks of chunkSize bytes, with cacheChunks of LRU cache per node.
+   * "flows" runs CrowdFlowGenerator on every node (see SetFlowWorkload).
+   */
+  void SetApplication (std::string mode, uint32_t chunks, uint32_t chunkSize, uint32_t cacheChunks);
+  /*
+   * For "flows": flows concurrent UDP flows per node to random peers, with
+   * packetSize byte packets spaced by the arrival random variable (an ns-3
+   * string such as "ns3::ExponentialRandomVariable[Mean=1.0]").
+   */
+  void SetFlowWorkload (uint32_t flows, std::string arrival, uint32_t packetSize);
+  /*
+   * "stream" appends per-flow counters and bounded histograms to a CFLW
+   * log every interval (crowd-trace-to-csv reads it back); "xml" is the
+   * original FlowMonitor with its end-of-run XML; "off" tracks nothing.
+   */
+  void SetFlowExport (std::string mode, Time interval);
+  /*
+   * "save" runs only the first warmup seconds and writes the node
+   * positions, next hops and neighbour caches to file; "load" starts from
+   * such a file instead of random placement and an empty network (see
+   * crowd-checkpoint.h for what is and is not restored), keeping the
+   * restored routes for hold; "off" does neither. A loaded run picks up
+   * where the saved one stopped: it is shorter by the checkpoint's time,
+   * its applications start right away and stop that much earlier, and its
+   * times count from the checkpoint.
+   */
+  void SetWarmStart (std::string mode, std::string file, Time warmup, Time hold);
+  /*
+   * "walk" is the RandomWalk2d crowd. "track" replays the precomputed
+   * tracks of a CTRK file (crowd-trajectory-gen), one per node, without
+   * scheduling any mobility event; a loaded checkpoint then only restores
+   * routes and neighbour caches, as the track decides where nodes are.
+   */
+  void SetMobility (std::string mode, std::string trackFile);
+  /*
+   * Run on a CrowdProfilingScheduler and report where the wall time went
+   * per event type, with a folded-stacks file and the queue depth.
+   */
+  void SetProfile (bool profile);
+  /*
+   * The simulator's event scheduler: "map" (the ns-3 default), "heap",
+   * "list", "calendar" or "bucket" (CrowdBucketScheduler). With profiling
+   * on it is the profiler's inner scheduler.
+   */
+  void SetScheduler (std::string name);
+  /*
+   * Simulated time at which the run stops (600 s by default).
+   */
+  void SetStopTime (Time stop);
+  /*
+   * "full" installs IPv4 and IPv6 with DAD and queue discs on every node;
+   * "lite" only the IPv6 the workloads use (see crowd-stack-helper.h),
+   * and needs the oracle routing.
+   */
+  void SetNodeProfile (std::string profile);
+  /*
+   * Write the points added to the dataset as "x y" lines, so that a sweep
+   * worker can hand its results back to the parent process.
+   */
+  bool WritePoints (std::string filename) const;
+  /*
+   * Write the run's summary metrics as "name value" lines for the
+   * replication runner: mean goodput while the applications run and, with
+   * the stream flow export, delivery ratio and mean delay.
+   */
+  bool WriteMetrics (std::string filename) const;
+  /*
+   * Write the wall time spent in the last Simulator::Run, the number of
+   * events it executed and the simulated seconds it covered, for the
+   * scheduler benchmark and crowd-perf-bench.
+   */
+  bool WriteLoopStats (std::string filename) const;
 private:
   void ReceivePacket (Ptr<Socket> socket);
   Ptr<Socket> SetupPacketReceive (Ptr<Node> node);
+  void AddPoint (double x, double y);
+  std::string GetOutputName (std::string suffix) const;
+  uint32_t GetFlowId (const Address &from);
 
   uint32_t m_bytesTotal;
   Gnuplot2dDataset m_output;
+  std::vector<std::pair<double, double> > m_points;
+  std::vector<std::pair<std::string, double> > m_metrics;
+  std::string m_outputPrefix;
+  std::string m_outputDir;
+  uint32_t m_nodes;
+  double m_width;
+  double m_height;
+  double m_speed;
+  DataRate m_rate;
+  uint32_t m_packetSize;
+  Time m_appStop;
+  std::string m_channelMode;
+  GoodputSampler m_sampler;
+  Time m_sampleInterval;
+  bool m_samplePerNode;
+  bool m_samplePerFlow;
+  std::map<Address, uint32_t> m_flowIds;
+  std::string m_captureMode;
+  uint32_t m_snapLen;
+  std::string m_captureTrigger;
+  Time m_capturePre;
+  Time m_capturePost;
+  std::string m_animMode;
+  std::string m_animWindows;
+  uint32_t m_animSampleEvery;
+  std::string m_routing;
+  double m_oracleRange;
+  double m_oracleRxPowerDbm;
+  std::string m_app;
+  uint32_t m_contentChunks;
+  uint32_t m_chunkSize;
+  uint32_t m_cacheChunks;
+  uint32_t m_flowsPerNode;
+  std::string m_flowArrival;
+  uint32_t m_flowPacketSize;
+  std::string m_flowExport;
+  Time m_flowInterval;
+  std::string m_warmStart;
+  std::string m_checkpointFile;
+  Time m_warmup;
+  Time m_checkpointHold;
+  std::string m_mobility;
+  std::string m_trackFile;
+  bool m_profile;
+  std::string m_scheduler;
+  Time m_stopTime;
+  std::string m_nodeProfile;
+  double m_loopSeconds;
+  uint64_t m_loopEvents;
+  double m_loopSimSeconds;
 };
 
 Experiment::Experiment ()
+  : m_outputPrefix (""),
+    m_outputDir (""),
+    m_nodes (20),
+    m_width (200.0),
+    m_height (200.0),
+    m_speed (2.0),
+    m_rate (60000000),
+    m_packetSize (4096),
+    m_appStop (Seconds (300.0)),
+    m_channelMode ("yans"),
+    m_sampleInterval (Seconds (1.0)),
+    m_samplePerNode (false),
+    m_samplePerFlow (false),
+    m_captureMode ("pcap"),
+    m_snapLen (128),
+    m_captureTrigger (""),
+    m_capturePre (Seconds (0.5)),
+    m_capturePost (Seconds (2.0)),
+    m_animMode ("full"),
+    m_animWindows ("0-30,290-300"),
+    m_animSampleEvery (10),
+    m_routing ("ripng"),
+    m_oracleRange (0.0),
+    m_oracleRxPowerDbm (-82.0),
+    m_app ("onoff"),
+    m_contentChunks (256),
+    m_chunkSize (1024),
+    m_cacheChunks (64),
+    m_flowsPerNode (100),
+    m_flowArrival ("ns3::ExponentialRandomVariable[Mean=1.0]"),
+    m_flowPacketSize (256),
+    m_flowExport ("xml"),
+    m_flowInterval (Seconds (10.0)),
+    m_warmStart ("off"),
+    m_checkpointFile ("crowdsrc-adhoc.ckpt"),
+    m_warmup (Seconds (10.0)),
+    m_checkpointHold (Seconds (30.0)),
+    m_mobility ("walk"),
+    m_trackFile ("crowd.ctrk"),
+    m_profile (false),
+    m_scheduler ("map"),
+    m_stopTime (Seconds (600.0)),
+    m_nodeProfile ("full"),
+    m_loopSeconds (0.0),
+    m_loopEvents (0),
+    m_loopSimSeconds (0.0)
 {
 }
 
 Experiment::Experiment (std::string name)
-  : m_output (name)
+  : Experiment ()
+{
+  m_output = Gnuplot2dDataset (name);
+  m_output.SetStyle (Gnuplot2dDataset::LINES);
+}
+
+void
+Experiment::SetOutputPrefix (std::string prefix)
+{
+  m_outputPrefix = prefix;
+}
+
+void
+Experiment::SetTitle (std::string title)
 {
+  m_output.SetTitle (title);
   m_output.SetStyle (Gnuplot2dDataset::LINES);
 }
 
+void
+Experiment::SetOutputDir (std::string dir)
+{
+  m_outputDir = dir;
+}
+
+std::string
+Experiment::GetOutputPath (std::string name) const
+{
+  if (m_outputDir.empty ())
+    {
+      return name;
+    }
+  return m_outputDir + "/" + name;
+}
+
+void
+Experiment::SetNodeCount (uint32_t nodes)
+{
+  m_nodes = nodes;
+}
+
+void
+Experiment::SetArea (double width, double height, double speed)
+{
+  NS_ABORT_MSG_UNLESS (width >= 60 && height >= 60, "area must be at least 60 m x 60 m");
+  NS_ABORT_MSG_UNLESS (speed > 0, "walk speed must be positive");
+  m_width = width;
+  m_height = height;
+  m_speed = speed;
+}
+
+void
+Experiment::SetTraffic (DataRate rate, uint32_t packetSize, Time appStop)
+{
+  NS_ABORT_MSG_UNLESS (rate.GetBitRate () > 0 && packetSize > 0, "traffic needs a rate and a packet size");
+  NS_ABORT_MSG_UNLESS (appStop.IsStrictlyPositive (), "applications must run for some time");
+  m_rate = rate;
+  m_packetSize = packetSize;
+  m_appStop = appStop;
+}
+
+void
+Experiment::SetChannelMode (std::string mode)
+{
+  NS_ABORT_MSG_UNLESS (mode == "yans" || mode == "grid" || mode == "grid-validate",
+                       "unknown channel mode " << mode);
+  m_channelMode = mode;
+}
+
+void
+Experiment::SetSampling (Time interval, bool perNode, bool perFlow)
+{
+  m_sampleInterval = interval;
+  m_samplePerNode = perNode;
+  m_samplePerFlow = perFlow;
+}
+
+void
+Experiment::SetCapture (std::string mode, uint32_t snapLen)
+{
+  NS_ABORT_MSG_UNLESS (mode == "pcapng" || mode == "pcap" || mode == "off",
+                       "unknown capture mode " << mode);
+  m_captureMode = mode;
+  m_snapLen = snapLen;
+}
+
+void
+Experiment::SetCaptureTrigger (std::string spec, Time pre, Time post)
+{
+  CrowdCaptureTrigger check;
+  NS_ABORT_MSG_UNLESS (spec.empty () || check.Parse (spec), "bad capture trigger " << spec);
+  NS_ABORT_MSG_UNLESS (spec.empty () || m_captureMode == "pcapng",
+                       "capture trigger needs --capture=pcapng, not " << m_captureMode);
+  NS_ABORT_MSG_IF (pre.IsStrictlyNegative () || post.IsStrictlyNegative (),
+                   "capture window must not be negative");
+  m_captureTrigger = spec;
+  m_capturePre = pre;
+  m_capturePost = post;
+}
+
+void
+Experiment::SetAnimation (std::string mode, std::string windows, uint32_t sampleEvery)
+{
+  NS_ABORT_MSG_UNLESS (mode == "sampled" || mode == "full" || mode == "off",
+                       "unknown animation mode " << mode);
+  m_animMode = mode;
+  m_animWindows = windows;
+  m_animSampleEvery = sampleEvery;
+}
+
+void
+Experiment::SetRouting (std::string mode, double range, double rxPowerDbm)
+{
+  NS_ABORT_MSG_UNLESS (mode == "ripng" || mode == "oracle", "unknown routing mode " << mode);
+  m_routing = mode;
+  m_oracleRange = range;
+  m_oracleRxPowerDbm = rxPowerDbm;
+}
+
+void
+Experiment::SetApplication (std::string mode, uint32_t chunks, uint32_t chunkSize, uint32_t cacheChunks)
+{
+  NS_ABORT_MSG_UNLESS (mode == "onoff" || mode == "content" || mode == "flows",
+                       "unknown application " << mode);
+  m_app = mode;
+  m_contentChunks = chunks;
+  m_chunkSize = chunkSize;
+  m_cacheChunks = cacheChunks;
+}
+
+void
+Experiment::SetFlowWorkload (uint32_t flows, std::string arrival, uint32_t packetSize)
+{
+  m_flowsPerNode = flows;
+  m_flowArrival = arrival;
+  m_flowPacketSize = packetSize;
+}
+
+void
+Experiment::SetFlowExport (std::string mode, Time interval)
+{
+  NS_ABORT_MSG_UNLESS (mode == "stream" || mode == "xml" || mode == "off",
+                       "unknown flow export mode " << mode);
+  m_flowExport = mode;
+  m_flowInterval = interval;
+}
+
+void
+Experiment::SetWarmStart (std::string mode, std::string file, Time warmup, Time hold)
+{
+  NS_ABORT_MSG_UNLESS (mode == "off" || mode == "save" || mode == "load",
+                       "unknown warm start mode " << mode);
+  NS_ABORT_MSG_IF (hold.IsStrictlyNegative (), "checkpoint hold must not be negative");
+  m_warmStart = mode;
+  m_checkpointFile = file;
+  m_warmup = warmup;
+  m_checkpointHold = hold;
+}
+
+void
+Experiment::SetMobility (std::string mode, std::string trackFile)
+{
+  NS_ABORT_MSG_UNLESS (mode == "walk" || mode == "track", "unknown mobility mode " << mode);
+  m_mobility = mode;
+  m_trackFile = trackFile;
+}
+
+void
+Experiment::SetProfile (bool profile)
+{
+  m_profile = profile;
+}
+
+static std::string
+SchedulerTypeName (std::string name)
+{
+  if (name == "map")
+    {
+      return "ns3::MapScheduler";
+    }
+  if (name == "heap")
+    {
+      return "ns3::HeapScheduler";
+    }
+  if (name == "list")
+    {
+      return "ns3::ListScheduler";
+    }
+  if (name == "calendar")
+    {
+      return "ns3::CalendarScheduler";
+    }
+  if (name == "bucket")
+    {
+      return "ns3::CrowdBucketScheduler";
+    }
+  return "";
+}
+
+void
+Experiment::SetScheduler (std::string name)
+{
+  NS_ABORT_MSG_IF (SchedulerTypeName (name).empty (), "unknown scheduler " << name);
+  m_scheduler = name;
+}
+
+void
+Experiment::SetStopTime (Time stop)
+{
+  m_stopTime = stop;
+}
+
+void
+Experiment::SetNodeProfile (std::string profile)
+{
+  NS_ABORT_MSG_UNLESS (profile == "full" || profile == "lite", "unknown node profile " << profile);
+  m_nodeProfile = profile;
+}
+
+bool
+Experiment::WriteLoopStats (std::string filename) const
+{
+  std::ofstream out (filename.c_str ());
+  out << "loop_s " << m_loopSeconds << std::endl;
+  out << "events " << m_loopEvents << std::endl;
+  out << "sim_s " << m_loopSimSeconds << std::endl;
+  return bool (out);
+}
+
+static double
+WallSeconds (void)
+{
+  struct timeval tv;
+  gettimeofday (&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/*
+ * With no prefix set the run keeps the original file names.
+ */
+std::string
+Experiment::GetOutputName (std::string name) const
+{
+  if (m_outputPrefix.empty ())
+    {
+      return GetOutputPath (name);
+    }
+  return GetOutputPath (m_outputPrefix + "-" + name);
+}
+
+void
+Experiment::AddPoint (double x, double y)
+{
+  m_output.Add (x, y);
+  m_points.push_back (std::make_pair (x, y));
+}
+
+bool
+Experiment::WritePoints (std::string filename) const
+{
+  std::ofstream out (filename.c_str ());
+  if (!out)
+    {
+      return false;
+    }
+  out.precision (17);
+  for (std::vector<std::pair<double, double> >::const_iterator i = m_points.begin (); i != m_points.end (); ++i)
+    {
+      out << i->first << " " << i->second << "\n";
+    }
+  return out.good ();
+}
+
+bool
+Experiment::WriteMetrics (std::string filename) const
+{
+  std::ofstream out (filename.c_str ());
+  if (!out)
+    {
+      return false;
+    }
+  out.precision (17);
+  for (std::vector<std::pair<std::string, double> >::const_iterator i = m_metrics.begin (); i != m_metrics.end (); ++i)
+    {
+      out << i->first << " " << i->second << "\n";
+    }
+  return out.good ();
+}
+
+/*
+ * Each course change used to be printed to std::cout with std::endl, which
+ * flushed on every RandomWalk2d leg of every node and dominated the run
+ * time. The legs now go to a buffered binary recorder instead; use
+ * crowd-trace-to-csv to get the text back.
+ */
+static void
+CourseChange (crowd::TrajectoryRecorder *recorder, uint32_t node, Ptr<const MobilityModel> mobility)
+{
+  Vector pos = mobility->GetPosition ();
+  Vector vel = mobility->GetVelocity ();
+  recorder->Record (node, Simulator::Now ().GetNanoSeconds (),
+                    pos.x, pos.y, pos.z, vel.x, vel.y, vel.z);
+}
+
+/*
+ * New chunks received by the content application count towards goodput
+ * like the packets of the OnOff flow.
+ */
 static void
-CourseChange (std::string context, Ptr<const MobilityModel> mobility)
- {
-   Vector pos = mobility->GetPosition ();
-   Vector vel = mobility->GetVelocity ();
-   std::cout << Simulator::Now () << ", model=" << mobility << ", POS: x=" << pos.x << ", y=" << pos.y
-             << ", z=" << pos.z << "; VEL:" << vel.x << ", y=" << vel.y
-             << ", z=" << vel.z << std::endl;
- }
+ContentReceived (GoodputSampler *sampler, uint32_t node, Ptr<const Packet> packet, const Address &from)
+{
+  sampler->Record (packet->GetSize (), node, 0xffffffff);
+}
 
 /* 
 * In this method, I had plans to add more functionality with
@@ -95,7 +671,8 @@ void
 Experiment::ReceivePacket (Ptr<Socket> socket)
 {
   Ptr<Packet> packet;
-  while ((packet = socket->Recv ()))
+  Address from;
+  while ((packet = socket->RecvFrom (from)))
     {
       SocketIpv6HopLimitTag hoplimitTag;
       if (packet->RemovePacketTag (hoplimitTag))
@@ -103,9 +680,31 @@ Experiment::ReceivePacket (Ptr<Socket> socket)
           NS_LOG_INFO (" HOPLIMIT = " << (uint32_t)hoplimitTag.GetHopLimit ());
         }
       m_bytesTotal += packet->GetSize ();
+      m_sampler.Record (packet->GetSize (), socket->GetNode ()->GetId (), GetFlowId (from));
     }
 }
 
+/*
+ * Flows are numbered by sender address in order of first arrival, one per
+ * sender at most; later senders are only counted in the total.
+ */
+uint32_t
+Experiment::GetFlowId (const Address &from)
+{
+  if (!m_samplePerFlow)
+    {
+      return 0xffffffff;
+    }
+  std::map<Address, uint32_t>::const_iterator i = m_flowIds.find (from);
+  if (i != m_flowIds.end ())
+    {
+      return i->second;
+    }
+  uint32_t id = m_flowIds.size ();
+  m_flowIds[from] = id;
+  return id;
+}
+
 Ptr<Socket>
 Experiment::SetupPacketReceive (Ptr<Node> node)
 {
@@ -132,86 +731,919 @@ Experiment::Run (const WifiHelper &wifi, const YansWifiPhyHelper &wifiPhy,
   Config::SetDefault ("ns3::RandomWalk2dMobilityModel::Mode", StringValue ("Time"));
   Config::SetDefault ("ns3::RandomWalk2dMobilityModel::Time", StringValue ("2s"));
   Config::SetDefault ("ns3::RandomWalk2dMobilityModel::Speed", StringValue ("ns3::ConstantRandomVariable[Constant=1.0]"));
-  Config::SetDefault ("ns3::RandomWalk2dMobilityModel::Bounds", StringValue ("0|200|0|200"));
+  std::ostringstream bounds;
+  bounds << "0|" << m_width << "|0|" << m_height;
+  Config::SetDefault ("ns3::RandomWalk2dMobilityModel::Bounds", StringValue (bounds.str ()));
 
   m_bytesTotal = 0;
+  TypeId scheduler = TypeId::LookupByName (SchedulerTypeName (m_scheduler));
+  if (m_profile)
+    {
+      Config::SetDefault ("ns3::CrowdProfilingScheduler::Inner", TypeIdValue (scheduler));
+      CrowdProfilingScheduler::Enable ();
+    }
+  else
+    {
+      ObjectFactory factory;
+      factory.SetTypeId (scheduler);
+      Simulator::SetScheduler (factory);
+    }
 
   NodeContainer c;
-  c.Create (20);
+  c.Create (m_nodes);
 
   YansWifiPhyHelper phy = wifiPhy;
-  phy.SetChannel (wifiChannel.Create ());
-
+  SpectrumWifiPhyHelper spectrumPhy = SpectrumWifiPhyHelper::Default ();
+  Ptr<CrowdSpectrumChannel> crowdChannel;
   WifiMacHelper mac = wifiMac;
-  NetDeviceContainer devices = wifi.Install (phy, mac, c);
+  NetDeviceContainer devices;
+  if (m_channelMode == "yans")
+    {
+      phy.SetChannel (wifiChannel.Create ());
+      devices = wifi.Install (phy, mac, c);
+    }
+  else
+    {
+      // Same models as YansWifiChannelHelper::Default () and the same PHY
+      // settings as the Yans helper built in main ()
+      crowdChannel = CreateObject<CrowdSpectrumChannel> ();
+      crowdChannel->AddPropagationLossModel (CreateObject<LogDistancePropagationLossModel> ());
+      crowdChannel->SetPropagationDelayModel (CreateObject<ConstantSpeedPropagationDelayModel> ());
+      crowdChannel->SetAttribute ("Validate", BooleanValue (m_channelMode == "grid-validate"));
+      spectrumPhy.SetChannel (crowdChannel);
+      spectrumPhy.Set ("RxGain", DoubleValue (-10) );
+      spectrumPhy.SetPcapDataLinkType (WifiPhyHelper::DLT_IEEE802_11_RADIO);
+      devices = wifi.Install (spectrumPhy, mac, c);
+    }
+  WifiPhyHelper &activePhy = crowdChannel ? static_cast<WifiPhyHelper &> (spectrumPhy)
+                                          : static_cast<WifiPhyHelper &> (phy);
 
+  CrowdCheckpoint checkpoint;
   MobilityHelper mobility;
-  mobility.SetPositionAllocator ("ns3::RandomDiscPositionAllocator",
-                                  "X", StringValue ("100.0"),
-                                  "Y", StringValue ("100.0"),
-                                  "Rho", StringValue ("ns3::UniformRandomVariable[Min=0|Max=30]"));
-  mobility.SetMobilityModel ("ns3::RandomWalk2dMobilityModel",
-                              "Mode", StringValue ("Time"),
-                              "Time", StringValue ("2s"),
-                              "Speed", StringValue ("ns3::ConstantRandomVariable[Constant=2.0]"),
-                              "Bounds", StringValue ("0|200|0|200"));
-
-  mobility.Install (c);
-  Config::Connect ("/NodeList/*/$ns3::MobilityModel/CourseChange",
-                    MakeCallback (&CourseChange));
+  if (m_warmStart == "load")
+    {
+      if (!checkpoint.Load (m_checkpointFile))
+        {
+          NS_FATAL_ERROR ("cannot load checkpoint " << m_checkpointFile);
+        }
+      NS_ABORT_MSG_UNLESS (checkpoint.GetNNodes () == m_nodes,
+                           m_checkpointFile << " is for " << checkpoint.GetNNodes () << " nodes");
+      mobility.SetPositionAllocator (checkpoint.GetPositionAllocator ());
+    }
+  else
+    {
+      mobility.SetPositionAllocator ("ns3::RandomDiscPositionAllocator",
+                                      "X", DoubleValue (m_width / 2),
+                                      "Y", DoubleValue (m_height / 2),
+                                      "Rho", StringValue ("ns3::UniformRandomVariable[Min=0|Max=30]"));
+    }
+  Ptr<CrowdTrackSet> tracks;
+  if (m_mobility == "track")
+    {
+      tracks = CreateObject<CrowdTrackSet> ();
+      if (!tracks->Open (m_trackFile))
+        {
+          NS_FATAL_ERROR ("cannot open track file " << m_trackFile);
+        }
+      tracks->Install (c);
+      if (crowdChannel)
+        {
+          // No CourseChange ever fires, so the grid rebins on this bound
+          crowdChannel->SetAttribute ("MaxSpeed", DoubleValue (tracks->GetMaxSpeed ()));
+        }
+    }
+  else
+    {
+      std::ostringstream speed;
+      speed << "ns3::ConstantRandomVariable[Constant=" << m_speed << "]";
+      mobility.SetMobilityModel ("ns3::RandomWalk2dMobilityModel",
+                                  "Mode", StringValue ("Time"),
+                                  "Time", StringValue ("2s"),
+                                  "Speed", StringValue (speed.str ()),
+                                  "Bounds", StringValue (bounds.str ()));
+      mobility.Install (c);
+    }
+  crowd::TrajectoryRecorder trajectory;
+  if (!trajectory.Open (GetOutputName ("trajectory.ctrj")))
+    {
+      NS_FATAL_ERROR ("cannot open " << GetOutputName ("trajectory.ctrj"));
+    }
+  CrowdTraceConnect<MobilityModel> (c, "CourseChange", &CourseChange, &trajectory);
 
 
   RipNgHelper ripNg;
   Ipv6StaticRoutingHelper staticRouting;
+  Ptr<CrowdOracle> oracle;
 
   Ipv6ListRoutingHelper list;
   list.Add (staticRouting, 0);
-  list.Add (ripNg, 10);
-
-  InternetStackHelper internet;
-  internet.SetRoutingHelper (list); // has effect on the next Install ()
-  internet.Install (c);
+  if (m_routing == "oracle")
+    {
+      double range = m_oracleRange;
+      if (range <= 0)
+        {
+          // The PHYs as configured: transmit power and both antenna gains
+          Ptr<WifiPhy> wifiPhy = DynamicCast<WifiNetDevice> (devices.Get (0))->GetPhy ();
+          DoubleValue txPower, txGain, rxGain;
+          wifiPhy->GetAttribute ("TxPowerStart", txPower);
+          wifiPhy->GetAttribute ("TxGain", txGain);
+          wifiPhy->GetAttribute ("RxGain", rxGain);
+          range = CrowdSpectrumChannel::ComputeCutoffRange (CreateObject<LogDistancePropagationLossModel> (),
+                                                           txPower.Get () + txGain.Get () + rxGain.Get (),
+                                                           m_oracleRxPowerDbm);
+        }
+      oracle = CreateObject<CrowdOracle> ();
+      oracle->SetAttribute ("Range", DoubleValue (range));
+      oracle->SetAttribute ("MaxSpeed", DoubleValue (tracks ? tracks->GetMaxSpeed () : m_speed));
+      list.Add (CrowdOracleRoutingHelper (oracle), 10);
+    }
+  else
+    {
+      list.Add (ripNg, 10);
+    }
 
-  Ipv6AddressHelper ipv6;
+  CrowdStackHelper internet;
+  internet.SetProfile (m_nodeProfile);
+  internet.SetRoutingHelper (list);
+  internet.SetBase (Ipv6Address ("2001:1::"), Ipv6Prefix (64));
   NS_LOG_INFO ("Assign IP Addresses.");
-  ipv6.SetBase (Ipv6Address ("2001:1::"), Ipv6Prefix (64));
-  Ipv6InterfaceContainer i = ipv6.Assign (devices);
+  Ipv6InterfaceContainer i = internet.Install (c, devices);
+  if (oracle)
+    {
+      // Oracle routes are multi-hop, so every node has to forward
+      for (uint32_t n = 0; n < i.GetN (); n++)
+        {
+          i.SetForwarding (n, true);
+        }
+    }
+  if (m_warmStart == "load")
+    {
+      checkpoint.Restore (c, m_checkpointHold);
+      checkpoint.PrintStats (std::clog);
+    }
 
   Inet6SocketAddress socket = Inet6SocketAddress (i.GetAddress (0, 1));
 
+  // OnOffApplication sends Create<Packet> (PacketSize): the payload bytes
+  // are a zero area that is never allocated (see crowd-payload-bench)
   OnOffHelper onoff ("ns3::PacketSocketFactory", Address (socket));
-  onoff.SetConstantRate (DataRate (60000000));
-  onoff.SetAttribute ("PacketSize", UintegerValue (4096));
+  onoff.SetConstantRate (m_rate);
+  onoff.SetAttribute ("PacketSize", UintegerValue (m_packetSize));
 
   Ptr<FlowMonitor> flowMonitor;
   FlowMonitorHelper flowHelper;
-  flowMonitor = flowHelper.InstallAll();
+  CrowdFlowExporter flowExporter;
+  if (m_flowExport == "xml")
+    {
+      flowMonitor = flowHelper.InstallAll();
+    }
+  else if (m_flowExport == "stream")
+    {
+      if (!flowExporter.Open (GetOutputName ("flows.cflw"), m_flowInterval))
+        {
+          NS_FATAL_ERROR ("cannot open " << GetOutputName ("flows.cflw"));
+        }
+      flowExporter.Install (c);
+    }
+
+  // A loaded checkpoint stands for the first part of the run, applications
+  // included, so the run only covers what comes after it
+  Time skipped = m_warmStart == "load" ? checkpoint.GetTime () : Seconds (0);
+  NS_ABORT_MSG_UNLESS (skipped < m_stopTime, m_checkpointFile << " is past the stop time");
+  Time appStart = Max (Seconds (0.5) - skipped, Seconds (0));
+  Time appStop = Max (m_appStop - skipped, appStart);
+  Time stopTime = m_stopTime - skipped;
 
-  ApplicationContainer apps = onoff.Install (c.Get (0));
-  apps.Start (Seconds (0.5));
-  apps.Stop (Seconds (300.0));
+  ApplicationContainer apps;
+  if (m_app == "content")
+    {
+      ObjectFactory content;
+      content.SetTypeId ("ns3::CrowdContentApp");
+      content.Set ("Chunks", UintegerValue (m_contentChunks));
+      content.Set ("ChunkSize", UintegerValue (m_chunkSize));
+      content.Set ("CacheChunks", UintegerValue (m_cacheChunks));
+      for (uint32_t n = 0; n < c.GetN (); n++)
+        {
+          content.Set ("Seed", BooleanValue (n == 0));
+          Ptr<Application> app = content.Create<Application> ();
+          c.Get (n)->AddApplication (app);
+          app->TraceConnectWithoutContext ("Rx", MakeBoundCallback (&ContentReceived, &m_sampler, n));
+          apps.Add (app);
+        }
+    }
+  else if (m_app == "flows")
+    {
+      std::ostringstream size;
+      size << "ns3::ConstantRandomVariable[Constant=" << m_flowPacketSize << "]";
+      ObjectFactory flows;
+      flows.SetTypeId ("ns3::CrowdFlowGenerator");
+      flows.Set ("Flows", UintegerValue (m_flowsPerNode));
+      flows.Set ("Interval", StringValue (m_flowArrival));
+      flows.Set ("Size", StringValue (size.str ()));
+      apps = CrowdFlowGenerator::Install (flows, c, i);
+      for (uint32_t n = 0; n < apps.GetN (); n++)
+        {
+          apps.Get (n)->TraceConnectWithoutContext ("Rx", MakeBoundCallback (&ContentReceived, &m_sampler, n));
+        }
+    }
+  else
+    {
+      apps = onoff.Install (c.Get (0));
+    }
+  apps.Start (appStart);
+  apps.Stop (appStop);
   
   NS_LOG_UNCOND ("socket receive");
   
   Ptr<Socket> recvSink = SetupPacketReceive (c.Get (1));
-  AnimationInterface anim ("animation.xml");
-  anim.EnablePacketMetadata (true);
-  phy.EnablePcap ("crowdsrc-adhoc", devices);
+  AnimationInterface *anim = 0;
+  CrowdAnimWriter sampledAnim;
+  std::string sampledAnimFile = GetOutputName (CrowdAnimWriter::OutputName ("animation.xml"));
+  if (m_animMode == "full")
+    {
+      anim = new AnimationInterface (GetOutputName ("animation.xml"));
+      anim->EnablePacketMetadata (true);
+    }
+  else if (m_animMode == "sampled")
+    {
+      if (!sampledAnim.Open (sampledAnimFile, m_animWindows, m_animSampleEvery, true))
+        {
+          NS_FATAL_ERROR ("cannot open " << sampledAnimFile);
+        }
+      sampledAnim.Install (c, devices);
+    }
+  CrowdPcapngCapture capture;
+  CrowdCaptureTrigger trigger;
+  if (m_captureMode == "pcap")
+    {
+      activePhy.EnablePcap (GetOutputName ("crowdsrc-adhoc"), devices);
+    }
+  else if (m_captureMode == "pcapng")
+    {
+      if (!capture.Open (GetOutputName ("crowdsrc-adhoc.pcapng"), m_snapLen))
+        {
+          NS_FATAL_ERROR ("cannot open " << GetOutputName ("crowdsrc-adhoc.pcapng"));
+        }
+      if (!m_captureTrigger.empty ())
+        {
+          capture.SetTriggered (m_capturePre, m_capturePost);
+        }
+      capture.Install (devices);
+    }
+  m_flowIds.clear ();
+  m_sampler.Start (m_sampleInterval, Seconds (0), stopTime,
+                   m_samplePerNode ? m_nodes : 0, m_samplePerFlow ? m_nodes : 0);
+  if (m_captureMode == "pcapng" && !m_captureTrigger.empty ())
+    {
+      trigger.Parse (m_captureTrigger);
+      trigger.SetActivePeriod (appStart, appStop);
+      trigger.Install (&capture, c, &m_sampler, m_sampleInterval, stopTime);
+    }
+
   NS_LOG_UNCOND ("run");
-  Simulator::Stop (Seconds (600.0));
+  Simulator::Stop (m_warmStart == "save" ? m_warmup : stopTime);
+  uint64_t eventsBefore = Simulator::GetEventCount ();
+  Time simStart = Simulator::Now ();
+  double loopStart = WallSeconds ();
   Simulator::Run ();
+  m_loopSeconds = WallSeconds () - loopStart;
+  m_loopEvents = Simulator::GetEventCount () - eventsBefore;
+  m_loopSimSeconds = (Simulator::Now () - simStart).GetSeconds ();
+  if (m_warmStart == "save")
+    {
+      checkpoint.Capture (c);
+      if (!checkpoint.Save (m_checkpointFile))
+        {
+          NS_FATAL_ERROR ("cannot write checkpoint " << m_checkpointFile);
+        }
+      checkpoint.PrintStats (std::clog);
+    }
+
+  m_metrics.clear ();
+  double goodputSum = 0;
+  uint32_t goodputSamples = 0;
+  for (uint32_t s = 0; s < m_sampler.GetSampleCount (); s++)
+    {
+      AddPoint (m_sampler.GetTime (s), m_sampler.GetGoodput (s));
+      if (m_sampler.GetTime (s) <= appStop.GetSeconds ())
+        {
+          goodputSum += m_sampler.GetGoodput (s);
+          goodputSamples++;
+        }
+    }
+  m_metrics.push_back (std::make_pair (std::string ("goodput_mbps"),
+                                       goodputSamples > 0 ? goodputSum / goodputSamples : 0.0));
+  if (!m_sampler.WriteCsv (GetOutputName ("goodput.csv")))
+    {
+      NS_FATAL_ERROR ("cannot write " << GetOutputName ("goodput.csv"));
+    }
 
   NS_LOG_UNCOND ("destroy");
-  flowMonitor->SerializeToXmlFile ("crowdsrc-adhoc-flow.xml", true, true);
+  trajectory.Close ();
+  NS_LOG_UNCOND ("trajectory: " << trajectory.GetRecordCount () << " course changes, "
+                 << trajectory.GetBytesWritten () << " bytes");
+  if (crowdChannel)
+    {
+      crowdChannel->PrintStats (std::clog);
+    }
+  if (m_captureMode == "pcapng")
+    {
+      capture.Close ();
+      capture.PrintStats (std::clog);
+      if (!m_captureTrigger.empty ())
+        {
+          NS_LOG_UNCOND ("capture trigger: fired " << trigger.GetFired () << " times");
+        }
+    }
+  if (m_animMode == "sampled")
+    {
+      if (!sampledAnim.Close ())
+        {
+          NS_FATAL_ERROR ("cannot write " << sampledAnimFile);
+        }
+      sampledAnim.PrintStats (std::clog);
+    }
+  if (oracle)
+    {
+      oracle->PrintStats (std::clog);
+    }
+  if (m_app == "content")
+    {
+      CrowdContentApp::PrintSummary (apps, std::clog);
+    }
+  else if (m_app == "flows")
+    {
+      CrowdFlowGenerator::PrintSummary (apps, std::clog);
+    }
+  if (m_flowExport == "xml")
+    {
+      flowMonitor->SerializeToXmlFile (GetOutputName ("crowdsrc-adhoc-flow.xml"), true, true);
+    }
+  else if (m_flowExport == "stream")
+    {
+      flowExporter.Close ();
+      flowExporter.PrintStats (std::clog);
+      crowd::FlowCounters totals = flowExporter.GetTotals ();
+      if (totals.txPackets > 0)
+        {
+          m_metrics.push_back (std::make_pair (std::string ("delivery"),
+                                               double (totals.rxPackets) / totals.txPackets));
+        }
+      if (totals.rxPackets > 0)
+        {
+          m_metrics.push_back (std::make_pair (std::string ("delay_ms"),
+                                               totals.delaySumNs / 1e6 / totals.rxPackets));
+        }
+    }
+  if (m_profile)
+    {
+      CrowdProfilingScheduler::Get ()->Report (std::clog, "crowdsrc-adhoc", GetOutputName ("profile.folded"),
+                                              GetOutputName ("profile-depth.csv"));
+    }
   Simulator::Destroy ();
+  delete anim;
 
   return m_output;
 }
 
+/*
+ * One point of the rate-manager sweep that used to live, commented out, in
+ * main (). It came from the wifi-adhoc.cc example, where every point was run
+ * one after the other; that took hours, so only "ideal" was kept.
+ */
+struct SweepPoint
+{
+  const char *plot;       // gnuplot output the dataset belongs to
+  const char *name;       // dataset title
+  WifiPhyStandard standard;
+  const char *manager;
+  const char *dataMode;   // 0 for rate-adaptive managers
+};
+
+static const SweepPoint g_sweepPoints[] = {
+  { "reference-rates.png", "54mb", WIFI_PHY_STANDARD_80211a, "ns3::ConstantRateWifiManager", "OfdmRate54Mbps" },
+  { "reference-rates.png", "48mb", WIFI_PHY_STANDARD_80211a, "ns3::ConstantRateWifiManager", "OfdmRate48Mbps" },
+  { "reference-rates.png", "36mb", WIFI_PHY_STANDARD_80211a, "ns3::ConstantRateWifiManager", "OfdmRate36Mbps" },
+  { "reference-rates.png", "24mb", WIFI_PHY_STANDARD_80211a, "ns3::ConstantRateWifiManager", "OfdmRate24Mbps" },
+  { "reference-rates.png", "18mb", WIFI_PHY_STANDARD_80211a, "ns3::ConstantRateWifiManager", "OfdmRate18Mbps" },
+  { "reference-rates.png", "12mb", WIFI_PHY_STANDARD_80211a, "ns3::ConstantRateWifiManager", "OfdmRate12Mbps" },
+  { "reference-rates.png", "9mb", WIFI_PHY_STANDARD_80211a, "ns3::ConstantRateWifiManager", "OfdmRate9Mbps" },
+  { "reference-rates.png", "6mb", WIFI_PHY_STANDARD_80211a, "ns3::ConstantRateWifiManager", "OfdmRate6Mbps" },
+  { "rate-control.png", "arf", WIFI_PHY_STANDARD_holland, "ns3::ArfWifiManager", 0 },
+  { "rate-control.png", "aarf", WIFI_PHY_STANDARD_holland, "ns3::AarfWifiManager", 0 },
+  { "rate-control.png", "aarf-cd", WIFI_PHY_STANDARD_holland, "ns3::AarfcdWifiManager", 0 },
+  { "rate-control.png", "cara", WIFI_PHY_STANDARD_holland, "ns3::CaraWifiManager", 0 },
+  { "rate-control.png", "rraa", WIFI_PHY_STANDARD_holland, "ns3::RraaWifiManager", 0 },
+  { "rate-control.png", "ideal", WIFI_PHY_STANDARD_holland, "ns3::IdealWifiManager", 0 },
+};
+
+static std::string
+SweepOutputPrefix (const SweepPoint &point, uint32_t run)
+{
+  std::ostringstream oss;
+  oss << "crowdsrc-adhoc-" << point.name << "-run" << run;
+  return oss.str ();
+}
+
+/*
+ * Runs in a forked worker: one rate manager with one RngRun value, using
+ * the scenario settings of the prototype experiment.
+ */
+static int
+RunSweepPoint (const Experiment &prototype, const SweepPoint &point, uint32_t run, WifiHelper wifi,
+               const YansWifiPhyHelper &wifiPhy, const WifiMacHelper &wifiMac,
+               const YansWifiChannelHelper &wifiChannel)
+{
+  RngSeedManager::SetRun (run);
+  wifi.SetStandard (point.standard);
+  if (point.dataMode)
+    {
+      wifi.SetRemoteStationManager (point.manager,
+                                    "DataMode", StringValue (point.dataMode));
+    }
+  else
+    {
+      wifi.SetRemoteStationManager (point.manager);
+    }
+
+  std::string prefix = SweepOutputPrefix (point, run);
+  Experiment experiment (prototype);
+  experiment.SetTitle (point.name);
+  experiment.SetOutputPrefix (prefix);
+  experiment.Run (wifi, wifiPhy, wifiMac, wifiChannel);
+  return experiment.WritePoints (experiment.GetOutputPath (prefix + ".dat")) ? 0 : 1;
+}
+
+/*
+ * Fork every (rate manager x RngRun) configuration into its own worker,
+ * then average the workers' points per x value into one dataset per rate
+ * manager and write one gnuplot script per plot. False if a configuration
+ * failed or a script could not be written.
+ */
+static bool
+RunSweep (const Experiment &prototype, uint32_t runs, uint32_t jobs, const WifiHelper &wifi,
+          const YansWifiPhyHelper &wifiPhy, const WifiMacHelper &wifiMac,
+          const YansWifiChannelHelper &wifiChannel)
+{
+  const uint32_t nPoints = sizeof (g_sweepPoints) / sizeof (g_sweepPoints[0]);
+  std::vector<std::pair<uint32_t, uint32_t> > jobList;  // (point, run)
+  std::vector<int> status;
+
+  CrowdWorkerPool pool (jobs);
+  pool.SetDoneCallback ([&] (uint32_t id, int exitStatus)
+    {
+      status[id] = exitStatus;
+      const SweepPoint &point = g_sweepPoints[jobList[id].first];
+      NS_LOG_UNCOND ("sweep: " << point.name << " run " << jobList[id].second
+                     << (exitStatus == 0 ? " done" : " FAILED"));
+    });
+  NS_LOG_UNCOND ("sweep: " << nPoints * runs << " configurations on "
+                 << pool.GetMaxWorkers () << " workers");
+
+  for (uint32_t run = 1; run <= runs; run++)
+    {
+      for (uint32_t p = 0; p < nPoints; p++)
+        {
+          jobList.push_back (std::make_pair (p, run));
+          status.push_back (-1);
+          const SweepPoint &point = g_sweepPoints[p];
+          pool.Submit ([&prototype, &point, run, &wifi, &wifiPhy, &wifiMac, &wifiChannel] ()
+            {
+              return RunSweepPoint (prototype, point, run, wifi, wifiPhy, wifiMac, wifiChannel);
+            });
+        }
+    }
+  pool.WaitAll ();
+  uint32_t failed = 0;
+  for (uint32_t id = 0; id < status.size (); id++)
+    {
+      if (status[id] != 0)
+        {
+          failed++;
+        }
+    }
+
+  std::map<std::string, Gnuplot> plots;
+  for (uint32_t p = 0; p < nPoints; p++)
+    {
+      const SweepPoint &point = g_sweepPoints[p];
+      // x -> (sum of y, number of runs contributing)
+      std::map<double, std::pair<double, uint32_t> > merged;
+      for (uint32_t id = 0; id < jobList.size (); id++)
+        {
+          if (jobList[id].first != p || status[id] != 0)
+            {
+              continue;
+            }
+          std::ifstream in (prototype.GetOutputPath (SweepOutputPrefix (point, jobList[id].second) + ".dat").c_str ());
+          double x, y;
+          while (in >> x >> y)
+            {
+              merged[x].first += y;
+              merged[x].second++;
+            }
+        }
+      Gnuplot2dDataset dataset (point.name);
+      dataset.SetStyle (Gnuplot2dDataset::LINES);
+      for (std::map<double, std::pair<double, uint32_t> >::const_iterator i = merged.begin (); i != merged.end (); ++i)
+        {
+          dataset.Add (i->first, i->second.first / i->second.second);
+        }
+      if (plots.find (point.plot) == plots.end ())
+        {
+          plots.insert (std::make_pair (std::string (point.plot), Gnuplot (point.plot)));
+        }
+      plots.find (point.plot)->second.AddDataset (dataset);
+    }
+
+  for (std::map<std::string, Gnuplot>::iterator i = plots.begin (); i != plots.end (); ++i)
+    {
+      std::string plotFile = prototype.GetOutputPath (i->first.substr (0, i->first.rfind ('.')) + ".plt");
+      std::ofstream out (plotFile.c_str ());
+      i->second.GenerateOutput (out);
+      if (!out)
+        {
+          NS_LOG_UNCOND ("sweep: cannot write " << plotFile);
+          failed++;
+          continue;
+        }
+      // The script names the image; rendering it is left to gnuplot
+      NS_LOG_UNCOND ("sweep: wrote " << plotFile << ", run \"gnuplot " << plotFile
+                     << "\" for " << i->first);
+    }
+  if (failed > 0)
+    {
+      NS_LOG_UNCOND ("sweep: " << failed << " FAILED");
+    }
+  return failed == 0;
+}
+
+static std::string
+ReplicationOutputPrefix (uint32_t run)
+{
+  std::ostringstream oss;
+  oss << "crowdsrc-adhoc-rep" << run;
+  return oss.str ();
+}
+
+/*
+ * Runs in a forked worker: the Ideal configuration with one RngRun value.
+ */
+static int
+RunReplication (const Experiment &prototype, uint32_t run, WifiHelper wifi,
+                const YansWifiPhyHelper &wifiPhy, const WifiMacHelper &wifiMac,
+                const YansWifiChannelHelper &wifiChannel)
+{
+  RngSeedManager::SetRun (run);
+  wifi.SetRemoteStationManager ("ns3::IdealWifiManager");
+  std::string prefix = ReplicationOutputPrefix (run);
+  Experiment experiment (prototype);
+  experiment.SetTitle ("ideal");
+  experiment.SetOutputPrefix (prefix);
+  experiment.Run (wifi, wifiPhy, wifiMac, wifiChannel);
+  return experiment.WriteMetrics (experiment.GetOutputPath (prefix + ".metrics")) ? 0 : 1;
+}
+
+/*
+ * Launch RngRun 1, 2, ... of the scenario in workers, folding each
+ * finished run's metrics into running statistics. No new run is launched
+ * once at least minRuns have finished and every metric's confidence
+ * interval is within relWidth of its mean, or after maxRuns; runs
+ * already in flight by then still count. False if a run failed or the
+ * intervals did not converge.
+ */
+static bool
+RunReplications (const Experiment &prototype, uint32_t minRuns, uint32_t maxRuns, double confidence,
+                 double relWidth, uint32_t jobs, const WifiHelper &wifi,
+                 const YansWifiPhyHelper &wifiPhy, const WifiMacHelper &wifiMac,
+                 const YansWifiChannelHelper &wifiChannel)
+{
+  crowd::ReplicationStats stats;
+  std::vector<uint32_t> runOf;
+  uint32_t failed = 0;
+
+  CrowdWorkerPool pool (jobs);
+  pool.SetDoneCallback ([&] (uint32_t id, int exitStatus)
+    {
+      uint32_t run = runOf[id];
+      if (exitStatus != 0 || !stats.AddFile (prototype.GetOutputPath (ReplicationOutputPrefix (run) + ".metrics")))
+        {
+          failed++;
+          NS_LOG_UNCOND ("replicate: run " << run << " FAILED");
+          return;
+        }
+      NS_LOG_UNCOND ("replicate: run " << run << " done, " << stats.GetReplications () << " finished");
+    });
+  NS_LOG_UNCOND ("replicate: " << minRuns << " to " << maxRuns << " runs on "
+                 << pool.GetMaxWorkers () << " workers, stopping at +-" << relWidth * 100
+                 << "% of the mean at " << confidence * 100 << "% confidence");
+
+  for (uint32_t run = 1; run <= maxRuns; run++)
+    {
+      // Wait for a free worker first, so that the decision to launch sees
+      // every result that came in meanwhile
+      while (pool.GetRunning () >= pool.GetMaxWorkers ())
+        {
+          pool.WaitOne ();
+        }
+      if (stats.GetReplications () >= minRuns && stats.IsConverged (confidence, relWidth))
+        {
+          break;
+        }
+      runOf.push_back (run);
+      pool.Submit ([&prototype, run, &wifi, &wifiPhy, &wifiMac, &wifiChannel] ()
+        {
+          return RunReplication (prototype, run, wifi, wifiPhy, wifiMac, wifiChannel);
+        });
+    }
+  pool.WaitAll ();
+
+  bool converged = stats.GetReplications () >= minRuns && stats.IsConverged (confidence, relWidth);
+  NS_LOG_UNCOND ("replicate: " << stats.GetReplications () << " runs, " << failed << " failed, "
+                 << (converged ? "converged" : "NOT converged"));
+  stats.Print (std::cout, confidence);
+  return failed == 0 && converged;
+}
+
+static std::string
+SchedulerBenchPrefix (std::string scheduler, uint32_t nodes)
+{
+  std::ostringstream oss;
+  oss << "crowdsrc-adhoc-sched-" << scheduler << "-" << nodes;
+  return oss.str ();
+}
+
+/*
+ * Runs in a forked worker: the Ideal configuration on nodes nodes with
+ * one scheduler, without packet capture or animation, whose file output
+ * would blur the event loop timing.
+ */
+static int
+RunSchedulerPoint (const Experiment &prototype, std::string scheduler, uint32_t nodes, WifiHelper wifi,
+                   const YansWifiPhyHelper &wifiPhy, const WifiMacHelper &wifiMac,
+                   const YansWifiChannelHelper &wifiChannel)
+{
+  wifi.SetRemoteStationManager ("ns3::IdealWifiManager");
+  std::string prefix = SchedulerBenchPrefix (scheduler, nodes);
+  Experiment experiment (prototype);
+  experiment.SetTitle ("ideal");
+  experiment.SetOutputPrefix (prefix);
+  experiment.SetNodeCount (nodes);
+  experiment.SetScheduler (scheduler);
+  experiment.SetCapture ("off", 0);
+  experiment.SetAnimation ("off", "", 1);
+  experiment.Run (wifi, wifiPhy, wifiMac, wifiChannel);
+  std::string loopFile = experiment.GetOutputPath (prefix + ".loop");
+  return experiment.WriteLoopStats (loopFile) ? 0 : 1;
+}
+
+/*
+ * Run the scenario once per (node count, scheduler), one worker at a time
+ * so that the runs do not compete for cores or memory bandwidth, and
+ * print the event loop time of each against the map scheduler's. False if
+ * a run failed.
+ */
+static bool
+RunSchedulerBench (const Experiment &prototype, std::string schedulerList, std::string nodeList,
+                   const WifiHelper &wifi, const YansWifiPhyHelper &wifiPhy,
+                   const WifiMacHelper &wifiMac, const YansWifiChannelHelper &wifiChannel)
+{
+  std::vector<std::string> schedulers;
+  std::vector<uint32_t> nodeCounts;
+  std::string item;
+  std::istringstream schedulerIn (schedulerList);
+  while (std::getline (schedulerIn, item, ','))
+    {
+      NS_ABORT_MSG_IF (SchedulerTypeName (item).empty (), "unknown scheduler " << item);
+      schedulers.push_back (item);
+    }
+  std::istringstream nodeIn (nodeList);
+  while (std::getline (nodeIn, item, ','))
+    {
+      char *end;
+      long count = std::strtol (item.c_str (), &end, 10);
+      NS_ABORT_MSG_UNLESS (end != item.c_str () && *end == '\0' && count > 0, "bad node count " << item);
+      nodeCounts.push_back (count);
+    }
+
+  std::vector<int> status;
+  // The child's own getrusage could report the parent's peak from before
+  // the fork; wait4 gives the child's alone
+  std::vector<double> rssMb;
+  CrowdWorkerPool pool (1);
+  pool.SetDoneCallback ([&] (uint32_t id, int exitStatus)
+    {
+      status[id] = exitStatus;
+      rssMb[id] = pool.GetLastUsage ().ru_maxrss / 1024.0;
+    });
+  for (uint32_t n = 0; n < nodeCounts.size (); n++)
+    {
+      for (uint32_t k = 0; k < schedulers.size (); k++)
+        {
+          status.push_back (-1);
+          rssMb.push_back (0);
+          std::string scheduler = schedulers[k];
+          uint32_t nodes = nodeCounts[n];
+          NS_LOG_UNCOND ("scheduler bench: " << scheduler << " on " << nodes << " nodes");
+          pool.Submit ([&prototype, scheduler, nodes, &wifi, &wifiPhy, &wifiMac, &wifiChannel] ()
+            {
+              return RunSchedulerPoint (prototype, scheduler, nodes, wifi, wifiPhy, wifiMac, wifiChannel);
+            });
+        }
+    }
+  pool.WaitAll ();
+
+  uint32_t failed = 0;
+  std::cout << "nodes  scheduler   loop s      events  ns/event  vs map  peak RSS MB" << std::endl;
+  for (uint32_t n = 0; n < nodeCounts.size (); n++)
+    {
+      double mapSeconds = 0;
+      for (uint32_t k = 0; k < schedulers.size (); k++)
+        {
+          uint32_t id = n * schedulers.size () + k;
+          std::map<std::string, double> values;
+          std::ifstream in (prototype.GetOutputPath (SchedulerBenchPrefix (schedulers[k], nodeCounts[n]) + ".loop").c_str ());
+          std::string name;
+          double value;
+          while (in >> name >> value)
+            {
+              values[name] = value;
+            }
+          char line[160];
+          if (status[id] != 0 || values.size () < 3)
+            {
+              std::snprintf (line, sizeof (line), "%5u  %-9s   FAILED", nodeCounts[n], schedulers[k].c_str ());
+              std::cout << line << std::endl;
+              failed++;
+              continue;
+            }
+          if (schedulers[k] == "map")
+            {
+              mapSeconds = values["loop_s"];
+            }
+          char ratio[16] = "-";
+          if (mapSeconds > 0 && values["loop_s"] > 0)
+            {
+              std::snprintf (ratio, sizeof (ratio), "%.2fx", mapSeconds / values["loop_s"]);
+            }
+          std::snprintf (line, sizeof (line), "%5u  %-9s %8.2f %11.0f %9.1f %7s %12.1f",
+                         nodeCounts[n], schedulers[k].c_str (), values["loop_s"], values["events"],
+                         values["events"] > 0 ? values["loop_s"] * 1e9 / values["events"] : 0.0,
+                         ratio, rssMb[id]);
+          std::cout << line << std::endl;
+        }
+    }
+  return failed == 0;
+}
+
 int main (int argc, char *argv[])
 {
+  bool sweep = false;
+  uint32_t runs = 1;
+  uint32_t jobs = 0;
+  uint32_t replications = 0;
+  uint32_t minReplications = 3;
+  double confidence = 0.95;
+  double ciWidth = 0.05;
+  uint32_t nodes = 20;
+  double width = 200.0;
+  double height = 200.0;
+  double speed = 2.0;
+  std::string rate ("60Mbps");
+  uint32_t packetSize = 4096;
+  double appStop = 300.0;
+  std::string scenario ("");
+  std::string outputDir ("");
+  std::string channel ("yans");
+  double sampleInterval = 1.0;
+  bool samplePerNode = false;
+  bool samplePerFlow = false;
+  std::string capture ("pcap");
+  uint32_t snapLen = 128;
+  std::string captureTrigger ("");
+  double capturePre = 0.5;
+  double capturePost = 2.0;
+  std::string anim ("full");
+  std::string animWindows ("0-30,290-300");
+  uint32_t animSample = 10;
+  std::string routing ("ripng");
+  double oracleRange = 0.0;
+  double oracleRxPower = -82.0;
+  std::string app ("onoff");
+  uint32_t chunks = 256;
+  uint32_t chunkSize = 1024;
+  uint32_t cacheChunks = 64;
+  uint32_t flows = 100;
+  std::string flowArrival ("ns3::ExponentialRandomVariable[Mean=1.0]");
+  uint32_t flowSize = 256;
+  std::string flowExport ("xml");
+  double flowInterval = 10.0;
+  std::string warmStart ("off");
+  std::string checkpointFile ("crowdsrc-adhoc.ckpt");
+  double warmup = 10.0;
+  double checkpointHold = 30.0;
+  std::string mobility ("walk");
+  std::string trackFile ("crowd.ctrk");
+  bool profile = false;
+  std::string scheduler ("map");
+  double stopTime = 600.0;
+  std::string schedulerBench ("");
+  std::string benchNodes ("20,200,2000");
+  std::string nodeProfile ("full");
+  std::string loopStats ("");
+
   CommandLine cmd;
-  cmd.Parse (argc, argv);
+  cmd.AddValue ("sweep", "run every rate manager in parallel worker processes", sweep);
+  cmd.AddValue ("runs", "number of RngRun seeds per rate manager in a sweep", runs);
+  cmd.AddValue ("jobs", "maximum concurrent sweep or replication workers (0 = number of cores)", jobs);
+  cmd.AddValue ("replications", "run up to this many RngRun replications in workers (0 = single run)", replications);
+  cmd.AddValue ("minReplications", "replications always run before the stopping test", minReplications);
+  cmd.AddValue ("confidence", "confidence level of the replication intervals", confidence);
+  cmd.AddValue ("ciWidth", "stop replicating once every interval is within this fraction of its mean", ciWidth);
+  cmd.AddValue ("nodes", "number of nodes in the crowd", nodes);
+  cmd.AddValue ("width", "width of the area the nodes walk in (m)", width);
+  cmd.AddValue ("height", "height of the area the nodes walk in (m)", height);
+  cmd.AddValue ("speed", "random walk speed (m/s)", speed);
+  cmd.AddValue ("rate", "onoff mode: data rate of the flow, e.g. 60Mbps", rate);
+  cmd.AddValue ("packetSize", "onoff mode: packet payload bytes", packetSize);
+  cmd.AddValue ("appStop", "simulated second the applications stop at", appStop);
+  cmd.AddValue ("scenario", "file of \"name = value\" options, read before (and overridden by) the command line", scenario);
+  cmd.AddValue ("outputDir", "directory for every output file, created if missing (default: current directory)", outputDir);
+  cmd.AddValue ("channel", "channel model: yans, grid or grid-validate", channel);
+  cmd.AddValue ("sampleInterval", "goodput sampling interval (seconds)", sampleInterval);
+  cmd.AddValue ("samplePerNode", "also sample goodput per receiving node", samplePerNode);
+  cmd.AddValue ("samplePerFlow", "also sample goodput per flow", samplePerFlow);
+  cmd.AddValue ("capture", "packet capture: pcap (per device, the original), pcapng (merged) or off", capture);
+  cmd.AddValue ("snapLen", "bytes of each frame kept in the pcapng capture", snapLen);
+  cmd.AddValue ("captureTrigger", "pcapng only around conditions, e.g. goodput<5,hops>3,region=0:50:0:50 (empty = always)", captureTrigger);
+  cmd.AddValue ("capturePre", "seconds captured before a trigger", capturePre);
+  cmd.AddValue ("capturePost", "seconds captured after a trigger", capturePost);
+  cmd.AddValue ("anim", "animation: full (the original AnimationInterface), sampled or off", anim);
+  cmd.AddValue ("animWindows", "sampled animation windows in seconds, e.g. 10-20,300-310", animWindows);
+  cmd.AddValue ("animSample", "sampled animation keeps one packet in animSample", animSample);
+  cmd.AddValue ("routing", "routing: ripng or oracle (positions, no control traffic)", routing);
+  cmd.AddValue ("oracleRange", "oracle link range in metres (0 = derive from oracleRxPower)", oracleRange);
+  cmd.AddValue ("oracleRxPower", "weakest usable signal (dBm) for the derived oracle range", oracleRxPower);
+  cmd.AddValue ("app", "traffic: onoff (saturating flow), content (crowd content sharing) or flows (many small flows)", app);
+  cmd.AddValue ("chunks", "content mode: chunks in the shared content", chunks);
+  cmd.AddValue ("chunkSize", "content mode: bytes per chunk", chunkSize);
+  cmd.AddValue ("cacheChunks", "content mode: chunks cached per node", cacheChunks);
+  cmd.AddValue ("flows", "flows mode: concurrent flows per node", flows);
+  cmd.AddValue ("flowArrival", "flows mode: random variable for the seconds between a flow's packets", flowArrival);
+  cmd.AddValue ("flowSize", "flows mode: packet payload bytes", flowSize);
+  cmd.AddValue ("flowExport", "flow statistics: xml (FlowMonitor, as before), stream (periodic CFLW log) or off", flowExport);
+  cmd.AddValue ("flowInterval", "seconds between flow statistics snapshots", flowInterval);
+  cmd.AddValue ("warmStart", "off, save (run the warm-up and checkpoint it) or load (start from the checkpoint)", warmStart);
+  cmd.AddValue ("checkpoint", "warm start checkpoint file", checkpointFile);
+  cmd.AddValue ("warmup", "simulated seconds run before a checkpoint is saved", warmup);
+  cmd.AddValue ("checkpointHold", "seconds the routes of a loaded checkpoint are kept, e.g. until RIPng's first periodic update", checkpointHold);
+  cmd.AddValue ("mobility", "node movement: walk (random walk) or track (precomputed CTRK tracks)", mobility);
+  cmd.AddValue ("track", "track file for --mobility=track", trackFile);
+  cmd.AddValue ("profile", "report wall time per event type, with a folded-stacks file", profile);
+  cmd.AddValue ("scheduler", "event scheduler: map, heap, list, calendar or bucket", scheduler);
+  cmd.AddValue ("stopTime", "simulated seconds to run", stopTime);
+  cmd.AddValue ("schedulerBench", "time the event loop with each of these schedulers, e.g. map,heap,list,calendar,bucket", schedulerBench);
+  cmd.AddValue ("benchNodes", "node counts for --schedulerBench", benchNodes);
+  cmd.AddValue ("nodeProfile", "per-node stack: full, or lite (IPv6 only, no DAD or queue discs; needs --routing=oracle)", nodeProfile);
+  cmd.AddValue ("loopStats", "write the event loop's wall time, events and simulated seconds to this file", loopStats);
+
+  // Scenario file options go ahead of the command line, which so
+  // overrides them
+  std::vector<std::string> args (argv, argv + argc);
+  uint32_t inserted = 1;
+  for (int a = 1; a < argc; a++)
+    {
+      std::string arg (argv[a]);
+      if (arg.compare (0, 11, "--scenario=") == 0)
+        {
+          crowd::ScenarioFile file;
+          if (!file.Read (arg.substr (11)))
+            {
+              NS_FATAL_ERROR (file.GetError ());
+            }
+          args.insert (args.begin () + inserted, file.GetArgs ().begin (), file.GetArgs ().end ());
+          inserted += file.GetArgs ().size ();
+        }
+    }
+  std::vector<char *> argp;
+  for (uint32_t a = 0; a < args.size (); a++)
+    {
+      argp.push_back (const_cast<char *> (args[a].c_str ()));
+    }
+  cmd.Parse (argp.size (), &argp[0]);
+  if (!outputDir.empty ())
+    {
+      SystemPath::MakeDirectories (outputDir);
+      // The options this run resolved to, as a scenario file that repeats
+      // it wherever its output goes
+      std::vector<std::string> omit;
+      omit.push_back ("scenario");
+      omit.push_back ("outputDir");
+      if (!crowd::ScenarioFile::Write (outputDir + "/scenario.txt", args, omit))
+        {
+          NS_FATAL_ERROR ("cannot write " << outputDir << "/scenario.txt");
+        }
+    }
 
   Gnuplot gnuplot = Gnuplot ("reference-rates.png");
 
@@ -244,111 +1676,60 @@ int main (int argc, char *argv[])
   wifiMac.SetType ("ns3::AdhocWifiMac");
 
   /* 
-  * The following code was taken from the wifi-adhoc.cc script, and
-  * was used for debugging as I would test the script against these
-  * different settings. In the final version, I thought they were superfluous
-  * as only one setting would produce an animation and trace files for analysis,
-  * so I opted for one, which was the Ideal setting. I have left these in for
-  * context with my testing.
+  * The fixed-rate and rate-control settings taken from the wifi-adhoc.cc
+  * script are in g_sweepPoints; --sweep runs all of them (times --runs
+  * seeds) in parallel. Without it only the Ideal setting is run, as that
+  * is the one that produces the animation and trace files for analysis.
    */
-
-
-  /*NS_LOG_DEBUG ("54");
-  experiment = Experiment ("54mb");
-  wifi.SetRemoteStationManager ("ns3::ConstantRateWifiManager",
-                                "DataMode", StringValue ("OfdmRate54Mbps"));                  
-  dataset = experiment.Run (wifi, wifiPhy, wifiMac, wifiChannel);
-  gnuplot.AddDataset (dataset);
-
-  NS_LOG_DEBUG ("48");
-  experiment = Experiment ("48mb");
-  wifi.SetRemoteStationManager ("ns3::ConstantRateWifiManager",
-                                "DataMode", StringValue ("OfdmRate48Mbps"));
-  dataset = experiment.Run (wifi, wifiPhy, wifiMac, wifiChannel);
-  gnuplot.AddDataset (dataset);
-
-  NS_LOG_DEBUG ("36");
-  experiment = Experiment ("36mb");
-  wifi.SetRemoteStationManager ("ns3::ConstantRateWifiManager",
-                                "DataMode", StringValue ("OfdmRate36Mbps"));
-  dataset = experiment.Run (wifi, wifiPhy, wifiMac, wifiChannel);
-  gnuplot.AddDataset (dataset);
-
-  NS_LOG_DEBUG ("24");
-  experiment = Experiment ("24mb");
-  wifi.SetRemoteStationManager ("ns3::ConstantRateWifiManager",
-                                "DataMode", StringValue ("OfdmRate24Mbps"));
-  dataset = experiment.Run (wifi, wifiPhy, wifiMac, wifiChannel);
-  gnuplot.AddDataset (dataset);
-
-  NS_LOG_DEBUG ("18");
-  experiment = Experiment ("18mb");
-  wifi.SetRemoteStationManager ("ns3::ConstantRateWifiManager",
-                                "DataMode", StringValue ("OfdmRate18Mbps"));
-  dataset = experiment.Run (wifi, wifiPhy, wifiMac, wifiChannel);
-  gnuplot.AddDataset (dataset);
-
-  NS_LOG_DEBUG ("12");
-  experiment = Experiment ("12mb");
-  wifi.SetRemoteStationManager ("ns3::ConstantRateWifiManager",
-                                "DataMode", StringValue ("OfdmRate12Mbps"));
-  dataset = experiment.Run (wifi, wifiPhy, wifiMac, wifiChannel);
-  gnuplot.AddDataset (dataset);
-
-  NS_LOG_DEBUG ("9");
-  experiment = Experiment ("9mb");
-  wifi.SetRemoteStationManager ("ns3::ConstantRateWifiManager",
-                                "DataMode", StringValue ("OfdmRate9Mbps"));
-  dataset = experiment.Run (wifi, wifiPhy, wifiMac, wifiChannel);
-  gnuplot.AddDataset (dataset);
-
-  NS_LOG_DEBUG ("6");
-  experiment = Experiment ("6mb");
-  wifi.SetRemoteStationManager ("ns3::ConstantRateWifiManager",
-                                "DataMode", StringValue ("OfdmRate6Mbps"));
-  dataset = experiment.Run (wifi, wifiPhy, wifiMac, wifiChannel);
-  gnuplot.AddDataset (dataset);
-
-  gnuplot.GenerateOutput (std::cout);
-
-  gnuplot = Gnuplot ("rate-control.png");
-  wifi.SetStandard (WIFI_PHY_STANDARD_holland);
-
-  NS_LOG_DEBUG ("arf");
-  experiment = Experiment ("arf");
-  wifi.SetRemoteStationManager ("ns3::ArfWifiManager");
-  dataset = experiment.Run (wifi, wifiPhy, wifiMac, wifiChannel);
-  gnuplot.AddDataset (dataset);
-
-  NS_LOG_DEBUG ("aarf");
-  experiment = Experiment ("aarf");
-  wifi.SetRemoteStationManager ("ns3::AarfWifiManager");
-  dataset = experiment.Run (wifi, wifiPhy, wifiMac, wifiChannel);
-  gnuplot.AddDataset (dataset);
-
-  NS_LOG_DEBUG ("aarf-cd");
-  experiment = Experiment ("aarf-cd");
-  wifi.SetRemoteStationManager ("ns3::AarfcdWifiManager");
-  dataset = experiment.Run (wifi, wifiPhy, wifiMac, wifiChannel);
-  gnuplot.AddDataset (dataset);
-
-  NS_LOG_DEBUG ("cara");
-  experiment = Experiment ("cara");
-  wifi.SetRemoteStationManager ("ns3::CaraWifiManager");
-  dataset = experiment.Run (wifi, wifiPhy, wifiMac, wifiChannel);
-  gnuplot.AddDataset (dataset);
-
-  NS_LOG_DEBUG ("rraa");
-  experiment = Experiment ("rraa");
-  wifi.SetRemoteStationManager ("ns3::RraaWifiManager");
-  dataset = experiment.Run (wifi, wifiPhy, wifiMac, wifiChannel);
-  gnuplot.AddDataset (dataset);*/
+  experiment.SetOutputDir (outputDir);
+  experiment.SetNodeCount (nodes);
+  experiment.SetArea (width, height, speed);
+  experiment.SetTraffic (DataRate (rate), packetSize, Seconds (appStop));
+  experiment.SetChannelMode (channel);
+  experiment.SetSampling (Seconds (sampleInterval), samplePerNode, samplePerFlow);
+  experiment.SetCapture (capture, snapLen);
+  experiment.SetCaptureTrigger (captureTrigger, Seconds (capturePre), Seconds (capturePost));
+  experiment.SetAnimation (anim, animWindows, animSample);
+  experiment.SetRouting (routing, oracleRange, oracleRxPower);
+  experiment.SetApplication (app, chunks, chunkSize, cacheChunks);
+  experiment.SetFlowWorkload (flows, flowArrival, flowSize);
+  experiment.SetFlowExport (flowExport, Seconds (flowInterval));
+  experiment.SetWarmStart (warmStart, checkpointFile, Seconds (warmup), Seconds (checkpointHold));
+  experiment.SetMobility (mobility, trackFile);
+  experiment.SetProfile (profile);
+  experiment.SetScheduler (scheduler);
+  experiment.SetStopTime (Seconds (stopTime));
+  experiment.SetNodeProfile (nodeProfile);
+  NS_ABORT_MSG_IF (nodeProfile == "lite" && routing != "oracle",
+                   "the lite node profile keeps no routing protocol state; use --routing=oracle");
+  NS_ABORT_MSG_IF ((sweep || replications > 0) && warmStart == "save",
+                   "save the checkpoint once, then sweep or replicate with --warmStart=load");
+  if (!schedulerBench.empty ())
+    {
+      return RunSchedulerBench (experiment, schedulerBench, benchNodes, wifi, wifiPhy, wifiMac, wifiChannel) ? 0 : 1;
+    }
+  if (sweep)
+    {
+      return RunSweep (experiment, runs, jobs, wifi, wifiPhy, wifiMac, wifiChannel) ? 0 : 1;
+    }
+  if (replications > 0)
+    {
+      NS_ABORT_MSG_UNLESS (minReplications >= 2 && minReplications <= replications,
+                           "need 2 <= minReplications <= replications");
+      NS_ABORT_MSG_UNLESS (confidence > 0 && confidence < 1, "confidence must be in (0, 1)");
+      return RunReplications (experiment, minReplications, replications, confidence, ciWidth, jobs,
+                              wifi, wifiPhy, wifiMac, wifiChannel) ? 0 : 1;
+    }
 
   NS_LOG_DEBUG ("ideal");
-  experiment = Experiment ("ideal");
+  experiment.SetTitle ("ideal");
   wifi.SetRemoteStationManager ("ns3::IdealWifiManager");
   dataset = experiment.Run (wifi, wifiPhy, wifiMac, wifiChannel);
   gnuplot.AddDataset (dataset);
+  if (!loopStats.empty () && !experiment.WriteLoopStats (loopStats))
+    {
+      NS_FATAL_ERROR ("cannot write " << loopStats);
+    }
 
   gnuplot.GenerateOutput (std::cout);
 
@@ -64,6 +64,18 @@
 #include "ns3/netanim-module.h"
 #include "ns3/core-module.h"
 #include "ns3/mobility-module.h"
+#include "ns3/spectrum-wifi-helper.h"
+
+#include <sys/time.h>
+
+#include <fstream>
+
+#include "crowd-trajectory.h"
+#include "crowd-trace-bind.h"
+#include "crowd-spectrum-channel.h"
+#include "crowd-pcapng-capture.h"
+#include "crowd-anim-writer.h"
+#include "crowd-event-profiler.h"
 
 using namespace ns3;
 
@@ -90,6 +102,10 @@ static void GenerateTraffic (Ptr<Socket> socket, uint32_t pktSize,
 {
   if (pktCount > 0)
     {
+      // Create<Packet> (size) only records the size (an ns-3 zero area): no
+      // payload bytes are allocated or copied anywhere in the stack, and
+      // readers such as pcap get zeros. crowd-payload-bench measures what
+      // real bytes would cost instead.
       socket->Send (Create<Packet> (pktSize));
       Simulator::Schedule (pktInterval, &GenerateTraffic,
                            socket, pktSize,pktCount - 1, pktInterval);
@@ -100,11 +116,23 @@ static void GenerateTraffic (Ptr<Socket> socket, uint32_t pktSize,
     }
 }
 
-static void CourseChange (std::string context, Ptr<const MobilityModel> position)
+// Course changes go to a buffered binary file rather than std::cout;
+// crowd-trace-to-csv turns it back into text.
+static void CourseChange (crowd::TrajectoryRecorder *recorder, uint32_t node,
+                          Ptr<const MobilityModel> position)
 {
   Vector pos = position->GetPosition ();
-  std::cout << Simulator::Now () << ", pos=" << position << ", x=" << pos.x << ", y=" << pos.y
-            << ", z=" << pos.z << std::endl;
+  Vector vel = position->GetVelocity ();
+  recorder->Record (node, Simulator::Now ().GetNanoSeconds (),
+                    pos.x, pos.y, pos.z, vel.x, vel.y, vel.z);
+}
+
+static double
+WallSeconds (void)
+{
+  struct timeval tv;
+  gettimeofday (&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1e6;
 }
 
 int main (int argc, char *argv[])
@@ -122,6 +150,14 @@ int main (int argc, char *argv[])
   bool ipRecvTos = true;
   uint32_t ipTtl = 0;
   bool ipRecvTtl = true;
+  std::string capture ("pcap");
+  uint32_t snapLen = 128;
+  std::string anim ("full");
+  std::string animWindows ("110-125");
+  uint32_t animSample = 1;
+  bool profile = false;
+  std::string channel ("yans");
+  std::string loopStats ("");
 
   CommandLine cmd;
   cmd.AddValue ("phyMode", "Wifi Phy mode", phyMode);
@@ -137,7 +173,22 @@ int main (int argc, char *argv[])
   cmd.AddValue ("IP_RECVTOS", "IP_RECVTOS", ipRecvTos);
   cmd.AddValue ("IP_TTL", "IP_TTL", ipTtl);
   cmd.AddValue ("IP_RECVTTL", "IP_RECVTTL", ipRecvTtl);
+  cmd.AddValue ("capture", "packet capture: pcap (per device, the original), pcapng (merged) or off", capture);
+  cmd.AddValue ("snapLen", "bytes of each frame kept in the pcapng capture", snapLen);
+  cmd.AddValue ("anim", "animation: full (the original AnimationInterface), sampled or off", anim);
+  cmd.AddValue ("animWindows", "sampled animation windows in seconds, e.g. 10-20,300-310", animWindows);
+  cmd.AddValue ("animSample", "sampled animation keeps one packet in animSample", animSample);
+  cmd.AddValue ("profile", "report wall time per event type, with a folded-stacks file", profile);
+  cmd.AddValue ("channel", "yans (the default: YansWifiPhy as before, so results compare with earlier runs), "
+                "or crowd (CrowdSpectrumChannel with shared broadcast fan-out, on SpectrumWifiPhy, "
+                "whose reception model differs)", channel);
+  cmd.AddValue ("loopStats", "write the event loop's wall time, events and simulated seconds to this file", loopStats);
   cmd.Parse (argc, argv);
+  NS_ABORT_MSG_UNLESS (channel == "yans" || channel == "crowd", "unknown channel " << channel);
+  if (profile)
+    {
+      CrowdProfilingScheduler::Enable ();
+    }
   // Convert to time object
   Time interPacketInterval = Seconds (interval);
 
@@ -168,7 +219,29 @@ int main (int argc, char *argv[])
   // The below FixedRssLossModel will cause the rss to be fixed regardless
   // of the distance between the two stations, and the transmit power
   wifiChannel.AddPropagationLoss ("ns3::FixedRssLossModel","Rss",DoubleValue (rss));
-  wifiPhy.SetChannel (wifiChannel.Create ());
+
+  // The crowd channel has the same models, on SpectrumWifiPhy; a frame
+  // to all numNodes - 1 receivers then costs one set of receive
+  // parameters and one event implementation instead of one per receiver
+  SpectrumWifiPhyHelper spectrumPhy = SpectrumWifiPhyHelper::Default ();
+  Ptr<CrowdSpectrumChannel> crowdChannel;
+  if (channel == "crowd")
+    {
+      crowdChannel = CreateObject<CrowdSpectrumChannel> ();
+      Ptr<FixedRssLossModel> fixedRss = CreateObject<FixedRssLossModel> ();
+      fixedRss->SetRss (rss);
+      crowdChannel->AddPropagationLossModel (fixedRss);
+      crowdChannel->SetPropagationDelayModel (CreateObject<ConstantSpeedPropagationDelayModel> ());
+      spectrumPhy.SetChannel (crowdChannel);
+      spectrumPhy.Set ("RxGain", DoubleValue (0) );
+      spectrumPhy.SetPcapDataLinkType (WifiPhyHelper::DLT_IEEE802_11_RADIO);
+    }
+  else
+    {
+      wifiPhy.SetChannel (wifiChannel.Create ());
+    }
+  WifiPhyHelper &activePhy = crowdChannel ? static_cast<WifiPhyHelper &> (spectrumPhy)
+                                          : static_cast<WifiPhyHelper &> (wifiPhy);
 
   // Add a mac and disable rate control
   WifiMacHelper wifiMac;
@@ -177,7 +250,7 @@ int main (int argc, char *argv[])
                                 "ControlMode",StringValue (phyMode));
   // Set it to adhoc mode
   wifiMac.SetType ("ns3::AdhocWifiMac");
-  NetDeviceContainer devices = wifi.Install (wifiPhy, wifiMac, c);
+  NetDeviceContainer devices = wifi.Install (activePhy, wifiMac, c);
 
   // Note that with FixedRssLossModel, the positions below are not
   // used for received signal strength.
@@ -189,8 +262,12 @@ int main (int argc, char *argv[])
   mobility.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
   mobility.Install (c);
 
-  Config::Connect ("/NodeList/*/$ns3::MobilityModel/CourseChange",
-                   MakeCallback (&CourseChange));
+  crowd::TrajectoryRecorder trajectory;
+  if (!trajectory.Open ("wifi-simple-adhoc-trajectory.ctrj"))
+    {
+      NS_FATAL_ERROR ("cannot open wifi-simple-adhoc-trajectory.ctrj");
+    }
+  CrowdTraceConnect<MobilityModel> (c, "CourseChange", &CourseChange, &trajectory);
 
   InternetStackHelper internet;
   internet.Install (c);
@@ -223,7 +300,19 @@ int main (int argc, char *argv[])
   source->Connect (remote);
 
   // Tracing
-  wifiPhy.EnablePcap ("wifi-simple-adhoc", devices);
+  CrowdPcapngCapture pcapng;
+  if (capture == "pcap")
+    {
+      activePhy.EnablePcap ("wifi-simple-adhoc", devices);
+    }
+  else if (capture == "pcapng")
+    {
+      if (!pcapng.Open ("wifi-simple-adhoc.pcapng", snapLen))
+        {
+          NS_FATAL_ERROR ("cannot open wifi-simple-adhoc.pcapng");
+        }
+      pcapng.Install (devices);
+    }
 
   // Output what we are doing
   NS_LOG_UNCOND ("Testing " << numPackets  << " packets sent with receiver rss " << rss );
@@ -234,11 +323,54 @@ int main (int argc, char *argv[])
 
   Simulator::Stop (Seconds (125.0));
 
-  AnimationInterface anim ("animation.xml");
-  anim.SetMobilityPollInterval (Seconds (1));
-  anim.EnablePacketMetadata (true);
+  AnimationInterface *fullAnim = 0;
+  CrowdAnimWriter sampledAnim;
+  if (anim == "full")
+    {
+      fullAnim = new AnimationInterface ("animation.xml");
+      fullAnim->SetMobilityPollInterval (Seconds (1));
+      fullAnim->EnablePacketMetadata (true);
+    }
+  else if (anim == "sampled")
+    {
+      if (!sampledAnim.Open (CrowdAnimWriter::OutputName ("animation.xml"), animWindows, animSample, true))
+        {
+          NS_FATAL_ERROR ("cannot open " << CrowdAnimWriter::OutputName ("animation.xml"));
+        }
+      sampledAnim.Install (c, devices);
+    }
+  uint64_t eventsBefore = Simulator::GetEventCount ();
+  double loopStart = WallSeconds ();
   Simulator::Run ();
+  double loopSeconds = WallSeconds () - loopStart;
+  if (!loopStats.empty ())
+    {
+      std::ofstream out (loopStats.c_str ());
+      out << "loop_s " << loopSeconds << std::endl;
+      out << "events " << Simulator::GetEventCount () - eventsBefore << std::endl;
+      out << "sim_s " << Simulator::Now ().GetSeconds () << std::endl;
+      if (!out)
+        {
+          NS_FATAL_ERROR ("cannot write " << loopStats);
+        }
+    }
+  trajectory.Close ();
+  pcapng.Close ();
+  if (!sampledAnim.Close ())
+    {
+      NS_FATAL_ERROR ("cannot write " << CrowdAnimWriter::OutputName ("animation.xml"));
+    }
+  if (crowdChannel)
+    {
+      crowdChannel->PrintStats (std::clog);
+    }
+  if (profile)
+    {
+      CrowdProfilingScheduler::Get ()->Report (std::clog, "simple-adhoc-modified", "profile.folded",
+                                              "profile-depth.csv");
+    }
   Simulator::Destroy ();
+  delete fullAnim;
 
   return 0;
 }